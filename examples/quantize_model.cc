@@ -0,0 +1,385 @@
+/*
+ * Offline weight quantizer for Qwen3 checkpoints.
+ *
+ * Rewrites a model directory with every layer projection already in the
+ * layout qwen3 loads for --dtype q8 or q4, so the quantization is paid once
+ * and the checkpoint shrinks to match:
+ *   q8: <name> I8 [out, in] and <name>_scale F32 [out]
+ *   q4: <name> U8 [out, in / 32, sizeof(gemm_q4_block_t)]
+ * Every other tensor is copied unchanged. Sharded checkpoints keep their
+ * shard file names and get a rewritten index; config.json is copied along.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+
+#define SAFETENSORS_CPP_IMPLEMENTATION
+#include "inference/model_loader/safetensors.hh"
+
+#include "inference/kernels/convert/convert.h"
+#include "inference/kernels/gemm/gemm.h"
+#include "inference/kernels/threadpool/threadpool.h"
+
+/* Rows handed to one thread at a time while quantizing a matrix. */
+#define QUANT_ROWS_PER_TASK 16
+
+enum entry_kind { ENTRY_COPY, ENTRY_QUANT, ENTRY_SCALE };
+
+struct out_entry_t {
+  std::string name;
+  std::string src_name;
+  entry_kind kind;
+  std::string dtype;
+  std::vector<size_t> shape;
+  size_t bytes;
+};
+
+struct quant_task_t {
+  const uint8_t *src;
+  convert_dtype_t src_dtype;
+  size_t rows;
+  size_t cols;
+  bool q4;
+  uint8_t *dst;
+  float *scales;
+};
+
+static bool read_file(const std::string &path, std::string *out) {
+  std::ifstream in(path.c_str(), std::ios::binary);
+  if (!in)
+    return false;
+  std::stringstream ss;
+  ss << in.rdbuf();
+  *out = ss.str();
+  return true;
+}
+
+static bool write_file(const std::string &path, const std::string &data) {
+  std::ofstream out(path.c_str(), std::ios::binary);
+  out << data;
+  return (bool)out;
+}
+
+static bool has_suffix(const std::string &s, const char *suffix) {
+  size_t n = strlen(suffix);
+  return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+}
+
+static bool convert_dtype_of(safetensors::dtype dtype, convert_dtype_t *out) {
+  switch (dtype) {
+  case safetensors::dtype::kFLOAT32:
+    *out = CONVERT_DTYPE_F32;
+    return true;
+  case safetensors::dtype::kFLOAT16:
+    *out = CONVERT_DTYPE_F16;
+    return true;
+  case safetensors::dtype::kBFLOAT16:
+    *out = CONVERT_DTYPE_BF16;
+    return true;
+  default:
+    return false;
+  }
+}
+
+/* The tensors qwen3 quantizes at load: the seven projections of each layer. */
+static bool is_projection(const std::string &name,
+                          const safetensors::tensor_t &tensor) {
+  convert_dtype_t dtype;
+  return name.compare(0, 13, "model.layers.") == 0 &&
+         has_suffix(name, "_proj.weight") && tensor.shape.size() == 2 &&
+         convert_dtype_of(tensor.dtype, &dtype);
+}
+
+static std::string json_string(const std::string &s) {
+  std::string out = "\"";
+  for (char c : s) {
+    if (c == '"' || c == '\\')
+      out += '\\';
+    out += c;
+  }
+  return out + "\"";
+}
+
+static void quantize_task(void *arg, int start, int end) {
+  quant_task_t *t = (quant_task_t *)arg;
+  std::vector<float> rows_f32;
+
+  for (int task = start; task < end; task++) {
+    size_t r0 = (size_t)task * QUANT_ROWS_PER_TASK;
+    size_t n = std::min((size_t)QUANT_ROWS_PER_TASK, t->rows - r0);
+    rows_f32.resize(n * t->cols);
+    convert_array(rows_f32.data(), CONVERT_DTYPE_F32,
+                  t->src + r0 * t->cols * convert_dtype_size(t->src_dtype),
+                  t->src_dtype, n * t->cols);
+
+    if (t->q4) {
+      size_t row_bytes = t->cols / GEMM_Q4_GROUP * sizeof(gemm_q4_block_t);
+      gemm_quantize_q4((gemm_q4_block_t *)(t->dst + r0 * row_bytes),
+                       rows_f32.data(), (int)n, (int)t->cols);
+    } else {
+      gemm_quantize_q8((int8_t *)t->dst + r0 * t->cols, t->scales + r0,
+                       rows_f32.data(), (int)n, (int)t->cols);
+    }
+  }
+}
+
+/* Plan the output tensors of one shard, in the order they are written. */
+static bool plan_shard(const safetensors::safetensors_t &st, bool q4,
+                       std::vector<out_entry_t> *entries) {
+  for (size_t i = 0; i < st.tensors.size(); i++) {
+    const std::string &name = st.tensors.keys()[i];
+    safetensors::tensor_t tensor;
+    st.tensors.at(i, &tensor);
+
+    out_entry_t e;
+    e.name = name;
+    e.src_name = name;
+    if (!is_projection(name, tensor)) {
+      e.kind = ENTRY_COPY;
+      e.dtype = safetensors::get_dtype_str(tensor.dtype);
+      e.shape = tensor.shape;
+      e.bytes = tensor.data_offsets[1] - tensor.data_offsets[0];
+      entries->push_back(e);
+      continue;
+    }
+
+    size_t rows = tensor.shape[0], cols = tensor.shape[1];
+    e.kind = ENTRY_QUANT;
+    if (q4) {
+      if (cols % GEMM_Q4_GROUP != 0) {
+        std::cerr << name << " has " << cols
+                  << " columns, not a multiple of " << GEMM_Q4_GROUP << "\n";
+        return false;
+      }
+      e.dtype = "U8";
+      e.shape = {rows, cols / GEMM_Q4_GROUP, sizeof(gemm_q4_block_t)};
+      e.bytes = rows * (cols / GEMM_Q4_GROUP) * sizeof(gemm_q4_block_t);
+      entries->push_back(e);
+    } else {
+      e.dtype = "I8";
+      e.shape = tensor.shape;
+      e.bytes = rows * cols;
+      entries->push_back(e);
+
+      out_entry_t s;
+      s.name = name + "_scale";
+      s.src_name = name;
+      s.kind = ENTRY_SCALE;
+      s.dtype = "F32";
+      s.shape = {rows};
+      s.bytes = rows * sizeof(float);
+      entries->push_back(s);
+    }
+  }
+  return true;
+}
+
+static std::string shard_header(const safetensors::safetensors_t &st,
+                                const std::vector<out_entry_t> &entries) {
+  std::ostringstream h;
+  h << "{";
+  if (st.metadata.size()) {
+    h << "\"__metadata__\":{";
+    for (size_t i = 0; i < st.metadata.size(); i++) {
+      std::string value;
+      st.metadata.at(i, &value);
+      h << (i ? "," : "") << json_string(st.metadata.keys()[i]) << ":"
+        << json_string(value);
+    }
+    h << "},";
+  }
+
+  size_t offset = 0;
+  for (size_t i = 0; i < entries.size(); i++) {
+    const out_entry_t &e = entries[i];
+    h << (i ? "," : "") << json_string(e.name) << ":{\"dtype\":\"" << e.dtype
+      << "\",\"shape\":[";
+    for (size_t d = 0; d < e.shape.size(); d++)
+      h << (d ? "," : "") << e.shape[d];
+    h << "],\"data_offsets\":[" << offset << "," << offset + e.bytes << "]}";
+    offset += e.bytes;
+  }
+  h << "}";
+
+  /* The data section starts 8-byte aligned, as the safetensors writer
+   * does it. */
+  std::string header = h.str();
+  while ((header.size() + 8) % 8 != 0)
+    header += ' ';
+  return header;
+}
+
+static bool quantize_shard(const std::string &in_path,
+                           const std::string &out_path, bool q4,
+                           std::vector<std::string> *names,
+                           size_t *total_bytes) {
+  safetensors::safetensors_t st;
+  std::string warn, err;
+  if (!safetensors::mmap_from_file(in_path, &st, &warn, &err) ||
+      !safetensors::validate_data_offsets(st, err)) {
+    std::cerr << "Failed to load " << in_path << ": " << err << "\n";
+    return false;
+  }
+
+  std::vector<out_entry_t> entries;
+  if (!plan_shard(st, q4, &entries))
+    return false;
+  std::string header = shard_header(st, entries);
+
+  FILE *out = fopen(out_path.c_str(), "wb");
+  if (!out) {
+    std::cerr << "Failed to create " << out_path << "\n";
+    return false;
+  }
+  uint64_t header_size = header.size();
+  bool ok = fwrite(&header_size, sizeof(header_size), 1, out) == 1 &&
+            fwrite(header.data(), 1, header.size(), out) == header.size();
+
+  std::vector<uint8_t> quant;
+  std::vector<float> scales;
+  for (size_t i = 0; ok && i < entries.size(); i++) {
+    const out_entry_t &e = entries[i];
+    safetensors::tensor_t tensor;
+    st.tensors.at(e.src_name, &tensor);
+    const uint8_t *src = st.databuffer_addr + tensor.data_offsets[0];
+
+    const void *data = src;
+    if (e.kind == ENTRY_QUANT) {
+      quant_task_t task;
+      task.src = src;
+      convert_dtype_of(tensor.dtype, &task.src_dtype);
+      task.rows = tensor.shape[0];
+      task.cols = tensor.shape[1];
+      task.q4 = q4;
+      quant.resize(e.bytes);
+      scales.resize(task.rows);
+      task.dst = quant.data();
+      task.scales = scales.data();
+
+      int tasks = (int)((task.rows + QUANT_ROWS_PER_TASK - 1) /
+                        QUANT_ROWS_PER_TASK);
+      threadpool_parallel_for(0, tasks, 1, quantize_task, &task);
+      data = quant.data();
+      std::cout << "  " << e.name << " [" << task.rows << ", " << task.cols
+                << "] -> " << e.dtype << "\n";
+    } else if (e.kind == ENTRY_SCALE) {
+      data = scales.data();
+    }
+
+    ok = fwrite(data, 1, e.bytes, out) == e.bytes;
+    names->push_back(e.name);
+    *total_bytes += e.bytes;
+  }
+
+  if (fclose(out) != 0 || !ok) {
+    std::cerr << "Failed to write " << out_path << "\n";
+    return false;
+  }
+  return true;
+}
+
+/* Shard file names in the order the index first mentions them. */
+static bool read_index_shards(const std::string &index_path,
+                              std::vector<std::string> *shards) {
+  std::string json;
+  if (!read_file(index_path, &json)) {
+    std::cerr << "Failed to open " << index_path << "\n";
+    return false;
+  }
+
+  const char *p = json.c_str();
+  ::minijson::value root, weight_map;
+  const ::minijson::object *obj = nullptr;
+  if (::minijson::parse(p, root) == ::minijson::no_error)
+    obj = root.as<::minijson::object>();
+  if (!obj || !obj->at("weight_map", &weight_map) ||
+      !weight_map.as<::minijson::object>()) {
+    std::cerr << index_path << " has no weight_map\n";
+    return false;
+  }
+
+  const ::minijson::object *map = weight_map.as<::minijson::object>();
+  for (size_t i = 0; i < map->size(); i++) {
+    ::minijson::value file;
+    map->at(i, &file);
+    const std::string *name = file.as<std::string>();
+    if (!name) {
+      std::cerr << "Invalid weight_map entry for " << map->keys()[i] << "\n";
+      return false;
+    }
+    if (std::find(shards->begin(), shards->end(), *name) == shards->end())
+      shards->push_back(*name);
+  }
+  return !shards->empty();
+}
+
+int main(int argc, char **argv) {
+  if (argc != 4 ||
+      (strcmp(argv[3], "q8") != 0 && strcmp(argv[3], "q4") != 0)) {
+    std::cerr << "Usage: " << argv[0] << " <model_dir> <out_dir> <q8|q4>\n";
+    return 1;
+  }
+
+  std::string in_dir = argv[1];
+  std::string out_dir = argv[2];
+  bool q4 = strcmp(argv[3], "q4") == 0;
+
+  if (mkdir(out_dir.c_str(), 0755) != 0 && errno != EEXIST) {
+    std::cerr << "Failed to create " << out_dir << "\n";
+    return 1;
+  }
+
+  std::string config;
+  if (!read_file(in_dir + "/config.json", &config) ||
+      !write_file(out_dir + "/config.json", config)) {
+    std::cerr << "Failed to copy " << in_dir << "/config.json\n";
+    return 1;
+  }
+
+  std::string index_path = in_dir + "/model.safetensors.index.json";
+  struct stat sb;
+  bool sharded = stat(index_path.c_str(), &sb) == 0;
+
+  std::vector<std::string> shards;
+  if (!sharded)
+    shards.push_back("model.safetensors");
+  else if (!read_index_shards(index_path, &shards))
+    return 1;
+
+  std::ostringstream weight_map;
+  size_t total_bytes = 0, num_tensors = 0;
+  for (const std::string &shard : shards) {
+    std::cout << "Quantizing " << shard << " to " << argv[3] << "\n";
+    std::vector<std::string> names;
+    if (!quantize_shard(in_dir + "/" + shard, out_dir + "/" + shard, q4,
+                        &names, &total_bytes))
+      return 1;
+    for (const std::string &name : names)
+      weight_map << (num_tensors++ ? ",\n" : "") << "    "
+                 << json_string(name) << ": " << json_string(shard);
+  }
+
+  if (sharded) {
+    std::ostringstream index;
+    index << "{\n  \"metadata\": {\n    \"total_size\": " << total_bytes
+          << "\n  },\n  \"weight_map\": {\n"
+          << weight_map.str() << "\n  }\n}\n";
+    if (!write_file(out_dir + "/model.safetensors.index.json", index.str())) {
+      std::cerr << "Failed to write the shard index\n";
+      return 1;
+    }
+  }
+
+  std::cout << "Wrote " << num_tensors << " tensors, "
+            << total_bytes / (1024.0 * 1024.0) << " MB of weights\n";
+  return 0;
+}
@@ -1,4 +1,5 @@
 #include "inference/model/qwen3/qwen3.h"
+#include "inference/model_loader/gguf.h"
 #include "inference/tokenizer/gpt2bpe.h"
 #include "inference/tokenizer/simd.h"
 #include "inference/kernels/sampling/sampling.h"
@@ -21,14 +22,49 @@ static int estimate_model_size_mb(const qwen3_model_t *model) {
     model->config.hidden_size * model->config.intermediate_size * 4 * 2 +
     model->config.intermediate_size * model->config.hidden_size * 4
   );
-  long long lm_head = (long long)model->config.vocab_size * model->config.hidden_size * 4;
+  long long lm_head = model->config.tie_word_embeddings ? 0 :
+    (long long)model->config.vocab_size * model->config.hidden_size * 4;
   return (vocab_embed + layers + lm_head) / (1024 * 1024);
 }
 
+/* GGUF files embed the vocabulary and merges as string arrays. */
+static bool load_gguf_tokenizer(GPT2BPETokenizer *tokenizer, const char *path) {
+  gguf_file_t gguf;
+  if (!gguf_open(&gguf, path))
+    return false;
+
+  const gguf_kv_t *tokens = gguf_find_kv(&gguf, "tokenizer.ggml.tokens");
+  const gguf_kv_t *merges = gguf_find_kv(&gguf, "tokenizer.ggml.merges");
+  bool ok = false;
+  if (tokens && merges) {
+    size_t num_tokens = (size_t)tokens->array_len;
+    size_t num_merges = (size_t)merges->array_len;
+    const char **strs =
+        (const char **)malloc((num_tokens + num_merges) * sizeof(char *));
+    size_t *lens = (size_t *)malloc((num_tokens + num_merges) * sizeof(size_t));
+    ok = strs && lens && gguf_kv_strings(tokens, strs, lens) &&
+         gguf_kv_strings(merges, strs + num_tokens, lens + num_tokens) &&
+         gpt2_load_from_strings(tokenizer, strs, lens, num_tokens,
+                                strs + num_tokens, lens + num_tokens,
+                                num_merges);
+    free(strs);
+    free(lens);
+  }
+  gguf_close(&gguf);
+  return ok;
+}
+
 static void print_usage(const char *prog) {
-  fprintf(stderr, "Usage: %s [options] <model_dir> [prompt]\n", prog);
+  fprintf(stderr, "Usage: %s [options] <model_dir|model.gguf> [prompt]\n", prog);
   fprintf(stderr, "Options:\n");
-  fprintf(stderr, "  --dtype <f32|f16>  Set compute dtype (default: f16)\n");
+  fprintf(stderr, "  --dtype <f32|f16|q8|q4> Set compute dtype (default: f16)\n");
+  fprintf(stderr, "  --no-mmap          Copy weights instead of mapping them\n");
+  fprintf(stderr, "  --prepack          Map f16 projections prepacked for the GEMM\n");
+  fprintf(stderr, "                     kernels from <model>.packed, creating it\n");
+  fprintf(stderr, "  --kv-int8          Store the KV cache as INT8\n");
+  fprintf(stderr, "  --kv-stream <s>,<w> Keep s sink tokens plus a window of w\n");
+  fprintf(stderr, "  --max-tokens <n>   Tokens to generate (default: 100)\n");
+  fprintf(stderr, "  --bench            Ignore EOS, print tok/s every 1000 tokens\n");
   fprintf(stderr, "  --help             Show this help message\n");
   fprintf(stderr, "\nIf no prompt is provided, uses BOS token only\n");
 }
@@ -40,8 +76,14 @@ int main(int argc, char **argv) {
   }
 
   qwen3_dtype_t dtype = QWEN3_DTYPE_F16;
+  qwen3_load_mode_t load_mode = QWEN3_LOAD_MMAP;
   const char *model_dir = NULL;
   const char *prompt = NULL;
+  bool kv_int8 = false;
+  int kv_sink = -1;
+  int kv_window = 0;
+  int max_tokens = 100;
+  bool bench = false;
 
   for (int i = 1; i < argc; i++) {
     if (strcmp(argv[i], "--dtype") == 0) {
@@ -54,10 +96,37 @@ int main(int argc, char **argv) {
         dtype = QWEN3_DTYPE_F32;
       } else if (strcmp(argv[i], "f16") == 0) {
         dtype = QWEN3_DTYPE_F16;
+      } else if (strcmp(argv[i], "q8") == 0) {
+        dtype = QWEN3_DTYPE_Q8;
+      } else if (strcmp(argv[i], "q4") == 0) {
+        dtype = QWEN3_DTYPE_Q4;
       } else {
-        fprintf(stderr, "Error: Invalid dtype '%s'. Use 'f32' or 'f16'\n", argv[i]);
+        fprintf(stderr,
+                "Error: Invalid dtype '%s'. Use 'f32', 'f16', 'q8' or 'q4'\n",
+                argv[i]);
+        return 1;
+      }
+    } else if (strcmp(argv[i], "--no-mmap") == 0) {
+      load_mode = QWEN3_LOAD_COPY;
+    } else if (strcmp(argv[i], "--prepack") == 0) {
+      load_mode = QWEN3_LOAD_PACKED;
+    } else if (strcmp(argv[i], "--kv-int8") == 0) {
+      kv_int8 = true;
+    } else if (strcmp(argv[i], "--kv-stream") == 0) {
+      if (i + 1 >= argc ||
+          sscanf(argv[i + 1], "%d,%d", &kv_sink, &kv_window) != 2) {
+        fprintf(stderr, "Error: --kv-stream requires <sink>,<window>\n");
+        return 1;
+      }
+      i++;
+    } else if (strcmp(argv[i], "--max-tokens") == 0) {
+      if (i + 1 >= argc || (max_tokens = atoi(argv[i + 1])) <= 0) {
+        fprintf(stderr, "Error: --max-tokens requires a positive count\n");
         return 1;
       }
+      i++;
+    } else if (strcmp(argv[i], "--bench") == 0) {
+      bench = true;
     } else if (strcmp(argv[i], "--help") == 0) {
       print_usage(argv[0]);
       return 0;
@@ -77,14 +146,29 @@ int main(int argc, char **argv) {
   qwen3_model_t model;
 
   double load_start = get_time_ms();
-  if (!qwen3_model_load(&model, model_dir, dtype)) {
+  if (!qwen3_model_load_with_mode(&model, model_dir, dtype, load_mode)) {
     fprintf(stderr, "Failed to load model\n");
     return 1;
   }
   double load_time = get_time_ms() - load_start;
 
+  if (kv_int8 && !qwen3_model_set_kv_int8(&model, true))
+    fprintf(stderr, "Warning: INT8 KV cache unavailable, using %s\n",
+            qwen3_dtype_f16_act(dtype) ? "f16" : "f32");
+  if (kv_sink >= 0 &&
+      !qwen3_model_set_kv_policy(&model, QWEN3_KV_STREAMING, kv_sink,
+                                 kv_window)) {
+    fprintf(stderr, "Error: --kv-stream %d,%d does not fit in %d positions\n",
+            kv_sink, kv_window, model.max_seq_len);
+    qwen3_model_free(&model);
+    return 1;
+  }
+
   int model_size_mb = estimate_model_size_mb(&model);
-  const char *dtype_str = (dtype == QWEN3_DTYPE_F16) ? "f16" : "f32";
+  const char *dtype_str = dtype == QWEN3_DTYPE_Q4    ? "q4"
+                          : dtype == QWEN3_DTYPE_Q8  ? "q8"
+                          : dtype == QWEN3_DTYPE_F16 ? "f16"
+                                                     : "f32";
   printf("Model: Qwen3-%.1fB (L%d, H%d, %dM params, ~%dMB, %s) | Load: %.1fms\n",
          model.config.hidden_size / 1024.0,
          model.config.num_hidden_layers,
@@ -97,7 +181,13 @@ int main(int argc, char **argv) {
   simd_init();
   GPT2BPETokenizer tokenizer;
   gpt2_init(&tokenizer);
-  if (!gpt2_load(&tokenizer, "tokenizers/qwen3/vocab.json", "tokenizers/qwen3/merges.txt")) {
+  size_t model_dir_len = strlen(model_dir);
+  bool tokenizer_loaded =
+      model_dir_len > 5 && strcmp(model_dir + model_dir_len - 5, ".gguf") == 0
+          ? load_gguf_tokenizer(&tokenizer, model_dir)
+          : gpt2_load(&tokenizer, "tokenizers/qwen3/vocab.json",
+                      "tokenizers/qwen3/merges.txt");
+  if (!tokenizer_loaded) {
     fprintf(stderr, "Error: Failed to load tokenizer\n");
     qwen3_model_free(&model);
     return 1;
@@ -162,34 +252,46 @@ int main(int argc, char **argv) {
   sampling_rng_t rng;
   sampling_rng_init(&rng, 42);
 
-  int max_tokens = 100;
-  int output_tokens[100];
   int num_generated = 0;
   int current_token;
 
   double decode_start = get_time_ms();
   double first_token_time = 0;
   int is_tty = isatty(fileno(stdout));
+  double interval_start = decode_start;
 
   for (int i = 0; i < max_tokens; i++) {
     current_token = sampling_sample_f32(logits, model.config.vocab_size,
                                         1.0f, 50, 0.9f, 0.0f, &rng);
-    output_tokens[i] = current_token;
     num_generated++;
 
     if (first_token_time == 0) {
       first_token_time = get_time_ms();
     }
 
-    char *decoded = gpt2_decode(&tokenizer, (uint32_t*)&current_token, 1);
-    if (decoded) {
-      printf("%s", decoded);
-      fflush(stdout);
-      free(decoded);
-    }
+    if (bench) {
+      /* With a streaming cache both columns should stay flat. */
+      if (num_generated % 1000 == 0) {
+        double now = get_time_ms();
+        printf("  %8d tokens  %8.1f tok/s  cache %5d positions  %6.1f MB\n",
+               num_generated, 1000 * 1000.0 / (now - interval_start),
+               model.cache_len[0],
+               kv_pool_pages_in_use(&model.kv_pool) *
+                   model.kv_pool.page_bytes / (1024.0 * 1024.0));
+        fflush(stdout);
+        interval_start = now;
+      }
+    } else {
+      char *decoded = gpt2_decode(&tokenizer, (uint32_t*)&current_token, 1);
+      if (decoded) {
+        printf("%s", decoded);
+        fflush(stdout);
+        free(decoded);
+      }
 
-    if (current_token == model.config.eos_token_id)
-      break;
+      if (current_token == model.config.eos_token_id)
+        break;
+    }
 
     int single_token[1] = {current_token};
     if (!qwen3_forward(&model, logits, single_token, 1))
@@ -210,6 +312,9 @@ int main(int argc, char **argv) {
   printf("  Decode time:      %.1f ms  (%.1f tok/s)\n", decode_time, output_tok_per_s);
   printf("  Time to 1st:      %.1f ms\n", time_to_first_token);
   printf("  Total time:       %.1f ms\n", prefill_time + decode_time);
+  size_t kv_pages = kv_pool_pages_in_use(&model.kv_pool);
+  printf("  KV cache:         %.1f MB in %zu pages\n",
+         kv_pages * model.kv_pool.page_bytes / (1024.0 * 1024.0), kv_pages);
   
   long long bytes_processed = 0;
   long long hidden_size_bytes = (long long)model.config.hidden_size * 4;
@@ -11,6 +11,40 @@
 
 #define DEFAULT_CHAR_DIR "_default"
 
+static ChatHooks g_hooks;
+
+void chat_set_hooks(const ChatHooks *hooks) {
+  if (hooks)
+    g_hooks = *hooks;
+  else
+    memset(&g_hooks, 0, sizeof(g_hooks));
+}
+
+/* json_path is the file the chat was read from; its snapshot sits beside it. */
+static bool chat_loaded(const char *id, const char *json_path) {
+  if (!g_hooks.on_load)
+    return true;
+  char kv_path[1024];
+  size_t len = strlen(json_path);
+  if (len > 5 && strcmp(json_path + len - 5, ".json") == 0 &&
+      len - 5 + 4 < sizeof(kv_path)) {
+    memcpy(kv_path, json_path, len - 5);
+    memcpy(kv_path + len - 5, ".kv", 4);
+  } else {
+    kv_path[0] = '\0';
+  }
+  g_hooks.on_load(g_hooks.userdata, id, kv_path);
+  return true;
+}
+
+static bool chat_saved(const char *id, const char *character_name) {
+  char kv_path[1024];
+  if (g_hooks.on_save &&
+      chat_kv_snapshot_path(id, character_name, kv_path, sizeof(kv_path)))
+    g_hooks.on_save(g_hooks.userdata, id, kv_path);
+  return true;
+}
+
 static const char *get_chats_dir(void) {
   static char path[512] = {0};
   if (path[0] == '\0') {
@@ -437,7 +471,7 @@ bool chat_save(const ChatHistory *history, const char *id, const char *title,
 
   free(escaped_title);
   fclose(f);
-  return true;
+  return chat_saved(id, character_name);
 }
 
 bool chat_save_with_note(const ChatHistory *history, const AuthorNote *note,
@@ -528,7 +562,7 @@ bool chat_save_with_note(const ChatHistory *history, const AuthorNote *note,
 
   free(escaped_title);
   fclose(f);
-  return true;
+  return chat_saved(id, character_name);
 }
 
 static bool try_load_chat_from_path_with_note(ChatHistory *history,
@@ -792,7 +826,7 @@ bool chat_load(ChatHistory *history, const char *id, const char *character_name,
       snprintf(filepath, sizeof(filepath), "%s/%s.json", char_dir, id);
       if (try_load_chat_from_path(history, filepath, out_character_path,
                                   path_size)) {
-        return true;
+        return chat_loaded(id, filepath);
       }
     }
   }
@@ -821,7 +855,7 @@ bool chat_load(ChatHistory *history, const char *id, const char *character_name,
       if (try_load_chat_from_path(history, filepath, out_character_path,
                                   path_size)) {
         closedir(d);
-        return true;
+        return chat_loaded(id, filepath);
       }
     }
   }
@@ -830,7 +864,8 @@ bool chat_load(ChatHistory *history, const char *id, const char *character_name,
   char filepath[768];
   snprintf(filepath, sizeof(filepath), "%s/%s.json", base_dir, id);
   return try_load_chat_from_path(history, filepath, out_character_path,
-                                 path_size);
+                                 path_size) &&
+         chat_loaded(id, filepath);
 }
 
 bool chat_load_with_note(ChatHistory *history, AuthorNote *note, const char *id,
@@ -843,7 +878,7 @@ bool chat_load_with_note(ChatHistory *history, AuthorNote *note, const char *id,
       snprintf(filepath, sizeof(filepath), "%s/%s.json", char_dir, id);
       if (try_load_chat_from_path_with_note(history, note, filepath,
                                             out_character_path, path_size)) {
-        return true;
+        return chat_loaded(id, filepath);
       }
     }
   }
@@ -871,7 +906,7 @@ bool chat_load_with_note(ChatHistory *history, AuthorNote *note, const char *id,
     if (try_load_chat_from_path_with_note(history, note, filepath,
                                           out_character_path, path_size)) {
       closedir(d);
-      return true;
+      return chat_loaded(id, filepath);
     }
   }
 
@@ -880,16 +915,41 @@ bool chat_load_with_note(ChatHistory *history, AuthorNote *note, const char *id,
   char filepath[768];
   snprintf(filepath, sizeof(filepath), "%s/%s.json", base_dir, id);
   return try_load_chat_from_path_with_note(history, note, filepath,
-                                           out_character_path, path_size);
+                                           out_character_path, path_size) &&
+         chat_loaded(id, filepath);
+}
+
+bool chat_kv_snapshot_path(const char *id, const char *character_name,
+                           char *out, size_t out_size) {
+  if (!id || !id[0] || !out || out_size == 0)
+    return false;
+  if (!ensure_character_chats_dir(character_name))
+    return false;
+
+  char char_dir[768];
+  if (!get_character_chats_dir(character_name, char_dir, sizeof(char_dir)))
+    return false;
+
+  int n = snprintf(out, out_size, "%s/%s.kv", char_dir, id);
+  return n > 0 && (size_t)n < out_size;
+}
+
+/* Removes a chat file and the KV snapshot kept next to it. */
+static bool unlink_chat_files(const char *dir, const char *id) {
+  char filepath[1024];
+  snprintf(filepath, sizeof(filepath), "%s/%s.json", dir, id);
+  if (unlink(filepath) != 0)
+    return false;
+  snprintf(filepath, sizeof(filepath), "%s/%s.kv", dir, id);
+  unlink(filepath);
+  return true;
 }
 
 bool chat_delete(const char *id, const char *character_name) {
   if (character_name && character_name[0]) {
     char char_dir[768];
     if (get_character_chats_dir(character_name, char_dir, sizeof(char_dir))) {
-      char filepath[1024];
-      snprintf(filepath, sizeof(filepath), "%s/%s.json", char_dir, id);
-      if (unlink(filepath) == 0)
+      if (unlink_chat_files(char_dir, id))
         return true;
     }
   }
@@ -913,9 +973,7 @@ bool chat_delete(const char *id, const char *character_name) {
 
     struct stat st;
     if (stat(subdir_path, &st) == 0 && S_ISDIR(st.st_mode)) {
-      char filepath[1024];
-      snprintf(filepath, sizeof(filepath), "%s/%s.json", subdir_path, id);
-      if (unlink(filepath) == 0) {
+      if (unlink_chat_files(subdir_path, id)) {
         closedir(d);
         return true;
       }
@@ -923,9 +981,7 @@ bool chat_delete(const char *id, const char *character_name) {
   }
   closedir(d);
 
-  char filepath[768];
-  snprintf(filepath, sizeof(filepath), "%s/%s.json", base_dir, id);
-  return unlink(filepath) == 0;
+  return unlink_chat_files(base_dir, id);
 }
 
 char *chat_generate_id(void) {
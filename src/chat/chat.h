@@ -46,6 +46,30 @@ bool chat_load_with_note(ChatHistory *history, AuthorNote *note, const char *id,
                          size_t path_size);
 bool chat_delete(const char *id, const char *character_name);
 
+/*
+ * A local inference engine keeps a KV cache per chat and needs to know which
+ * chat is current. Hooks registered here run after chat_load or
+ * chat_load_with_note has read a chat and after chat_save or
+ * chat_save_with_note has written one. kv_path is where the chat's KV cache
+ * snapshot lives, next to its JSON file; on_load gets an empty string when
+ * it cannot be derived. The TUI itself only talks to remote APIs, so it
+ * registers none; an engine such as the Qwen3 session manager
+ * (qwen3_sessions_chat_loaded, qwen3_sessions_chat_saved) does.
+ */
+typedef struct {
+  void (*on_load)(void *userdata, const char *id, const char *kv_path);
+  void (*on_save)(void *userdata, const char *id, const char *kv_path);
+  void *userdata;
+} ChatHooks;
+
+/* NULL clears the hooks. */
+void chat_set_hooks(const ChatHooks *hooks);
+
+/* Path of the KV cache snapshot kept alongside a chat's JSON file, as passed
+ * to ChatHooks.on_save. Creates the character's chat directory if needed. */
+bool chat_kv_snapshot_path(const char *id, const char *character_name,
+                           char *out, size_t out_size);
+
 char *chat_generate_id(void);
 const char *chat_auto_title(const ChatHistory *history);
 
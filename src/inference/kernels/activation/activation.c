@@ -4,7 +4,9 @@
 
 #include "inference/kernels/activation/activation.h"
 #include "inference/kernels/activation/activation_kernels.h"
+#include "inference/kernels/threadpool/threadpool.h"
 #include <math.h>
+#include <stdbool.h>
 #include <string.h>
 
 #ifndef M_SQRT1_2
@@ -112,9 +114,81 @@ static inline float fp16_to_float(uint16_t fp16) {
   return result;
 }
 
+/* ============ Row Parallelism ============ */
+
+/* Batches of at least ACTIVATION_PARALLEL_MIN_ELEMS outputs are split by token
+ * rows on the shared thread pool; chunks keep at least
+ * ACTIVATION_PARALLEL_GRAIN_ELEMS outputs each. */
+#define ACTIVATION_PARALLEL_MIN_ELEMS (1 << 16)
+#define ACTIVATION_PARALLEL_GRAIN_ELEMS (1 << 14)
+
+typedef void (*activation_f32_fn)(float *out, const float *input,
+                                  int num_tokens, int d);
+typedef void (*activation_u16_fn)(uint16_t *out, const uint16_t *input,
+                                  int num_tokens, int d);
+
+typedef struct {
+  activation_f32_fn fn;
+  float *out;
+  const float *input;
+  int d;
+  int in_stride;
+} activation_f32_task_t;
+
+typedef struct {
+  activation_u16_fn fn;
+  uint16_t *out;
+  const uint16_t *input;
+  int d;
+  int in_stride;
+} activation_u16_task_t;
+
+static int activation_parallel_grain(int num_tokens, int d) {
+  if (num_tokens < 2 ||
+      (long long)num_tokens * d < ACTIVATION_PARALLEL_MIN_ELEMS ||
+      threadpool_get_num_threads() <= 1)
+    return 0;
+  return (ACTIVATION_PARALLEL_GRAIN_ELEMS + d - 1) / d;
+}
+
+static void activation_f32_rows(void *arg, int start, int end) {
+  const activation_f32_task_t *t = (const activation_f32_task_t *)arg;
+  t->fn(t->out + (size_t)start * t->d,
+        t->input + (size_t)start * t->in_stride, end - start, t->d);
+}
+
+static void activation_u16_rows(void *arg, int start, int end) {
+  const activation_u16_task_t *t = (const activation_u16_task_t *)arg;
+  t->fn(t->out + (size_t)start * t->d,
+        t->input + (size_t)start * t->in_stride, end - start, t->d);
+}
+
+static bool activation_parallel_f32(activation_f32_fn fn, float *out,
+                                    const float *input, int num_tokens, int d,
+                                    int in_stride) {
+  int grain = activation_parallel_grain(num_tokens, d);
+  if (grain == 0)
+    return false;
+  activation_f32_task_t t = {fn, out, input, d, in_stride};
+  threadpool_parallel_for(0, num_tokens, grain, activation_f32_rows, &t);
+  return true;
+}
+
+static bool activation_parallel_u16(activation_u16_fn fn, uint16_t *out,
+                                    const uint16_t *input, int num_tokens,
+                                    int d, int in_stride) {
+  int grain = activation_parallel_grain(num_tokens, d);
+  if (grain == 0)
+    return false;
+  activation_u16_task_t t = {fn, out, input, d, in_stride};
+  threadpool_parallel_for(0, num_tokens, grain, activation_u16_rows, &t);
+  return true;
+}
+
 /* ============ SiLU Implementation ============ */
 
-void silu_f32(float *out, const float *input, int num_tokens, int d) {
+static void silu_f32_serial(float *out, const float *input, int num_tokens,
+                            int d) {
   if (num_tokens <= 0 || d <= 0)
     return;
 
@@ -132,7 +206,8 @@ void silu_f32(float *out, const float *input, int num_tokens, int d) {
   }
 }
 
-void silu_bf16(uint16_t *out, const uint16_t *input, int num_tokens, int d) {
+static void silu_bf16_serial(uint16_t *out, const uint16_t *input,
+                             int num_tokens, int d) {
   if (num_tokens <= 0 || d <= 0)
     return;
 
@@ -151,7 +226,8 @@ void silu_bf16(uint16_t *out, const uint16_t *input, int num_tokens, int d) {
   }
 }
 
-void silu_f16(uint16_t *out, const uint16_t *input, int num_tokens, int d) {
+static void silu_f16_serial(uint16_t *out, const uint16_t *input,
+                            int num_tokens, int d) {
   if (num_tokens <= 0 || d <= 0)
     return;
 
@@ -172,7 +248,8 @@ void silu_f16(uint16_t *out, const uint16_t *input, int num_tokens, int d) {
 
 /* ============ SiLU and Mul (SwiGLU) Implementation ============ */
 
-void silu_and_mul_f32(float *out, const float *input, int num_tokens, int d) {
+static void silu_and_mul_f32_serial(float *out, const float *input,
+                                    int num_tokens, int d) {
   if (num_tokens <= 0 || d <= 0)
     return;
 
@@ -193,8 +270,8 @@ void silu_and_mul_f32(float *out, const float *input, int num_tokens, int d) {
   }
 }
 
-void silu_and_mul_bf16(uint16_t *out, const uint16_t *input, int num_tokens,
-                       int d) {
+static void silu_and_mul_bf16_serial(uint16_t *out, const uint16_t *input,
+                                     int num_tokens, int d) {
   if (num_tokens <= 0 || d <= 0)
     return;
 
@@ -215,8 +292,8 @@ void silu_and_mul_bf16(uint16_t *out, const uint16_t *input, int num_tokens,
   }
 }
 
-void silu_and_mul_f16(uint16_t *out, const uint16_t *input, int num_tokens,
-                      int d) {
+static void silu_and_mul_f16_serial(uint16_t *out, const uint16_t *input,
+                                    int num_tokens, int d) {
   if (num_tokens <= 0 || d <= 0)
     return;
 
@@ -239,7 +316,8 @@ void silu_and_mul_f16(uint16_t *out, const uint16_t *input, int num_tokens,
 
 /* ============ GELU Implementation ============ */
 
-void gelu_f32(float *out, const float *input, int num_tokens, int d) {
+static void gelu_f32_serial(float *out, const float *input, int num_tokens,
+                            int d) {
   if (num_tokens <= 0 || d <= 0)
     return;
 
@@ -257,7 +335,8 @@ void gelu_f32(float *out, const float *input, int num_tokens, int d) {
   }
 }
 
-void gelu_bf16(uint16_t *out, const uint16_t *input, int num_tokens, int d) {
+static void gelu_bf16_serial(uint16_t *out, const uint16_t *input,
+                             int num_tokens, int d) {
   if (num_tokens <= 0 || d <= 0)
     return;
 
@@ -276,7 +355,8 @@ void gelu_bf16(uint16_t *out, const uint16_t *input, int num_tokens, int d) {
   }
 }
 
-void gelu_f16(uint16_t *out, const uint16_t *input, int num_tokens, int d) {
+static void gelu_f16_serial(uint16_t *out, const uint16_t *input,
+                            int num_tokens, int d) {
   if (num_tokens <= 0 || d <= 0)
     return;
 
@@ -297,7 +377,8 @@ void gelu_f16(uint16_t *out, const uint16_t *input, int num_tokens, int d) {
 
 /* ============ GELU and Mul (GeGLU) Implementation ============ */
 
-void gelu_and_mul_f32(float *out, const float *input, int num_tokens, int d) {
+static void gelu_and_mul_f32_serial(float *out, const float *input,
+                                    int num_tokens, int d) {
   if (num_tokens <= 0 || d <= 0)
     return;
 
@@ -318,8 +399,8 @@ void gelu_and_mul_f32(float *out, const float *input, int num_tokens, int d) {
   }
 }
 
-void gelu_and_mul_bf16(uint16_t *out, const uint16_t *input, int num_tokens,
-                       int d) {
+static void gelu_and_mul_bf16_serial(uint16_t *out, const uint16_t *input,
+                                     int num_tokens, int d) {
   if (num_tokens <= 0 || d <= 0)
     return;
 
@@ -340,8 +421,8 @@ void gelu_and_mul_bf16(uint16_t *out, const uint16_t *input, int num_tokens,
   }
 }
 
-void gelu_and_mul_f16(uint16_t *out, const uint16_t *input, int num_tokens,
-                      int d) {
+static void gelu_and_mul_f16_serial(uint16_t *out, const uint16_t *input,
+                                    int num_tokens, int d) {
   if (num_tokens <= 0 || d <= 0)
     return;
 
@@ -364,7 +445,8 @@ void gelu_and_mul_f16(uint16_t *out, const uint16_t *input, int num_tokens,
 
 /* ============ GELU Tanh Implementation ============ */
 
-void gelu_tanh_f32(float *out, const float *input, int num_tokens, int d) {
+static void gelu_tanh_f32_serial(float *out, const float *input, int num_tokens,
+                                 int d) {
   if (num_tokens <= 0 || d <= 0)
     return;
 
@@ -382,8 +464,8 @@ void gelu_tanh_f32(float *out, const float *input, int num_tokens, int d) {
   }
 }
 
-void gelu_tanh_bf16(uint16_t *out, const uint16_t *input, int num_tokens,
-                    int d) {
+static void gelu_tanh_bf16_serial(uint16_t *out, const uint16_t *input,
+                                  int num_tokens, int d) {
   if (num_tokens <= 0 || d <= 0)
     return;
 
@@ -402,8 +484,8 @@ void gelu_tanh_bf16(uint16_t *out, const uint16_t *input, int num_tokens,
   }
 }
 
-void gelu_tanh_f16(uint16_t *out, const uint16_t *input, int num_tokens,
-                   int d) {
+static void gelu_tanh_f16_serial(uint16_t *out, const uint16_t *input,
+                                 int num_tokens, int d) {
   if (num_tokens <= 0 || d <= 0)
     return;
 
@@ -424,8 +506,8 @@ void gelu_tanh_f16(uint16_t *out, const uint16_t *input, int num_tokens,
 
 /* ============ GELU Tanh and Mul Implementation ============ */
 
-void gelu_tanh_and_mul_f32(float *out, const float *input, int num_tokens,
-                           int d) {
+static void gelu_tanh_and_mul_f32_serial(float *out, const float *input,
+                                         int num_tokens, int d) {
   if (num_tokens <= 0 || d <= 0)
     return;
 
@@ -446,8 +528,8 @@ void gelu_tanh_and_mul_f32(float *out, const float *input, int num_tokens,
   }
 }
 
-void gelu_tanh_and_mul_bf16(uint16_t *out, const uint16_t *input,
-                            int num_tokens, int d) {
+static void gelu_tanh_and_mul_bf16_serial(uint16_t *out, const uint16_t *input,
+                                          int num_tokens, int d) {
   if (num_tokens <= 0 || d <= 0)
     return;
 
@@ -468,8 +550,8 @@ void gelu_tanh_and_mul_bf16(uint16_t *out, const uint16_t *input,
   }
 }
 
-void gelu_tanh_and_mul_f16(uint16_t *out, const uint16_t *input, int num_tokens,
-                           int d) {
+static void gelu_tanh_and_mul_f16_serial(uint16_t *out, const uint16_t *input,
+                                         int num_tokens, int d) {
   if (num_tokens <= 0 || d <= 0)
     return;
 
@@ -492,7 +574,8 @@ void gelu_tanh_and_mul_f16(uint16_t *out, const uint16_t *input, int num_tokens,
 
 /* ============ GELU Quick Implementation ============ */
 
-void gelu_quick_f32(float *out, const float *input, int num_tokens, int d) {
+static void gelu_quick_f32_serial(float *out, const float *input,
+                                  int num_tokens, int d) {
   if (num_tokens <= 0 || d <= 0)
     return;
 
@@ -510,8 +593,8 @@ void gelu_quick_f32(float *out, const float *input, int num_tokens, int d) {
   }
 }
 
-void gelu_quick_bf16(uint16_t *out, const uint16_t *input, int num_tokens,
-                     int d) {
+static void gelu_quick_bf16_serial(uint16_t *out, const uint16_t *input,
+                                   int num_tokens, int d) {
   if (num_tokens <= 0 || d <= 0)
     return;
 
@@ -530,8 +613,8 @@ void gelu_quick_bf16(uint16_t *out, const uint16_t *input, int num_tokens,
   }
 }
 
-void gelu_quick_f16(uint16_t *out, const uint16_t *input, int num_tokens,
-                    int d) {
+static void gelu_quick_f16_serial(uint16_t *out, const uint16_t *input,
+                                  int num_tokens, int d) {
   if (num_tokens <= 0 || d <= 0)
     return;
 
@@ -552,8 +635,8 @@ void gelu_quick_f16(uint16_t *out, const uint16_t *input, int num_tokens,
 
 /* ============ GELU Quick and Mul Implementation ============ */
 
-void gelu_quick_and_mul_f32(float *out, const float *input, int num_tokens,
-                            int d) {
+static void gelu_quick_and_mul_f32_serial(float *out, const float *input,
+                                          int num_tokens, int d) {
   if (num_tokens <= 0 || d <= 0)
     return;
 
@@ -574,8 +657,8 @@ void gelu_quick_and_mul_f32(float *out, const float *input, int num_tokens,
   }
 }
 
-void gelu_quick_and_mul_bf16(uint16_t *out, const uint16_t *input,
-                             int num_tokens, int d) {
+static void gelu_quick_and_mul_bf16_serial(uint16_t *out, const uint16_t *input,
+                                           int num_tokens, int d) {
   if (num_tokens <= 0 || d <= 0)
     return;
 
@@ -596,8 +679,8 @@ void gelu_quick_and_mul_bf16(uint16_t *out, const uint16_t *input,
   }
 }
 
-void gelu_quick_and_mul_f16(uint16_t *out, const uint16_t *input,
-                            int num_tokens, int d) {
+static void gelu_quick_and_mul_f16_serial(uint16_t *out, const uint16_t *input,
+                                          int num_tokens, int d) {
   if (num_tokens <= 0 || d <= 0)
     return;
 
@@ -617,3 +700,157 @@ void gelu_quick_and_mul_f16(uint16_t *out, const uint16_t *input,
     }
   }
 }
+
+/* ============ Public Entry Points ============ */
+
+void silu_f32(float *out, const float *input, int num_tokens, int d) {
+  if (!activation_parallel_f32(silu_f32_serial, out, input, num_tokens, d, d))
+    silu_f32_serial(out, input, num_tokens, d);
+}
+
+void silu_bf16(uint16_t *out, const uint16_t *input, int num_tokens, int d) {
+  if (!activation_parallel_u16(silu_bf16_serial, out, input, num_tokens, d, d))
+    silu_bf16_serial(out, input, num_tokens, d);
+}
+
+void silu_f16(uint16_t *out, const uint16_t *input, int num_tokens, int d) {
+  if (!activation_parallel_u16(silu_f16_serial, out, input, num_tokens, d, d))
+    silu_f16_serial(out, input, num_tokens, d);
+}
+
+void silu_and_mul_f32(float *out, const float *input, int num_tokens, int d) {
+  if (!activation_parallel_f32(silu_and_mul_f32_serial, out, input, num_tokens,
+                               d, 2 * d))
+    silu_and_mul_f32_serial(out, input, num_tokens, d);
+}
+
+void silu_and_mul_bf16(uint16_t *out, const uint16_t *input, int num_tokens,
+                       int d) {
+  if (!activation_parallel_u16(silu_and_mul_bf16_serial, out, input, num_tokens,
+                               d, 2 * d))
+    silu_and_mul_bf16_serial(out, input, num_tokens, d);
+}
+
+void silu_and_mul_f16(uint16_t *out, const uint16_t *input, int num_tokens,
+                      int d) {
+  if (!activation_parallel_u16(silu_and_mul_f16_serial, out, input, num_tokens,
+                               d, 2 * d))
+    silu_and_mul_f16_serial(out, input, num_tokens, d);
+}
+
+void gelu_f32(float *out, const float *input, int num_tokens, int d) {
+  if (!activation_parallel_f32(gelu_f32_serial, out, input, num_tokens, d, d))
+    gelu_f32_serial(out, input, num_tokens, d);
+}
+
+void gelu_bf16(uint16_t *out, const uint16_t *input, int num_tokens, int d) {
+  if (!activation_parallel_u16(gelu_bf16_serial, out, input, num_tokens, d, d))
+    gelu_bf16_serial(out, input, num_tokens, d);
+}
+
+void gelu_f16(uint16_t *out, const uint16_t *input, int num_tokens, int d) {
+  if (!activation_parallel_u16(gelu_f16_serial, out, input, num_tokens, d, d))
+    gelu_f16_serial(out, input, num_tokens, d);
+}
+
+void gelu_and_mul_f32(float *out, const float *input, int num_tokens, int d) {
+  if (!activation_parallel_f32(gelu_and_mul_f32_serial, out, input, num_tokens,
+                               d, 2 * d))
+    gelu_and_mul_f32_serial(out, input, num_tokens, d);
+}
+
+void gelu_and_mul_bf16(uint16_t *out, const uint16_t *input, int num_tokens,
+                       int d) {
+  if (!activation_parallel_u16(gelu_and_mul_bf16_serial, out, input, num_tokens,
+                               d, 2 * d))
+    gelu_and_mul_bf16_serial(out, input, num_tokens, d);
+}
+
+void gelu_and_mul_f16(uint16_t *out, const uint16_t *input, int num_tokens,
+                      int d) {
+  if (!activation_parallel_u16(gelu_and_mul_f16_serial, out, input, num_tokens,
+                               d, 2 * d))
+    gelu_and_mul_f16_serial(out, input, num_tokens, d);
+}
+
+void gelu_tanh_f32(float *out, const float *input, int num_tokens, int d) {
+  if (!activation_parallel_f32(gelu_tanh_f32_serial, out, input, num_tokens, d,
+                               d))
+    gelu_tanh_f32_serial(out, input, num_tokens, d);
+}
+
+void gelu_tanh_bf16(uint16_t *out, const uint16_t *input, int num_tokens,
+                    int d) {
+  if (!activation_parallel_u16(gelu_tanh_bf16_serial, out, input, num_tokens, d,
+                               d))
+    gelu_tanh_bf16_serial(out, input, num_tokens, d);
+}
+
+void gelu_tanh_f16(uint16_t *out, const uint16_t *input, int num_tokens,
+                   int d) {
+  if (!activation_parallel_u16(gelu_tanh_f16_serial, out, input, num_tokens, d,
+                               d))
+    gelu_tanh_f16_serial(out, input, num_tokens, d);
+}
+
+void gelu_tanh_and_mul_f32(float *out, const float *input, int num_tokens,
+                           int d) {
+  if (!activation_parallel_f32(gelu_tanh_and_mul_f32_serial, out, input,
+                               num_tokens, d, 2 * d))
+    gelu_tanh_and_mul_f32_serial(out, input, num_tokens, d);
+}
+
+void gelu_tanh_and_mul_bf16(uint16_t *out, const uint16_t *input,
+                            int num_tokens, int d) {
+  if (!activation_parallel_u16(gelu_tanh_and_mul_bf16_serial, out, input,
+                               num_tokens, d, 2 * d))
+    gelu_tanh_and_mul_bf16_serial(out, input, num_tokens, d);
+}
+
+void gelu_tanh_and_mul_f16(uint16_t *out, const uint16_t *input, int num_tokens,
+                           int d) {
+  if (!activation_parallel_u16(gelu_tanh_and_mul_f16_serial, out, input,
+                               num_tokens, d, 2 * d))
+    gelu_tanh_and_mul_f16_serial(out, input, num_tokens, d);
+}
+
+void gelu_quick_f32(float *out, const float *input, int num_tokens, int d) {
+  if (!activation_parallel_f32(gelu_quick_f32_serial, out, input, num_tokens, d,
+                               d))
+    gelu_quick_f32_serial(out, input, num_tokens, d);
+}
+
+void gelu_quick_bf16(uint16_t *out, const uint16_t *input, int num_tokens,
+                     int d) {
+  if (!activation_parallel_u16(gelu_quick_bf16_serial, out, input, num_tokens,
+                               d, d))
+    gelu_quick_bf16_serial(out, input, num_tokens, d);
+}
+
+void gelu_quick_f16(uint16_t *out, const uint16_t *input, int num_tokens,
+                    int d) {
+  if (!activation_parallel_u16(gelu_quick_f16_serial, out, input, num_tokens, d,
+                               d))
+    gelu_quick_f16_serial(out, input, num_tokens, d);
+}
+
+void gelu_quick_and_mul_f32(float *out, const float *input, int num_tokens,
+                            int d) {
+  if (!activation_parallel_f32(gelu_quick_and_mul_f32_serial, out, input,
+                               num_tokens, d, 2 * d))
+    gelu_quick_and_mul_f32_serial(out, input, num_tokens, d);
+}
+
+void gelu_quick_and_mul_bf16(uint16_t *out, const uint16_t *input,
+                             int num_tokens, int d) {
+  if (!activation_parallel_u16(gelu_quick_and_mul_bf16_serial, out, input,
+                               num_tokens, d, 2 * d))
+    gelu_quick_and_mul_bf16_serial(out, input, num_tokens, d);
+}
+
+void gelu_quick_and_mul_f16(uint16_t *out, const uint16_t *input,
+                            int num_tokens, int d) {
+  if (!activation_parallel_u16(gelu_quick_and_mul_f16_serial, out, input,
+                               num_tokens, d, 2 * d))
+    gelu_quick_and_mul_f16_serial(out, input, num_tokens, d);
+}
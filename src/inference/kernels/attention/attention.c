@@ -6,11 +6,13 @@
  */
 
 #include "inference/kernels/attention/attention.h"
+#include "inference/kernels/attention/attention_kernels.h"
+#include "inference/kernels/convert/convert.h"
+#include "inference/kernels/kv_cache/kv_cache.h"
+#include "inference/kernels/threadpool/threadpool.h"
 #include <math.h>
-#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
-#include <unistd.h>
 
 #if defined(__ARM_NEON) || defined(__ARM_NEON__)
 #define HAS_NEON 1
@@ -30,27 +32,12 @@ void flash_attention_f16_neon(uint16_t *output, const uint16_t *query,
 #define HAS_NEON 0
 #endif
 
-static int g_num_threads = 0;
-
-static int get_cpu_count(void) {
-  int count = (int)sysconf(_SC_NPROCESSORS_ONLN);
-  return count > 0 ? count : 1;
-}
-
+/* Thread count is a property of the shared kernel thread pool. */
 void attention_set_num_threads(int num_threads) {
-  if (num_threads <= 0) {
-    g_num_threads = get_cpu_count();
-  } else {
-    g_num_threads = num_threads;
-  }
+  threadpool_set_num_threads(num_threads);
 }
 
-int attention_get_num_threads(void) {
-  if (g_num_threads == 0) {
-    g_num_threads = get_cpu_count();
-  }
-  return g_num_threads;
-}
+int attention_get_num_threads(void) { return threadpool_get_num_threads(); }
 
 static inline float bf16_to_float(uint16_t bf16) {
   uint32_t bits = ((uint32_t)bf16) << 16;
@@ -407,16 +394,8 @@ static void mha_work(mha_ctx_t *ctx, int start_head, int end_head) {
   }
 }
 
-typedef struct {
-  mha_ctx_t *ctx;
-  int start_head;
-  int end_head;
-} mha_task_t;
-
-static void *mha_thread_fn(void *arg) {
-  mha_task_t *task = (mha_task_t *)arg;
-  mha_work(task->ctx, task->start_head, task->end_head);
-  return NULL;
+static void mha_range(void *arg, int start, int end) {
+  mha_work((mha_ctx_t *)arg, start, end);
 }
 
 void flash_attention_mha_f32(float *output, const float *query,
@@ -436,32 +415,442 @@ void flash_attention_mha_f32(float *output, const float *query,
     return;
   }
 
-  if (num_threads > num_heads)
-    num_threads = num_heads;
+  threadpool_parallel_for(0, num_heads, 1, mha_range, &ctx);
+}
+
+/*
+ * Tiled attention over a paged cache.
+ *
+ * A tile holds the rows of up to ATTN_TILE_ROWS (query, head) pairs of one
+ * KV group, query-major, so all heads of a query sit next to each other and
+ * share its causal limit. Key tiles of ATTN_TILE_KEYS positions are widened
+ * into contiguous FP32 rows once per query tile.
+ *
+ * Each (KV head, query tile) pair is an independent work item that writes
+ * its own output rows. Items are dealt round-robin to ATTN_PREFILL_LANES
+ * lanes, each with its own slice of the scratch, and lanes run on the
+ * thread pool. Which thread runs a lane never changes the arithmetic, so
+ * the output is the same for any thread count.
+ */
 
-  pthread_t *threads = (pthread_t *)malloc(num_threads * sizeof(pthread_t));
-  mha_task_t *tasks = (mha_task_t *)malloc(num_threads * sizeof(mha_task_t));
+#define ATTN_TILE_ROWS 64
+#define ATTN_TILE_KEYS 32
+#define ATTN_PREFILL_LANES 32
 
-  int heads_per_thread = (num_heads + num_threads - 1) / num_threads;
+#if HAS_NEON || ATTENTION_X86_AVX2
+#define HAS_TILE_KERNELS 1
+#else
+#define HAS_TILE_KERNELS 0
+#endif
 
-  for (int t = 0; t < num_threads; t++) {
-    tasks[t].ctx = &ctx;
-    tasks[t].start_head = t * heads_per_thread;
-    tasks[t].end_head = tasks[t].start_head + heads_per_thread;
-    if (tasks[t].end_head > num_heads)
-      tasks[t].end_head = num_heads;
+static void qk_tile(float *scores, const float *q, const float *k,
+                    int num_keys, int head_dim) {
+#if HAS_TILE_KERNELS
+  attention_qk_tile_kernel(scores, q, k, num_keys, head_dim);
+#else
+  for (int j = 0; j < num_keys; j++)
+    scores[j] = dot_product_f32(q, k + (size_t)j * head_dim, head_dim);
+#endif
+}
 
-    if (tasks[t].start_head < num_heads) {
-      pthread_create(&threads[t], NULL, mha_thread_fn, &tasks[t]);
+static float exp_tile(float *p, int n, float max) {
+#if HAS_TILE_KERNELS
+  return attention_exp_tile_kernel(p, n, max);
+#else
+  float sum = 0.0f;
+  for (int j = 0; j < n; j++) {
+    p[j] = expf(p[j] - max);
+    sum += p[j];
+  }
+  return sum;
+#endif
+}
+
+static void pv_tile(float *out, const float *p, const float *v, int num_keys,
+                    int head_dim, float alpha) {
+#if HAS_TILE_KERNELS
+  attention_pv_tile_kernel(out, p, v, num_keys, head_dim, alpha);
+#else
+  vec_scale_f32(out, alpha, head_dim);
+  for (int j = 0; j < num_keys; j++)
+    vec_mad_f32(out, v + (size_t)j * head_dim, p[j], head_dim);
+#endif
+}
+
+static int tile_queries(int heads_per_kv) {
+  return heads_per_kv < ATTN_TILE_ROWS ? ATTN_TILE_ROWS / heads_per_kv : 1;
+}
+
+static size_t lane_floats(int head_dim, int heads_per_kv) {
+  size_t rows = (size_t)tile_queries(heads_per_kv) * heads_per_kv;
+  /* q, acc, scores, max and sum per row; K and V per key. */
+  return rows * (2 * (size_t)head_dim + ATTN_TILE_KEYS + 2) +
+         (size_t)2 * ATTN_TILE_KEYS * head_dim;
+}
+
+size_t flash_attention_paged_scratch_floats(int head_dim, int heads_per_kv) {
+  return ATTN_PREFILL_LANES * lane_floats(head_dim, heads_per_kv);
+}
+
+static void load_rows(float *dst, const void *src, bool f16, int n) {
+  if (f16)
+    convert_f16_to_f32((const uint16_t *)src, dst, n);
+  else
+    memcpy(dst, src, n * sizeof(float));
+}
+
+/* Widen one KV head's key and value at pos into FP32 tile rows. An INT8
+ * view is dequantized with the position's per-head scales; otherwise its
+ * rows are FP16 when f16 is set and FP32 when not. */
+static void load_kv_rows(float *k_dst, float *v_dst,
+                         const kv_layer_view_t *kv, int pos, int kv_head,
+                         bool f16) {
+  int head_dim = kv->head_dim;
+  if (kv->quantized) {
+    const int8_t *k = (const int8_t *)kv_view_key(kv, pos) +
+                      (size_t)kv_head * head_dim;
+    const int8_t *v = (const int8_t *)kv_view_value(kv, pos) +
+                      (size_t)kv_head * head_dim;
+    kv_cache_dequantize_q8(k_dst, k, kv_view_key_scale(kv, pos)[kv_head],
+                           head_dim);
+    kv_cache_dequantize_q8(v_dst, v, kv_view_value_scale(kv, pos)[kv_head],
+                           head_dim);
+    return;
+  }
+  size_t offset = (size_t)kv_head * head_dim *
+                  (f16 ? sizeof(uint16_t) : sizeof(float));
+  load_rows(k_dst, (const char *)kv_view_key(kv, pos) + offset, f16,
+            head_dim);
+  load_rows(v_dst, (const char *)kv_view_value(kv, pos) + offset, f16,
+            head_dim);
+}
+
+typedef struct {
+  void *output;
+  const void *query;
+  bool f16;
+  const kv_layer_view_t *kv;
+  const int64_t *positions;
+  int seq_len;
+  int kv_len;
+  int num_heads;
+  float scale;
+  int items;
+  int lanes;
+  float *scratch;
+} prefill_ctx_t;
+
+/* One KV head against queries [q0, q0 + nq), in a lane's scratch. */
+static void prefill_tile(const prefill_ctx_t *ctx, float *scratch,
+                         int kv_head, int q0, int nq) {
+  const kv_layer_view_t *kv = ctx->kv;
+  const int64_t *positions = ctx->positions;
+  int head_dim = kv->head_dim;
+  int group = ctx->num_heads / kv->num_heads;
+  int q_stride = ctx->num_heads * head_dim;
+  size_t elem = ctx->f16 ? sizeof(uint16_t) : sizeof(float);
+  int max_rows = tile_queries(group) * group;
+  int rows = nq * group;
+
+  float *q_tile = scratch;
+  float *acc = q_tile + (size_t)max_rows * head_dim;
+  float *scores = acc + (size_t)max_rows * head_dim;
+  float *row_max = scores + (size_t)max_rows * ATTN_TILE_KEYS;
+  float *row_sum = row_max + max_rows;
+  float *k_tile = row_sum + max_rows;
+  float *v_tile = k_tile + (size_t)ATTN_TILE_KEYS * head_dim;
+
+  /* The keys this tile needs end at its furthest query. */
+  int64_t last = 0;
+  for (int i = 0; i < nq; i++) {
+    if (positions[q0 + i] + 1 > last)
+      last = positions[q0 + i] + 1;
+  }
+  int keys_end = last < ctx->kv_len ? (int)last : ctx->kv_len;
+
+  for (int i = 0; i < nq; i++) {
+    for (int g = 0; g < group; g++) {
+      int r = i * group + g;
+      const char *src = (const char *)ctx->query +
+                        ((size_t)(q0 + i) * q_stride +
+                         (size_t)(kv_head * group + g) * head_dim) *
+                            elem;
+      load_rows(q_tile + (size_t)r * head_dim, src, ctx->f16, head_dim);
+      vec_scale_f32(q_tile + (size_t)r * head_dim, ctx->scale, head_dim);
     }
   }
+  memset(acc, 0, (size_t)rows * head_dim * sizeof(float));
+  /* Finite, so the first alpha is exp(-huge) = 0 even under -ffast-math. */
+  for (int r = 0; r < rows; r++) {
+    row_max[r] = -1e30f;
+    row_sum[r] = 0.0f;
+  }
+
+  for (int k0 = 0; k0 < keys_end; k0 += ATTN_TILE_KEYS) {
+    int nk = keys_end - k0 < ATTN_TILE_KEYS ? keys_end - k0 : ATTN_TILE_KEYS;
+    for (int j = 0; j < nk; j++)
+      load_kv_rows(k_tile + (size_t)j * head_dim, v_tile + (size_t)j * head_dim,
+                   kv, k0 + j, kv_head, ctx->f16);
+
+    for (int i = 0; i < nq; i++) {
+      /* Causal limit: keys up to this query's position. */
+      int64_t limit = positions[q0 + i] + 1;
+      if (limit > keys_end)
+        limit = keys_end;
+      int n = limit - k0 < nk ? (int)(limit - k0) : nk;
+      if (n <= 0)
+        continue;
+
+      for (int g = 0; g < group; g++) {
+        int r = i * group + g;
+        float *s = scores + (size_t)r * ATTN_TILE_KEYS;
+        qk_tile(s, q_tile + (size_t)r * head_dim, k_tile, n, head_dim);
+
+        float m = row_max[r];
+        for (int j = 0; j < n; j++) {
+          if (s[j] > m)
+            m = s[j];
+        }
+        float alpha = expf(row_max[r] - m);
+        row_sum[r] = row_sum[r] * alpha + exp_tile(s, n, m);
+        pv_tile(acc + (size_t)r * head_dim, s, v_tile, n, head_dim, alpha);
+        row_max[r] = m;
+      }
+    }
+  }
+
+  for (int i = 0; i < nq; i++) {
+    for (int g = 0; g < group; g++) {
+      int r = i * group + g;
+      float *o = acc + (size_t)r * head_dim;
+      float inv = row_sum[r] > 0.0f ? 1.0f / row_sum[r] : 0.0f;
+      vec_scale_f32(o, inv, head_dim);
+
+      size_t offset = (size_t)(q0 + i) * q_stride +
+                      (size_t)(kv_head * group + g) * head_dim;
+      if (ctx->f16)
+        convert_f32_to_f16(o, (uint16_t *)ctx->output + offset, head_dim);
+      else
+        memcpy((float *)ctx->output + offset, o, head_dim * sizeof(float));
+    }
+  }
+}
+
+static void prefill_lanes(void *arg, int start, int end) {
+  const prefill_ctx_t *ctx = (const prefill_ctx_t *)arg;
+  int group = ctx->num_heads / ctx->kv->num_heads;
+  int max_queries = tile_queries(group);
+  size_t lane_size = lane_floats(ctx->kv->head_dim, group);
+
+  for (int lane = start; lane < end; lane++) {
+    float *scratch = ctx->scratch + lane * lane_size;
+    for (int item = lane; item < ctx->items; item += ctx->lanes) {
+      int kv_head = item % ctx->kv->num_heads;
+      int q0 = item / ctx->kv->num_heads * max_queries;
+      int nq = ctx->seq_len - q0 < max_queries ? ctx->seq_len - q0
+                                               : max_queries;
+      prefill_tile(ctx, scratch, kv_head, q0, nq);
+    }
+  }
+}
+
+static void flash_attention_paged(void *output, const void *query, bool f16,
+                                  const kv_layer_view_t *kv,
+                                  const int64_t *positions, int seq_len,
+                                  int kv_len, int num_heads, float scale,
+                                  float *scratch) {
+  int max_queries = tile_queries(num_heads / kv->num_heads);
+  int tiles = (seq_len + max_queries - 1) / max_queries;
+  int items = kv->num_heads * tiles;
+  int lanes = items < ATTN_PREFILL_LANES ? items : ATTN_PREFILL_LANES;
+
+  prefill_ctx_t ctx = {output, query,  f16,       kv,    positions,
+                       seq_len, kv_len, num_heads, scale, items,
+                       lanes,   scratch};
+  if (lanes == 1 || attention_get_num_threads() <= 1)
+    prefill_lanes(&ctx, 0, lanes);
+  else
+    threadpool_parallel_for(0, lanes, 1, prefill_lanes, &ctx);
+}
+
+void flash_attention_paged_f32(float *output, const float *query,
+                               const kv_layer_view_t *kv,
+                               const int64_t *positions, int seq_len,
+                               int kv_len, int num_heads, float scale,
+                               float *scratch) {
+  flash_attention_paged(output, query, false, kv, positions, seq_len, kv_len,
+                        num_heads, scale, scratch);
+}
+
+void flash_attention_paged_f16(uint16_t *output, const uint16_t *query,
+                               const kv_layer_view_t *kv,
+                               const int64_t *positions, int seq_len,
+                               int kv_len, int num_heads, float scale,
+                               float *scratch) {
+  flash_attention_paged(output, query, true, kv, positions, seq_len, kv_len,
+                        num_heads, scale, scratch);
+}
+
+/*
+ * Split-K decode. The cache is cut into chunks of at least
+ * ATTN_DECODE_CHUNK_KEYS positions, at most ATTN_DECODE_MAX_SPLITS of them;
+ * one work item is a (KV head, chunk) pair. Each item leaves, per query
+ * head, its unnormalized output followed by its max and sum.
+ */
+
+#define ATTN_DECODE_CHUNK_KEYS 256
+#define ATTN_DECODE_MAX_SPLITS 64
+#define ATTN_DECODE_TILE_KEYS 16
+
+size_t flash_attention_decode_scratch_floats(int num_heads, int head_dim) {
+  /* The scaled FP32 query, then the partial results of every split. */
+  return (size_t)num_heads * head_dim +
+         (size_t)ATTN_DECODE_MAX_SPLITS * num_heads * (head_dim + 2);
+}
+
+typedef struct {
+  bool f16;
+  const kv_layer_view_t *kv;
+  int kv_len;
+  int num_heads;
+  int splits;
+  int chunk;
+  const float *query;
+  float *partial;
+} decode_ctx_t;
+
+/* Unnormalized output of one query head over one split, then its max and
+ * sum. */
+static float *decode_partial(const decode_ctx_t *ctx, int split, int head) {
+  return ctx->partial +
+         ((size_t)split * ctx->num_heads + head) * (ctx->kv->head_dim + 2);
+}
 
-  for (int t = 0; t < num_threads; t++) {
-    if (tasks[t].start_head < num_heads) {
-      pthread_join(threads[t], NULL);
+static void decode_range(void *arg, int start, int end) {
+  decode_ctx_t *ctx = (decode_ctx_t *)arg;
+  const kv_layer_view_t *kv = ctx->kv;
+  int head_dim = kv->head_dim;
+  int group = ctx->num_heads / kv->num_heads;
+
+  float k_tile[ATTN_DECODE_TILE_KEYS * ATTENTION_MAX_HEAD_DIM];
+  float v_tile[ATTN_DECODE_TILE_KEYS * ATTENTION_MAX_HEAD_DIM];
+  float scores[ATTN_DECODE_TILE_KEYS];
+
+  for (int item = start; item < end; item++) {
+    int kv_head = item / ctx->splits;
+    int split = item % ctx->splits;
+    int k_start = split * ctx->chunk;
+    int k_end = k_start + ctx->chunk < ctx->kv_len ? k_start + ctx->chunk
+                                                   : ctx->kv_len;
+
+    for (int h = kv_head * group; h < (kv_head + 1) * group; h++) {
+      float *acc = decode_partial(ctx, split, h);
+      memset(acc, 0, head_dim * sizeof(float));
+      acc[head_dim] = -1e30f;
+      acc[head_dim + 1] = 0.0f;
+    }
+
+    /* Each K/V tile is loaded once for every query head of the group. */
+    for (int k0 = k_start; k0 < k_end; k0 += ATTN_DECODE_TILE_KEYS) {
+      int nk = k_end - k0 < ATTN_DECODE_TILE_KEYS ? k_end - k0
+                                                  : ATTN_DECODE_TILE_KEYS;
+      for (int j = 0; j < nk; j++)
+        load_kv_rows(k_tile + j * head_dim, v_tile + j * head_dim, kv, k0 + j,
+                     kv_head, ctx->f16);
+
+      for (int h = kv_head * group; h < (kv_head + 1) * group; h++) {
+        float *acc = decode_partial(ctx, split, h);
+        qk_tile(scores, ctx->query + (size_t)h * head_dim, k_tile, nk,
+                head_dim);
+        float m = acc[head_dim];
+        for (int j = 0; j < nk; j++) {
+          if (scores[j] > m)
+            m = scores[j];
+        }
+        float alpha = expf(acc[head_dim] - m);
+        acc[head_dim + 1] = acc[head_dim + 1] * alpha + exp_tile(scores, nk, m);
+        pv_tile(acc, scores, v_tile, nk, head_dim, alpha);
+        acc[head_dim] = m;
+      }
     }
   }
+}
+
+static void flash_attention_decode_paged(void *output, const void *query,
+                                         bool f16, const kv_layer_view_t *kv,
+                                         int kv_len, int num_heads,
+                                         float scale, float *scratch) {
+  int head_dim = kv->head_dim;
+
+  int splits = (kv_len + ATTN_DECODE_CHUNK_KEYS - 1) / ATTN_DECODE_CHUNK_KEYS;
+  if (splits > ATTN_DECODE_MAX_SPLITS)
+    splits = ATTN_DECODE_MAX_SPLITS;
+  if (splits < 1)
+    splits = 1;
+  int chunk = (kv_len + splits - 1) / splits;
+  chunk = (chunk + ATTN_DECODE_TILE_KEYS - 1) / ATTN_DECODE_TILE_KEYS *
+          ATTN_DECODE_TILE_KEYS;
+  splits = (kv_len + chunk - 1) / chunk;
+
+  float *q = scratch;
+  for (int h = 0; h < num_heads; h++) {
+    const char *src = (const char *)query +
+                      (size_t)h * head_dim *
+                          (f16 ? sizeof(uint16_t) : sizeof(float));
+    load_rows(q + (size_t)h * head_dim, src, f16, head_dim);
+    vec_scale_f32(q + (size_t)h * head_dim, scale, head_dim);
+  }
+
+  float *partial = scratch + (size_t)num_heads * head_dim;
+  decode_ctx_t ctx = {f16, kv, kv_len, num_heads, splits, chunk, q, partial};
+  int items = kv->num_heads * splits;
+  if (items == 1 || attention_get_num_threads() <= 1)
+    decode_range(&ctx, 0, items);
+  else
+    threadpool_parallel_for(0, items, 1, decode_range, &ctx);
+
+  /* out = sum_s e^(m_s - M) acc_s / sum_s e^(m_s - M) l_s */
+  for (int h = 0; h < num_heads; h++) {
+    float *out = decode_partial(&ctx, 0, h);
+    float max = out[head_dim];
+    for (int s = 1; s < splits; s++) {
+      float m = decode_partial(&ctx, s, h)[head_dim];
+      if (m > max)
+        max = m;
+    }
+
+    float w = expf(out[head_dim] - max);
+    float sum = out[head_dim + 1] * w;
+    vec_scale_f32(out, w, head_dim);
+    for (int s = 1; s < splits; s++) {
+      const float *part = decode_partial(&ctx, s, h);
+      w = expf(part[head_dim] - max);
+      sum += part[head_dim + 1] * w;
+      vec_mad_f32(out, part, w, head_dim);
+    }
+    vec_scale_f32(out, sum > 0.0f ? 1.0f / sum : 0.0f, head_dim);
+
+    if (f16)
+      convert_f32_to_f16(out, (uint16_t *)output + (size_t)h * head_dim,
+                         head_dim);
+    else
+      memcpy((float *)output + (size_t)h * head_dim, out,
+             head_dim * sizeof(float));
+  }
+}
+
+void flash_attention_decode_paged_f32(float *output, const float *query,
+                                      const kv_layer_view_t *kv, int kv_len,
+                                      int num_heads, float scale,
+                                      float *scratch) {
+  flash_attention_decode_paged(output, query, false, kv, kv_len, num_heads,
+                               scale, scratch);
+}
 
-  free(threads);
-  free(tasks);
+void flash_attention_decode_paged_f16(uint16_t *output, const uint16_t *query,
+                                      const kv_layer_view_t *kv, int kv_len,
+                                      int num_heads, float scale,
+                                      float *scratch) {
+  flash_attention_decode_paged(output, query, true, kv, kv_len, num_heads,
+                               scale, scratch);
 }
@@ -1,6 +1,7 @@
 #ifndef ATTENTION_H
 #define ATTENTION_H
 
+#include "inference/kernels/kv_cache/kv_pages.h"
 #include <stddef.h>
 #include <stdint.h>
 
@@ -74,6 +75,76 @@ void flash_attention_mha_f32(float *output, const float *query,
                              int seq_len_kv, int head_dim, float scale,
                              const float *mask);
 
+/*
+ * Causal GQA attention of a chunk of queries over a paged KV cache
+ *
+ * Query i attends to cache positions [0, positions[i]], capped at kv_len.
+ * The work is blocked into query tiles and key tiles with an online
+ * softmax: each K/V tile is widened to FP32 once and shared by every query
+ * head of its KV group, and key tiles past the last query of a tile are
+ * never loaded. (KV head, query tile) pairs run on the attention threads;
+ * the result does not depend on the thread count.
+ *
+ * Parameters:
+ *   output:    [seq_len, num_heads, head_dim]
+ *   query:     [seq_len, num_heads, head_dim]
+ *   kv:        layer view with F32 rows (F16 for the _f16 variant) or INT8
+ *              rows, which are dequantized as their tiles are loaded
+ *   positions: [seq_len] cache position of each query
+ *   seq_len:   number of queries
+ *   kv_len:    cached positions, including this chunk's
+ *   num_heads: query heads, a multiple of kv->num_heads
+ *   scale:     scaling factor
+ *   scratch:   flash_attention_paged_scratch_floats() floats
+ */
+size_t flash_attention_paged_scratch_floats(int head_dim, int heads_per_kv);
+
+void flash_attention_paged_f32(float *output, const float *query,
+                               const kv_layer_view_t *kv,
+                               const int64_t *positions, int seq_len,
+                               int kv_len, int num_heads, float scale,
+                               float *scratch);
+
+void flash_attention_paged_f16(uint16_t *output, const uint16_t *query,
+                               const kv_layer_view_t *kv,
+                               const int64_t *positions, int seq_len,
+                               int kv_len, int num_heads, float scale,
+                               float *scratch);
+
+/*
+ * Single-token decode attention over a paged KV cache ("flash decoding")
+ *
+ * The query attends to all kv_len cached positions. With one query there is
+ * too little work per head to keep many cores busy, so the sequence is
+ * split into chunks processed in parallel, each keeping its own softmax
+ * max and sum for every head of its KV group; a final log-sum-exp pass
+ * merges the chunks. The split depends only on kv_len, so results are the
+ * same for any thread count.
+ *
+ * Parameters:
+ *   output:    [num_heads, head_dim]
+ *   query:     [num_heads, head_dim]
+ *   kv:        as for flash_attention_paged_*; head_dim at most
+ *              ATTENTION_MAX_HEAD_DIM
+ *   kv_len:    cached positions, including the query's own
+ *   num_heads: query heads, a multiple of kv->num_heads
+ *   scale:     scaling factor
+ *   scratch:   flash_attention_decode_scratch_floats() floats
+ */
+#define ATTENTION_MAX_HEAD_DIM 256
+
+size_t flash_attention_decode_scratch_floats(int num_heads, int head_dim);
+
+void flash_attention_decode_paged_f32(float *output, const float *query,
+                                      const kv_layer_view_t *kv, int kv_len,
+                                      int num_heads, float scale,
+                                      float *scratch);
+
+void flash_attention_decode_paged_f16(uint16_t *output, const uint16_t *query,
+                                      const kv_layer_view_t *kv, int kv_len,
+                                      int num_heads, float scale,
+                                      float *scratch);
+
 void attention_set_num_threads(int num_threads);
 int attention_get_num_threads(void);
 
@@ -0,0 +1,42 @@
+/*
+ * Attention kernel interface for architecture-specific implementations
+ */
+
+#ifndef ATTENTION_KERNELS_H
+#define ATTENTION_KERNELS_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* attention_x86.c needs AVX2 and FMA at compile time. */
+#if defined(__AVX2__) && defined(__FMA__)
+#define ATTENTION_X86_AVX2 1
+#else
+#define ATTENTION_X86_AVX2 0
+#endif
+
+/*
+ * Tile primitives of flash_attention_paged_*, provided by attention_neon.c
+ * or attention_x86.c. Keys and values of a tile are contiguous FP32 rows of
+ * head_dim floats.
+ */
+
+/* scores[j] = dot(q, key row j) for j < num_keys. */
+void attention_qk_tile_kernel(float *scores, const float *q, const float *k,
+                              int num_keys, int head_dim);
+
+/* p[j] = exp(p[j] - max) for j < n; returns the sum of the new p. */
+float attention_exp_tile_kernel(float *p, int n, float max);
+
+/* out = out * alpha + sum_j p[j] * value row j. */
+void attention_pv_tile_kernel(float *out, const float *p, const float *v,
+                              int num_keys, int head_dim, float alpha);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // ATTENTION_KERNELS_H
@@ -4,6 +4,7 @@
  */
 
 #include "inference/kernels/attention/attention.h"
+#include "inference/kernels/attention/attention_kernels.h"
 #include <math.h>
 #include <stddef.h>
 #include <stdlib.h>
@@ -437,4 +438,129 @@ void flash_attention_f16_neon(uint16_t *output, const uint16_t *query,
   free(VKQ);
 }
 
+/* Cephes exp: x = n * ln2 + r, degree-6 polynomial for exp(r), 2^n built
+ * in the exponent bits. Matches exp_ps in attention_x86.c. */
+static inline float32x4_t exp_f32x4(float32x4_t x) {
+  x = vmaxq_f32(x, vdupq_n_f32(-87.3f));
+  x = vminq_f32(x, vdupq_n_f32(88.3f));
+
+  float32x4_t n = vrndnq_f32(vmulq_f32(x, vdupq_n_f32(1.44269504f)));
+  float32x4_t r = vfmsq_f32(x, n, vdupq_n_f32(0.693359375f));
+  r = vfmsq_f32(r, n, vdupq_n_f32(-2.12194440e-4f));
+
+  float32x4_t p = vdupq_n_f32(1.9875691500e-4f);
+  p = vfmaq_f32(vdupq_n_f32(1.3981999507e-3f), p, r);
+  p = vfmaq_f32(vdupq_n_f32(8.3334519073e-3f), p, r);
+  p = vfmaq_f32(vdupq_n_f32(4.1665795894e-2f), p, r);
+  p = vfmaq_f32(vdupq_n_f32(1.6666665459e-1f), p, r);
+  p = vfmaq_f32(vdupq_n_f32(5.0000001201e-1f), p, r);
+  p = vfmaq_f32(r, p, vmulq_f32(r, r));
+  p = vaddq_f32(p, vdupq_n_f32(1.0f));
+
+  int32x4_t e = vshlq_n_s32(vaddq_s32(vcvtq_s32_f32(n), vdupq_n_s32(127)),
+                            23);
+  return vmulq_f32(p, vreinterpretq_f32_s32(e));
+}
+
+void attention_qk_tile_kernel(float *scores, const float *q, const float *k,
+                              int num_keys, int head_dim) {
+  int vec_end = head_dim & ~3;
+  int j = 0;
+
+  for (; j + 4 <= num_keys; j += 4) {
+    const float *k0 = k + (size_t)j * head_dim;
+    const float *k1 = k0 + head_dim;
+    const float *k2 = k1 + head_dim;
+    const float *k3 = k2 + head_dim;
+    float32x4_t s0 = vdupq_n_f32(0.0f);
+    float32x4_t s1 = vdupq_n_f32(0.0f);
+    float32x4_t s2 = vdupq_n_f32(0.0f);
+    float32x4_t s3 = vdupq_n_f32(0.0f);
+    for (int d = 0; d < vec_end; d += 4) {
+      float32x4_t qv = vld1q_f32(q + d);
+      s0 = vfmaq_f32(s0, qv, vld1q_f32(k0 + d));
+      s1 = vfmaq_f32(s1, qv, vld1q_f32(k1 + d));
+      s2 = vfmaq_f32(s2, qv, vld1q_f32(k2 + d));
+      s3 = vfmaq_f32(s3, qv, vld1q_f32(k3 + d));
+    }
+    float t0 = vaddvq_f32(s0), t1 = vaddvq_f32(s1);
+    float t2 = vaddvq_f32(s2), t3 = vaddvq_f32(s3);
+    for (int d = vec_end; d < head_dim; d++) {
+      t0 += q[d] * k0[d];
+      t1 += q[d] * k1[d];
+      t2 += q[d] * k2[d];
+      t3 += q[d] * k3[d];
+    }
+    scores[j] = t0;
+    scores[j + 1] = t1;
+    scores[j + 2] = t2;
+    scores[j + 3] = t3;
+  }
+
+  for (; j < num_keys; j++) {
+    const float *kj = k + (size_t)j * head_dim;
+    float32x4_t s = vdupq_n_f32(0.0f);
+    for (int d = 0; d < vec_end; d += 4)
+      s = vfmaq_f32(s, vld1q_f32(q + d), vld1q_f32(kj + d));
+    float t = vaddvq_f32(s);
+    for (int d = vec_end; d < head_dim; d++)
+      t += q[d] * kj[d];
+    scores[j] = t;
+  }
+}
+
+float attention_exp_tile_kernel(float *p, int n, float max) {
+  float32x4_t max_v = vdupq_n_f32(max);
+  float32x4_t sum_v = vdupq_n_f32(0.0f);
+  int j = 0;
+  for (; j + 4 <= n; j += 4) {
+    float32x4_t e = exp_f32x4(vsubq_f32(vld1q_f32(p + j), max_v));
+    vst1q_f32(p + j, e);
+    sum_v = vaddq_f32(sum_v, e);
+  }
+  float sum = vaddvq_f32(sum_v);
+  for (; j < n; j++) {
+    p[j] = expf(p[j] - max);
+    sum += p[j];
+  }
+  return sum;
+}
+
+void attention_pv_tile_kernel(float *out, const float *p, const float *v,
+                              int num_keys, int head_dim, float alpha) {
+  int d = 0;
+
+  for (; d + 16 <= head_dim; d += 16) {
+    float32x4_t o0 = vmulq_n_f32(vld1q_f32(out + d), alpha);
+    float32x4_t o1 = vmulq_n_f32(vld1q_f32(out + d + 4), alpha);
+    float32x4_t o2 = vmulq_n_f32(vld1q_f32(out + d + 8), alpha);
+    float32x4_t o3 = vmulq_n_f32(vld1q_f32(out + d + 12), alpha);
+    for (int j = 0; j < num_keys; j++) {
+      const float *vj = v + (size_t)j * head_dim + d;
+      o0 = vfmaq_n_f32(o0, vld1q_f32(vj), p[j]);
+      o1 = vfmaq_n_f32(o1, vld1q_f32(vj + 4), p[j]);
+      o2 = vfmaq_n_f32(o2, vld1q_f32(vj + 8), p[j]);
+      o3 = vfmaq_n_f32(o3, vld1q_f32(vj + 12), p[j]);
+    }
+    vst1q_f32(out + d, o0);
+    vst1q_f32(out + d + 4, o1);
+    vst1q_f32(out + d + 8, o2);
+    vst1q_f32(out + d + 12, o3);
+  }
+
+  for (; d + 4 <= head_dim; d += 4) {
+    float32x4_t o = vmulq_n_f32(vld1q_f32(out + d), alpha);
+    for (int j = 0; j < num_keys; j++)
+      o = vfmaq_n_f32(o, vld1q_f32(v + (size_t)j * head_dim + d), p[j]);
+    vst1q_f32(out + d, o);
+  }
+
+  for (; d < head_dim; d++) {
+    float o = out[d] * alpha;
+    for (int j = 0; j < num_keys; j++)
+      o += p[j] * v[(size_t)j * head_dim + d];
+    out[d] = o;
+  }
+}
+
 #endif
@@ -0,0 +1,148 @@
+/*
+ * Flash Attention - AVX2 Tile Kernels
+ *
+ * exp uses the Cephes range reduction: x = n * ln2 + r with |r| <= ln2 / 2,
+ * a degree-6 polynomial for exp(r) and 2^n assembled in the exponent bits.
+ * Relative error stays within 2 ulp over the range softmax feeds it.
+ */
+
+#include "inference/kernels/attention/attention_kernels.h"
+#include <math.h>
+
+#if ATTENTION_X86_AVX2
+
+#include <immintrin.h>
+
+static inline float hsum_ps(__m256 v) {
+  __m128 s = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+  s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+  s = _mm_add_ss(s, _mm_movehdup_ps(s));
+  return _mm_cvtss_f32(s);
+}
+
+static inline __m256 exp_ps(__m256 x) {
+  x = _mm256_max_ps(x, _mm256_set1_ps(-87.3f));
+  x = _mm256_min_ps(x, _mm256_set1_ps(88.3f));
+
+  __m256 n = _mm256_round_ps(_mm256_mul_ps(x, _mm256_set1_ps(1.44269504f)),
+                             _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+  __m256 r = _mm256_fnmadd_ps(n, _mm256_set1_ps(0.693359375f), x);
+  r = _mm256_fnmadd_ps(n, _mm256_set1_ps(-2.12194440e-4f), r);
+
+  __m256 p = _mm256_set1_ps(1.9875691500e-4f);
+  p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(1.3981999507e-3f));
+  p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(8.3334519073e-3f));
+  p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(4.1665795894e-2f));
+  p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(1.6666665459e-1f));
+  p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(5.0000001201e-1f));
+  p = _mm256_fmadd_ps(p, _mm256_mul_ps(r, r), r);
+  p = _mm256_add_ps(p, _mm256_set1_ps(1.0f));
+
+  __m256i e = _mm256_slli_epi32(
+      _mm256_add_epi32(_mm256_cvtps_epi32(n), _mm256_set1_epi32(127)), 23);
+  return _mm256_mul_ps(p, _mm256_castsi256_ps(e));
+}
+
+static inline float dot_tail(const float *a, const float *b, int i, int n) {
+  float sum = 0.0f;
+  for (; i < n; i++)
+    sum += a[i] * b[i];
+  return sum;
+}
+
+void attention_qk_tile_kernel(float *scores, const float *q, const float *k,
+                              int num_keys, int head_dim) {
+  int vec_end = head_dim & ~7;
+  int j = 0;
+
+  /* Four keys per pass, so each q vector is loaded once for all four. */
+  for (; j + 4 <= num_keys; j += 4) {
+    const float *k0 = k + (size_t)j * head_dim;
+    const float *k1 = k0 + head_dim;
+    const float *k2 = k1 + head_dim;
+    const float *k3 = k2 + head_dim;
+    __m256 s0 = _mm256_setzero_ps();
+    __m256 s1 = _mm256_setzero_ps();
+    __m256 s2 = _mm256_setzero_ps();
+    __m256 s3 = _mm256_setzero_ps();
+    for (int d = 0; d < vec_end; d += 8) {
+      __m256 qv = _mm256_loadu_ps(q + d);
+      s0 = _mm256_fmadd_ps(qv, _mm256_loadu_ps(k0 + d), s0);
+      s1 = _mm256_fmadd_ps(qv, _mm256_loadu_ps(k1 + d), s1);
+      s2 = _mm256_fmadd_ps(qv, _mm256_loadu_ps(k2 + d), s2);
+      s3 = _mm256_fmadd_ps(qv, _mm256_loadu_ps(k3 + d), s3);
+    }
+    scores[j] = hsum_ps(s0) + dot_tail(q, k0, vec_end, head_dim);
+    scores[j + 1] = hsum_ps(s1) + dot_tail(q, k1, vec_end, head_dim);
+    scores[j + 2] = hsum_ps(s2) + dot_tail(q, k2, vec_end, head_dim);
+    scores[j + 3] = hsum_ps(s3) + dot_tail(q, k3, vec_end, head_dim);
+  }
+
+  for (; j < num_keys; j++) {
+    const float *kj = k + (size_t)j * head_dim;
+    __m256 s = _mm256_setzero_ps();
+    for (int d = 0; d < vec_end; d += 8)
+      s = _mm256_fmadd_ps(_mm256_loadu_ps(q + d), _mm256_loadu_ps(kj + d), s);
+    scores[j] = hsum_ps(s) + dot_tail(q, kj, vec_end, head_dim);
+  }
+}
+
+float attention_exp_tile_kernel(float *p, int n, float max) {
+  __m256 max_v = _mm256_set1_ps(max);
+  __m256 sum_v = _mm256_setzero_ps();
+  int j = 0;
+  for (; j + 8 <= n; j += 8) {
+    __m256 e = exp_ps(_mm256_sub_ps(_mm256_loadu_ps(p + j), max_v));
+    _mm256_storeu_ps(p + j, e);
+    sum_v = _mm256_add_ps(sum_v, e);
+  }
+  float sum = hsum_ps(sum_v);
+  for (; j < n; j++) {
+    p[j] = expf(p[j] - max);
+    sum += p[j];
+  }
+  return sum;
+}
+
+void attention_pv_tile_kernel(float *out, const float *p, const float *v,
+                              int num_keys, int head_dim, float alpha) {
+  __m256 alpha_v = _mm256_set1_ps(alpha);
+  int d = 0;
+
+  /* 32 output columns stay in registers across the whole key tile. */
+  for (; d + 32 <= head_dim; d += 32) {
+    __m256 o0 = _mm256_mul_ps(_mm256_loadu_ps(out + d), alpha_v);
+    __m256 o1 = _mm256_mul_ps(_mm256_loadu_ps(out + d + 8), alpha_v);
+    __m256 o2 = _mm256_mul_ps(_mm256_loadu_ps(out + d + 16), alpha_v);
+    __m256 o3 = _mm256_mul_ps(_mm256_loadu_ps(out + d + 24), alpha_v);
+    for (int j = 0; j < num_keys; j++) {
+      const float *vj = v + (size_t)j * head_dim + d;
+      __m256 w = _mm256_set1_ps(p[j]);
+      o0 = _mm256_fmadd_ps(w, _mm256_loadu_ps(vj), o0);
+      o1 = _mm256_fmadd_ps(w, _mm256_loadu_ps(vj + 8), o1);
+      o2 = _mm256_fmadd_ps(w, _mm256_loadu_ps(vj + 16), o2);
+      o3 = _mm256_fmadd_ps(w, _mm256_loadu_ps(vj + 24), o3);
+    }
+    _mm256_storeu_ps(out + d, o0);
+    _mm256_storeu_ps(out + d + 8, o1);
+    _mm256_storeu_ps(out + d + 16, o2);
+    _mm256_storeu_ps(out + d + 24, o3);
+  }
+
+  for (; d + 8 <= head_dim; d += 8) {
+    __m256 o = _mm256_mul_ps(_mm256_loadu_ps(out + d), alpha_v);
+    for (int j = 0; j < num_keys; j++)
+      o = _mm256_fmadd_ps(_mm256_set1_ps(p[j]),
+                          _mm256_loadu_ps(v + (size_t)j * head_dim + d), o);
+    _mm256_storeu_ps(out + d, o);
+  }
+
+  for (; d < head_dim; d++) {
+    float o = out[d] * alpha;
+    for (int j = 0; j < num_keys; j++)
+      o += p[j] * v[(size_t)j * head_dim + d];
+    out[d] = o;
+  }
+}
+
+#endif
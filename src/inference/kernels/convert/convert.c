@@ -0,0 +1,211 @@
+/*
+ * Dtype Conversion - Dispatcher, Scalar Fallback and Threading
+ */
+
+#include "inference/kernels/convert/convert.h"
+#include "inference/kernels/convert/convert_kernels.h"
+#include "inference/kernels/threadpool/threadpool.h"
+#include <stdbool.h>
+
+/* Arrays below this many elements are converted on the calling thread. */
+#define CONVERT_PARALLEL_MIN (1 << 18)
+#define CONVERT_CHUNK (1 << 16)
+#define CONVERT_TILE 32
+
+size_t convert_dtype_size(convert_dtype_t dtype) {
+  return dtype == CONVERT_DTYPE_F32 ? sizeof(float) : sizeof(uint16_t);
+}
+
+static bool has_vector_kernels(void) {
+  convert_caps_t caps = convert_get_capabilities();
+  return caps.has_neon || caps.has_f16c;
+}
+
+static void f16_to_f32_serial(const uint16_t *src, float *dst, size_t count) {
+  if (has_vector_kernels()) {
+    convert_f16_to_f32_kernel(src, dst, count);
+    return;
+  }
+  for (size_t i = 0; i < count; i++)
+    dst[i] = fp16_to_f32(src[i]);
+}
+
+static void f32_to_f16_serial(const float *src, uint16_t *dst, size_t count) {
+  if (has_vector_kernels()) {
+    convert_f32_to_f16_kernel(src, dst, count);
+    return;
+  }
+  for (size_t i = 0; i < count; i++)
+    dst[i] = f32_to_fp16(src[i]);
+}
+
+static void bf16_to_f32_serial(const uint16_t *src, float *dst, size_t count) {
+  if (has_vector_kernels()) {
+    convert_bf16_to_f32_kernel(src, dst, count);
+    return;
+  }
+  for (size_t i = 0; i < count; i++)
+    dst[i] = bf16_to_f32(src[i]);
+}
+
+static void f32_to_bf16_serial(const float *src, uint16_t *dst, size_t count) {
+  if (has_vector_kernels()) {
+    convert_f32_to_bf16_kernel(src, dst, count);
+    return;
+  }
+  for (size_t i = 0; i < count; i++)
+    dst[i] = f32_to_bf16(src[i]);
+}
+
+static void bf16_to_f16_serial(const uint16_t *src, uint16_t *dst,
+                               size_t count) {
+  if (has_vector_kernels()) {
+    convert_bf16_to_f16_kernel(src, dst, count);
+    return;
+  }
+  for (size_t i = 0; i < count; i++)
+    dst[i] = f32_to_fp16(bf16_to_f32(src[i]));
+}
+
+/* No direct instruction for FP16 -> BF16; stage through FP32. */
+static void f16_to_bf16_serial(const uint16_t *src, uint16_t *dst,
+                               size_t count) {
+  float tmp[256];
+  for (size_t i = 0; i < count; i += 256) {
+    size_t n = count - i < 256 ? count - i : 256;
+    f16_to_f32_serial(src + i, tmp, n);
+    f32_to_bf16_serial(tmp, dst + i, n);
+  }
+}
+
+static void convert_serial(void *dst, convert_dtype_t dst_dtype,
+                           const void *src, convert_dtype_t src_dtype,
+                           size_t count) {
+  if (dst_dtype == src_dtype) {
+    memcpy(dst, src, count * convert_dtype_size(dst_dtype));
+    return;
+  }
+
+  switch (src_dtype) {
+  case CONVERT_DTYPE_F32:
+    if (dst_dtype == CONVERT_DTYPE_F16)
+      f32_to_f16_serial((const float *)src, (uint16_t *)dst, count);
+    else
+      f32_to_bf16_serial((const float *)src, (uint16_t *)dst, count);
+    break;
+  case CONVERT_DTYPE_F16:
+    if (dst_dtype == CONVERT_DTYPE_F32)
+      f16_to_f32_serial((const uint16_t *)src, (float *)dst, count);
+    else
+      f16_to_bf16_serial((const uint16_t *)src, (uint16_t *)dst, count);
+    break;
+  case CONVERT_DTYPE_BF16:
+    if (dst_dtype == CONVERT_DTYPE_F32)
+      bf16_to_f32_serial((const uint16_t *)src, (float *)dst, count);
+    else
+      bf16_to_f16_serial((const uint16_t *)src, (uint16_t *)dst, count);
+    break;
+  }
+}
+
+typedef struct {
+  void *dst;
+  convert_dtype_t dst_dtype;
+  const void *src;
+  convert_dtype_t src_dtype;
+  size_t rows, cols;
+} convert_task_t;
+
+static void convert_chunks(void *arg, int start, int end) {
+  const convert_task_t *t = (const convert_task_t *)arg;
+  size_t s = (size_t)start * CONVERT_CHUNK;
+  size_t e = (size_t)end * CONVERT_CHUNK;
+  if (e > t->cols)
+    e = t->cols;
+  convert_serial((char *)t->dst + s * convert_dtype_size(t->dst_dtype),
+                 t->dst_dtype,
+                 (const char *)t->src + s * convert_dtype_size(t->src_dtype),
+                 t->src_dtype, e - s);
+}
+
+void convert_array(void *dst, convert_dtype_t dst_dtype, const void *src,
+                   convert_dtype_t src_dtype, size_t count) {
+  if (count < CONVERT_PARALLEL_MIN) {
+    convert_serial(dst, dst_dtype, src, src_dtype, count);
+    return;
+  }
+
+  convert_task_t t = {dst, dst_dtype, src, src_dtype, 1, count};
+  int chunks = (int)((count + CONVERT_CHUNK - 1) / CONVERT_CHUNK);
+  threadpool_parallel_for(0, chunks, 1, convert_chunks, &t);
+}
+
+void convert_f16_to_f32(const uint16_t *src, float *dst, size_t count) {
+  convert_array(dst, CONVERT_DTYPE_F32, src, CONVERT_DTYPE_F16, count);
+}
+
+void convert_f32_to_f16(const float *src, uint16_t *dst, size_t count) {
+  convert_array(dst, CONVERT_DTYPE_F16, src, CONVERT_DTYPE_F32, count);
+}
+
+void convert_bf16_to_f32(const uint16_t *src, float *dst, size_t count) {
+  convert_array(dst, CONVERT_DTYPE_F32, src, CONVERT_DTYPE_BF16, count);
+}
+
+void convert_f32_to_bf16(const float *src, uint16_t *dst, size_t count) {
+  convert_array(dst, CONVERT_DTYPE_BF16, src, CONVERT_DTYPE_F32, count);
+}
+
+void convert_bf16_to_f16(const uint16_t *src, uint16_t *dst, size_t count) {
+  convert_array(dst, CONVERT_DTYPE_F16, src, CONVERT_DTYPE_BF16, count);
+}
+
+/*
+ * Each tile is widened row by row into FP32, transposed in L1, and narrowed
+ * row by row into the destination, so every conversion runs on contiguous
+ * vectors. Threads own horizontal bands of the source.
+ */
+static void convert_transpose_bands(void *arg, int start, int end) {
+  const convert_task_t *t = (const convert_task_t *)arg;
+  size_t ssz = convert_dtype_size(t->src_dtype);
+  size_t dsz = convert_dtype_size(t->dst_dtype);
+  float in[CONVERT_TILE][CONVERT_TILE];
+  float out[CONVERT_TILE][CONVERT_TILE];
+
+  for (int band = start; band < end; band++) {
+    size_t r0 = (size_t)band * CONVERT_TILE;
+    size_t nr = t->rows - r0 < CONVERT_TILE ? t->rows - r0 : CONVERT_TILE;
+
+    for (size_t c0 = 0; c0 < t->cols; c0 += CONVERT_TILE) {
+      size_t nc = t->cols - c0 < CONVERT_TILE ? t->cols - c0 : CONVERT_TILE;
+
+      for (size_t r = 0; r < nr; r++) {
+        const char *src =
+            (const char *)t->src + ((r0 + r) * t->cols + c0) * ssz;
+        convert_serial(in[r], CONVERT_DTYPE_F32, src, t->src_dtype, nc);
+      }
+      for (size_t c = 0; c < nc; c++) {
+        for (size_t r = 0; r < nr; r++)
+          out[c][r] = in[r][c];
+      }
+      for (size_t c = 0; c < nc; c++) {
+        char *dst = (char *)t->dst + ((c0 + c) * t->rows + r0) * dsz;
+        convert_serial(dst, t->dst_dtype, out[c], CONVERT_DTYPE_F32, nr);
+      }
+    }
+  }
+}
+
+void convert_transpose(void *dst, convert_dtype_t dst_dtype, const void *src,
+                       convert_dtype_t src_dtype, size_t rows, size_t cols) {
+  if (rows == 0 || cols == 0)
+    return;
+
+  convert_task_t t = {dst, dst_dtype, src, src_dtype, rows, cols};
+  int bands = (int)((rows + CONVERT_TILE - 1) / CONVERT_TILE);
+  if (rows * cols < CONVERT_PARALLEL_MIN) {
+    convert_transpose_bands(&t, 0, bands);
+    return;
+  }
+  threadpool_parallel_for(0, bands, 1, convert_transpose_bands, &t);
+}
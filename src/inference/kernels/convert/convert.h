@@ -0,0 +1,127 @@
+/*
+ * Dtype Conversion - FP32 / FP16 / BF16
+ *
+ * Array conversions are vectorized (F16C/AVX2 on x86-64, NEON on ARM) and
+ * large arrays are split across the shared kernel thread pool. Narrowing
+ * conversions round to nearest-even, matching the hardware instructions, so
+ * the scalar tails and the vector bodies agree bit for bit.
+ */
+
+#ifndef CONVERT_H
+#define CONVERT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+  CONVERT_DTYPE_F32 = 0,
+  CONVERT_DTYPE_F16 = 1,
+  CONVERT_DTYPE_BF16 = 2,
+} convert_dtype_t;
+
+size_t convert_dtype_size(convert_dtype_t dtype);
+
+void convert_f16_to_f32(const uint16_t *src, float *dst, size_t count);
+void convert_f32_to_f16(const float *src, uint16_t *dst, size_t count);
+void convert_bf16_to_f32(const uint16_t *src, float *dst, size_t count);
+void convert_f32_to_bf16(const float *src, uint16_t *dst, size_t count);
+void convert_bf16_to_f16(const uint16_t *src, uint16_t *dst, size_t count);
+
+/* dst[i] = src[i] for any pair of dtypes (same dtype is a copy). */
+void convert_array(void *dst, convert_dtype_t dst_dtype, const void *src,
+                   convert_dtype_t src_dtype, size_t count);
+
+/*
+ * Convert a row-major [rows, cols] matrix into its [cols, rows] transpose.
+ * Works on square tiles so that both the reads and the writes stay
+ * contiguous.
+ */
+void convert_transpose(void *dst, convert_dtype_t dst_dtype, const void *src,
+                       convert_dtype_t src_dtype, size_t rows, size_t cols);
+
+/* Single-element conversions for scalar loops and vector tails. */
+
+static inline float fp16_to_f32(uint16_t h) {
+  uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+  uint32_t exp = (h >> 10) & 0x1F;
+  uint32_t mant = h & 0x3FF;
+  uint32_t bits;
+
+  if (exp == 0) {
+    if (mant == 0) {
+      bits = sign;
+    } else {
+      int e = -14;
+      while ((mant & 0x400) == 0) {
+        mant <<= 1;
+        e--;
+      }
+      mant &= 0x3FF;
+      bits = sign | ((uint32_t)(e + 127) << 23) | (mant << 13);
+    }
+  } else if (exp == 31) {
+    bits = sign | 0x7F800000 | (mant << 13);
+  } else {
+    bits = sign | ((exp - 15 + 127) << 23) | (mant << 13);
+  }
+
+  float f;
+  memcpy(&f, &bits, sizeof(f));
+  return f;
+}
+
+static inline uint16_t f32_to_fp16(float f) {
+  const uint32_t f16_overflow = (127u + 16u) << 23;
+  const uint32_t f16_min_normal = (127u - 14u) << 23;
+  const uint32_t denorm_magic_bits = ((127u - 15u) + (23u - 10u) + 1u) << 23;
+  uint32_t x;
+  memcpy(&x, &f, sizeof(x));
+  uint32_t sign = x & 0x80000000u;
+  x ^= sign;
+
+  uint16_t h;
+  if (x >= f16_overflow) {
+    h = (x > 0x7F800000u) ? 0x7E00 : 0x7C00;
+  } else if (x < f16_min_normal) {
+    /* Adding 0.5 lets the FPU round the subnormal mantissa for us. */
+    float fx, magic;
+    memcpy(&fx, &x, sizeof(fx));
+    memcpy(&magic, &denorm_magic_bits, sizeof(magic));
+    fx += magic;
+    uint32_t r;
+    memcpy(&r, &fx, sizeof(r));
+    h = (uint16_t)(r - denorm_magic_bits);
+  } else {
+    uint32_t mant_odd = (x >> 13) & 1;
+    x += ((uint32_t)(15 - 127) << 23) + 0xFFF + mant_odd;
+    h = (uint16_t)(x >> 13);
+  }
+  return (uint16_t)(h | (sign >> 16));
+}
+
+static inline float bf16_to_f32(uint16_t b) {
+  uint32_t bits = (uint32_t)b << 16;
+  float f;
+  memcpy(&f, &bits, sizeof(f));
+  return f;
+}
+
+static inline uint16_t f32_to_bf16(float f) {
+  uint32_t bits;
+  memcpy(&bits, &f, sizeof(bits));
+  if ((bits & 0x7FFFFFFFu) > 0x7F800000u)
+    return (uint16_t)((bits >> 16) | 0x40);
+  bits += 0x7FFF + ((bits >> 16) & 1);
+  return (uint16_t)(bits >> 16);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CONVERT_H */
@@ -0,0 +1,42 @@
+/*
+ * Dtype conversion kernel interface for architecture-specific implementations
+ */
+
+#ifndef CONVERT_KERNELS_H
+#define CONVERT_KERNELS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* convert_x86.c needs AVX2 and F16C at compile time. */
+#if defined(__AVX2__) && defined(__F16C__)
+#define CONVERT_X86_F16C 1
+#else
+#define CONVERT_X86_F16C 0
+#endif
+
+typedef struct {
+  bool has_neon;
+  bool has_f16c;
+} convert_caps_t;
+
+convert_caps_t convert_get_capabilities(void);
+
+/* Provided by convert_neon.c or convert_x86.c; count may be any size. */
+void convert_f16_to_f32_kernel(const uint16_t *src, float *dst, size_t count);
+void convert_f32_to_f16_kernel(const float *src, uint16_t *dst, size_t count);
+void convert_bf16_to_f32_kernel(const uint16_t *src, float *dst, size_t count);
+void convert_f32_to_bf16_kernel(const float *src, uint16_t *dst, size_t count);
+void convert_bf16_to_f16_kernel(const uint16_t *src, uint16_t *dst,
+                                size_t count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CONVERT_KERNELS_H */
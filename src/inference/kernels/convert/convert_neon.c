@@ -0,0 +1,136 @@
+/*
+ * Dtype Conversion - NEON Implementation
+ */
+
+#include "inference/kernels/convert/convert.h"
+#include "inference/kernels/convert/convert_kernels.h"
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define HAS_NEON 1
+#else
+#define HAS_NEON 0
+#endif
+
+convert_caps_t convert_get_capabilities(void) {
+  convert_caps_t caps = {0};
+#if HAS_NEON
+  caps.has_neon = true;
+#endif
+#if CONVERT_X86_F16C
+  caps.has_f16c = true;
+#endif
+  return caps;
+}
+
+#if HAS_NEON
+
+static inline float32x4_t bf16x4_to_f32x4(uint16x4_t v) {
+  return vreinterpretq_f32_u32(vshll_n_u16(v, 16));
+}
+
+static inline uint16x4_t f32x4_to_bf16x4(float32x4_t v) {
+  uint32x4_t bits = vreinterpretq_u32_f32(v);
+  uint32x4_t lsb = vandq_u32(vshrq_n_u32(bits, 16), vdupq_n_u32(1));
+  uint32x4_t rounded = vaddq_u32(bits, vaddq_u32(lsb, vdupq_n_u32(0x7FFF)));
+  uint32x4_t quiet_nan = vorrq_u32(bits, vdupq_n_u32(0x400000));
+  uint32x4_t is_num = vceqq_f32(v, v);
+  return vshrn_n_u32(vbslq_u32(is_num, rounded, quiet_nan), 16);
+}
+
+void convert_f16_to_f32_kernel(const uint16_t *src, float *dst, size_t count) {
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    float16x8_t h = vld1q_f16((const float16_t *)(src + i));
+    vst1q_f32(dst + i, vcvt_f32_f16(vget_low_f16(h)));
+    vst1q_f32(dst + i + 4, vcvt_f32_f16(vget_high_f16(h)));
+  }
+  for (; i < count; i++)
+    dst[i] = fp16_to_f32(src[i]);
+}
+
+void convert_f32_to_f16_kernel(const float *src, uint16_t *dst, size_t count) {
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    float16x4_t lo = vcvt_f16_f32(vld1q_f32(src + i));
+    float16x4_t hi = vcvt_f16_f32(vld1q_f32(src + i + 4));
+    vst1q_f16((float16_t *)(dst + i), vcombine_f16(lo, hi));
+  }
+  for (; i < count; i++)
+    dst[i] = f32_to_fp16(src[i]);
+}
+
+void convert_bf16_to_f32_kernel(const uint16_t *src, float *dst,
+                                size_t count) {
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    uint16x8_t b = vld1q_u16(src + i);
+    vst1q_f32(dst + i, bf16x4_to_f32x4(vget_low_u16(b)));
+    vst1q_f32(dst + i + 4, bf16x4_to_f32x4(vget_high_u16(b)));
+  }
+  for (; i < count; i++)
+    dst[i] = bf16_to_f32(src[i]);
+}
+
+void convert_f32_to_bf16_kernel(const float *src, uint16_t *dst,
+                                size_t count) {
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    uint16x4_t lo = f32x4_to_bf16x4(vld1q_f32(src + i));
+    uint16x4_t hi = f32x4_to_bf16x4(vld1q_f32(src + i + 4));
+    vst1q_u16(dst + i, vcombine_u16(lo, hi));
+  }
+  for (; i < count; i++)
+    dst[i] = f32_to_bf16(src[i]);
+}
+
+void convert_bf16_to_f16_kernel(const uint16_t *src, uint16_t *dst,
+                                size_t count) {
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    uint16x8_t b = vld1q_u16(src + i);
+    float16x4_t lo = vcvt_f16_f32(bf16x4_to_f32x4(vget_low_u16(b)));
+    float16x4_t hi = vcvt_f16_f32(bf16x4_to_f32x4(vget_high_u16(b)));
+    vst1q_f16((float16_t *)(dst + i), vcombine_f16(lo, hi));
+  }
+  for (; i < count; i++)
+    dst[i] = f32_to_fp16(bf16_to_f32(src[i]));
+}
+
+#elif !CONVERT_X86_F16C
+
+/* No vector unit: convert.c never calls these, they only satisfy the link. */
+void convert_f16_to_f32_kernel(const uint16_t *src, float *dst, size_t count) {
+  (void)src;
+  (void)dst;
+  (void)count;
+}
+
+void convert_f32_to_f16_kernel(const float *src, uint16_t *dst, size_t count) {
+  (void)src;
+  (void)dst;
+  (void)count;
+}
+
+void convert_bf16_to_f32_kernel(const uint16_t *src, float *dst,
+                                size_t count) {
+  (void)src;
+  (void)dst;
+  (void)count;
+}
+
+void convert_f32_to_bf16_kernel(const float *src, uint16_t *dst,
+                                size_t count) {
+  (void)src;
+  (void)dst;
+  (void)count;
+}
+
+void convert_bf16_to_f16_kernel(const uint16_t *src, uint16_t *dst,
+                                size_t count) {
+  (void)src;
+  (void)dst;
+  (void)count;
+}
+
+#endif
@@ -0,0 +1,102 @@
+/*
+ * Dtype Conversion - F16C/AVX2 Implementation
+ *
+ * FP16 goes through the F16C instructions; BF16 is the upper half of an
+ * FP32, so widening is a shift and narrowing is an integer round-to-even.
+ */
+
+#include "inference/kernels/convert/convert.h"
+#include "inference/kernels/convert/convert_kernels.h"
+
+#if CONVERT_X86_F16C
+
+#include <immintrin.h>
+
+static inline __m256 load_bf16x8(const uint16_t *src) {
+  __m128i h = _mm_loadu_si128((const __m128i *)src);
+  return _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_cvtepu16_epi32(h), 16));
+}
+
+static inline __m128i narrow_bf16x8(__m256 v) {
+  __m256i bits = _mm256_castps_si256(v);
+  __m256i lsb = _mm256_and_si256(_mm256_srli_epi32(bits, 16),
+                                 _mm256_set1_epi32(1));
+  __m256i rounded = _mm256_add_epi32(
+      bits, _mm256_add_epi32(lsb, _mm256_set1_epi32(0x7FFF)));
+  __m256i quiet_nan = _mm256_or_si256(bits, _mm256_set1_epi32(0x400000));
+  __m256 is_nan = _mm256_cmp_ps(v, v, _CMP_UNORD_Q);
+  __m256i r = _mm256_castps_si256(
+      _mm256_blendv_ps(_mm256_castsi256_ps(rounded),
+                       _mm256_castsi256_ps(quiet_nan), is_nan));
+  r = _mm256_srli_epi32(r, 16);
+  return _mm_packus_epi32(_mm256_castsi256_si128(r),
+                          _mm256_extracti128_si256(r, 1));
+}
+
+void convert_f16_to_f32_kernel(const uint16_t *src, float *dst, size_t count) {
+  size_t i = 0;
+  for (; i + 16 <= count; i += 16) {
+    __m128i a = _mm_loadu_si128((const __m128i *)(src + i));
+    __m128i b = _mm_loadu_si128((const __m128i *)(src + i + 8));
+    _mm256_storeu_ps(dst + i, _mm256_cvtph_ps(a));
+    _mm256_storeu_ps(dst + i + 8, _mm256_cvtph_ps(b));
+  }
+  for (; i + 8 <= count; i += 8) {
+    __m128i a = _mm_loadu_si128((const __m128i *)(src + i));
+    _mm256_storeu_ps(dst + i, _mm256_cvtph_ps(a));
+  }
+  for (; i < count; i++)
+    dst[i] = fp16_to_f32(src[i]);
+}
+
+void convert_f32_to_f16_kernel(const float *src, uint16_t *dst, size_t count) {
+  size_t i = 0;
+  for (; i + 16 <= count; i += 16) {
+    __m128i a =
+        _mm256_cvtps_ph(_mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT);
+    __m128i b = _mm256_cvtps_ph(_mm256_loadu_ps(src + i + 8),
+                                _MM_FROUND_TO_NEAREST_INT);
+    _mm_storeu_si128((__m128i *)(dst + i), a);
+    _mm_storeu_si128((__m128i *)(dst + i + 8), b);
+  }
+  for (; i + 8 <= count; i += 8) {
+    __m128i a =
+        _mm256_cvtps_ph(_mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT);
+    _mm_storeu_si128((__m128i *)(dst + i), a);
+  }
+  for (; i < count; i++)
+    dst[i] = f32_to_fp16(src[i]);
+}
+
+void convert_bf16_to_f32_kernel(const uint16_t *src, float *dst,
+                                size_t count) {
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8)
+    _mm256_storeu_ps(dst + i, load_bf16x8(src + i));
+  for (; i < count; i++)
+    dst[i] = bf16_to_f32(src[i]);
+}
+
+void convert_f32_to_bf16_kernel(const float *src, uint16_t *dst,
+                                size_t count) {
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8)
+    _mm_storeu_si128((__m128i *)(dst + i),
+                     narrow_bf16x8(_mm256_loadu_ps(src + i)));
+  for (; i < count; i++)
+    dst[i] = f32_to_bf16(src[i]);
+}
+
+void convert_bf16_to_f16_kernel(const uint16_t *src, uint16_t *dst,
+                                size_t count) {
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m128i h =
+        _mm256_cvtps_ph(load_bf16x8(src + i), _MM_FROUND_TO_NEAREST_INT);
+    _mm_storeu_si128((__m128i *)(dst + i), h);
+  }
+  for (; i < count; i++)
+    dst[i] = f32_to_fp16(bf16_to_f32(src[i]));
+}
+
+#endif
@@ -1,5 +1,8 @@
 #include "inference/kernels/gemm/gemm.h"
+#include "inference/kernels/convert/convert.h"
 #include "inference/kernels/gemm/gemm_kernels.h"
+#include "inference/kernels/threadpool/threadpool.h"
+#include <math.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
@@ -15,12 +18,6 @@
 #define HAS_ACCELERATE 1
 #endif
 
-#if defined(__ARM_NEON) || defined(__ARM_NEON__)
-#include <arm_neon.h>
-#endif
-
-static int g_num_threads = 0;
-
 static int get_cpu_count(void) {
 #ifdef _WIN32
   SYSTEM_INFO sysinfo;
@@ -32,140 +29,44 @@ static int get_cpu_count(void) {
 #endif
 }
 
+/* Thread count is a property of the shared kernel thread pool. */
 void gemm_set_num_threads(int num_threads) {
-  if (num_threads <= 0) {
-    g_num_threads = get_cpu_count();
-  } else {
-    g_num_threads = num_threads;
-  }
+  threadpool_set_num_threads(num_threads);
 }
 
-int gemm_get_num_threads(void) {
-  if (g_num_threads == 0) {
-    g_num_threads = get_cpu_count();
-  }
-  return g_num_threads;
-}
+int gemm_get_num_threads(void) { return threadpool_get_num_threads(); }
 
 int gemm_get_max_threads(void) { return get_cpu_count(); }
 
 #define MT_THRESHOLD_M 64
 #define MT_THRESHOLD_FLOPS (64 * 64 * 64 * 2)
 
-static inline uint16_t float_to_bf16_c(float x) {
-  uint32_t bits;
-  memcpy(&bits, &x, sizeof(float));
-  uint32_t lsb = (bits >> 16) & 1;
-  uint32_t rounding_bias = 0x7fff + lsb;
-  bits += rounding_bias;
-  return (uint16_t)(bits >> 16);
-}
-
-static inline float bf16_to_float_c(uint16_t bf16) {
-  uint32_t bits = ((uint32_t)bf16) << 16;
-  float result;
-  memcpy(&result, &bits, sizeof(float));
-  return result;
-}
-
-static inline uint16_t float_to_fp16_c(float x) {
-  uint32_t bits;
-  memcpy(&bits, &x, sizeof(float));
-  uint32_t sign = bits & 0x80000000;
-  uint32_t exp = (bits >> 23) & 0xFF;
-  uint32_t mant = bits & 0x7FFFFF;
-
-  if (exp == 0xFF) {
-    if (mant != 0)
-      return 0x7E00;
-    return (uint16_t)((sign >> 16) | 0x7C00);
-  }
-  if (exp == 0 && mant == 0)
-    return (uint16_t)(sign >> 16);
-
-  int32_t new_exp = (int32_t)exp - 127 + 15;
-  if (new_exp <= 0)
-    return (uint16_t)(sign >> 16);
-  if (new_exp >= 31)
-    return (uint16_t)((sign >> 16) | 0x7C00);
-
-  uint16_t fp16_exp = (uint16_t)(new_exp << 10);
-  uint16_t fp16_mant = (uint16_t)(mant >> 13);
-  return (uint16_t)((sign >> 16) | fp16_exp | fp16_mant);
+/* Decode shapes take the small-M path, which splits N rather than M and so
+ * is worth threading from the first row once there is enough work. */
+static bool use_gemv(int M, bool transpose_A) {
+  return M <= GEMM_GEMV_MAX_M && (M == 1 || !transpose_A);
 }
 
-static inline float fp16_to_float_c(uint16_t fp16) {
-  uint32_t sign = (fp16 & 0x8000) << 16;
-  uint32_t exp = (fp16 >> 10) & 0x1F;
-  uint32_t mant = fp16 & 0x3FF;
-
-  uint32_t f32_bits;
-  if (exp == 0) {
-    if (mant == 0) {
-      f32_bits = sign;
-    } else {
-      int e = -14;
-      while ((mant & 0x400) == 0) {
-        mant <<= 1;
-        e--;
-      }
-      mant &= 0x3FF;
-      f32_bits = sign | (((uint32_t)(e + 127)) << 23) | (mant << 13);
-    }
-  } else if (exp == 31) {
-    f32_bits = sign | 0x7F800000 | (mant << 13);
-  } else {
-    f32_bits = sign | (((uint32_t)(exp - 15 + 127)) << 23) | (mant << 13);
-  }
-
-  float result;
-  memcpy(&result, &f32_bits, sizeof(float));
-  return result;
+static int gemv_threads(int M, int N, int K) {
+  long long flops = (long long)M * N * K * 2;
+  return flops >= MT_THRESHOLD_FLOPS ? gemm_get_num_threads() : 1;
 }
 
+/* Kept for existing callers; the conversions live in the convert module. */
 void bf16_array_to_f32(const uint16_t *src, float *dst, size_t count) {
-  for (size_t i = 0; i < count; i++)
-    dst[i] = bf16_to_float_c(src[i]);
+  convert_bf16_to_f32(src, dst, count);
 }
 
 void f32_array_to_bf16(const float *src, uint16_t *dst, size_t count) {
-  for (size_t i = 0; i < count; i++)
-    dst[i] = float_to_bf16_c(src[i]);
+  convert_f32_to_bf16(src, dst, count);
 }
 
 void f16_array_to_f32(const uint16_t *src, float *dst, size_t count) {
-#if defined(__ARM_NEON) || defined(__ARM_NEON__)
-  size_t i = 0;
-  for (; i + 8 <= count; i += 8) {
-    float16x8_t f16 = vld1q_f16((const float16_t *)&src[i]);
-    float32x4_t lo = vcvt_f32_f16(vget_low_f16(f16));
-    float32x4_t hi = vcvt_f32_f16(vget_high_f16(f16));
-    vst1q_f32(&dst[i], lo);
-    vst1q_f32(&dst[i + 4], hi);
-  }
-  for (; i < count; i++)
-    dst[i] = fp16_to_float_c(src[i]);
-#else
-  for (size_t i = 0; i < count; i++)
-    dst[i] = fp16_to_float_c(src[i]);
-#endif
+  convert_f16_to_f32(src, dst, count);
 }
 
 void f32_array_to_f16(const float *src, uint16_t *dst, size_t count) {
-#if defined(__ARM_NEON) || defined(__ARM_NEON__)
-  size_t i = 0;
-  for (; i + 8 <= count; i += 8) {
-    float32x4_t lo = vld1q_f32(&src[i]);
-    float32x4_t hi = vld1q_f32(&src[i + 4]);
-    float16x8_t f16 = vcombine_f16(vcvt_f16_f32(lo), vcvt_f16_f32(hi));
-    vst1q_f16((float16_t *)&dst[i], f16);
-  }
-  for (; i < count; i++)
-    dst[i] = float_to_fp16_c(src[i]);
-#else
-  for (size_t i = 0; i < count; i++)
-    dst[i] = float_to_fp16_c(src[i]);
-#endif
+  convert_f32_to_f16(src, dst, count);
 }
 
 static void gemm_f32_naive(const float *A, const float *B, float *C, int M,
@@ -236,6 +137,20 @@ void gemm_f32(const float *A, const float *B, float *C, int M, int N, int K,
 
   gemm_caps_t caps = gemm_get_capabilities();
 
+  if (caps.has_avx2) {
+    int nt = gemm_get_num_threads();
+    long long flops = (long long)M * N * K * 2;
+    if (use_gemv(M, transpose_A)) {
+      gemv_f32_kernel_avx2(A, B, C, M, N, K, transpose_B,
+                           gemv_threads(M, N, K));
+    } else if (nt > 1 && M >= MT_THRESHOLD_M && flops >= MT_THRESHOLD_FLOPS) {
+      gemm_f32_kernel_avx2_mt(A, B, C, M, N, K, transpose_A, transpose_B, nt);
+    } else {
+      gemm_f32_kernel_avx2(A, B, C, M, N, K, transpose_A, transpose_B);
+    }
+    return;
+  }
+
   if (caps.has_neon && !transpose_A && !transpose_B) {
     int nt = gemm_get_num_threads();
     long long flops = (long long)M * N * K * 2;
@@ -256,9 +171,9 @@ static void gemm_bf16_naive(const uint16_t *A, const uint16_t *B, uint16_t *C,
     for (int j = 0; j < N; j++) {
       float sum = 0.0f;
       for (int k = 0; k < K; k++) {
-        sum += bf16_to_float_c(A[i * K + k]) * bf16_to_float_c(B[k * N + j]);
+        sum += bf16_to_f32(A[i * K + k]) * bf16_to_f32(B[k * N + j]);
       }
-      C[i * N + j] = float_to_bf16_c(sum);
+      C[i * N + j] = f32_to_bf16(sum);
     }
   }
 }
@@ -291,9 +206,9 @@ static void gemm_f16_naive(const uint16_t *A, const uint16_t *B, uint16_t *C,
     for (int j = 0; j < N; j++) {
       float sum = 0.0f;
       for (int k = 0; k < K; k++) {
-        sum += fp16_to_float_c(A[i * K + k]) * fp16_to_float_c(B[k * N + j]);
+        sum += fp16_to_f32(A[i * K + k]) * fp16_to_f32(B[k * N + j]);
       }
-      C[i * N + j] = float_to_fp16_c(sum);
+      C[i * N + j] = f32_to_fp16(sum);
     }
   }
 }
@@ -316,6 +231,19 @@ void gemm_f16(const uint16_t *A, const uint16_t *B, uint16_t *C, int M, int N,
     return;
   }
 
+  if (caps.has_avx2) {
+    int nt = gemm_get_num_threads();
+    long long flops = (long long)M * N * K * 2;
+    if (use_gemv(M, false)) {
+      gemv_f16_kernel_avx2(A, B, C, M, N, K, false, gemv_threads(M, N, K));
+    } else if (nt > 1 && M >= MT_THRESHOLD_M && flops >= MT_THRESHOLD_FLOPS) {
+      gemm_f16_kernel_avx2_mt(A, B, C, M, N, K, false, false, nt);
+    } else {
+      gemm_f16_kernel_avx2(A, B, C, M, N, K, false, false);
+    }
+    return;
+  }
+
 #ifdef HAS_ACCELERATE
   {
     BNNSNDArrayDescriptor descA = {
@@ -407,3 +335,304 @@ void gemm_f16(const uint16_t *A, const uint16_t *B, uint16_t *C, int M, int N,
 
   gemm_f16_naive(A, B, C, M, N, K);
 }
+
+static void gemm_f16_transpose_b_naive(const uint16_t *A, const uint16_t *B,
+                                       uint16_t *C, int M, int N, int K) {
+  for (int i = 0; i < M; i++) {
+    for (int j = 0; j < N; j++) {
+      float sum = 0.0f;
+      for (int k = 0; k < K; k++) {
+        sum += fp16_to_f32(A[i * K + k]) * fp16_to_f32(B[j * K + k]);
+      }
+      C[i * N + j] = f32_to_fp16(sum);
+    }
+  }
+}
+
+void gemm_f16_transpose_b(const uint16_t *A, const uint16_t *B, uint16_t *C,
+                          int M, int N, int K) {
+  if (M <= 0 || N <= 0 || K <= 0)
+    return;
+
+  gemm_caps_t caps = gemm_get_capabilities();
+
+  if (caps.has_avx2) {
+    int nt = gemm_get_num_threads();
+    long long flops = (long long)M * N * K * 2;
+    if (use_gemv(M, false)) {
+      gemv_f16_kernel_avx2(A, B, C, M, N, K, true, gemv_threads(M, N, K));
+    } else if (nt > 1 && M >= MT_THRESHOLD_M && flops >= MT_THRESHOLD_FLOPS) {
+      gemm_f16_kernel_avx2_mt(A, B, C, M, N, K, false, true, nt);
+    } else {
+      gemm_f16_kernel_avx2(A, B, C, M, N, K, false, true);
+    }
+    return;
+  }
+
+  /* AMX and Accelerate beat the dot-product kernel once there are enough
+   * rows, but take B as [K, N]: transposing it is one pass over B against
+   * the M that the product makes. */
+#ifdef HAS_ACCELERATE
+  bool has_blas = true;
+#else
+  bool has_blas = caps.has_amx;
+#endif
+  if (has_blas && M >= 32 && N >= 32) {
+    uint16_t *B_t = (uint16_t *)malloc((size_t)N * K * sizeof(uint16_t));
+    if (B_t) {
+      convert_transpose(B_t, CONVERT_DTYPE_F16, B, CONVERT_DTYPE_F16,
+                        (size_t)N, (size_t)K);
+      gemm_f16(A, B_t, C, M, N, K);
+      free(B_t);
+      return;
+    }
+  }
+
+  /* The dot-product kernel splits N across threads, so unlike the other
+   * entry points it is worth going parallel even for a single row. */
+  if (caps.has_neon) {
+    int nt = gemm_get_num_threads();
+    long long flops = (long long)M * N * K * 2;
+    if (nt > 1 && flops >= MT_THRESHOLD_FLOPS) {
+      gemm_f16_kernel_bt_mt(A, B, C, M, N, K, nt);
+    } else {
+      gemm_f16_kernel_bt(A, B, C, M, N, K);
+    }
+    return;
+  }
+
+  gemm_f16_transpose_b_naive(A, B, C, M, N, K);
+}
+
+const char *gemm_f16_packed_layout(void) {
+  gemm_caps_t caps = gemm_get_capabilities();
+  return caps.has_avx2 ? "f16-panel16" : NULL;
+}
+
+size_t gemm_f16_packed_size(int N, int K) {
+  size_t panels = (size_t)(N + GEMM_F16_PANEL - 1) / GEMM_F16_PANEL;
+  return panels * GEMM_F16_PANEL * K * sizeof(uint16_t);
+}
+
+void gemm_pack_f16_b(uint16_t *dst, const uint16_t *B, int N, int K) {
+  for (int j0 = 0; j0 < N; j0 += GEMM_F16_PANEL) {
+    int nr = N - j0 < GEMM_F16_PANEL ? N - j0 : GEMM_F16_PANEL;
+    for (int k = 0; k < K; k++) {
+      int c = 0;
+      for (; c < nr; c++)
+        dst[c] = B[(size_t)(j0 + c) * K + k];
+      for (; c < GEMM_F16_PANEL; c++)
+        dst[c] = 0;
+      dst += GEMM_F16_PANEL;
+    }
+  }
+}
+
+static void gemm_f16_packed_b_naive(const uint16_t *A, const uint16_t *B,
+                                    uint16_t *C, int M, int N, int K) {
+  for (int i = 0; i < M; i++) {
+    for (int j = 0; j < N; j++) {
+      const uint16_t *panel =
+          B + (size_t)(j / GEMM_F16_PANEL) * K * GEMM_F16_PANEL +
+          j % GEMM_F16_PANEL;
+      float sum = 0.0f;
+      for (int k = 0; k < K; k++)
+        sum += fp16_to_f32(A[i * K + k]) *
+               fp16_to_f32(panel[(size_t)k * GEMM_F16_PANEL]);
+      C[i * N + j] = f32_to_fp16(sum);
+    }
+  }
+}
+
+void gemm_f16_packed_b(const uint16_t *A, const uint16_t *B, uint16_t *C,
+                       int M, int N, int K) {
+  if (M <= 0 || N <= 0 || K <= 0)
+    return;
+
+  gemm_caps_t caps = gemm_get_capabilities();
+
+  if (caps.has_avx2) {
+    int nt = gemm_get_num_threads();
+    long long flops = (long long)M * N * K * 2;
+    if (use_gemv(M, false))
+      nt = gemv_threads(M, N, K);
+    else if (M < MT_THRESHOLD_M || flops < MT_THRESHOLD_FLOPS)
+      nt = 1;
+    gemm_f16_packed_kernel_avx2(A, B, C, M, N, K, nt);
+    return;
+  }
+
+  gemm_f16_packed_b_naive(A, B, C, M, N, K);
+}
+
+static void gemm_q8_naive(const void *A, bool a_f16, const int8_t *B,
+                          const float *scales, void *C, int M, int N, int K) {
+  for (int i = 0; i < M; i++) {
+    for (int j = 0; j < N; j++) {
+      const int8_t *b = B + (size_t)j * K;
+      float sum = 0.0f;
+      for (int k = 0; k < K; k++) {
+        float a = a_f16 ? fp16_to_f32(((const uint16_t *)A)[i * K + k])
+                        : ((const float *)A)[i * K + k];
+        sum += a * b[k];
+      }
+      sum *= scales[j];
+      if (a_f16)
+        ((uint16_t *)C)[i * N + j] = f32_to_fp16(sum);
+      else
+        ((float *)C)[i * N + j] = sum;
+    }
+  }
+}
+
+static void gemm_q8(const void *A, bool a_f16, const int8_t *B,
+                    const float *scales, void *C, int M, int N, int K) {
+  if (M <= 0 || N <= 0 || K <= 0)
+    return;
+
+  gemm_caps_t caps = gemm_get_capabilities();
+  int nt = gemm_get_num_threads();
+  long long flops = (long long)M * N * K * 2;
+
+  if (caps.has_avx2) {
+    if (use_gemv(M, false))
+      nt = gemv_threads(M, N, K);
+    else if (M < MT_THRESHOLD_M || flops < MT_THRESHOLD_FLOPS)
+      nt = 1;
+    gemm_q8_kernel_avx2(A, a_f16, B, scales, C, M, N, K, nt);
+    return;
+  }
+
+  if (caps.has_neon) {
+    gemm_q8_kernel_bt_mt(A, a_f16, B, scales, C, M, N, K,
+                         flops >= MT_THRESHOLD_FLOPS ? nt : 1);
+    return;
+  }
+
+  gemm_q8_naive(A, a_f16, B, scales, C, M, N, K);
+}
+
+void gemm_q8_f32(const float *A, const int8_t *B, const float *scales,
+                 float *C, int M, int N, int K) {
+  gemm_q8(A, false, B, scales, C, M, N, K);
+}
+
+void gemm_q8_f16(const uint16_t *A, const int8_t *B, const float *scales,
+                 uint16_t *C, int M, int N, int K) {
+  gemm_q8(A, true, B, scales, C, M, N, K);
+}
+
+void gemm_quantize_q8(int8_t *dst, float *scales, const float *src, int N,
+                      int K) {
+  for (int n = 0; n < N; n++) {
+    const float *row = src + (size_t)n * K;
+    int8_t *q = dst + (size_t)n * K;
+    float absmax = 0.0f;
+    for (int k = 0; k < K; k++) {
+      float a = fabsf(row[k]);
+      if (a > absmax)
+        absmax = a;
+    }
+
+    float inv = absmax > 0.0f ? 127.0f / absmax : 0.0f;
+    for (int k = 0; k < K; k++)
+      q[k] = (int8_t)lrintf(row[k] * inv);
+    scales[n] = absmax / 127.0f;
+  }
+}
+
+static float q4_weight(const gemm_q4_block_t *row, int k) {
+  const gemm_q4_block_t *b = row + k / GEMM_Q4_GROUP;
+  int i = k % GEMM_Q4_GROUP;
+  int q = i < GEMM_Q4_GROUP / 2 ? b->qs[i] & 15
+                                : b->qs[i - GEMM_Q4_GROUP / 2] >> 4;
+  return (float)q * fp16_to_f32(b->d) + fp16_to_f32(b->m);
+}
+
+static void gemm_q4_naive(const void *A, bool a_f16, const gemm_q4_block_t *B,
+                          void *C, int M, int N, int K) {
+  int groups = K / GEMM_Q4_GROUP;
+  for (int i = 0; i < M; i++) {
+    for (int j = 0; j < N; j++) {
+      const gemm_q4_block_t *b = B + (size_t)j * groups;
+      float sum = 0.0f;
+      for (int k = 0; k < K; k++) {
+        float a = a_f16 ? fp16_to_f32(((const uint16_t *)A)[i * K + k])
+                        : ((const float *)A)[i * K + k];
+        sum += a * q4_weight(b, k);
+      }
+      if (a_f16)
+        ((uint16_t *)C)[i * N + j] = f32_to_fp16(sum);
+      else
+        ((float *)C)[i * N + j] = sum;
+    }
+  }
+}
+
+static void gemm_q4(const void *A, bool a_f16, const gemm_q4_block_t *B,
+                    void *C, int M, int N, int K) {
+  if (M <= 0 || N <= 0 || K <= 0 || K % GEMM_Q4_GROUP != 0)
+    return;
+
+  gemm_caps_t caps = gemm_get_capabilities();
+  int nt = gemm_get_num_threads();
+  long long flops = (long long)M * N * K * 2;
+
+  if (caps.has_avx2) {
+    if (use_gemv(M, false))
+      nt = gemv_threads(M, N, K);
+    else if (M < MT_THRESHOLD_M || flops < MT_THRESHOLD_FLOPS)
+      nt = 1;
+    gemm_q4_kernel_avx2(A, a_f16, B, C, M, N, K, nt);
+    return;
+  }
+
+  if (caps.has_neon) {
+    gemm_q4_kernel_bt_mt(A, a_f16, B, C, M, N, K,
+                         flops >= MT_THRESHOLD_FLOPS ? nt : 1);
+    return;
+  }
+
+  gemm_q4_naive(A, a_f16, B, C, M, N, K);
+}
+
+void gemm_q4_f32(const float *A, const gemm_q4_block_t *B, float *C, int M,
+                 int N, int K) {
+  gemm_q4(A, false, B, C, M, N, K);
+}
+
+void gemm_q4_f16(const uint16_t *A, const gemm_q4_block_t *B, uint16_t *C,
+                 int M, int N, int K) {
+  gemm_q4(A, true, B, C, M, N, K);
+}
+
+/* d and m are rounded to FP16 first so that the nibbles are chosen against
+ * the values the kernels will actually use. */
+void gemm_quantize_q4(gemm_q4_block_t *dst, const float *src, int N, int K) {
+  int groups = K / GEMM_Q4_GROUP;
+  for (int n = 0; n < N; n++) {
+    for (int g = 0; g < groups; g++) {
+      const float *x = src + (size_t)n * K + g * GEMM_Q4_GROUP;
+      gemm_q4_block_t *b = dst + (size_t)n * groups + g;
+      float lo = x[0], hi = x[0];
+      for (int i = 1; i < GEMM_Q4_GROUP; i++) {
+        if (x[i] < lo)
+          lo = x[i];
+        if (x[i] > hi)
+          hi = x[i];
+      }
+
+      b->d = f32_to_fp16((hi - lo) / 15.0f);
+      b->m = f32_to_fp16(lo);
+      float d = fp16_to_f32(b->d), m = fp16_to_f32(b->m);
+      float inv = d > 0.0f ? 1.0f / d : 0.0f;
+      for (int i = 0; i < GEMM_Q4_GROUP / 2; i++) {
+        long q0 = lrintf((x[i] - m) * inv);
+        long q1 = lrintf((x[i + GEMM_Q4_GROUP / 2] - m) * inv);
+        q0 = q0 < 0 ? 0 : q0 > 15 ? 15 : q0;
+        q1 = q1 < 0 ? 0 : q1 > 15 ? 15 : q1;
+        b->qs[i] = (uint8_t)(q0 | q1 << 4);
+      }
+    }
+  }
+}
@@ -5,6 +5,10 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 void gemm_set_num_threads(int num_threads);
 int gemm_get_num_threads(void);
 int gemm_get_max_threads(void);
@@ -18,10 +22,76 @@ void gemm_bf16(const uint16_t *A, const uint16_t *B, uint16_t *C, int M, int N,
 void gemm_f16(const uint16_t *A, const uint16_t *B, uint16_t *C, int M, int N,
               int K);
 
+/* C[M,N] = A[M,K] * B^T with B stored [N, K], i.e. the row-major [out, in]
+ * layout of a linear layer weight as found in safetensors files. */
+void gemm_f16_transpose_b(const uint16_t *A, const uint16_t *B, uint16_t *C,
+                          int M, int N, int K);
+
+/*
+ * Prepacked FP16 weights. gemm_pack_f16_b rearranges B [N, K] (the layout
+ * gemm_f16_transpose_b takes) into panels of GEMM_F16_PANEL columns, each
+ * holding its K x GEMM_F16_PANEL block k-major with the last panel zero
+ * padded: the order in which the kernels consume B, so a product streams
+ * it front to back without repacking. gemm_f16_packed_layout names the
+ * layout the kernels of this build read, or is NULL when they have no packed
+ * path; packed weights are only valid for the layout they were made for.
+ */
+#define GEMM_F16_PANEL 16
+
+const char *gemm_f16_packed_layout(void);
+size_t gemm_f16_packed_size(int N, int K);
+void gemm_pack_f16_b(uint16_t *dst, const uint16_t *B, int N, int K);
+
+/* C[M,N] = A[M,K] * B^T with B packed by gemm_pack_f16_b. */
+void gemm_f16_packed_b(const uint16_t *A, const uint16_t *B, uint16_t *C,
+                       int M, int N, int K);
+
+/*
+ * Weight-only INT8: C[M,N] = A[M,K] * B^T with B stored [N, K] as INT8 rows,
+ * row n dequantized as B[n, k] * scales[n]. Accumulation is FP32.
+ */
+void gemm_q8_f32(const float *A, const int8_t *B, const float *scales,
+                 float *C, int M, int N, int K);
+void gemm_q8_f16(const uint16_t *A, const int8_t *B, const float *scales,
+                 uint16_t *C, int M, int N, int K);
+
+/* Symmetric per-row quantization of src [N, K] into that layout:
+ * scales[n] = max |src[n, :]| / 127. */
+void gemm_quantize_q8(int8_t *dst, float *scales, const float *src, int N,
+                      int K);
+
+/*
+ * Weight-only 4-bit: B is [N, K] stored as K / GEMM_Q4_GROUP blocks per row.
+ * A block covers GEMM_Q4_GROUP consecutive weights, each dequantized as
+ * q * d + m with FP16 d and m and q in [0, 15]. qs[i] holds weight i in its
+ * low nibble and weight i + 16 in its high nibble. K must be a multiple of
+ * GEMM_Q4_GROUP.
+ */
+#define GEMM_Q4_GROUP 32
+
+typedef struct {
+  uint16_t d;
+  uint16_t m;
+  uint8_t qs[GEMM_Q4_GROUP / 2];
+} gemm_q4_block_t;
+
+void gemm_q4_f32(const float *A, const gemm_q4_block_t *B, float *C, int M,
+                 int N, int K);
+void gemm_q4_f16(const uint16_t *A, const gemm_q4_block_t *B, uint16_t *C,
+                 int M, int N, int K);
+
+/* Asymmetric per-group quantization of src [N, K] into that layout: m is the
+ * group minimum and d = (max - min) / 15. */
+void gemm_quantize_q4(gemm_q4_block_t *dst, const float *src, int N, int K);
+
 void bf16_array_to_f32(const uint16_t *src, float *dst, size_t count);
 void f32_array_to_bf16(const float *src, uint16_t *dst, size_t count);
 
 void f16_array_to_f32(const uint16_t *src, float *dst, size_t count);
 void f32_array_to_f16(const float *src, uint16_t *dst, size_t count);
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif
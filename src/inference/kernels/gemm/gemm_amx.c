@@ -12,8 +12,8 @@
 #if defined(__APPLE__) && defined(__aarch64__)
 
 #include "inference/kernels/amx/aarch64.h"
+#include "inference/kernels/threadpool/threadpool.h"
 #include <arm_neon.h>
-#include <pthread.h>
 
 /* AMX Operations */
 #define FMA16_MATRIX_MODE 0
@@ -255,15 +255,16 @@ void gemm_bf16_kernel_amx(const uint16_t *A, const uint16_t *B, uint16_t *C,
   free(pack_b);
 }
 
-/* Multi-threaded dispatchers */
+/* Multi-threaded dispatchers: row tiles run on the shared thread pool. AMX
+ * state is per thread, so every chunk enables and clears it. */
 
 typedef struct {
   const uint16_t *A, *B;
   uint16_t *C;
-  int M, N, K, m_start, m_end;
+  int M, N, K;
 } amx_mt_args;
 
-static void *f16_mt_worker(void *ptr) {
+static void f16_mt_rows(void *ptr, int start, int end) {
   amx_mt_args *args = (amx_mt_args *)ptr;
   int K = args->K;
   int M = args->M; /* Full M for bounds check */
@@ -271,11 +272,14 @@ static void *f16_mt_worker(void *ptr) {
 
   uint16_t *pack_a = aligned_alloc(64, K * 32 * sizeof(uint16_t));
   uint16_t *pack_b = aligned_alloc(64, K * 32 * sizeof(uint16_t));
-  if (!pack_a || !pack_b)
-    return NULL;
+  if (!pack_a || !pack_b) {
+    free(pack_a);
+    free(pack_b);
+    return;
+  }
 
   AMX_SET();
-  for (int m = args->m_start; m < args->m_end; m += 32) {
+  for (int m = start * 32; m < end * 32 && m < M; m += 32) {
     int m_len = (m + 32 > M) ? (M - m) : 32;
     pack_a_f16(args->A + m * K, K, m_len, K, pack_a);
     for (int n = 0; n < N; n += 32) {
@@ -288,7 +292,6 @@ static void *f16_mt_worker(void *ptr) {
   AMX_CLR();
   free(pack_a);
   free(pack_b);
-  return NULL;
 }
 
 void gemm_f16_kernel_amx_mt(const uint16_t *A, const uint16_t *B, uint16_t *C,
@@ -298,33 +301,11 @@ void gemm_f16_kernel_amx_mt(const uint16_t *A, const uint16_t *B, uint16_t *C,
     return;
   }
 
-  pthread_t *threads = malloc(nt * sizeof(pthread_t));
-  amx_mt_args *args = malloc(nt * sizeof(amx_mt_args));
-
-  int rows_per = (M + nt - 1) / nt;
-  /* Align to tile size 32 */
-  rows_per = (rows_per + 31) & ~31;
-
-  int active = 0;
-  for (int i = 0; i < nt; i++) {
-    int start = i * rows_per;
-    if (start >= M)
-      break;
-    int end = start + rows_per;
-    if (end > M)
-      end = M;
-
-    args[i] = (amx_mt_args){A, B, C, M, N, K, start, end};
-    pthread_create(&threads[i], NULL, f16_mt_worker, &args[i]);
-    active++;
-  }
-  for (int i = 0; i < active; i++)
-    pthread_join(threads[i], NULL);
-  free(threads);
-  free(args);
+  amx_mt_args args = {A, B, C, M, N, K};
+  threadpool_parallel_for(0, (M + 31) / 32, 1, f16_mt_rows, &args);
 }
 
-static void *bf16_mt_worker(void *ptr) {
+static void bf16_mt_rows(void *ptr, int start, int end) {
   amx_mt_args *args = (amx_mt_args *)ptr;
   int K = args->K;
   int M = args->M;
@@ -332,11 +313,14 @@ static void *bf16_mt_worker(void *ptr) {
 
   float *pack_a = aligned_alloc(64, K * 16 * sizeof(float));
   float *pack_b = aligned_alloc(64, K * 16 * sizeof(float));
-  if (!pack_a || !pack_b)
-    return NULL;
+  if (!pack_a || !pack_b) {
+    free(pack_a);
+    free(pack_b);
+    return;
+  }
 
   AMX_SET();
-  for (int m = args->m_start; m < args->m_end; m += 16) {
+  for (int m = start * 16; m < end * 16 && m < M; m += 16) {
     int m_len = (m + 16 > M) ? (M - m) : 16;
     pack_a_bf16_to_f32(args->A + m * K, K, m_len, K, pack_a);
     for (int n = 0; n < N; n += 16) {
@@ -349,7 +333,6 @@ static void *bf16_mt_worker(void *ptr) {
   AMX_CLR();
   free(pack_a);
   free(pack_b);
-  return NULL;
 }
 
 void gemm_bf16_kernel_amx_mt(const uint16_t *A, const uint16_t *B, uint16_t *C,
@@ -359,29 +342,8 @@ void gemm_bf16_kernel_amx_mt(const uint16_t *A, const uint16_t *B, uint16_t *C,
     return;
   }
 
-  pthread_t *threads = malloc(nt * sizeof(pthread_t));
-  amx_mt_args *args = malloc(nt * sizeof(amx_mt_args));
-
-  int rows_per = (M + nt - 1) / nt;
-  rows_per = (rows_per + 15) & ~15; /* Align to 16 */
-
-  int active = 0;
-  for (int i = 0; i < nt; i++) {
-    int start = i * rows_per;
-    if (start >= M)
-      break;
-    int end = start + rows_per;
-    if (end > M)
-      end = M;
-
-    args[i] = (amx_mt_args){A, B, C, M, N, K, start, end};
-    pthread_create(&threads[i], NULL, bf16_mt_worker, &args[i]);
-    active++;
-  }
-  for (int i = 0; i < active; i++)
-    pthread_join(threads[i], NULL);
-  free(threads);
-  free(args);
+  amx_mt_args args = {A, B, C, M, N, K};
+  threadpool_parallel_for(0, (M + 15) / 16, 1, bf16_mt_rows, &args);
 }
 
 #else
@@ -1,10 +1,28 @@
 #ifndef GEMM_KERNELS_H
 #define GEMM_KERNELS_H
 
+#include "inference/kernels/gemm/gemm.h"
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 
+/* x86-64 kernels (gemm_x86.c) need AVX2, FMA and F16C at compile time. */
+#if defined(__AVX2__) && defined(__FMA__) && defined(__F16C__)
+#define GEMM_X86_AVX2 1
+#else
+#define GEMM_X86_AVX2 0
+#endif
+
+/* AVX-512F variants inside gemm_x86.c are selected at compile time; there is
+ * no runtime dispatch. The default x86-64-v3 build leaves them out, the
+ * ENABLE_AVX512 CMake option (meson: -Davx512=true) targets x86-64-v4 and
+ * compiles them in, and that binary then requires an AVX-512 CPU. */
+#if GEMM_X86_AVX2 && defined(__AVX512F__)
+#define GEMM_X86_AVX512 1
+#else
+#define GEMM_X86_AVX512 0
+#endif
+
 typedef struct {
   bool has_neon;
   bool has_avx2;
@@ -19,6 +37,48 @@ void gemm_f32_kernel(const float *A, const float *B, float *C, int M, int N,
 void gemm_f32_kernel_mt(const float *A, const float *B, float *C, int M, int N,
                         int K, int num_threads);
 
+/* Packed-panel AVX2/FMA GEMM; handles all four transpose combinations. */
+void gemm_f32_kernel_avx2(const float *A, const float *B, float *C, int M,
+                          int N, int K, bool transpose_A, bool transpose_B);
+void gemm_f32_kernel_avx2_mt(const float *A, const float *B, float *C, int M,
+                             int N, int K, bool transpose_A, bool transpose_B,
+                             int num_threads);
+
+/* FP16 storage, FP32 accumulation; widens with F16C while packing. */
+void gemm_f16_kernel_avx2(const uint16_t *A, const uint16_t *B, uint16_t *C,
+                          int M, int N, int K, bool transpose_A,
+                          bool transpose_B);
+void gemm_f16_kernel_avx2_mt(const uint16_t *A, const uint16_t *B, uint16_t *C,
+                             int M, int N, int K, bool transpose_A,
+                             bool transpose_B, int num_threads);
+
+/* Small-M path: at most GEMM_GEMV_MAX_M rows of row-major A, no packing, B
+ * streamed once per column block and the blocks split across threads. */
+#define GEMM_GEMV_MAX_M 4
+
+void gemv_f32_kernel_avx2(const float *A, const float *B, float *C, int M,
+                          int N, int K, bool transpose_B, int num_threads);
+void gemv_f16_kernel_avx2(const uint16_t *A, const uint16_t *B, uint16_t *C,
+                          int M, int N, int K, bool transpose_B,
+                          int num_threads);
+
+/* B in the gemm_pack_f16_b panel layout; small M streams the panels with a
+ * broadcast-FMA GEMV, larger M widens them into the blocked driver. */
+void gemm_f16_packed_kernel_avx2(const uint16_t *A, const uint16_t *B,
+                                 uint16_t *C, int M, int N, int K,
+                                 int num_threads);
+
+/* Weight-only INT8 B stored [N, K] with one FP32 scale per row. A and C are
+ * FP16 when a_f16 is set, FP32 otherwise. Small M runs the GEMV path over
+ * column blocks, larger M widens and scales B while packing. */
+void gemm_q8_kernel_avx2(const void *A, bool a_f16, const int8_t *B,
+                         const float *scales, void *C, int M, int N, int K,
+                         int num_threads);
+
+/* 4-bit counterpart: B is [N, K / GEMM_Q4_GROUP] gemm_q4_block_t. */
+void gemm_q4_kernel_avx2(const void *A, bool a_f16, const gemm_q4_block_t *B,
+                         void *C, int M, int N, int K, int num_threads);
+
 void gemm_bf16_kernel(const uint16_t *A, const uint16_t *B, uint16_t *C, int M,
                       int N, int K);
 void gemm_bf16_kernel_mt(const uint16_t *A, const uint16_t *B, uint16_t *C,
@@ -29,6 +89,20 @@ void gemm_f16_kernel(const uint16_t *A, const uint16_t *B, uint16_t *C, int M,
 void gemm_f16_kernel_mt(const uint16_t *A, const uint16_t *B, uint16_t *C,
                         int M, int N, int K, int num_threads);
 
+/* B stored [N, K]; FP32 accumulation. Threads split the N dimension. */
+void gemm_f16_kernel_bt(const uint16_t *A, const uint16_t *B, uint16_t *C,
+                        int M, int N, int K);
+void gemm_f16_kernel_bt_mt(const uint16_t *A, const uint16_t *B, uint16_t *C,
+                           int M, int N, int K, int num_threads);
+
+/* INT8 counterpart of gemm_f16_kernel_bt_mt, same operand conventions as
+ * gemm_q8_kernel_avx2. */
+void gemm_q8_kernel_bt_mt(const void *A, bool a_f16, const int8_t *B,
+                          const float *scales, void *C, int M, int N, int K,
+                          int num_threads);
+void gemm_q4_kernel_bt_mt(const void *A, bool a_f16, const gemm_q4_block_t *B,
+                          void *C, int M, int N, int K, int num_threads);
+
 void gemm_f16_kernel_amx(const uint16_t *A, const uint16_t *B, uint16_t *C,
                          int M, int N, int K);
 void gemm_bf16_kernel_amx(const uint16_t *A, const uint16_t *B, uint16_t *C,
@@ -1,11 +1,8 @@
 #include "inference/kernels/gemm/gemm_kernels.h"
+#include "inference/kernels/threadpool/threadpool.h"
 #include <stdlib.h>
 #include <string.h>
 
-#ifndef _WIN32
-#include <pthread.h>
-#endif
-
 #if defined(__ARM_NEON) || defined(__ARM_NEON__)
 #include <arm_neon.h>
 #define HAS_NEON 1
@@ -91,6 +88,12 @@ gemm_caps_t gemm_get_capabilities(void) {
 #endif
 #if defined(__APPLE__) && defined(__aarch64__)
   caps.has_amx = true;
+#endif
+#if GEMM_X86_AVX2
+  caps.has_avx2 = true;
+#endif
+#if GEMM_X86_AVX512
+  caps.has_avx512 = true;
 #endif
   return caps;
 }
@@ -728,32 +731,32 @@ void gemm_f16_kernel(const uint16_t *A, const uint16_t *B, uint16_t *C, int M,
   }
 }
 
-#ifndef _WIN32
+/* Multi-threaded variants split C into 8-row blocks and run them on the
+ * shared thread pool. */
 
 typedef struct {
   const float *A;
   const float *B;
   float *C;
   int M, N, K;
-  int m_start, m_end;
-} gemm_f32_task_t;
-
-static void *gemm_f32_thread_fn(void *arg) {
-  gemm_f32_task_t *task = (gemm_f32_task_t *)arg;
-  const float *A = task->A;
-  const float *B = task->B;
-  float *C = task->C;
-  int N = task->N;
-  int K = task->K;
-
-  for (int mi = task->m_start; mi < task->m_end; mi += 8) {
-    int mi_end = (mi + 8 > task->m_end) ? task->m_end : mi + 8;
+} gemm_f32_mt_ctx_t;
+
+static void gemm_f32_rows(void *arg, int start, int end) {
+  const gemm_f32_mt_ctx_t *ctx = (const gemm_f32_mt_ctx_t *)arg;
+  int N = ctx->N;
+  int K = ctx->K;
+  int m_start = start * 8;
+  int m_end = end * 8 > ctx->M ? ctx->M : end * 8;
+  const float *A = ctx->A + (size_t)m_start * K;
+  float *C = ctx->C + (size_t)m_start * N;
+
+  for (int mi = m_start; mi < m_end; mi += 8) {
+    int mi_end = (mi + 8 > m_end) ? m_end : mi + 8;
     for (int ni = 0; ni < N; ni += 8) {
-      micro_kernel_8x8_neon(A, B, C, mi_end - task->m_start, N, K, K, N, N,
-                            mi - task->m_start, ni);
+      micro_kernel_8x8_neon(A, ctx->B, C, mi_end - m_start, N, K, K, N, N,
+                            mi - m_start, ni);
     }
   }
-  return NULL;
 }
 
 void gemm_f32_kernel_mt(const float *A, const float *B, float *C, int M, int N,
@@ -765,46 +768,8 @@ void gemm_f32_kernel_mt(const float *A, const float *B, float *C, int M, int N,
     return;
   }
 
-  if (num_threads > M / 8)
-    num_threads = M / 8;
-  if (num_threads < 1)
-    num_threads = 1;
-
-  pthread_t *threads = (pthread_t *)malloc(num_threads * sizeof(pthread_t));
-  gemm_f32_task_t *tasks =
-      (gemm_f32_task_t *)malloc(num_threads * sizeof(gemm_f32_task_t));
-
-  int rows_per_thread = (M + num_threads - 1) / num_threads;
-  rows_per_thread = ((rows_per_thread + 7) / 8) * 8;
-
-  for (int t = 0; t < num_threads; t++) {
-    int m_start = t * rows_per_thread;
-    int m_end = m_start + rows_per_thread;
-    if (m_end > M)
-      m_end = M;
-    if (m_start >= M) {
-      num_threads = t;
-      break;
-    }
-
-    tasks[t].A = A + m_start * K;
-    tasks[t].B = B;
-    tasks[t].C = C + m_start * N;
-    tasks[t].M = M;
-    tasks[t].N = N;
-    tasks[t].K = K;
-    tasks[t].m_start = m_start;
-    tasks[t].m_end = m_end;
-
-    pthread_create(&threads[t], NULL, gemm_f32_thread_fn, &tasks[t]);
-  }
-
-  for (int t = 0; t < num_threads; t++) {
-    pthread_join(threads[t], NULL);
-  }
-
-  free(threads);
-  free(tasks);
+  gemm_f32_mt_ctx_t ctx = {A, B, C, M, N, K};
+  threadpool_parallel_for(0, (M + 7) / 8, 1, gemm_f32_rows, &ctx);
 }
 
 typedef struct {
@@ -812,24 +777,23 @@ typedef struct {
   const uint16_t *B;
   uint16_t *C;
   int M, N, K;
-  int m_start, m_end;
-} gemm_bf16_task_t;
-
-static void *gemm_bf16_thread_fn(void *arg) {
-  gemm_bf16_task_t *task = (gemm_bf16_task_t *)arg;
-  const uint16_t *A = task->A;
-  const uint16_t *B = task->B;
-  uint16_t *C = task->C;
-  int M_local = task->m_end - task->m_start;
-  int N = task->N;
-  int K = task->K;
+} gemm_u16_mt_ctx_t;
+
+static void gemm_bf16_rows(void *arg, int start, int end) {
+  const gemm_u16_mt_ctx_t *ctx = (const gemm_u16_mt_ctx_t *)arg;
+  int N = ctx->N;
+  int K = ctx->K;
+  int m_start = start * 8;
+  int m_end = end * 8 > ctx->M ? ctx->M : end * 8;
+  const uint16_t *A = ctx->A + (size_t)m_start * K;
+  uint16_t *C = ctx->C + (size_t)m_start * N;
+  int M_local = m_end - m_start;
 
   for (int mi = 0; mi < M_local; mi += 8) {
     for (int ni = 0; ni < N; ni += 8) {
-      micro_kernel_bf16_8x8_neon(A, B, C, M_local, N, K, mi, ni);
+      micro_kernel_bf16_8x8_neon(A, ctx->B, C, M_local, N, K, mi, ni);
     }
   }
-  return NULL;
 }
 
 void gemm_bf16_kernel_mt(const uint16_t *A, const uint16_t *B, uint16_t *C,
@@ -839,71 +803,25 @@ void gemm_bf16_kernel_mt(const uint16_t *A, const uint16_t *B, uint16_t *C,
     return;
   }
 
-  if (num_threads > M / 8)
-    num_threads = M / 8;
-  if (num_threads < 1)
-    num_threads = 1;
-
-  pthread_t *threads = (pthread_t *)malloc(num_threads * sizeof(pthread_t));
-  gemm_bf16_task_t *tasks =
-      (gemm_bf16_task_t *)malloc(num_threads * sizeof(gemm_bf16_task_t));
-
-  int rows_per_thread = (M + num_threads - 1) / num_threads;
-  rows_per_thread = ((rows_per_thread + 7) / 8) * 8;
-
-  for (int t = 0; t < num_threads; t++) {
-    int m_start = t * rows_per_thread;
-    int m_end = m_start + rows_per_thread;
-    if (m_end > M)
-      m_end = M;
-    if (m_start >= M) {
-      num_threads = t;
-      break;
-    }
-
-    tasks[t].A = A + m_start * K;
-    tasks[t].B = B;
-    tasks[t].C = C + m_start * N;
-    tasks[t].M = M;
-    tasks[t].N = N;
-    tasks[t].K = K;
-    tasks[t].m_start = m_start;
-    tasks[t].m_end = m_end;
-
-    pthread_create(&threads[t], NULL, gemm_bf16_thread_fn, &tasks[t]);
-  }
-
-  for (int t = 0; t < num_threads; t++) {
-    pthread_join(threads[t], NULL);
-  }
-
-  free(threads);
-  free(tasks);
+  gemm_u16_mt_ctx_t ctx = {A, B, C, M, N, K};
+  threadpool_parallel_for(0, (M + 7) / 8, 1, gemm_bf16_rows, &ctx);
 }
 
-typedef struct {
-  const uint16_t *A;
-  const uint16_t *B;
-  uint16_t *C;
-  int M, N, K;
-  int m_start, m_end;
-} gemm_f16_task_t;
-
-static void *gemm_f16_thread_fn(void *arg) {
-  gemm_f16_task_t *task = (gemm_f16_task_t *)arg;
-  const uint16_t *A = task->A;
-  const uint16_t *B = task->B;
-  uint16_t *C = task->C;
-  int M_local = task->m_end - task->m_start;
-  int N = task->N;
-  int K = task->K;
+static void gemm_f16_rows(void *arg, int start, int end) {
+  const gemm_u16_mt_ctx_t *ctx = (const gemm_u16_mt_ctx_t *)arg;
+  int N = ctx->N;
+  int K = ctx->K;
+  int m_start = start * 8;
+  int m_end = end * 8 > ctx->M ? ctx->M : end * 8;
+  const uint16_t *A = ctx->A + (size_t)m_start * K;
+  uint16_t *C = ctx->C + (size_t)m_start * N;
+  int M_local = m_end - m_start;
 
   for (int mi = 0; mi < M_local; mi += 8) {
     for (int ni = 0; ni < N; ni += 8) {
-      micro_kernel_f16_8x8_neon(A, B, C, M_local, N, K, mi, ni);
+      micro_kernel_f16_8x8_neon(A, ctx->B, C, M_local, N, K, mi, ni);
     }
   }
-  return NULL;
 }
 
 void gemm_f16_kernel_mt(const uint16_t *A, const uint16_t *B, uint16_t *C,
@@ -913,72 +831,372 @@ void gemm_f16_kernel_mt(const uint16_t *A, const uint16_t *B, uint16_t *C,
     return;
   }
 
-  if (num_threads > M / 8)
-    num_threads = M / 8;
-  if (num_threads < 1)
-    num_threads = 1;
-
-  pthread_t *threads = (pthread_t *)malloc(num_threads * sizeof(pthread_t));
-  gemm_f16_task_t *tasks =
-      (gemm_f16_task_t *)malloc(num_threads * sizeof(gemm_f16_task_t));
-
-  int rows_per_thread = (M + num_threads - 1) / num_threads;
-  rows_per_thread = ((rows_per_thread + 7) / 8) * 8;
-
-  for (int t = 0; t < num_threads; t++) {
-    int m_start = t * rows_per_thread;
-    int m_end = m_start + rows_per_thread;
-    if (m_end > M)
-      m_end = M;
-    if (m_start >= M) {
-      num_threads = t;
-      break;
+  gemm_u16_mt_ctx_t ctx = {A, B, C, M, N, K};
+  threadpool_parallel_for(0, (M + 7) / 8, 1, gemm_f16_rows, &ctx);
+}
+
+/* B stored [N, K]: every output is a dot product of an A row with a B row, so
+ * both operands stream contiguously along K. Four B rows share each A load.
+ * Threads split N, which also keeps the M == 1 decode case parallel. */
+
+static inline float dot_f16_scalar(const uint16_t *a, const uint16_t *b,
+                                   int K) {
+  float sum = 0.0f;
+  for (int k = 0; k < K; k++)
+    sum += fp16_to_float_c(a[k]) * fp16_to_float_c(b[k]);
+  return sum;
+}
+
+static inline void dot4_f16_bt_neon(const uint16_t *a, const uint16_t *b,
+                                    int K, uint16_t *out) {
+  const uint16_t *b0 = b;
+  const uint16_t *b1 = b + K;
+  const uint16_t *b2 = b + 2 * K;
+  const uint16_t *b3 = b + 3 * K;
+  float32x4_t s0 = vdupq_n_f32(0.0f), s1 = vdupq_n_f32(0.0f);
+  float32x4_t s2 = vdupq_n_f32(0.0f), s3 = vdupq_n_f32(0.0f);
+
+  int k = 0;
+  for (; k + 8 <= K; k += 8) {
+    float16x8_t av = vld1q_f16((const float16_t *)&a[k]);
+    float32x4_t alo = vcvt_f32_f16(vget_low_f16(av));
+    float32x4_t ahi = vcvt_f32_f16(vget_high_f16(av));
+
+    float16x8_t bv = vld1q_f16((const float16_t *)&b0[k]);
+    s0 = vfmaq_f32(s0, alo, vcvt_f32_f16(vget_low_f16(bv)));
+    s0 = vfmaq_f32(s0, ahi, vcvt_f32_f16(vget_high_f16(bv)));
+    bv = vld1q_f16((const float16_t *)&b1[k]);
+    s1 = vfmaq_f32(s1, alo, vcvt_f32_f16(vget_low_f16(bv)));
+    s1 = vfmaq_f32(s1, ahi, vcvt_f32_f16(vget_high_f16(bv)));
+    bv = vld1q_f16((const float16_t *)&b2[k]);
+    s2 = vfmaq_f32(s2, alo, vcvt_f32_f16(vget_low_f16(bv)));
+    s2 = vfmaq_f32(s2, ahi, vcvt_f32_f16(vget_high_f16(bv)));
+    bv = vld1q_f16((const float16_t *)&b3[k]);
+    s3 = vfmaq_f32(s3, alo, vcvt_f32_f16(vget_low_f16(bv)));
+    s3 = vfmaq_f32(s3, ahi, vcvt_f32_f16(vget_high_f16(bv)));
+  }
+
+  float r0 = vaddvq_f32(s0), r1 = vaddvq_f32(s1);
+  float r2 = vaddvq_f32(s2), r3 = vaddvq_f32(s3);
+  if (k < K) {
+    r0 += dot_f16_scalar(a + k, b0 + k, K - k);
+    r1 += dot_f16_scalar(a + k, b1 + k, K - k);
+    r2 += dot_f16_scalar(a + k, b2 + k, K - k);
+    r3 += dot_f16_scalar(a + k, b3 + k, K - k);
+  }
+
+  out[0] = float_to_fp16_c(r0);
+  out[1] = float_to_fp16_c(r1);
+  out[2] = float_to_fp16_c(r2);
+  out[3] = float_to_fp16_c(r3);
+}
+
+static void gemm_f16_bt_cols(const uint16_t *A, const uint16_t *B, uint16_t *C,
+                             int M, int N, int K, int n_start, int n_end) {
+  int j = n_start;
+  for (; j + 4 <= n_end; j += 4) {
+    __builtin_prefetch(&B[(size_t)(j + 4) * K], 0, 1);
+    for (int i = 0; i < M; i++) {
+      dot4_f16_bt_neon(A + (size_t)i * K, B + (size_t)j * K, K,
+                       C + (size_t)i * N + j);
+    }
+  }
+  for (; j < n_end; j++) {
+    for (int i = 0; i < M; i++) {
+      C[(size_t)i * N + j] = float_to_fp16_c(
+          dot_f16_scalar(A + (size_t)i * K, B + (size_t)j * K, K));
     }
+  }
+}
 
-    tasks[t].A = A + m_start * K;
-    tasks[t].B = B;
-    tasks[t].C = C + m_start * N;
-    tasks[t].M = M;
-    tasks[t].N = N;
-    tasks[t].K = K;
-    tasks[t].m_start = m_start;
-    tasks[t].m_end = m_end;
+void gemm_f16_kernel_bt(const uint16_t *A, const uint16_t *B, uint16_t *C,
+                        int M, int N, int K) {
+  gemm_f16_bt_cols(A, B, C, M, N, K, 0, N);
+}
+
+static void gemm_f16_bt_cols_task(void *arg, int start, int end) {
+  const gemm_u16_mt_ctx_t *ctx = (const gemm_u16_mt_ctx_t *)arg;
+  int n_start = start * 16;
+  int n_end = end * 16 > ctx->N ? ctx->N : end * 16;
+  gemm_f16_bt_cols(ctx->A, ctx->B, ctx->C, ctx->M, ctx->N, ctx->K, n_start,
+                   n_end);
+}
 
-    pthread_create(&threads[t], NULL, gemm_f16_thread_fn, &tasks[t]);
+void gemm_f16_kernel_bt_mt(const uint16_t *A, const uint16_t *B, uint16_t *C,
+                           int M, int N, int K, int num_threads) {
+  if (num_threads <= 1 || N < 32) {
+    gemm_f16_kernel_bt(A, B, C, M, N, K);
+    return;
   }
 
-  for (int t = 0; t < num_threads; t++) {
-    pthread_join(threads[t], NULL);
+  gemm_u16_mt_ctx_t ctx = {A, B, C, M, N, K};
+  threadpool_parallel_for(0, (N + 15) / 16, 1, gemm_f16_bt_cols_task, &ctx);
+}
+
+/* Weight-only INT8 rows: the same dot-product layout, with eight weights
+ * widened per step and the row scale applied to the finished sum. */
+
+static inline float32x4_t load_a_f32x4(const void *a, bool f16, int k) {
+  if (f16)
+    return vcvt_f32_f16(vld1_f16((const float16_t *)a + k));
+  return vld1q_f32((const float *)a + k);
+}
+
+static inline float load_a_f32(const void *a, bool f16, int k) {
+  return f16 ? fp16_to_float_c(((const uint16_t *)a)[k])
+             : ((const float *)a)[k];
+}
+
+static inline void store_c_f32(void *c, bool f16, size_t i, float v) {
+  if (f16)
+    ((uint16_t *)c)[i] = float_to_fp16_c(v);
+  else
+    ((float *)c)[i] = v;
+}
+
+static inline void q8x8_to_f32(const int8_t *p, float32x4_t *lo,
+                               float32x4_t *hi) {
+  int16x8_t w = vmovl_s8(vld1_s8(p));
+  *lo = vcvtq_f32_s32(vmovl_s16(vget_low_s16(w)));
+  *hi = vcvtq_f32_s32(vmovl_s16(vget_high_s16(w)));
+}
+
+static inline float dot_q8_row(const void *a, bool f16, const int8_t *b,
+                               int K) {
+  float32x4_t s = vdupq_n_f32(0.0f);
+  int k = 0;
+  for (; k + 8 <= K; k += 8) {
+    float32x4_t lo, hi;
+    q8x8_to_f32(b + k, &lo, &hi);
+    s = vfmaq_f32(s, load_a_f32x4(a, f16, k), lo);
+    s = vfmaq_f32(s, load_a_f32x4(a, f16, k + 4), hi);
   }
+  float r = vaddvq_f32(s);
+  for (; k < K; k++)
+    r += load_a_f32(a, f16, k) * b[k];
+  return r;
+}
 
-  free(threads);
-  free(tasks);
+static inline void dot4_q8_bt_neon(const void *a, bool f16, const int8_t *b,
+                                   int K, float out[4]) {
+  const int8_t *b0 = b;
+  const int8_t *b1 = b + K;
+  const int8_t *b2 = b + 2 * K;
+  const int8_t *b3 = b + 3 * K;
+  float32x4_t s0 = vdupq_n_f32(0.0f), s1 = vdupq_n_f32(0.0f);
+  float32x4_t s2 = vdupq_n_f32(0.0f), s3 = vdupq_n_f32(0.0f);
+
+  int k = 0;
+  for (; k + 8 <= K; k += 8) {
+    float32x4_t alo = load_a_f32x4(a, f16, k);
+    float32x4_t ahi = load_a_f32x4(a, f16, k + 4);
+    float32x4_t lo, hi;
+
+    q8x8_to_f32(b0 + k, &lo, &hi);
+    s0 = vfmaq_f32(vfmaq_f32(s0, alo, lo), ahi, hi);
+    q8x8_to_f32(b1 + k, &lo, &hi);
+    s1 = vfmaq_f32(vfmaq_f32(s1, alo, lo), ahi, hi);
+    q8x8_to_f32(b2 + k, &lo, &hi);
+    s2 = vfmaq_f32(vfmaq_f32(s2, alo, lo), ahi, hi);
+    q8x8_to_f32(b3 + k, &lo, &hi);
+    s3 = vfmaq_f32(vfmaq_f32(s3, alo, lo), ahi, hi);
+  }
+
+  out[0] = vaddvq_f32(s0);
+  out[1] = vaddvq_f32(s1);
+  out[2] = vaddvq_f32(s2);
+  out[3] = vaddvq_f32(s3);
+  for (; k < K; k++) {
+    float ak = load_a_f32(a, f16, k);
+    out[0] += ak * b0[k];
+    out[1] += ak * b1[k];
+    out[2] += ak * b2[k];
+    out[3] += ak * b3[k];
+  }
 }
 
-#else
+typedef struct {
+  const void *A;
+  bool a_f16;
+  const int8_t *B;
+  const float *scales;
+  void *C;
+  int M, N, K;
+} gemm_q8_bt_ctx_t;
+
+static void gemm_q8_bt_cols(const gemm_q8_bt_ctx_t *ctx, int n_start,
+                            int n_end) {
+  const int M = ctx->M, N = ctx->N, K = ctx->K;
+  size_t elem = ctx->a_f16 ? sizeof(uint16_t) : sizeof(float);
+  int j = n_start;
+  for (; j + 4 <= n_end; j += 4) {
+    const int8_t *b = ctx->B + (size_t)j * K;
+    __builtin_prefetch(b + (size_t)4 * K, 0, 1);
+    for (int i = 0; i < M; i++) {
+      const char *a = (const char *)ctx->A + (size_t)i * K * elem;
+      float out[4];
+      dot4_q8_bt_neon(a, ctx->a_f16, b, K, out);
+      for (int t = 0; t < 4; t++)
+        store_c_f32(ctx->C, ctx->a_f16, (size_t)i * N + j + t,
+                    out[t] * ctx->scales[j + t]);
+    }
+  }
+  for (; j < n_end; j++) {
+    for (int i = 0; i < M; i++) {
+      const char *a = (const char *)ctx->A + (size_t)i * K * elem;
+      float dot = dot_q8_row(a, ctx->a_f16, ctx->B + (size_t)j * K, K);
+      store_c_f32(ctx->C, ctx->a_f16, (size_t)i * N + j,
+                  dot * ctx->scales[j]);
+    }
+  }
+}
 
-void gemm_f32_kernel_mt(const float *A, const float *B, float *C, int M, int N,
-                        int K, int num_threads) {
-  (void)num_threads;
-  gemm_f32_kernel(A, B, C, M, N, K);
+static void gemm_q8_bt_cols_task(void *arg, int start, int end) {
+  const gemm_q8_bt_ctx_t *ctx = (const gemm_q8_bt_ctx_t *)arg;
+  int n_end = end * 16 > ctx->N ? ctx->N : end * 16;
+  gemm_q8_bt_cols(ctx, start * 16, n_end);
 }
 
-void gemm_bf16_kernel_mt(const uint16_t *A, const uint16_t *B, uint16_t *C,
-                         int M, int N, int K, int num_threads) {
-  (void)num_threads;
-  gemm_bf16_kernel(A, B, C, M, N, K);
+void gemm_q8_kernel_bt_mt(const void *A, bool a_f16, const int8_t *B,
+                          const float *scales, void *C, int M, int N, int K,
+                          int num_threads) {
+  gemm_q8_bt_ctx_t ctx = {A, a_f16, B, scales, C, M, N, K};
+  if (num_threads <= 1 || N < 32) {
+    gemm_q8_bt_cols(&ctx, 0, N);
+    return;
+  }
+  threadpool_parallel_for(0, (N + 15) / 16, 1, gemm_q8_bt_cols_task, &ctx);
 }
 
-void gemm_f16_kernel_mt(const uint16_t *A, const uint16_t *B, uint16_t *C,
-                        int M, int N, int K, int num_threads) {
-  (void)num_threads;
-  gemm_f16_kernel(A, B, C, M, N, K);
+/* 4-bit rows: a group's nibbles are widened to FP32 and dotted with the
+ * group of a loaded once for all four rows; d scales that dot and the group
+ * minimum adds m * sum(a). */
+
+static inline void load_a_group(const void *a, bool f16, int k,
+                                float32x4_t av[8], float *sum) {
+  float32x4_t s = vdupq_n_f32(0.0f);
+  for (int t = 0; t < 8; t++) {
+    av[t] = load_a_f32x4(a, f16, k + t * 4);
+    s = vaddq_f32(s, av[t]);
+  }
+  *sum = vaddvq_f32(s);
 }
 
-#endif
+static inline float32x4_t u16x4_to_f32(uint16x4_t v) {
+  return vcvtq_f32_u32(vmovl_u16(v));
+}
+
+static inline float32x4_t dot_q4_group(const gemm_q4_block_t *b,
+                                       const float32x4_t av[8]) {
+  uint8x16_t q = vld1q_u8(b->qs);
+  uint16x8_t w0 = vmovl_u8(vget_low_u8(vandq_u8(q, vdupq_n_u8(15))));
+  uint16x8_t w1 = vmovl_u8(vget_high_u8(vandq_u8(q, vdupq_n_u8(15))));
+  uint16x8_t w2 = vmovl_u8(vget_low_u8(vshrq_n_u8(q, 4)));
+  uint16x8_t w3 = vmovl_u8(vget_high_u8(vshrq_n_u8(q, 4)));
+  float32x4_t d = vmulq_f32(av[0], u16x4_to_f32(vget_low_u16(w0)));
+  d = vfmaq_f32(d, av[1], u16x4_to_f32(vget_high_u16(w0)));
+  d = vfmaq_f32(d, av[2], u16x4_to_f32(vget_low_u16(w1)));
+  d = vfmaq_f32(d, av[3], u16x4_to_f32(vget_high_u16(w1)));
+  d = vfmaq_f32(d, av[4], u16x4_to_f32(vget_low_u16(w2)));
+  d = vfmaq_f32(d, av[5], u16x4_to_f32(vget_high_u16(w2)));
+  d = vfmaq_f32(d, av[6], u16x4_to_f32(vget_low_u16(w3)));
+  d = vfmaq_f32(d, av[7], u16x4_to_f32(vget_high_u16(w3)));
+  return d;
+}
+
+static inline void dot4_q4_bt_neon(const void *a, bool f16,
+                                   const gemm_q4_block_t *b, int groups,
+                                   float out[4]) {
+  const gemm_q4_block_t *rows[4] = {b, b + groups, b + 2 * groups,
+                                    b + 3 * groups};
+  float32x4_t s[4] = {vdupq_n_f32(0.0f), vdupq_n_f32(0.0f),
+                      vdupq_n_f32(0.0f), vdupq_n_f32(0.0f)};
+  float m[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+
+  for (int g = 0; g < groups; g++) {
+    float32x4_t av[8];
+    float asum;
+    load_a_group(a, f16, g * GEMM_Q4_GROUP, av, &asum);
+    for (int r = 0; r < 4; r++) {
+      const gemm_q4_block_t *blk = rows[r] + g;
+      s[r] = vfmaq_n_f32(s[r], dot_q4_group(blk, av),
+                         fp16_to_float_c(blk->d));
+      m[r] += fp16_to_float_c(blk->m) * asum;
+    }
+  }
+  for (int r = 0; r < 4; r++)
+    out[r] = vaddvq_f32(s[r]) + m[r];
+}
+
+static inline float dot_q4_row(const void *a, bool f16,
+                               const gemm_q4_block_t *b, int groups) {
+  float32x4_t s = vdupq_n_f32(0.0f);
+  float m = 0.0f;
+  for (int g = 0; g < groups; g++) {
+    float32x4_t av[8];
+    float asum;
+    load_a_group(a, f16, g * GEMM_Q4_GROUP, av, &asum);
+    s = vfmaq_n_f32(s, dot_q4_group(b + g, av), fp16_to_float_c(b[g].d));
+    m += fp16_to_float_c(b[g].m) * asum;
+  }
+  return vaddvq_f32(s) + m;
+}
+
+typedef struct {
+  const void *A;
+  bool a_f16;
+  const gemm_q4_block_t *B;
+  void *C;
+  int M, N, K;
+} gemm_q4_bt_ctx_t;
+
+static void gemm_q4_bt_cols(const gemm_q4_bt_ctx_t *ctx, int n_start,
+                            int n_end) {
+  const int M = ctx->M, N = ctx->N, K = ctx->K;
+  const int groups = K / GEMM_Q4_GROUP;
+  size_t elem = ctx->a_f16 ? sizeof(uint16_t) : sizeof(float);
+  int j = n_start;
+  for (; j + 4 <= n_end; j += 4) {
+    const gemm_q4_block_t *b = ctx->B + (size_t)j * groups;
+    __builtin_prefetch(b + (size_t)4 * groups, 0, 1);
+    for (int i = 0; i < M; i++) {
+      const char *a = (const char *)ctx->A + (size_t)i * K * elem;
+      float out[4];
+      dot4_q4_bt_neon(a, ctx->a_f16, b, groups, out);
+      for (int t = 0; t < 4; t++)
+        store_c_f32(ctx->C, ctx->a_f16, (size_t)i * N + j + t, out[t]);
+    }
+  }
+  for (; j < n_end; j++) {
+    for (int i = 0; i < M; i++) {
+      const char *a = (const char *)ctx->A + (size_t)i * K * elem;
+      store_c_f32(ctx->C, ctx->a_f16, (size_t)i * N + j,
+                  dot_q4_row(a, ctx->a_f16, ctx->B + (size_t)j * groups,
+                             groups));
+    }
+  }
+}
+
+static void gemm_q4_bt_cols_task(void *arg, int start, int end) {
+  const gemm_q4_bt_ctx_t *ctx = (const gemm_q4_bt_ctx_t *)arg;
+  int n_end = end * 16 > ctx->N ? ctx->N : end * 16;
+  gemm_q4_bt_cols(ctx, start * 16, n_end);
+}
+
+void gemm_q4_kernel_bt_mt(const void *A, bool a_f16, const gemm_q4_block_t *B,
+                          void *C, int M, int N, int K, int num_threads) {
+  gemm_q4_bt_ctx_t ctx = {A, a_f16, B, C, M, N, K};
+  if (num_threads <= 1 || N < 32) {
+    gemm_q4_bt_cols(&ctx, 0, N);
+    return;
+  }
+  threadpool_parallel_for(0, (N + 15) / 16, 1, gemm_q4_bt_cols_task, &ctx);
+}
 
 #else
 
+/* On x86-64 the f32 and f16 entry points are provided by gemm_x86.c. */
+#if !GEMM_X86_AVX2
 void gemm_f32_kernel(const float *A, const float *B, float *C, int M, int N,
                      int K) {
   (void)A;
@@ -988,6 +1206,7 @@ void gemm_f32_kernel(const float *A, const float *B, float *C, int M, int N,
   (void)N;
   (void)K;
 }
+#endif
 
 void gemm_bf16_kernel(const uint16_t *A, const uint16_t *B, uint16_t *C, int M,
                       int N, int K) {
@@ -999,6 +1218,7 @@ void gemm_bf16_kernel(const uint16_t *A, const uint16_t *B, uint16_t *C, int M,
   (void)K;
 }
 
+#if !GEMM_X86_AVX2
 void gemm_f16_kernel(const uint16_t *A, const uint16_t *B, uint16_t *C, int M,
                      int N, int K) {
   (void)A;
@@ -1008,7 +1228,9 @@ void gemm_f16_kernel(const uint16_t *A, const uint16_t *B, uint16_t *C, int M,
   (void)N;
   (void)K;
 }
+#endif
 
+#if !GEMM_X86_AVX2
 void gemm_f32_kernel_mt(const float *A, const float *B, float *C, int M, int N,
                         int K, int num_threads) {
   (void)A;
@@ -1019,6 +1241,7 @@ void gemm_f32_kernel_mt(const float *A, const float *B, float *C, int M, int N,
   (void)K;
   (void)num_threads;
 }
+#endif
 
 void gemm_bf16_kernel_mt(const uint16_t *A, const uint16_t *B, uint16_t *C,
                          int M, int N, int K, int num_threads) {
@@ -1031,6 +1254,7 @@ void gemm_bf16_kernel_mt(const uint16_t *A, const uint16_t *B, uint16_t *C,
   (void)num_threads;
 }
 
+#if !GEMM_X86_AVX2
 void gemm_f16_kernel_mt(const uint16_t *A, const uint16_t *B, uint16_t *C,
                         int M, int N, int K, int num_threads) {
   (void)A;
@@ -1041,5 +1265,53 @@ void gemm_f16_kernel_mt(const uint16_t *A, const uint16_t *B, uint16_t *C,
   (void)K;
   (void)num_threads;
 }
+#endif
+
+void gemm_f16_kernel_bt(const uint16_t *A, const uint16_t *B, uint16_t *C,
+                        int M, int N, int K) {
+  (void)A;
+  (void)B;
+  (void)C;
+  (void)M;
+  (void)N;
+  (void)K;
+}
+
+void gemm_f16_kernel_bt_mt(const uint16_t *A, const uint16_t *B, uint16_t *C,
+                           int M, int N, int K, int num_threads) {
+  (void)A;
+  (void)B;
+  (void)C;
+  (void)M;
+  (void)N;
+  (void)K;
+  (void)num_threads;
+}
+
+void gemm_q8_kernel_bt_mt(const void *A, bool a_f16, const int8_t *B,
+                          const float *scales, void *C, int M, int N, int K,
+                          int num_threads) {
+  (void)A;
+  (void)a_f16;
+  (void)B;
+  (void)scales;
+  (void)C;
+  (void)M;
+  (void)N;
+  (void)K;
+  (void)num_threads;
+}
+
+void gemm_q4_kernel_bt_mt(const void *A, bool a_f16, const gemm_q4_block_t *B,
+                          void *C, int M, int N, int K, int num_threads) {
+  (void)A;
+  (void)a_f16;
+  (void)B;
+  (void)C;
+  (void)M;
+  (void)N;
+  (void)K;
+  (void)num_threads;
+}
 
 #endif
@@ -0,0 +1,1878 @@
+/*
+ * x86-64 GEMM kernels (AVX2 + FMA + F16C)
+ *
+ * Packed-panel GEMM in the BLIS style: C is produced in MC x NC blocks while
+ * K is consumed KC at a time. Each A block is packed into MR-row panels and
+ * each B block into NR-column panels (zero padded at the edges) so the 6x16
+ * register-blocked microkernel streams both operands with unit stride.
+ * Packing absorbs the transpose flags, so all four layouts share one
+ * microkernel.
+ *
+ * FP16 operands are widened to FP32 while packing (F16C), so the same
+ * microkernel serves both precisions and accumulation is always FP32. The
+ * result is narrowed back to FP16 once per C block. When the compiler targets
+ * AVX-512F, B panels and the M == 1 path use 16-lane conversions instead.
+ *
+ * Decode-sized problems (M <= GEMM_GEMV_MAX_M) bypass packing altogether and
+ * run matrix-vector kernels over column blocks of B, split across threads.
+ *
+ * FP16 weights prepacked by gemm_pack_f16_b are already NR-column panels,
+ * k-major: the blocked driver only widens them, and the GEMV walks each
+ * panel front to back with a broadcast of x per k.
+ *
+ * Weight-only INT8 B ([N, K] rows with a scale per row) goes through the same
+ * two drivers: the GEMV path multiplies the weights in int16 against a
+ * block-scaled int16 copy of x and applies the row scale to the finished dot
+ * product, and the packed path widens and scales B into the usual FP32
+ * panels. 4-bit B (groups of 32 weights with an FP16 scale and minimum) is
+ * handled alike: GEMV runs the int16 dot per group, packing dequantizes.
+ */
+
+#include "inference/kernels/gemm/gemm_kernels.h"
+#include "inference/kernels/threadpool/threadpool.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if GEMM_X86_AVX2
+
+#include <immintrin.h>
+
+#define GEMM_MR 6
+#define GEMM_NR 16
+#define GEMM_MC 120
+#define GEMM_KC 256
+#define GEMM_NC 3072
+
+/* Prepacked FP16 panels are the B panels of the microkernel. */
+#if GEMM_F16_PANEL != GEMM_NR
+#error "gemm_pack_f16_b panels must be GEMM_NR columns wide"
+#endif
+
+/* Strided view of one GEMM problem: A(i, k) = A[i * rs_a + k * cs_a],
+ * B(k, j) = B[k * rs_b + j * cs_b], C(i, j) = C[i * ldc + j]. */
+typedef struct {
+  const float *A;
+  size_t rs_a, cs_a;
+  const float *B;
+  size_t rs_b, cs_b;
+  float *C;
+  size_t ldc;
+  int M, N, K;
+} gemm_f32_problem_t;
+
+/* With b_packed, B is in the gemm_pack_f16_b layout instead (rs_b and cs_b
+ * unused): B(k, j) = B[(j / NR) * K * NR + k * NR + j % NR]. */
+typedef struct {
+  const uint16_t *A;
+  size_t rs_a, cs_a;
+  const uint16_t *B;
+  size_t rs_b, cs_b;
+  uint16_t *C;
+  size_t ldc;
+  int M, N, K;
+  bool b_packed;
+} gemm_f16_problem_t;
+
+/* Quantized B of either kind, one row of ldb bytes per column j: INT8 with
+ * B(k, j) = B[j * ldb + k] * scales[j], or Q4 blocks when q4 is set (scales
+ * unused). A and C are FP16 when a_f16 is set, FP32 otherwise, with row
+ * strides lda and ldc. */
+typedef struct {
+  const void *A;
+  size_t lda;
+  const void *B;
+  size_t ldb;
+  const float *scales;
+  void *C;
+  size_t ldc;
+  int M, N, K;
+  bool a_f16;
+  bool q4;
+} gemm_qw_problem_t;
+
+static inline int imin(int a, int b) { return a < b ? a : b; }
+
+static inline __m256 load_f16x8(const uint16_t *p) {
+  return _mm256_cvtph_ps(_mm_loadu_si128((const __m128i *)p));
+}
+
+static inline void store_f16x8(uint16_t *p, __m256 v) {
+  _mm_storeu_si128((__m128i *)p, _mm256_cvtps_ph(v, _MM_FROUND_TO_NEAREST_INT));
+}
+
+static inline __m256 load_q8x8(const int8_t *p) {
+  return _mm256_cvtepi32_ps(
+      _mm256_cvtepi8_epi32(_mm_loadl_epi64((const __m128i *)p)));
+}
+
+static inline float f16_to_f32(uint16_t h) { return _cvtsh_ss(h); }
+
+static inline uint16_t f32_to_f16(float f) {
+  return (uint16_t)_cvtss_sh(f, _MM_FROUND_TO_NEAREST_INT);
+}
+
+static inline float hsum256_ps(__m256 v) {
+  __m128 lo = _mm256_castps256_ps128(v);
+  __m128 hi = _mm256_extractf128_ps(v, 1);
+  lo = _mm_add_ps(lo, hi);
+  __m128 shuf = _mm_movehdup_ps(lo);
+  __m128 sums = _mm_add_ps(lo, shuf);
+  shuf = _mm_movehl_ps(shuf, sums);
+  sums = _mm_add_ss(sums, shuf);
+  return _mm_cvtss_f32(sums);
+}
+
+static inline void transpose8x8_ps(__m256 r[8]) {
+  __m256 t0 = _mm256_unpacklo_ps(r[0], r[1]);
+  __m256 t1 = _mm256_unpackhi_ps(r[0], r[1]);
+  __m256 t2 = _mm256_unpacklo_ps(r[2], r[3]);
+  __m256 t3 = _mm256_unpackhi_ps(r[2], r[3]);
+  __m256 t4 = _mm256_unpacklo_ps(r[4], r[5]);
+  __m256 t5 = _mm256_unpackhi_ps(r[4], r[5]);
+  __m256 t6 = _mm256_unpacklo_ps(r[6], r[7]);
+  __m256 t7 = _mm256_unpackhi_ps(r[6], r[7]);
+  __m256 s0 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+  __m256 s1 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+  __m256 s2 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+  __m256 s3 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+  __m256 s4 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(1, 0, 1, 0));
+  __m256 s5 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(3, 2, 3, 2));
+  __m256 s6 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(1, 0, 1, 0));
+  __m256 s7 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(3, 2, 3, 2));
+  r[0] = _mm256_permute2f128_ps(s0, s4, 0x20);
+  r[1] = _mm256_permute2f128_ps(s1, s5, 0x20);
+  r[2] = _mm256_permute2f128_ps(s2, s6, 0x20);
+  r[3] = _mm256_permute2f128_ps(s3, s7, 0x20);
+  r[4] = _mm256_permute2f128_ps(s0, s4, 0x31);
+  r[5] = _mm256_permute2f128_ps(s1, s5, 0x31);
+  r[6] = _mm256_permute2f128_ps(s2, s6, 0x31);
+  r[7] = _mm256_permute2f128_ps(s3, s7, 0x31);
+}
+
+/* ============ Packing ============ */
+
+/* Pack an mc x kc block of A into ceil(mc / MR) panels laid out k-major:
+ * panel[k * MR + r] = A(i + r, k). */
+static void pack_a_f32(const float *A, size_t rs, size_t cs, int mc, int kc,
+                       float *pa) {
+  for (int i = 0; i < mc; i += GEMM_MR) {
+    int mr = imin(GEMM_MR, mc - i);
+    const float *a = A + (size_t)i * rs;
+
+    if (mr == GEMM_MR && cs == 1) {
+      const float *a0 = a, *a1 = a + rs, *a2 = a + 2 * rs;
+      const float *a3 = a + 3 * rs, *a4 = a + 4 * rs, *a5 = a + 5 * rs;
+      for (int k = 0; k < kc; k++) {
+        pa[0] = a0[k];
+        pa[1] = a1[k];
+        pa[2] = a2[k];
+        pa[3] = a3[k];
+        pa[4] = a4[k];
+        pa[5] = a5[k];
+        pa += GEMM_MR;
+      }
+    } else if (mr == GEMM_MR && rs == 1) {
+      for (int k = 0; k < kc; k++) {
+        memcpy(pa, a + (size_t)k * cs, GEMM_MR * sizeof(float));
+        pa += GEMM_MR;
+      }
+    } else {
+      for (int k = 0; k < kc; k++) {
+        int r = 0;
+        for (; r < mr; r++)
+          pa[r] = a[(size_t)r * rs + (size_t)k * cs];
+        for (; r < GEMM_MR; r++)
+          pa[r] = 0.0f;
+        pa += GEMM_MR;
+      }
+    }
+  }
+}
+
+/* Pack a kc x nc block of B into ceil(nc / NR) panels laid out k-major:
+ * panel[k * NR + c] = B(k, j + c). A transposed B (PyTorch [out, in] weight)
+ * is packed with 8x8 register transposes. */
+static void pack_b_f32(const float *B, size_t rs, size_t cs, int kc, int nc,
+                       float *pb) {
+  for (int j = 0; j < nc; j += GEMM_NR) {
+    int nr = imin(GEMM_NR, nc - j);
+    const float *b = B + (size_t)j * cs;
+
+    if (nr == GEMM_NR && cs == 1) {
+      for (int k = 0; k < kc; k++) {
+        const float *src = b + (size_t)k * rs;
+        _mm256_store_ps(pb + k * GEMM_NR, _mm256_loadu_ps(src));
+        _mm256_store_ps(pb + k * GEMM_NR + 8, _mm256_loadu_ps(src + 8));
+      }
+    } else if (nr == GEMM_NR && rs == 1) {
+      int k = 0;
+      for (; k + 8 <= kc; k += 8) {
+        for (int half = 0; half < 2; half++) {
+          __m256 r[8];
+          for (int c = 0; c < 8; c++)
+            r[c] = _mm256_loadu_ps(b + (size_t)(half * 8 + c) * cs + k);
+          transpose8x8_ps(r);
+          for (int t = 0; t < 8; t++)
+            _mm256_store_ps(pb + (k + t) * GEMM_NR + half * 8, r[t]);
+        }
+      }
+      for (; k < kc; k++) {
+        for (int c = 0; c < GEMM_NR; c++)
+          pb[k * GEMM_NR + c] = b[(size_t)c * cs + k];
+      }
+    } else {
+      for (int k = 0; k < kc; k++) {
+        int c = 0;
+        for (; c < nr; c++)
+          pb[k * GEMM_NR + c] = b[(size_t)k * rs + (size_t)c * cs];
+        for (; c < GEMM_NR; c++)
+          pb[k * GEMM_NR + c] = 0.0f;
+      }
+    }
+    pb += (size_t)kc * GEMM_NR;
+  }
+}
+
+/* FP16 variants of the packers above: same panel layout, widened to FP32. */
+static void pack_a_f16(const uint16_t *A, size_t rs, size_t cs, int mc, int kc,
+                       float *pa) {
+  for (int i = 0; i < mc; i += GEMM_MR) {
+    int mr = imin(GEMM_MR, mc - i);
+    const uint16_t *a = A + (size_t)i * rs;
+
+    if (mr == GEMM_MR && cs == 1) {
+      int k = 0;
+      for (; k + 8 <= kc; k += 8) {
+        float rows[GEMM_MR][8] __attribute__((aligned(32)));
+        for (int r = 0; r < GEMM_MR; r++)
+          _mm256_store_ps(rows[r], load_f16x8(a + (size_t)r * rs + k));
+        for (int t = 0; t < 8; t++) {
+          for (int r = 0; r < GEMM_MR; r++)
+            pa[r] = rows[r][t];
+          pa += GEMM_MR;
+        }
+      }
+      for (; k < kc; k++) {
+        for (int r = 0; r < GEMM_MR; r++)
+          pa[r] = f16_to_f32(a[(size_t)r * rs + k]);
+        pa += GEMM_MR;
+      }
+    } else {
+      for (int k = 0; k < kc; k++) {
+        int r = 0;
+        for (; r < mr; r++)
+          pa[r] = f16_to_f32(a[(size_t)r * rs + (size_t)k * cs]);
+        for (; r < GEMM_MR; r++)
+          pa[r] = 0.0f;
+        pa += GEMM_MR;
+      }
+    }
+  }
+}
+
+static void pack_b_f16(const uint16_t *B, size_t rs, size_t cs, int kc, int nc,
+                       float *pb) {
+  for (int j = 0; j < nc; j += GEMM_NR) {
+    int nr = imin(GEMM_NR, nc - j);
+    const uint16_t *b = B + (size_t)j * cs;
+
+    if (nr == GEMM_NR && cs == 1) {
+      for (int k = 0; k < kc; k++) {
+        const uint16_t *src = b + (size_t)k * rs;
+#if GEMM_X86_AVX512
+        _mm512_store_ps(pb + k * GEMM_NR,
+                        _mm512_cvtph_ps(_mm256_loadu_si256((const __m256i *)src)));
+#else
+        _mm256_store_ps(pb + k * GEMM_NR, load_f16x8(src));
+        _mm256_store_ps(pb + k * GEMM_NR + 8, load_f16x8(src + 8));
+#endif
+      }
+    } else if (nr == GEMM_NR && rs == 1) {
+      int k = 0;
+      for (; k + 8 <= kc; k += 8) {
+        for (int half = 0; half < 2; half++) {
+          __m256 r[8];
+          for (int c = 0; c < 8; c++)
+            r[c] = load_f16x8(b + (size_t)(half * 8 + c) * cs + k);
+          transpose8x8_ps(r);
+          for (int t = 0; t < 8; t++)
+            _mm256_store_ps(pb + (k + t) * GEMM_NR + half * 8, r[t]);
+        }
+      }
+      for (; k < kc; k++) {
+        for (int c = 0; c < GEMM_NR; c++)
+          pb[k * GEMM_NR + c] = f16_to_f32(b[(size_t)c * cs + k]);
+      }
+    } else {
+      for (int k = 0; k < kc; k++) {
+        int c = 0;
+        for (; c < nr; c++)
+          pb[k * GEMM_NR + c] = f16_to_f32(b[(size_t)k * rs + (size_t)c * cs]);
+        for (; c < GEMM_NR; c++)
+          pb[k * GEMM_NR + c] = 0.0f;
+      }
+    }
+    pb += (size_t)kc * GEMM_NR;
+  }
+}
+
+/* Prepacked FP16 panels hold their kc x NR block contiguously, panel_stride
+ * halves apart, so packing reduces to widening them in order. */
+static void widen_b_panels_f16(const uint16_t *B, size_t panel_stride, int kc,
+                               int nc, float *pb) {
+  for (int j = 0; j < nc; j += GEMM_NR) {
+    const uint16_t *src = B + (size_t)(j / GEMM_NR) * panel_stride;
+    for (int i = 0; i < kc * GEMM_NR; i += 16) {
+#if GEMM_X86_AVX512
+      __m256i h = _mm256_loadu_si256((const __m256i *)(src + i));
+      _mm512_store_ps(pb + i, _mm512_cvtph_ps(h));
+#else
+      _mm256_store_ps(pb + i, load_f16x8(src + i));
+      _mm256_store_ps(pb + i + 8, load_f16x8(src + i + 8));
+#endif
+    }
+    pb += (size_t)kc * GEMM_NR;
+  }
+}
+
+/* INT8 rows of B become the panel columns, widened and scaled by their row
+ * scale; a full panel is transposed 8 x 8 like the FP16 rs == 1 case. */
+static void pack_b_q8(const int8_t *B, size_t ldb, const float *scales,
+                      int kc, int nc, float *pb) {
+  for (int j = 0; j < nc; j += GEMM_NR) {
+    int nr = imin(GEMM_NR, nc - j);
+    const int8_t *b = B + (size_t)j * ldb;
+    const float *sc = scales + j;
+
+    if (nr == GEMM_NR) {
+      int k = 0;
+      for (; k + 8 <= kc; k += 8) {
+        for (int half = 0; half < 2; half++) {
+          __m256 r[8];
+          for (int c = 0; c < 8; c++) {
+            int col = half * 8 + c;
+            r[c] = _mm256_mul_ps(load_q8x8(b + (size_t)col * ldb + k),
+                                 _mm256_set1_ps(sc[col]));
+          }
+          transpose8x8_ps(r);
+          for (int t = 0; t < 8; t++)
+            _mm256_store_ps(pb + (k + t) * GEMM_NR + half * 8, r[t]);
+        }
+      }
+      for (; k < kc; k++) {
+        for (int c = 0; c < GEMM_NR; c++)
+          pb[k * GEMM_NR + c] = b[(size_t)c * ldb + k] * sc[c];
+      }
+    } else {
+      for (int k = 0; k < kc; k++) {
+        int c = 0;
+        for (; c < nr; c++)
+          pb[k * GEMM_NR + c] = b[(size_t)c * ldb + k] * sc[c];
+        for (; c < GEMM_NR; c++)
+          pb[k * GEMM_NR + c] = 0.0f;
+      }
+    }
+    pb += (size_t)kc * GEMM_NR;
+  }
+}
+
+/* Q4 rows of B become the panel columns, dequantized eight weights at a time
+ * and transposed 8 x 8 like the INT8 case. B points at the group holding
+ * the block's first k, and kc is a whole number of groups. */
+static inline __m256 dequant_q4x8(const gemm_q4_block_t *b, int part) {
+  __m256i q = _mm256_cvtepu8_epi32(
+      _mm_loadl_epi64((const __m128i *)(b->qs + (part & 1) * 8)));
+  q = part < 2 ? _mm256_and_si256(q, _mm256_set1_epi32(15))
+               : _mm256_srli_epi32(q, 4);
+  return _mm256_fmadd_ps(_mm256_cvtepi32_ps(q),
+                         _mm256_set1_ps(f16_to_f32(b->d)),
+                         _mm256_set1_ps(f16_to_f32(b->m)));
+}
+
+static inline float dequant_q4(const gemm_q4_block_t *b, int k) {
+  const gemm_q4_block_t *g = b + k / GEMM_Q4_GROUP;
+  int i = k % GEMM_Q4_GROUP;
+  int q = i < 16 ? g->qs[i] & 15 : g->qs[i - 16] >> 4;
+  return (float)q * f16_to_f32(g->d) + f16_to_f32(g->m);
+}
+
+static void pack_b_q4(const char *B, size_t ldb, int kc, int nc, float *pb) {
+  for (int j = 0; j < nc; j += GEMM_NR) {
+    int nr = imin(GEMM_NR, nc - j);
+    const char *b = B + (size_t)j * ldb;
+
+    if (nr == GEMM_NR) {
+      for (int k = 0; k < kc; k += GEMM_Q4_GROUP) {
+        for (int half = 0; half < 2; half++) {
+          for (int part = 0; part < 4; part++) {
+            __m256 r[8];
+            for (int c = 0; c < 8; c++) {
+              const gemm_q4_block_t *blk =
+                  (const gemm_q4_block_t *)(b + (size_t)(half * 8 + c) * ldb);
+              r[c] = dequant_q4x8(blk + k / GEMM_Q4_GROUP, part);
+            }
+            transpose8x8_ps(r);
+            for (int t = 0; t < 8; t++)
+              _mm256_store_ps(pb + (k + part * 8 + t) * GEMM_NR + half * 8,
+                              r[t]);
+          }
+        }
+      }
+    } else {
+      for (int k = 0; k < kc; k++) {
+        int c = 0;
+        for (; c < nr; c++)
+          pb[k * GEMM_NR + c] = dequant_q4(
+              (const gemm_q4_block_t *)(b + (size_t)c * ldb), k);
+        for (; c < GEMM_NR; c++)
+          pb[k * GEMM_NR + c] = 0.0f;
+      }
+    }
+    pb += (size_t)kc * GEMM_NR;
+  }
+}
+
+/* ============ Microkernel ============ */
+
+/* C[0:mr, 0:nr] (+)= packed A panel (kc x 6) * packed B panel (kc x 16). */
+static void micro_kernel_6x16_avx2(int kc, const float *pa, const float *pb,
+                                   float *C, size_t ldc, int mr, int nr,
+                                   bool accumulate) {
+  __m256 c00 = _mm256_setzero_ps(), c01 = _mm256_setzero_ps();
+  __m256 c10 = _mm256_setzero_ps(), c11 = _mm256_setzero_ps();
+  __m256 c20 = _mm256_setzero_ps(), c21 = _mm256_setzero_ps();
+  __m256 c30 = _mm256_setzero_ps(), c31 = _mm256_setzero_ps();
+  __m256 c40 = _mm256_setzero_ps(), c41 = _mm256_setzero_ps();
+  __m256 c50 = _mm256_setzero_ps(), c51 = _mm256_setzero_ps();
+
+  for (int k = 0; k < kc; k++) {
+    __m256 b0 = _mm256_load_ps(pb);
+    __m256 b1 = _mm256_load_ps(pb + 8);
+    __m256 a;
+
+    a = _mm256_broadcast_ss(pa + 0);
+    c00 = _mm256_fmadd_ps(a, b0, c00);
+    c01 = _mm256_fmadd_ps(a, b1, c01);
+    a = _mm256_broadcast_ss(pa + 1);
+    c10 = _mm256_fmadd_ps(a, b0, c10);
+    c11 = _mm256_fmadd_ps(a, b1, c11);
+    a = _mm256_broadcast_ss(pa + 2);
+    c20 = _mm256_fmadd_ps(a, b0, c20);
+    c21 = _mm256_fmadd_ps(a, b1, c21);
+    a = _mm256_broadcast_ss(pa + 3);
+    c30 = _mm256_fmadd_ps(a, b0, c30);
+    c31 = _mm256_fmadd_ps(a, b1, c31);
+    a = _mm256_broadcast_ss(pa + 4);
+    c40 = _mm256_fmadd_ps(a, b0, c40);
+    c41 = _mm256_fmadd_ps(a, b1, c41);
+    a = _mm256_broadcast_ss(pa + 5);
+    c50 = _mm256_fmadd_ps(a, b0, c50);
+    c51 = _mm256_fmadd_ps(a, b1, c51);
+
+    pa += GEMM_MR;
+    pb += GEMM_NR;
+  }
+
+#define STORE_ROW(row, v0, v1)                                                 \
+  do {                                                                         \
+    float *c_ = C + (size_t)(row) * ldc;                                       \
+    if (accumulate) {                                                          \
+      v0 = _mm256_add_ps(v0, _mm256_loadu_ps(c_));                             \
+      v1 = _mm256_add_ps(v1, _mm256_loadu_ps(c_ + 8));                         \
+    }                                                                          \
+    _mm256_storeu_ps(c_, v0);                                                  \
+    _mm256_storeu_ps(c_ + 8, v1);                                              \
+  } while (0)
+
+  if (mr == GEMM_MR && nr == GEMM_NR) {
+    STORE_ROW(0, c00, c01);
+    STORE_ROW(1, c10, c11);
+    STORE_ROW(2, c20, c21);
+    STORE_ROW(3, c30, c31);
+    STORE_ROW(4, c40, c41);
+    STORE_ROW(5, c50, c51);
+    return;
+  }
+#undef STORE_ROW
+
+  float tile[GEMM_MR * GEMM_NR] __attribute__((aligned(32)));
+  _mm256_store_ps(tile + 0 * GEMM_NR, c00);
+  _mm256_store_ps(tile + 0 * GEMM_NR + 8, c01);
+  _mm256_store_ps(tile + 1 * GEMM_NR, c10);
+  _mm256_store_ps(tile + 1 * GEMM_NR + 8, c11);
+  _mm256_store_ps(tile + 2 * GEMM_NR, c20);
+  _mm256_store_ps(tile + 2 * GEMM_NR + 8, c21);
+  _mm256_store_ps(tile + 3 * GEMM_NR, c30);
+  _mm256_store_ps(tile + 3 * GEMM_NR + 8, c31);
+  _mm256_store_ps(tile + 4 * GEMM_NR, c40);
+  _mm256_store_ps(tile + 4 * GEMM_NR + 8, c41);
+  _mm256_store_ps(tile + 5 * GEMM_NR, c50);
+  _mm256_store_ps(tile + 5 * GEMM_NR + 8, c51);
+
+  for (int i = 0; i < mr; i++) {
+    float *c = C + (size_t)i * ldc;
+    for (int j = 0; j < nr; j++)
+      c[j] = accumulate ? c[j] + tile[i * GEMM_NR + j] : tile[i * GEMM_NR + j];
+  }
+}
+
+/* ============ Single-row path ============ */
+
+/* The dot-product loops stream four weight rows at a time. Hardware
+ * prefetchers ramp up again for every new row, so each cache-line step also
+ * pulls the matching line of the next group of rows into L2. */
+static inline void gemv_prefetch_rows(const void *b0, const void *b1,
+                                      const void *b2, const void *b3,
+                                      size_t ahead) {
+  _mm_prefetch((const char *)b0 + ahead, _MM_HINT_T1);
+  _mm_prefetch((const char *)b1 + ahead, _MM_HINT_T1);
+  _mm_prefetch((const char *)b2 + ahead, _MM_HINT_T1);
+  _mm_prefetch((const char *)b3 + ahead, _MM_HINT_T1);
+}
+
+/* M == 1: A is a contiguous K-vector for either transpose flag, so the
+ * problem is a matrix-vector product and packing would only add traffic. */
+static void gemv_f32_avx2(const gemm_f32_problem_t *p) {
+  const float *x = p->A;
+  const int N = p->N, K = p->K;
+  float *y = p->C;
+
+  if (p->rs_b == 1) {
+    size_t ahead = 4 * p->cs_b * sizeof(float);
+    /* B(k, j) = B[j * cs_b + k]: one dot product per output. */
+    int j = 0;
+    for (; j + 4 <= N; j += 4) {
+      const float *b0 = p->B + (size_t)j * p->cs_b;
+      const float *b1 = b0 + p->cs_b;
+      const float *b2 = b1 + p->cs_b;
+      const float *b3 = b2 + p->cs_b;
+      __m256 acc0 = _mm256_setzero_ps(), acc1 = _mm256_setzero_ps();
+      __m256 acc2 = _mm256_setzero_ps(), acc3 = _mm256_setzero_ps();
+      int k = 0;
+      for (; k + 16 <= K; k += 16) {
+        gemv_prefetch_rows(b0 + k, b1 + k, b2 + k, b3 + k, ahead);
+        for (int u = 0; u < 16; u += 8) {
+          __m256 xv = _mm256_loadu_ps(x + k + u);
+          acc0 = _mm256_fmadd_ps(xv, _mm256_loadu_ps(b0 + k + u), acc0);
+          acc1 = _mm256_fmadd_ps(xv, _mm256_loadu_ps(b1 + k + u), acc1);
+          acc2 = _mm256_fmadd_ps(xv, _mm256_loadu_ps(b2 + k + u), acc2);
+          acc3 = _mm256_fmadd_ps(xv, _mm256_loadu_ps(b3 + k + u), acc3);
+        }
+      }
+      for (; k + 8 <= K; k += 8) {
+        __m256 xv = _mm256_loadu_ps(x + k);
+        acc0 = _mm256_fmadd_ps(xv, _mm256_loadu_ps(b0 + k), acc0);
+        acc1 = _mm256_fmadd_ps(xv, _mm256_loadu_ps(b1 + k), acc1);
+        acc2 = _mm256_fmadd_ps(xv, _mm256_loadu_ps(b2 + k), acc2);
+        acc3 = _mm256_fmadd_ps(xv, _mm256_loadu_ps(b3 + k), acc3);
+      }
+      float s0 = hsum256_ps(acc0), s1 = hsum256_ps(acc1);
+      float s2 = hsum256_ps(acc2), s3 = hsum256_ps(acc3);
+      for (; k < K; k++) {
+        s0 += x[k] * b0[k];
+        s1 += x[k] * b1[k];
+        s2 += x[k] * b2[k];
+        s3 += x[k] * b3[k];
+      }
+      y[j] = s0;
+      y[j + 1] = s1;
+      y[j + 2] = s2;
+      y[j + 3] = s3;
+    }
+    for (; j < N; j++) {
+      const float *b = p->B + (size_t)j * p->cs_b;
+      __m256 acc = _mm256_setzero_ps();
+      int k = 0;
+      for (; k + 8 <= K; k += 8)
+        acc = _mm256_fmadd_ps(_mm256_loadu_ps(x + k), _mm256_loadu_ps(b + k),
+                              acc);
+      float s = hsum256_ps(acc);
+      for (; k < K; k++)
+        s += x[k] * b[k];
+      y[j] = s;
+    }
+    return;
+  }
+
+  /* B(k, j) = B[k * rs_b + j]: accumulate scaled rows of B. */
+  int j = 0;
+  for (; j + 32 <= N; j += 32) {
+    __m256 acc0 = _mm256_setzero_ps(), acc1 = _mm256_setzero_ps();
+    __m256 acc2 = _mm256_setzero_ps(), acc3 = _mm256_setzero_ps();
+    for (int k = 0; k < K; k++) {
+      const float *b = p->B + (size_t)k * p->rs_b + j;
+      __m256 xv = _mm256_broadcast_ss(x + k);
+      acc0 = _mm256_fmadd_ps(xv, _mm256_loadu_ps(b), acc0);
+      acc1 = _mm256_fmadd_ps(xv, _mm256_loadu_ps(b + 8), acc1);
+      acc2 = _mm256_fmadd_ps(xv, _mm256_loadu_ps(b + 16), acc2);
+      acc3 = _mm256_fmadd_ps(xv, _mm256_loadu_ps(b + 24), acc3);
+    }
+    _mm256_storeu_ps(y + j, acc0);
+    _mm256_storeu_ps(y + j + 8, acc1);
+    _mm256_storeu_ps(y + j + 16, acc2);
+    _mm256_storeu_ps(y + j + 24, acc3);
+  }
+  for (; j + 8 <= N; j += 8) {
+    __m256 acc = _mm256_setzero_ps();
+    for (int k = 0; k < K; k++)
+      acc = _mm256_fmadd_ps(_mm256_broadcast_ss(x + k),
+                            _mm256_loadu_ps(p->B + (size_t)k * p->rs_b + j),
+                            acc);
+    _mm256_storeu_ps(y + j, acc);
+  }
+  for (; j < N; j++) {
+    float s = 0.0f;
+    for (int k = 0; k < K; k++)
+      s += x[k] * p->B[(size_t)k * p->rs_b + j];
+    y[j] = s;
+  }
+}
+
+/* FP16 single-row path. Weights are converted on the fly while streaming, so
+ * the kernel reads half the bytes of the FP32 GEMV for the same FLOPs. */
+static void gemv_f16_avx2(const gemm_f16_problem_t *p) {
+  const uint16_t *x = p->A;
+  const int N = p->N, K = p->K;
+  uint16_t *y = p->C;
+
+  if (p->rs_b == 1) {
+    size_t ahead = 4 * p->cs_b * sizeof(uint16_t);
+    int j = 0;
+    for (; j + 4 <= N; j += 4) {
+      const uint16_t *b0 = p->B + (size_t)j * p->cs_b;
+      const uint16_t *b1 = b0 + p->cs_b;
+      const uint16_t *b2 = b1 + p->cs_b;
+      const uint16_t *b3 = b2 + p->cs_b;
+      int k = 0;
+#if GEMM_X86_AVX512
+      __m512 acc0 = _mm512_setzero_ps(), acc1 = _mm512_setzero_ps();
+      __m512 acc2 = _mm512_setzero_ps(), acc3 = _mm512_setzero_ps();
+      for (; k + 16 <= K; k += 16) {
+        if ((k & 31) == 0)
+          gemv_prefetch_rows(b0 + k, b1 + k, b2 + k, b3 + k, ahead);
+        __m512 xv = _mm512_cvtph_ps(_mm256_loadu_si256((const __m256i *)(x + k)));
+        acc0 = _mm512_fmadd_ps(
+            xv, _mm512_cvtph_ps(_mm256_loadu_si256((const __m256i *)(b0 + k))),
+            acc0);
+        acc1 = _mm512_fmadd_ps(
+            xv, _mm512_cvtph_ps(_mm256_loadu_si256((const __m256i *)(b1 + k))),
+            acc1);
+        acc2 = _mm512_fmadd_ps(
+            xv, _mm512_cvtph_ps(_mm256_loadu_si256((const __m256i *)(b2 + k))),
+            acc2);
+        acc3 = _mm512_fmadd_ps(
+            xv, _mm512_cvtph_ps(_mm256_loadu_si256((const __m256i *)(b3 + k))),
+            acc3);
+      }
+      float s0 = _mm512_reduce_add_ps(acc0), s1 = _mm512_reduce_add_ps(acc1);
+      float s2 = _mm512_reduce_add_ps(acc2), s3 = _mm512_reduce_add_ps(acc3);
+#else
+      __m256 acc0 = _mm256_setzero_ps(), acc1 = _mm256_setzero_ps();
+      __m256 acc2 = _mm256_setzero_ps(), acc3 = _mm256_setzero_ps();
+      for (; k + 32 <= K; k += 32) {
+        gemv_prefetch_rows(b0 + k, b1 + k, b2 + k, b3 + k, ahead);
+        for (int u = 0; u < 32; u += 8) {
+          __m256 xv = load_f16x8(x + k + u);
+          acc0 = _mm256_fmadd_ps(xv, load_f16x8(b0 + k + u), acc0);
+          acc1 = _mm256_fmadd_ps(xv, load_f16x8(b1 + k + u), acc1);
+          acc2 = _mm256_fmadd_ps(xv, load_f16x8(b2 + k + u), acc2);
+          acc3 = _mm256_fmadd_ps(xv, load_f16x8(b3 + k + u), acc3);
+        }
+      }
+      for (; k + 8 <= K; k += 8) {
+        __m256 xv = load_f16x8(x + k);
+        acc0 = _mm256_fmadd_ps(xv, load_f16x8(b0 + k), acc0);
+        acc1 = _mm256_fmadd_ps(xv, load_f16x8(b1 + k), acc1);
+        acc2 = _mm256_fmadd_ps(xv, load_f16x8(b2 + k), acc2);
+        acc3 = _mm256_fmadd_ps(xv, load_f16x8(b3 + k), acc3);
+      }
+      float s0 = hsum256_ps(acc0), s1 = hsum256_ps(acc1);
+      float s2 = hsum256_ps(acc2), s3 = hsum256_ps(acc3);
+#endif
+      for (; k < K; k++) {
+        float xk = f16_to_f32(x[k]);
+        s0 += xk * f16_to_f32(b0[k]);
+        s1 += xk * f16_to_f32(b1[k]);
+        s2 += xk * f16_to_f32(b2[k]);
+        s3 += xk * f16_to_f32(b3[k]);
+      }
+      y[j] = f32_to_f16(s0);
+      y[j + 1] = f32_to_f16(s1);
+      y[j + 2] = f32_to_f16(s2);
+      y[j + 3] = f32_to_f16(s3);
+    }
+    for (; j < N; j++) {
+      const uint16_t *b = p->B + (size_t)j * p->cs_b;
+      __m256 acc = _mm256_setzero_ps();
+      int k = 0;
+      for (; k + 8 <= K; k += 8)
+        acc = _mm256_fmadd_ps(load_f16x8(x + k), load_f16x8(b + k), acc);
+      float s = hsum256_ps(acc);
+      for (; k < K; k++)
+        s += f16_to_f32(x[k]) * f16_to_f32(b[k]);
+      y[j] = f32_to_f16(s);
+    }
+    return;
+  }
+
+  int j = 0;
+#if GEMM_X86_AVX512
+  for (; j + 64 <= N; j += 64) {
+    __m512 acc0 = _mm512_setzero_ps(), acc1 = _mm512_setzero_ps();
+    __m512 acc2 = _mm512_setzero_ps(), acc3 = _mm512_setzero_ps();
+    for (int k = 0; k < K; k++) {
+      const uint16_t *b = p->B + (size_t)k * p->rs_b + j;
+      __m512 xv = _mm512_set1_ps(f16_to_f32(x[k]));
+      acc0 = _mm512_fmadd_ps(
+          xv, _mm512_cvtph_ps(_mm256_loadu_si256((const __m256i *)b)), acc0);
+      acc1 = _mm512_fmadd_ps(
+          xv, _mm512_cvtph_ps(_mm256_loadu_si256((const __m256i *)(b + 16))),
+          acc1);
+      acc2 = _mm512_fmadd_ps(
+          xv, _mm512_cvtph_ps(_mm256_loadu_si256((const __m256i *)(b + 32))),
+          acc2);
+      acc3 = _mm512_fmadd_ps(
+          xv, _mm512_cvtph_ps(_mm256_loadu_si256((const __m256i *)(b + 48))),
+          acc3);
+    }
+    _mm256_storeu_si256((__m256i *)(y + j),
+                        _mm512_cvtps_ph(acc0, _MM_FROUND_TO_NEAREST_INT));
+    _mm256_storeu_si256((__m256i *)(y + j + 16),
+                        _mm512_cvtps_ph(acc1, _MM_FROUND_TO_NEAREST_INT));
+    _mm256_storeu_si256((__m256i *)(y + j + 32),
+                        _mm512_cvtps_ph(acc2, _MM_FROUND_TO_NEAREST_INT));
+    _mm256_storeu_si256((__m256i *)(y + j + 48),
+                        _mm512_cvtps_ph(acc3, _MM_FROUND_TO_NEAREST_INT));
+  }
+#endif
+  for (; j + 32 <= N; j += 32) {
+    __m256 acc0 = _mm256_setzero_ps(), acc1 = _mm256_setzero_ps();
+    __m256 acc2 = _mm256_setzero_ps(), acc3 = _mm256_setzero_ps();
+    for (int k = 0; k < K; k++) {
+      const uint16_t *b = p->B + (size_t)k * p->rs_b + j;
+      __m256 xv = _mm256_set1_ps(f16_to_f32(x[k]));
+      acc0 = _mm256_fmadd_ps(xv, load_f16x8(b), acc0);
+      acc1 = _mm256_fmadd_ps(xv, load_f16x8(b + 8), acc1);
+      acc2 = _mm256_fmadd_ps(xv, load_f16x8(b + 16), acc2);
+      acc3 = _mm256_fmadd_ps(xv, load_f16x8(b + 24), acc3);
+    }
+    store_f16x8(y + j, acc0);
+    store_f16x8(y + j + 8, acc1);
+    store_f16x8(y + j + 16, acc2);
+    store_f16x8(y + j + 24, acc3);
+  }
+  for (; j + 8 <= N; j += 8) {
+    __m256 acc = _mm256_setzero_ps();
+    for (int k = 0; k < K; k++)
+      acc = _mm256_fmadd_ps(_mm256_set1_ps(f16_to_f32(x[k])),
+                            load_f16x8(p->B + (size_t)k * p->rs_b + j), acc);
+    store_f16x8(y + j, acc);
+  }
+  for (; j < N; j++) {
+    float s = 0.0f;
+    for (int k = 0; k < K; k++)
+      s += f16_to_f32(x[k]) * f16_to_f32(p->B[(size_t)k * p->rs_b + j]);
+    y[j] = f32_to_f16(s);
+  }
+}
+
+/* Prepacked FP16 B: each k of a panel is NR consecutive weights that meet
+ * one broadcast element of x, so the weights are read strictly in address
+ * order. x is widened GEMM_KC elements at a time, and four k steps go to
+ * separate accumulators to cover the FMA latency. */
+/* Widen x[k0, k0 + kc) to FP32. */
+static inline void widen_x_f16(float *xf, const uint16_t *x, int kc) {
+  int t = 0;
+  for (; t + 8 <= kc; t += 8)
+    _mm256_store_ps(xf + t, load_f16x8(x + t));
+  for (; t < kc; t++)
+    xf[t] = f16_to_f32(x[t]);
+}
+
+static inline void store_panel_f16(uint16_t *y, const float *out, int nr) {
+  if (nr == GEMM_NR) {
+    store_f16x8(y, _mm256_load_ps(out));
+    store_f16x8(y + 8, _mm256_load_ps(out + 8));
+  } else {
+    for (int c = 0; c < nr; c++)
+      y[c] = f32_to_f16(out[c]);
+  }
+}
+
+#if GEMM_X86_AVX512
+#define PANEL_ROW(b, k)                                                        \
+  _mm512_cvtph_ps(_mm256_loadu_si256((const __m256i *)((b) + (k) * GEMM_NR)))
+#endif
+
+/* y = x * B for M == 1 with B in panels. Four panels are walked side by side
+ * so each broadcast of x feeds four FMAs and the loads form four streams;
+ * a single panel stream does not keep enough misses in flight. */
+static void gemv_f16_packed_avx2(const gemm_f16_problem_t *p) {
+  float xf[GEMM_KC] __attribute__((aligned(32)));
+  float out[4 * GEMM_NR] __attribute__((aligned(64)));
+  const uint16_t *x = p->A;
+  const int N = p->N, K = p->K;
+  const size_t ps = (size_t)K * GEMM_NR;
+  uint16_t *y = p->C;
+  int j = 0;
+
+  for (; j + 4 * GEMM_NR <= N; j += 4 * GEMM_NR) {
+    const uint16_t *b0 = p->B + (size_t)(j / GEMM_NR) * ps;
+    const uint16_t *b1 = b0 + ps, *b2 = b1 + ps, *b3 = b2 + ps;
+#if GEMM_X86_AVX512
+    __m512 c0 = _mm512_setzero_ps(), c1 = _mm512_setzero_ps();
+    __m512 c2 = _mm512_setzero_ps(), c3 = _mm512_setzero_ps();
+    __m512 d0 = _mm512_setzero_ps(), d1 = _mm512_setzero_ps();
+    __m512 d2 = _mm512_setzero_ps(), d3 = _mm512_setzero_ps();
+#else
+    __m256 c0 = _mm256_setzero_ps(), c1 = _mm256_setzero_ps();
+    __m256 c2 = _mm256_setzero_ps(), c3 = _mm256_setzero_ps();
+    __m256 d0 = _mm256_setzero_ps(), d1 = _mm256_setzero_ps();
+    __m256 d2 = _mm256_setzero_ps(), d3 = _mm256_setzero_ps();
+#endif
+
+    for (int k0 = 0; k0 < K; k0 += GEMM_KC) {
+      int kc = imin(GEMM_KC, K - k0);
+      widen_x_f16(xf, x + k0, kc);
+      const size_t o = (size_t)k0 * GEMM_NR;
+      const uint16_t *p0 = b0 + o, *p1 = b1 + o, *p2 = b2 + o, *p3 = b3 + o;
+      int k = 0;
+#if GEMM_X86_AVX512
+      for (; k + 2 <= kc; k += 2) {
+        __m512 xa = _mm512_set1_ps(xf[k]), xb = _mm512_set1_ps(xf[k + 1]);
+        c0 = _mm512_fmadd_ps(xa, PANEL_ROW(p0, k), c0);
+        c1 = _mm512_fmadd_ps(xa, PANEL_ROW(p1, k), c1);
+        c2 = _mm512_fmadd_ps(xa, PANEL_ROW(p2, k), c2);
+        c3 = _mm512_fmadd_ps(xa, PANEL_ROW(p3, k), c3);
+        d0 = _mm512_fmadd_ps(xb, PANEL_ROW(p0, k + 1), d0);
+        d1 = _mm512_fmadd_ps(xb, PANEL_ROW(p1, k + 1), d1);
+        d2 = _mm512_fmadd_ps(xb, PANEL_ROW(p2, k + 1), d2);
+        d3 = _mm512_fmadd_ps(xb, PANEL_ROW(p3, k + 1), d3);
+      }
+      for (; k < kc; k++) {
+        __m512 xa = _mm512_set1_ps(xf[k]);
+        c0 = _mm512_fmadd_ps(xa, PANEL_ROW(p0, k), c0);
+        c1 = _mm512_fmadd_ps(xa, PANEL_ROW(p1, k), c1);
+        c2 = _mm512_fmadd_ps(xa, PANEL_ROW(p2, k), c2);
+        c3 = _mm512_fmadd_ps(xa, PANEL_ROW(p3, k), c3);
+      }
+#else
+      for (; k < kc; k++) {
+        __m256 xa = _mm256_broadcast_ss(xf + k);
+        const size_t r = (size_t)k * GEMM_NR;
+        c0 = _mm256_fmadd_ps(xa, load_f16x8(p0 + r), c0);
+        d0 = _mm256_fmadd_ps(xa, load_f16x8(p0 + r + 8), d0);
+        c1 = _mm256_fmadd_ps(xa, load_f16x8(p1 + r), c1);
+        d1 = _mm256_fmadd_ps(xa, load_f16x8(p1 + r + 8), d1);
+        c2 = _mm256_fmadd_ps(xa, load_f16x8(p2 + r), c2);
+        d2 = _mm256_fmadd_ps(xa, load_f16x8(p2 + r + 8), d2);
+        c3 = _mm256_fmadd_ps(xa, load_f16x8(p3 + r), c3);
+        d3 = _mm256_fmadd_ps(xa, load_f16x8(p3 + r + 8), d3);
+      }
+#endif
+    }
+
+#if GEMM_X86_AVX512
+    _mm512_store_ps(out, _mm512_add_ps(c0, d0));
+    _mm512_store_ps(out + GEMM_NR, _mm512_add_ps(c1, d1));
+    _mm512_store_ps(out + 2 * GEMM_NR, _mm512_add_ps(c2, d2));
+    _mm512_store_ps(out + 3 * GEMM_NR, _mm512_add_ps(c3, d3));
+#else
+    _mm256_store_ps(out, c0);
+    _mm256_store_ps(out + 8, d0);
+    _mm256_store_ps(out + GEMM_NR, c1);
+    _mm256_store_ps(out + GEMM_NR + 8, d1);
+    _mm256_store_ps(out + 2 * GEMM_NR, c2);
+    _mm256_store_ps(out + 2 * GEMM_NR + 8, d2);
+    _mm256_store_ps(out + 3 * GEMM_NR, c3);
+    _mm256_store_ps(out + 3 * GEMM_NR + 8, d3);
+#endif
+    for (int q = 0; q < 4; q++)
+      store_panel_f16(y + j + q * GEMM_NR, out + q * GEMM_NR, GEMM_NR);
+  }
+
+  /* Remaining panels, one at a time. */
+  for (; j < N; j += GEMM_NR) {
+    const uint16_t *b0 = p->B + (size_t)(j / GEMM_NR) * ps;
+#if GEMM_X86_AVX512
+    __m512 c0 = _mm512_setzero_ps(), d0 = _mm512_setzero_ps();
+#else
+    __m256 c0 = _mm256_setzero_ps(), d0 = _mm256_setzero_ps();
+#endif
+    for (int k0 = 0; k0 < K; k0 += GEMM_KC) {
+      int kc = imin(GEMM_KC, K - k0);
+      widen_x_f16(xf, x + k0, kc);
+      const uint16_t *p0 = b0 + (size_t)k0 * GEMM_NR;
+      for (int k = 0; k < kc; k++) {
+#if GEMM_X86_AVX512
+        c0 = _mm512_fmadd_ps(_mm512_set1_ps(xf[k]), PANEL_ROW(p0, k), c0);
+#else
+        __m256 xa = _mm256_broadcast_ss(xf + k);
+        c0 = _mm256_fmadd_ps(xa, load_f16x8(p0 + (size_t)k * GEMM_NR), c0);
+        d0 = _mm256_fmadd_ps(xa, load_f16x8(p0 + (size_t)k * GEMM_NR + 8),
+                             d0);
+#endif
+      }
+    }
+#if GEMM_X86_AVX512
+    _mm512_store_ps(out, _mm512_add_ps(c0, d0));
+#else
+    _mm256_store_ps(out, c0);
+    _mm256_store_ps(out + 8, d0);
+#endif
+    store_panel_f16(y + j, out, imin(GEMM_NR, N - j));
+  }
+}
+
+#if GEMM_X86_AVX512
+#undef PANEL_ROW
+#endif
+
+static inline __m256 load_a_x8(const void *x, bool f16, int k) {
+  return f16 ? load_f16x8((const uint16_t *)x + k)
+             : _mm256_loadu_ps((const float *)x + k);
+}
+
+static inline float load_a_x1(const void *x, bool f16, int k) {
+  return f16 ? f16_to_f32(((const uint16_t *)x)[k]) : ((const float *)x)[k];
+}
+
+static inline void store_c_x1(void *y, bool f16, int j, float v) {
+  if (f16)
+    ((uint16_t *)y)[j] = f32_to_f16(v);
+  else
+    ((float *)y)[j] = v;
+}
+
+/* The INT8 single-row path rounds x to int16 once, with one scale per
+ * GEMM_Q8_XBLOCK elements, so that sixteen weights at a time go through
+ * madd_epi16 instead of being converted to FP32. A block's int32 sums stay
+ * below 2^31 (256 * 127 * 32767), and the int16 rounding of x is far below
+ * the INT8 rounding of the weights. */
+#define GEMM_Q8_XBLOCK 256
+#define GEMM_QW_GEMV_MAX_K 32768
+
+static inline float hmax256_ps(__m256 v) {
+  __m128 m = _mm_max_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+  m = _mm_max_ps(m, _mm_movehl_ps(m, m));
+  m = _mm_max_ss(m, _mm_movehdup_ps(m));
+  return _mm_cvtss_f32(m);
+}
+
+/* Rounds x to int16 with one scale per block elements; xsum, when given,
+ * receives the sum of each block of x. */
+static void quantize_x_s16(int16_t *xq, float *xs, float *xsum, const void *x,
+                           bool f16, int K, int block) {
+  const __m256 sign = _mm256_set1_ps(-0.0f);
+  for (int k0 = 0; k0 < K; k0 += block) {
+    int n = imin(block, K - k0);
+    __m256 mx = _mm256_setzero_ps();
+    __m256 sv = _mm256_setzero_ps();
+    int k = 0;
+    for (; k + 8 <= n; k += 8) {
+      __m256 v = load_a_x8(x, f16, k0 + k);
+      mx = _mm256_max_ps(mx, _mm256_andnot_ps(sign, v));
+      sv = _mm256_add_ps(sv, v);
+    }
+    float absmax = hmax256_ps(mx);
+    float sum = hsum256_ps(sv);
+    for (; k < n; k++) {
+      float v = load_a_x1(x, f16, k0 + k);
+      absmax = fmaxf(absmax, fabsf(v));
+      sum += v;
+    }
+    if (xsum)
+      xsum[k0 / block] = sum;
+
+    float inv = absmax > 0.0f ? 32767.0f / absmax : 0.0f;
+    __m256 iv = _mm256_set1_ps(inv);
+    for (k = 0; k + 16 <= n; k += 16) {
+      __m256i lo =
+          _mm256_cvtps_epi32(_mm256_mul_ps(load_a_x8(x, f16, k0 + k), iv));
+      __m256i hi =
+          _mm256_cvtps_epi32(_mm256_mul_ps(load_a_x8(x, f16, k0 + k + 8), iv));
+      /* packs works per 128-bit lane; put the quarters back in order. */
+      __m256i q = _mm256_permute4x64_epi64(_mm256_packs_epi32(lo, hi), 0xD8);
+      _mm256_storeu_si256((__m256i *)(xq + k0 + k), q);
+    }
+    for (; k < n; k++)
+      xq[k0 + k] = (int16_t)lrintf(load_a_x1(x, f16, k0 + k) * inv);
+    xs[k0 / block] = absmax / 32767.0f;
+  }
+}
+
+static inline __m256i madd_q8x16(__m256i acc, __m256i xv, const int8_t *b) {
+  __m256i w = _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i *)b));
+  return _mm256_add_epi32(acc, _mm256_madd_epi16(xv, w));
+}
+
+static void gemv_q8_avx2(const gemm_qw_problem_t *p) {
+  int16_t xq[GEMM_QW_GEMV_MAX_K];
+  float xs[GEMM_QW_GEMV_MAX_K / GEMM_Q8_XBLOCK];
+  const int N = p->N, K = p->K;
+  const int kq = K & ~15;
+  const size_t ldb = p->ldb;
+  size_t ahead = 4 * ldb;
+
+  quantize_x_s16(xq, xs, NULL, p->A, p->a_f16, K, GEMM_Q8_XBLOCK);
+
+  int j = 0;
+  for (; j + 4 <= N; j += 4) {
+    const int8_t *b0 = (const int8_t *)p->B + (size_t)j * ldb;
+    const int8_t *b1 = b0 + ldb;
+    const int8_t *b2 = b1 + ldb;
+    const int8_t *b3 = b2 + ldb;
+    __m256 acc0 = _mm256_setzero_ps(), acc1 = _mm256_setzero_ps();
+    __m256 acc2 = _mm256_setzero_ps(), acc3 = _mm256_setzero_ps();
+    for (int k0 = 0; k0 < kq; k0 += GEMM_Q8_XBLOCK) {
+      int end = imin(k0 + GEMM_Q8_XBLOCK, kq);
+      __m256i i0 = _mm256_setzero_si256(), i1 = _mm256_setzero_si256();
+      __m256i i2 = _mm256_setzero_si256(), i3 = _mm256_setzero_si256();
+      int k = k0;
+      for (; k + 64 <= end; k += 64) {
+        gemv_prefetch_rows(b0 + k, b1 + k, b2 + k, b3 + k, ahead);
+        for (int u = 0; u < 64; u += 16) {
+          __m256i xv = _mm256_loadu_si256((const __m256i *)(xq + k + u));
+          i0 = madd_q8x16(i0, xv, b0 + k + u);
+          i1 = madd_q8x16(i1, xv, b1 + k + u);
+          i2 = madd_q8x16(i2, xv, b2 + k + u);
+          i3 = madd_q8x16(i3, xv, b3 + k + u);
+        }
+      }
+      for (; k < end; k += 16) {
+        __m256i xv = _mm256_loadu_si256((const __m256i *)(xq + k));
+        i0 = madd_q8x16(i0, xv, b0 + k);
+        i1 = madd_q8x16(i1, xv, b1 + k);
+        i2 = madd_q8x16(i2, xv, b2 + k);
+        i3 = madd_q8x16(i3, xv, b3 + k);
+      }
+      __m256 s = _mm256_set1_ps(xs[k0 / GEMM_Q8_XBLOCK]);
+      acc0 = _mm256_fmadd_ps(_mm256_cvtepi32_ps(i0), s, acc0);
+      acc1 = _mm256_fmadd_ps(_mm256_cvtepi32_ps(i1), s, acc1);
+      acc2 = _mm256_fmadd_ps(_mm256_cvtepi32_ps(i2), s, acc2);
+      acc3 = _mm256_fmadd_ps(_mm256_cvtepi32_ps(i3), s, acc3);
+    }
+    float s0 = hsum256_ps(acc0), s1 = hsum256_ps(acc1);
+    float s2 = hsum256_ps(acc2), s3 = hsum256_ps(acc3);
+    for (int k = kq; k < K; k++) {
+      float xk = load_a_x1(p->A, p->a_f16, k);
+      s0 += xk * b0[k];
+      s1 += xk * b1[k];
+      s2 += xk * b2[k];
+      s3 += xk * b3[k];
+    }
+    store_c_x1(p->C, p->a_f16, j, s0 * p->scales[j]);
+    store_c_x1(p->C, p->a_f16, j + 1, s1 * p->scales[j + 1]);
+    store_c_x1(p->C, p->a_f16, j + 2, s2 * p->scales[j + 2]);
+    store_c_x1(p->C, p->a_f16, j + 3, s3 * p->scales[j + 3]);
+  }
+  for (; j < N; j++) {
+    const int8_t *b = (const int8_t *)p->B + (size_t)j * ldb;
+    __m256 acc = _mm256_setzero_ps();
+    for (int k0 = 0; k0 < kq; k0 += GEMM_Q8_XBLOCK) {
+      int end = imin(k0 + GEMM_Q8_XBLOCK, kq);
+      __m256i i0 = _mm256_setzero_si256();
+      for (int k = k0; k < end; k += 16)
+        i0 = madd_q8x16(i0, _mm256_loadu_si256((const __m256i *)(xq + k)),
+                        b + k);
+      acc = _mm256_fmadd_ps(_mm256_cvtepi32_ps(i0),
+                            _mm256_set1_ps(xs[k0 / GEMM_Q8_XBLOCK]), acc);
+    }
+    float s = hsum256_ps(acc);
+    for (int k = kq; k < K; k++)
+      s += load_a_x1(p->A, p->a_f16, k) * b[k];
+    store_c_x1(p->C, p->a_f16, j, s * p->scales[j]);
+  }
+}
+
+/* Q4 single-row path on the same int16 copy of x, scaled per group. Each
+ * group's nibbles widen to int16 in one shuffle and meet x in two madds.
+ * d and m sit next to each other, so one conversion yields both; lane 1 of
+ * the small accumulator collects the group minimums' m * sum(x). */
+static inline __m256 q4_group_dot(__m256 acc, __m128 *macc,
+                                  const gemm_q4_block_t *b, __m256i xl,
+                                  __m256i xh, __m128 xs_sum) {
+  int32_t dm_bits;
+  memcpy(&dm_bits, &b->d, sizeof(dm_bits));
+  __m128 dm = _mm_mul_ps(_mm_cvtph_ps(_mm_cvtsi32_si128(dm_bits)), xs_sum);
+  *macc = _mm_add_ps(*macc, dm);
+
+  __m256i w = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)b->qs));
+  __m256i lo = _mm256_and_si256(w, _mm256_set1_epi16(15));
+  __m256i hi = _mm256_srli_epi16(w, 4);
+  __m256i dot = _mm256_add_epi32(_mm256_madd_epi16(lo, xl),
+                                 _mm256_madd_epi16(hi, xh));
+  return _mm256_fmadd_ps(_mm256_cvtepi32_ps(dot), _mm256_broadcastss_ps(dm),
+                         acc);
+}
+
+static inline float q4_row_result(__m256 acc, __m128 macc) {
+  return hsum256_ps(acc) + _mm_cvtss_f32(_mm_movehdup_ps(macc));
+}
+
+static void gemv_q4_avx2(const gemm_qw_problem_t *p) {
+  int16_t xq[GEMM_QW_GEMV_MAX_K];
+  float xs[GEMM_QW_GEMV_MAX_K / GEMM_Q4_GROUP];
+  float xsum[GEMM_QW_GEMV_MAX_K / GEMM_Q4_GROUP];
+  const int N = p->N, G = p->K / GEMM_Q4_GROUP;
+  const size_t ldb = p->ldb;
+  size_t ahead = 4 * ldb;
+
+  quantize_x_s16(xq, xs, xsum, p->A, p->a_f16, p->K, GEMM_Q4_GROUP);
+
+  int j = 0;
+  for (; j + 4 <= N; j += 4) {
+    const char *row = (const char *)p->B + (size_t)j * ldb;
+    const gemm_q4_block_t *b0 = (const gemm_q4_block_t *)row;
+    const gemm_q4_block_t *b1 = (const gemm_q4_block_t *)(row + ldb);
+    const gemm_q4_block_t *b2 = (const gemm_q4_block_t *)(row + 2 * ldb);
+    const gemm_q4_block_t *b3 = (const gemm_q4_block_t *)(row + 3 * ldb);
+    __m256 acc0 = _mm256_setzero_ps(), acc1 = _mm256_setzero_ps();
+    __m256 acc2 = _mm256_setzero_ps(), acc3 = _mm256_setzero_ps();
+    __m128 m0 = _mm_setzero_ps(), m1 = _mm_setzero_ps();
+    __m128 m2 = _mm_setzero_ps(), m3 = _mm_setzero_ps();
+    for (int g = 0; g < G; g++) {
+      gemv_prefetch_rows(b0 + g, b1 + g, b2 + g, b3 + g, ahead);
+      const int16_t *xg = xq + g * GEMM_Q4_GROUP;
+      __m256i xl = _mm256_loadu_si256((const __m256i *)xg);
+      __m256i xh = _mm256_loadu_si256((const __m256i *)(xg + 16));
+      __m128 xv = _mm_setr_ps(xs[g], xsum[g], 0.0f, 0.0f);
+      acc0 = q4_group_dot(acc0, &m0, b0 + g, xl, xh, xv);
+      acc1 = q4_group_dot(acc1, &m1, b1 + g, xl, xh, xv);
+      acc2 = q4_group_dot(acc2, &m2, b2 + g, xl, xh, xv);
+      acc3 = q4_group_dot(acc3, &m3, b3 + g, xl, xh, xv);
+    }
+    store_c_x1(p->C, p->a_f16, j, q4_row_result(acc0, m0));
+    store_c_x1(p->C, p->a_f16, j + 1, q4_row_result(acc1, m1));
+    store_c_x1(p->C, p->a_f16, j + 2, q4_row_result(acc2, m2));
+    store_c_x1(p->C, p->a_f16, j + 3, q4_row_result(acc3, m3));
+  }
+  for (; j < N; j++) {
+    const gemm_q4_block_t *b =
+        (const gemm_q4_block_t *)((const char *)p->B + (size_t)j * ldb);
+    __m256 acc = _mm256_setzero_ps();
+    __m128 m = _mm_setzero_ps();
+    for (int g = 0; g < G; g++) {
+      const int16_t *xg = xq + g * GEMM_Q4_GROUP;
+      acc = q4_group_dot(acc, &m, b + g,
+                         _mm256_loadu_si256((const __m256i *)xg),
+                         _mm256_loadu_si256((const __m256i *)(xg + 16)),
+                         _mm_setr_ps(xs[g], xsum[g], 0.0f, 0.0f));
+    }
+    store_c_x1(p->C, p->a_f16, j, q4_row_result(acc, m));
+  }
+}
+
+/* ============ Blocked driver ============ */
+
+static size_t pack_a_floats(void) { return (size_t)GEMM_MC * GEMM_KC; }
+
+static size_t pack_b_floats(int N) {
+  int nc = imin(N, GEMM_NC);
+  int panels = (nc + GEMM_NR - 1) / GEMM_NR;
+  return (size_t)panels * GEMM_NR * GEMM_KC;
+}
+
+static void gemm_f32_blocked_avx2(const gemm_f32_problem_t *p, float *pa,
+                                  float *pb) {
+  const int M = p->M, N = p->N, K = p->K;
+
+  for (int jc = 0; jc < N; jc += GEMM_NC) {
+    int nc = imin(GEMM_NC, N - jc);
+
+    for (int pc = 0; pc < K; pc += GEMM_KC) {
+      int kc = imin(GEMM_KC, K - pc);
+      bool accumulate = pc > 0;
+
+      pack_b_f32(p->B + (size_t)pc * p->rs_b + (size_t)jc * p->cs_b, p->rs_b,
+                 p->cs_b, kc, nc, pb);
+
+      for (int ic = 0; ic < M; ic += GEMM_MC) {
+        int mc = imin(GEMM_MC, M - ic);
+
+        pack_a_f32(p->A + (size_t)ic * p->rs_a + (size_t)pc * p->cs_a, p->rs_a,
+                   p->cs_a, mc, kc, pa);
+
+        for (int jr = 0; jr < nc; jr += GEMM_NR) {
+          const float *pb_panel = pb + (size_t)(jr / GEMM_NR) * kc * GEMM_NR;
+          for (int ir = 0; ir < mc; ir += GEMM_MR) {
+            const float *pa_panel = pa + (size_t)(ir / GEMM_MR) * kc * GEMM_MR;
+            float *c = p->C + (size_t)(ic + ir) * p->ldc + jc + jr;
+            micro_kernel_6x16_avx2(kc, pa_panel, pb_panel, c, p->ldc,
+                                   imin(GEMM_MR, mc - ir),
+                                   imin(GEMM_NR, nc - jr), accumulate);
+          }
+        }
+      }
+    }
+  }
+}
+
+/* Narrow an m x n FP32 block to FP16. */
+static void store_block_f16(uint16_t *dst, size_t ldd, const float *src,
+                            size_t lds, int m, int n) {
+  for (int i = 0; i < m; i++) {
+    uint16_t *d = dst + (size_t)i * ldd;
+    const float *s = src + (size_t)i * lds;
+    int j = 0;
+    for (; j + 8 <= n; j += 8)
+      store_f16x8(d + j, _mm256_loadu_ps(s + j));
+    for (; j < n; j++)
+      d[j] = f32_to_f16(s[j]);
+  }
+}
+
+/* FP16 blocked GEMM. C is accumulated in an FP32 M x NC scratch (cbuf) across
+ * the K blocks and narrowed once the last K block of a row band is done. */
+static void gemm_f16_blocked_avx2(const gemm_f16_problem_t *p, float *pa,
+                                  float *pb, float *cbuf) {
+  const int M = p->M, N = p->N, K = p->K;
+  const size_t ldcb = (size_t)imin(N, GEMM_NC);
+
+  for (int jc = 0; jc < N; jc += GEMM_NC) {
+    int nc = imin(GEMM_NC, N - jc);
+
+    for (int pc = 0; pc < K; pc += GEMM_KC) {
+      int kc = imin(GEMM_KC, K - pc);
+      bool accumulate = pc > 0;
+      bool last = pc + kc >= K;
+
+      if (p->b_packed)
+        widen_b_panels_f16(p->B + ((size_t)jc * K + (size_t)pc * GEMM_NR),
+                           (size_t)K * GEMM_NR, kc, nc, pb);
+      else
+        pack_b_f16(p->B + (size_t)pc * p->rs_b + (size_t)jc * p->cs_b,
+                   p->rs_b, p->cs_b, kc, nc, pb);
+
+      for (int ic = 0; ic < M; ic += GEMM_MC) {
+        int mc = imin(GEMM_MC, M - ic);
+
+        pack_a_f16(p->A + (size_t)ic * p->rs_a + (size_t)pc * p->cs_a, p->rs_a,
+                   p->cs_a, mc, kc, pa);
+
+        for (int jr = 0; jr < nc; jr += GEMM_NR) {
+          const float *pb_panel = pb + (size_t)(jr / GEMM_NR) * kc * GEMM_NR;
+          for (int ir = 0; ir < mc; ir += GEMM_MR) {
+            const float *pa_panel = pa + (size_t)(ir / GEMM_MR) * kc * GEMM_MR;
+            float *c = cbuf + (size_t)(ic + ir) * ldcb + jr;
+            micro_kernel_6x16_avx2(kc, pa_panel, pb_panel, c, ldcb,
+                                   imin(GEMM_MR, mc - ir),
+                                   imin(GEMM_NR, nc - jr), accumulate);
+          }
+        }
+
+        if (last)
+          store_block_f16(p->C + (size_t)ic * p->ldc + jc, p->ldc,
+                          cbuf + (size_t)ic * ldcb, ldcb, mc, nc);
+      }
+    }
+  }
+}
+
+/* INT8 blocked GEMM. FP32 results accumulate in C itself; FP16 ones go
+ * through cbuf as in the FP16 driver. */
+static void gemm_qw_blocked_avx2(const gemm_qw_problem_t *p, float *pa,
+                                 float *pb, float *cbuf) {
+  const int M = p->M, N = p->N, K = p->K;
+  const size_t ldcb = p->a_f16 ? (size_t)imin(N, GEMM_NC) : p->ldc;
+
+  for (int jc = 0; jc < N; jc += GEMM_NC) {
+    int nc = imin(GEMM_NC, N - jc);
+
+    for (int pc = 0; pc < K; pc += GEMM_KC) {
+      int kc = imin(GEMM_KC, K - pc);
+      bool accumulate = pc > 0;
+      bool last = pc + kc >= K;
+
+      if (p->q4)
+        pack_b_q4((const char *)p->B + (size_t)jc * p->ldb +
+                      (size_t)(pc / GEMM_Q4_GROUP) * sizeof(gemm_q4_block_t),
+                  p->ldb, kc, nc, pb);
+      else
+        pack_b_q8((const int8_t *)p->B + (size_t)jc * p->ldb + pc, p->ldb,
+                  p->scales + jc, kc, nc, pb);
+
+      for (int ic = 0; ic < M; ic += GEMM_MC) {
+        int mc = imin(GEMM_MC, M - ic);
+        size_t a_off = (size_t)ic * p->lda + pc;
+        float *cb;
+
+        if (p->a_f16) {
+          pack_a_f16((const uint16_t *)p->A + a_off, p->lda, 1, mc, kc, pa);
+          cb = cbuf + (size_t)ic * ldcb;
+        } else {
+          pack_a_f32((const float *)p->A + a_off, p->lda, 1, mc, kc, pa);
+          cb = (float *)p->C + (size_t)ic * p->ldc + jc;
+        }
+
+        for (int jr = 0; jr < nc; jr += GEMM_NR) {
+          const float *pb_panel = pb + (size_t)(jr / GEMM_NR) * kc * GEMM_NR;
+          for (int ir = 0; ir < mc; ir += GEMM_MR) {
+            const float *pa_panel = pa + (size_t)(ir / GEMM_MR) * kc * GEMM_MR;
+            micro_kernel_6x16_avx2(kc, pa_panel, pb_panel,
+                                   cb + (size_t)ir * ldcb + jr, ldcb,
+                                   imin(GEMM_MR, mc - ir),
+                                   imin(GEMM_NR, nc - jr), accumulate);
+          }
+        }
+
+        if (last && p->a_f16)
+          store_block_f16((uint16_t *)p->C + (size_t)ic * p->ldc + jc, p->ldc,
+                          cb, ldcb, mc, nc);
+      }
+    }
+  }
+}
+
+/* Scalar versions of the three drivers for when the pack buffers cannot be
+ * allocated. They need no scratch, so C is still written, only slowly. */
+static void gemm_f32_scalar(const gemm_f32_problem_t *p) {
+  for (int i = 0; i < p->M; i++) {
+    for (int j = 0; j < p->N; j++) {
+      float sum = 0.0f;
+      for (int k = 0; k < p->K; k++)
+        sum += p->A[(size_t)i * p->rs_a + (size_t)k * p->cs_a] *
+               p->B[(size_t)k * p->rs_b + (size_t)j * p->cs_b];
+      p->C[(size_t)i * p->ldc + j] = sum;
+    }
+  }
+}
+
+static void gemm_f16_scalar(const gemm_f16_problem_t *p) {
+  for (int i = 0; i < p->M; i++) {
+    for (int j = 0; j < p->N; j++) {
+      float sum = 0.0f;
+      for (int k = 0; k < p->K; k++) {
+        size_t b = p->b_packed ? (size_t)(j / GEMM_NR) * p->K * GEMM_NR +
+                                     (size_t)k * GEMM_NR + j % GEMM_NR
+                               : (size_t)k * p->rs_b + (size_t)j * p->cs_b;
+        sum += f16_to_f32(p->A[(size_t)i * p->rs_a + (size_t)k * p->cs_a]) *
+               f16_to_f32(p->B[b]);
+      }
+      p->C[(size_t)i * p->ldc + j] = f32_to_f16(sum);
+    }
+  }
+}
+
+static void gemm_qw_scalar(const gemm_qw_problem_t *p) {
+  size_t elem = p->a_f16 ? sizeof(uint16_t) : sizeof(float);
+  for (int i = 0; i < p->M; i++) {
+    const char *a = (const char *)p->A + (size_t)i * p->lda * elem;
+    char *c = (char *)p->C + (size_t)i * p->ldc * elem;
+    for (int j = 0; j < p->N; j++) {
+      const char *b = (const char *)p->B + (size_t)j * p->ldb;
+      float sum = 0.0f;
+      for (int k = 0; k < p->K; k++) {
+        float w = p->q4 ? dequant_q4((const gemm_q4_block_t *)b, k)
+                        : (float)((const int8_t *)b)[k];
+        sum += load_a_x1(a, p->a_f16, k) * w;
+      }
+      store_c_x1(c, p->a_f16, j, p->q4 ? sum : sum * p->scales[j]);
+    }
+  }
+}
+
+static void gemm_f32_run_avx2(const gemm_f32_problem_t *p) {
+  if (p->M == 1) {
+    gemv_f32_avx2(p);
+    return;
+  }
+
+  float *pa = (float *)_mm_malloc(pack_a_floats() * sizeof(float), 64);
+  float *pb = (float *)_mm_malloc(pack_b_floats(p->N) * sizeof(float), 64);
+  if (pa && pb)
+    gemm_f32_blocked_avx2(p, pa, pb);
+  else
+    gemm_f32_scalar(p);
+
+  _mm_free(pa);
+  _mm_free(pb);
+}
+
+static void gemm_f16_run_avx2(const gemm_f16_problem_t *p) {
+  if (p->M == 1) {
+    if (p->b_packed)
+      gemv_f16_packed_avx2(p);
+    else
+      gemv_f16_avx2(p);
+    return;
+  }
+
+  size_t cbuf_floats = (size_t)p->M * imin(p->N, GEMM_NC);
+  float *pa = (float *)_mm_malloc(pack_a_floats() * sizeof(float), 64);
+  float *pb = (float *)_mm_malloc(pack_b_floats(p->N) * sizeof(float), 64);
+  float *cbuf = (float *)_mm_malloc(cbuf_floats * sizeof(float), 64);
+  if (pa && pb && cbuf)
+    gemm_f16_blocked_avx2(p, pa, pb, cbuf);
+  else
+    gemm_f16_scalar(p);
+
+  _mm_free(pa);
+  _mm_free(pb);
+  _mm_free(cbuf);
+}
+
+static void gemm_qw_run_avx2(const gemm_qw_problem_t *p) {
+  if (p->M == 1 && p->K <= GEMM_QW_GEMV_MAX_K) {
+    if (p->q4)
+      gemv_q4_avx2(p);
+    else
+      gemv_q8_avx2(p);
+    return;
+  }
+
+  size_t cbuf_floats = p->a_f16 ? (size_t)p->M * imin(p->N, GEMM_NC) : 1;
+  float *pa = (float *)_mm_malloc(pack_a_floats() * sizeof(float), 64);
+  float *pb = (float *)_mm_malloc(pack_b_floats(p->N) * sizeof(float), 64);
+  float *cbuf = (float *)_mm_malloc(cbuf_floats * sizeof(float), 64);
+  if (pa && pb && cbuf)
+    gemm_qw_blocked_avx2(p, pa, pb, cbuf);
+  else
+    gemm_qw_scalar(p);
+
+  _mm_free(pa);
+  _mm_free(pb);
+  _mm_free(cbuf);
+}
+
+static void gemm_f32_problem_init(gemm_f32_problem_t *p, const float *A,
+                                  const float *B, float *C, int M, int N, int K,
+                                  bool transpose_A, bool transpose_B) {
+  p->A = A;
+  p->rs_a = transpose_A ? 1 : (size_t)K;
+  p->cs_a = transpose_A ? (size_t)M : 1;
+  p->B = B;
+  p->rs_b = transpose_B ? 1 : (size_t)N;
+  p->cs_b = transpose_B ? (size_t)K : 1;
+  p->C = C;
+  p->ldc = (size_t)N;
+  p->M = M;
+  p->N = N;
+  p->K = K;
+}
+
+static void gemm_f16_problem_init(gemm_f16_problem_t *p, const uint16_t *A,
+                                  const uint16_t *B, uint16_t *C, int M, int N,
+                                  int K, bool transpose_A, bool transpose_B) {
+  p->A = A;
+  p->rs_a = transpose_A ? 1 : (size_t)K;
+  p->cs_a = transpose_A ? (size_t)M : 1;
+  p->B = B;
+  p->rs_b = transpose_B ? 1 : (size_t)N;
+  p->cs_b = transpose_B ? (size_t)K : 1;
+  p->C = C;
+  p->ldc = (size_t)N;
+  p->M = M;
+  p->N = N;
+  p->K = K;
+  p->b_packed = false;
+}
+
+void gemm_f32_kernel_avx2(const float *A, const float *B, float *C, int M,
+                          int N, int K, bool transpose_A, bool transpose_B) {
+  gemm_f32_problem_t p;
+  gemm_f32_problem_init(&p, A, B, C, M, N, K, transpose_A, transpose_B);
+  gemm_f32_run_avx2(&p);
+}
+
+void gemm_f16_kernel_avx2(const uint16_t *A, const uint16_t *B, uint16_t *C,
+                          int M, int N, int K, bool transpose_A,
+                          bool transpose_B) {
+  gemm_f16_problem_t p;
+  gemm_f16_problem_init(&p, A, B, C, M, N, K, transpose_A, transpose_B);
+  gemm_f16_run_avx2(&p);
+}
+
+/* ============ Multi-threaded driver ============ */
+
+/* Choose a tm x tn grid of C tiles for num_threads workers. Splitting N keeps
+ * each thread's packed B disjoint; splitting M re-packs B once per row band,
+ * so the cost model charges packing traffic alongside the FMA work. */
+static void gemm_partition(int M, int N, int num_threads, int *out_tm,
+                           int *out_tn) {
+  int best_tm = 1, best_tn = 1;
+  double best_cost = -1.0;
+
+  for (int tm = 1; tm <= num_threads; tm++) {
+    int tn = num_threads / tm;
+    int rows = (M + tm - 1) / tm;
+    int cols = (N + tn - 1) / tn;
+    if (tm > 1 && rows < GEMM_MR)
+      break;
+    if (tn > 1 && cols < GEMM_NR)
+      continue;
+    rows = (rows + GEMM_MR - 1) / GEMM_MR * GEMM_MR;
+    cols = (cols + GEMM_NR - 1) / GEMM_NR * GEMM_NR;
+    double cost = (double)rows * cols + 8.0 * ((double)rows + cols);
+    if (best_cost < 0.0 || cost < best_cost) {
+      best_cost = cost;
+      best_tm = tm;
+      best_tn = tn;
+    }
+  }
+
+  *out_tm = best_tm;
+  *out_tn = best_tn;
+}
+
+/* Runs one C tile [m0, m0 + m) x [n0, n0 + n) of the problem behind ctx. */
+typedef void (*gemm_tile_fn)(void *ctx, int m0, int m, int n0, int n);
+
+static void gemm_f32_tile(void *ctx, int m0, int m, int n0, int n) {
+  const gemm_f32_problem_t *p = (const gemm_f32_problem_t *)ctx;
+  gemm_f32_problem_t s = *p;
+  s.A = p->A + (size_t)m0 * p->rs_a;
+  s.B = p->B + (size_t)n0 * p->cs_b;
+  s.C = p->C + (size_t)m0 * p->ldc + n0;
+  s.M = m;
+  s.N = n;
+  gemm_f32_run_avx2(&s);
+}
+
+static void gemm_f16_tile(void *ctx, int m0, int m, int n0, int n) {
+  const gemm_f16_problem_t *p = (const gemm_f16_problem_t *)ctx;
+  gemm_f16_problem_t s = *p;
+  s.A = p->A + (size_t)m0 * p->rs_a;
+  /* Tiles start on a panel boundary: n0 is a multiple of NR. */
+  s.B = p->b_packed ? p->B + (size_t)n0 * p->K : p->B + (size_t)n0 * p->cs_b;
+  s.C = p->C + (size_t)m0 * p->ldc + n0;
+  s.M = m;
+  s.N = n;
+  gemm_f16_run_avx2(&s);
+}
+
+static void gemm_qw_tile(void *ctx, int m0, int m, int n0, int n) {
+  const gemm_qw_problem_t *p = (const gemm_qw_problem_t *)ctx;
+  size_t elem = p->a_f16 ? sizeof(uint16_t) : sizeof(float);
+  gemm_qw_problem_t s = *p;
+  s.A = (const char *)p->A + (size_t)m0 * p->lda * elem;
+  s.B = (const char *)p->B + (size_t)n0 * p->ldb;
+  if (!p->q4)
+    s.scales = p->scales + n0;
+  s.C = (char *)p->C + ((size_t)m0 * p->ldc + n0) * elem;
+  s.M = m;
+  s.N = n;
+  gemm_qw_run_avx2(&s);
+}
+
+typedef struct {
+  gemm_tile_fn fn;
+  void *ctx;
+  int M, N;
+  int tn, rows, cols;
+} gemm_tiling_t;
+
+static void gemm_tile_range(void *arg, int start, int end) {
+  const gemm_tiling_t *t = (const gemm_tiling_t *)arg;
+  for (int idx = start; idx < end; idx++) {
+    int m0 = (idx / t->tn) * t->rows;
+    int n0 = (idx % t->tn) * t->cols;
+    if (m0 >= t->M || n0 >= t->N)
+      continue;
+    t->fn(t->ctx, m0, imin(t->rows, t->M - m0), n0,
+          imin(t->cols, t->N - n0));
+  }
+}
+
+/* Split C into a tm x tn grid and run the tiles on the shared thread pool. */
+static void gemm_run_tiled(int M, int N, int num_threads, gemm_tile_fn fn,
+                           void *ctx) {
+  if (num_threads <= 1) {
+    fn(ctx, 0, M, 0, N);
+    return;
+  }
+
+  int tm, tn;
+  gemm_partition(M, N, num_threads, &tm, &tn);
+  if (tm * tn <= 1) {
+    fn(ctx, 0, M, 0, N);
+    return;
+  }
+
+  gemm_tiling_t t;
+  t.fn = fn;
+  t.ctx = ctx;
+  t.M = M;
+  t.N = N;
+  t.tn = tn;
+  t.rows = (M + tm - 1) / tm;
+  t.cols = (N + tn - 1) / tn;
+  t.cols = (t.cols + GEMM_NR - 1) / GEMM_NR * GEMM_NR;
+
+  threadpool_parallel_for(0, tm * tn, 1, gemm_tile_range, &t);
+}
+
+void gemm_f32_kernel_avx2_mt(const float *A, const float *B, float *C, int M,
+                             int N, int K, bool transpose_A, bool transpose_B,
+                             int num_threads) {
+  gemm_f32_problem_t p;
+  gemm_f32_problem_init(&p, A, B, C, M, N, K, transpose_A, transpose_B);
+  gemm_run_tiled(M, N, num_threads, gemm_f32_tile, &p);
+}
+
+void gemm_f16_kernel_avx2_mt(const uint16_t *A, const uint16_t *B, uint16_t *C,
+                             int M, int N, int K, bool transpose_A,
+                             bool transpose_B, int num_threads) {
+  gemm_f16_problem_t p;
+  gemm_f16_problem_init(&p, A, B, C, M, N, K, transpose_A, transpose_B);
+  gemm_run_tiled(M, N, num_threads, gemm_f16_tile, &p);
+}
+
+/* ============ Small-M driver ============ */
+
+/* Decode-sized problems skip packing: every row of A runs the single-row
+ * kernel against one block of B's columns before moving on, so a block is
+ * read from memory once and re-read from L2 by the remaining rows. Blocks are
+ * sized to fit in L2 and are dealt out to the thread pool. */
+#define GEMV_BLOCK_BYTES (128 * 1024)
+#define GEMV_BLOCK_ALIGN 64
+
+typedef struct {
+  gemm_tile_fn fn;
+  void *ctx;
+  int M, N, cols;
+} gemv_blocks_t;
+
+static void gemv_block_range(void *arg, int start, int end) {
+  const gemv_blocks_t *g = (const gemv_blocks_t *)arg;
+  for (int blk = start; blk < end; blk++) {
+    int n0 = blk * g->cols;
+    int n = imin(g->cols, g->N - n0);
+    for (int i = 0; i < g->M; i++)
+      g->fn(g->ctx, i, 1, n0, n);
+  }
+}
+
+static void gemv_run_blocked(int M, int N, int K, size_t elem_size,
+                             int num_threads, gemm_tile_fn fn, void *ctx) {
+  int cols = (int)(GEMV_BLOCK_BYTES / ((size_t)K * elem_size));
+  cols = cols / GEMV_BLOCK_ALIGN * GEMV_BLOCK_ALIGN;
+  if (cols < GEMV_BLOCK_ALIGN)
+    cols = GEMV_BLOCK_ALIGN;
+
+  gemv_blocks_t g = {fn, ctx, M, N, cols};
+  int blocks = (N + cols - 1) / cols;
+  if (num_threads <= 1) {
+    gemv_block_range(&g, 0, blocks);
+    return;
+  }
+  threadpool_parallel_for(0, blocks, 1, gemv_block_range, &g);
+}
+
+void gemv_f32_kernel_avx2(const float *A, const float *B, float *C, int M,
+                          int N, int K, bool transpose_B, int num_threads) {
+  gemm_f32_problem_t p;
+  gemm_f32_problem_init(&p, A, B, C, M, N, K, false, transpose_B);
+  gemv_run_blocked(M, N, K, sizeof(float), num_threads, gemm_f32_tile, &p);
+}
+
+void gemv_f16_kernel_avx2(const uint16_t *A, const uint16_t *B, uint16_t *C,
+                          int M, int N, int K, bool transpose_B,
+                          int num_threads) {
+  gemm_f16_problem_t p;
+  gemm_f16_problem_init(&p, A, B, C, M, N, K, false, transpose_B);
+  gemv_run_blocked(M, N, K, sizeof(uint16_t), num_threads, gemm_f16_tile, &p);
+}
+
+void gemm_f16_packed_kernel_avx2(const uint16_t *A, const uint16_t *B,
+                                 uint16_t *C, int M, int N, int K,
+                                 int num_threads) {
+  gemm_f16_problem_t p;
+  gemm_f16_problem_init(&p, A, B, C, M, N, K, false, true);
+  p.b_packed = true;
+
+  if (M <= GEMM_GEMV_MAX_M)
+    gemv_run_blocked(M, N, K, sizeof(uint16_t), num_threads, gemm_f16_tile,
+                     &p);
+  else
+    gemm_run_tiled(M, N, num_threads, gemm_f16_tile, &p);
+}
+
+void gemm_q8_kernel_avx2(const void *A, bool a_f16, const int8_t *B,
+                         const float *scales, void *C, int M, int N, int K,
+                         int num_threads) {
+  gemm_qw_problem_t p;
+  p.A = A;
+  p.lda = (size_t)K;
+  p.B = B;
+  p.ldb = (size_t)K;
+  p.scales = scales;
+  p.C = C;
+  p.ldc = (size_t)N;
+  p.M = M;
+  p.N = N;
+  p.K = K;
+  p.a_f16 = a_f16;
+  p.q4 = false;
+
+  if (M <= GEMM_GEMV_MAX_M)
+    gemv_run_blocked(M, N, K, sizeof(int8_t), num_threads, gemm_qw_tile, &p);
+  else
+    gemm_run_tiled(M, N, num_threads, gemm_qw_tile, &p);
+}
+
+void gemm_q4_kernel_avx2(const void *A, bool a_f16, const gemm_q4_block_t *B,
+                         void *C, int M, int N, int K, int num_threads) {
+  int groups = K / GEMM_Q4_GROUP;
+  gemm_qw_problem_t p;
+  p.A = A;
+  p.lda = (size_t)K;
+  p.B = B;
+  p.ldb = (size_t)groups * sizeof(gemm_q4_block_t);
+  p.scales = NULL;
+  p.C = C;
+  p.ldc = (size_t)N;
+  p.M = M;
+  p.N = N;
+  p.K = K;
+  p.a_f16 = a_f16;
+  p.q4 = true;
+
+  /* Column blocks are sized by the bytes of a row of B. */
+  if (M <= GEMM_GEMV_MAX_M)
+    gemv_run_blocked(M, N, groups, sizeof(gemm_q4_block_t), num_threads,
+                     gemm_qw_tile, &p);
+  else
+    gemm_run_tiled(M, N, num_threads, gemm_qw_tile, &p);
+}
+
+void gemm_f32_kernel(const float *A, const float *B, float *C, int M, int N,
+                     int K) {
+  gemm_f32_kernel_avx2(A, B, C, M, N, K, false, false);
+}
+
+void gemm_f32_kernel_mt(const float *A, const float *B, float *C, int M, int N,
+                        int K, int num_threads) {
+  gemm_f32_kernel_avx2_mt(A, B, C, M, N, K, false, false, num_threads);
+}
+
+void gemm_f16_kernel(const uint16_t *A, const uint16_t *B, uint16_t *C, int M,
+                     int N, int K) {
+  gemm_f16_kernel_avx2(A, B, C, M, N, K, false, false);
+}
+
+void gemm_f16_kernel_mt(const uint16_t *A, const uint16_t *B, uint16_t *C,
+                        int M, int N, int K, int num_threads) {
+  gemm_f16_kernel_avx2_mt(A, B, C, M, N, K, false, false, num_threads);
+}
+
+#else
+
+void gemm_f32_kernel_avx2(const float *A, const float *B, float *C, int M,
+                          int N, int K, bool transpose_A, bool transpose_B) {
+  (void)A;
+  (void)B;
+  (void)C;
+  (void)M;
+  (void)N;
+  (void)K;
+  (void)transpose_A;
+  (void)transpose_B;
+}
+
+void gemm_f32_kernel_avx2_mt(const float *A, const float *B, float *C, int M,
+                             int N, int K, bool transpose_A, bool transpose_B,
+                             int num_threads) {
+  (void)A;
+  (void)B;
+  (void)C;
+  (void)M;
+  (void)N;
+  (void)K;
+  (void)transpose_A;
+  (void)transpose_B;
+  (void)num_threads;
+}
+
+void gemm_f16_kernel_avx2(const uint16_t *A, const uint16_t *B, uint16_t *C,
+                          int M, int N, int K, bool transpose_A,
+                          bool transpose_B) {
+  (void)A;
+  (void)B;
+  (void)C;
+  (void)M;
+  (void)N;
+  (void)K;
+  (void)transpose_A;
+  (void)transpose_B;
+}
+
+void gemv_f32_kernel_avx2(const float *A, const float *B, float *C, int M,
+                          int N, int K, bool transpose_B, int num_threads) {
+  (void)A;
+  (void)B;
+  (void)C;
+  (void)M;
+  (void)N;
+  (void)K;
+  (void)transpose_B;
+  (void)num_threads;
+}
+
+void gemv_f16_kernel_avx2(const uint16_t *A, const uint16_t *B, uint16_t *C,
+                          int M, int N, int K, bool transpose_B,
+                          int num_threads) {
+  (void)A;
+  (void)B;
+  (void)C;
+  (void)M;
+  (void)N;
+  (void)K;
+  (void)transpose_B;
+  (void)num_threads;
+}
+
+void gemm_f16_packed_kernel_avx2(const uint16_t *A, const uint16_t *B,
+                                 uint16_t *C, int M, int N, int K,
+                                 int num_threads) {
+  (void)A;
+  (void)B;
+  (void)C;
+  (void)M;
+  (void)N;
+  (void)K;
+  (void)num_threads;
+}
+
+void gemm_q8_kernel_avx2(const void *A, bool a_f16, const int8_t *B,
+                         const float *scales, void *C, int M, int N, int K,
+                         int num_threads) {
+  (void)A;
+  (void)a_f16;
+  (void)B;
+  (void)scales;
+  (void)C;
+  (void)M;
+  (void)N;
+  (void)K;
+  (void)num_threads;
+}
+
+void gemm_q4_kernel_avx2(const void *A, bool a_f16, const gemm_q4_block_t *B,
+                         void *C, int M, int N, int K, int num_threads) {
+  (void)A;
+  (void)a_f16;
+  (void)B;
+  (void)C;
+  (void)M;
+  (void)N;
+  (void)K;
+  (void)num_threads;
+}
+
+void gemm_f16_kernel_avx2_mt(const uint16_t *A, const uint16_t *B, uint16_t *C,
+                             int M, int N, int K, bool transpose_A,
+                             bool transpose_B, int num_threads) {
+  (void)A;
+  (void)B;
+  (void)C;
+  (void)M;
+  (void)N;
+  (void)K;
+  (void)transpose_A;
+  (void)transpose_B;
+  (void)num_threads;
+}
+
+#endif
@@ -4,6 +4,8 @@
 
 #include "inference/kernels/kv_cache/kv_cache.h"
 #include "inference/kernels/kv_cache/kv_cache_kernels.h"
+#include "inference/kernels/convert/convert.h"
+#include <math.h>
 #include <string.h>
 
 static void kv_cache_append_f32_scalar(float *key_cache, float *value_cache,
@@ -101,3 +103,107 @@ void kv_cache_append_f16(uint16_t *key_cache, uint16_t *value_cache,
                                num_tokens, num_heads, head_dim);
   }
 }
+
+static bool has_q8_kernels(void) {
+  kv_cache_caps_t caps = kv_cache_get_capabilities();
+  return caps.has_neon || caps.has_avx2;
+}
+
+static void kv_cache_quantize_q8_scalar(int8_t *dst, float *scale,
+                                        const float *src, int n) {
+  float absmax = 0.0f;
+  for (int i = 0; i < n; i++) {
+    float a = fabsf(src[i]);
+    if (a > absmax)
+      absmax = a;
+  }
+
+  float inv = absmax > 0.0f ? 127.0f / absmax : 0.0f;
+  for (int i = 0; i < n; i++)
+    dst[i] = (int8_t)lrintf(src[i] * inv);
+  *scale = absmax / 127.0f;
+}
+
+void kv_cache_quantize_q8(int8_t *dst, float *scale, const float *src,
+                          int n) {
+  if (has_q8_kernels())
+    kv_cache_quantize_q8_kernel(dst, scale, src, n);
+  else
+    kv_cache_quantize_q8_scalar(dst, scale, src, n);
+}
+
+void kv_cache_append_q8_f32(int8_t *key_cache, int8_t *value_cache,
+                            float *key_scale, float *value_scale,
+                            const float *key, const float *value,
+                            int cache_len, int num_tokens, int num_heads,
+                            int head_dim) {
+  for (int t = 0; t < num_tokens; t++) {
+    for (int h = 0; h < num_heads; h++) {
+      int row = (cache_len + t) * num_heads + h;
+      int input_offset = (t * num_heads + h) * head_dim;
+
+      kv_cache_quantize_q8(key_cache + row * head_dim, key_scale + row,
+                           key + input_offset, head_dim);
+      kv_cache_quantize_q8(value_cache + row * head_dim, value_scale + row,
+                           value + input_offset, head_dim);
+    }
+  }
+}
+
+/* Appends are once per token, so the inline conversion is enough here. */
+static void widen_f16(float *dst, const uint16_t *src, int n) {
+  for (int i = 0; i < n; i++)
+    dst[i] = fp16_to_f32(src[i]);
+}
+
+void kv_cache_append_q8_f16(int8_t *key_cache, int8_t *value_cache,
+                            float *key_scale, float *value_scale,
+                            const uint16_t *key, const uint16_t *value,
+                            int cache_len, int num_tokens, int num_heads,
+                            int head_dim) {
+  float row_f32[KV_CACHE_Q8_MAX_HEAD_DIM];
+
+  for (int t = 0; t < num_tokens; t++) {
+    for (int h = 0; h < num_heads; h++) {
+      int row = (cache_len + t) * num_heads + h;
+      int input_offset = (t * num_heads + h) * head_dim;
+
+      widen_f16(row_f32, key + input_offset, head_dim);
+      kv_cache_quantize_q8(key_cache + row * head_dim, key_scale + row,
+                           row_f32, head_dim);
+      widen_f16(row_f32, value + input_offset, head_dim);
+      kv_cache_quantize_q8(value_cache + row * head_dim, value_scale + row,
+                           row_f32, head_dim);
+    }
+  }
+}
+
+float kv_cache_dot_q8(const int8_t *row, const float *x, int n) {
+  if (has_q8_kernels())
+    return kv_cache_dot_q8_kernel(row, x, n);
+
+  float sum = 0.0f;
+  for (int i = 0; i < n; i++)
+    sum += (float)row[i] * x[i];
+  return sum;
+}
+
+void kv_cache_accumulate_q8(float *out, const int8_t *row, float alpha,
+                            float weight, int n) {
+  if (has_q8_kernels()) {
+    kv_cache_accumulate_q8_kernel(out, row, alpha, weight, n);
+    return;
+  }
+  for (int i = 0; i < n; i++)
+    out[i] = out[i] * alpha + (float)row[i] * weight;
+}
+
+void kv_cache_dequantize_q8(float *dst, const int8_t *row, float scale,
+                            int n) {
+  if (has_q8_kernels()) {
+    kv_cache_dequantize_q8_kernel(dst, row, scale, n);
+    return;
+  }
+  for (int i = 0; i < n; i++)
+    dst[i] = (float)row[i] * scale;
+}
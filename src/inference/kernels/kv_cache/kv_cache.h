@@ -47,6 +47,53 @@ void kv_cache_append_f16(uint16_t *key_cache, uint16_t *value_cache,
                          int cache_len, int num_tokens, int num_heads,
                          int head_dim);
 
+/*
+ * Append key/value tensors to an INT8 cache (FP32 / FP16 input)
+ *
+ * Each [head_dim] row of a token and head is stored as int8 with one FP32
+ * scale, absmax / 127, so that row ~= q * scale. head_dim must not exceed
+ * KV_CACHE_Q8_MAX_HEAD_DIM.
+ *
+ * Parameters:
+ *   key_cache:   [cache_len, num_heads, head_dim] - int8 cache (modified)
+ *   value_cache: [cache_len, num_heads, head_dim] - int8 cache (modified)
+ *   key_scale:   [cache_len, num_heads] - per-row key scales (modified)
+ *   value_scale: [cache_len, num_heads] - per-row value scales (modified)
+ *   key, value, cache_len, num_tokens, num_heads, head_dim: as above
+ */
+#define KV_CACHE_Q8_MAX_HEAD_DIM 512
+
+void kv_cache_append_q8_f32(int8_t *key_cache, int8_t *value_cache,
+                            float *key_scale, float *value_scale,
+                            const float *key, const float *value,
+                            int cache_len, int num_tokens, int num_heads,
+                            int head_dim);
+void kv_cache_append_q8_f16(int8_t *key_cache, int8_t *value_cache,
+                            float *key_scale, float *value_scale,
+                            const uint16_t *key, const uint16_t *value,
+                            int cache_len, int num_tokens, int num_heads,
+                            int head_dim);
+
+/* Quantize one row of n values into dst and its scale. */
+void kv_cache_quantize_q8(int8_t *dst, float *scale, const float *src,
+                          int n);
+
+/*
+ * Read side of the INT8 cache, for attention kernels that dequantize on
+ * the fly. The row scale is left to the caller so it can be folded into
+ * the softmax score and weight.
+ */
+
+/* Returns sum(row[i] * x[i]). */
+float kv_cache_dot_q8(const int8_t *row, const float *x, int n);
+
+/* out = out * alpha + row * weight */
+void kv_cache_accumulate_q8(float *out, const int8_t *row, float alpha,
+                            float weight, int n);
+
+/* dst = row * scale, for kernels that work on widened FP32 tiles. */
+void kv_cache_dequantize_q8(float *dst, const int8_t *row, float scale, int n);
+
 #ifdef __cplusplus
 }
 #endif
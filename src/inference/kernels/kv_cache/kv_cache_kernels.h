@@ -12,8 +12,16 @@
 extern "C" {
 #endif
 
+/* kv_cache_x86.c needs AVX2 and FMA at compile time. */
+#if defined(__AVX2__) && defined(__FMA__)
+#define KV_CACHE_X86_AVX2 1
+#else
+#define KV_CACHE_X86_AVX2 0
+#endif
+
 typedef struct {
   bool has_neon;
+  bool has_avx2;
 } kv_cache_caps_t;
 
 kv_cache_caps_t kv_cache_get_capabilities(void);
@@ -33,6 +41,15 @@ void kv_cache_append_f16_kernel(uint16_t *key_cache, uint16_t *value_cache,
                                 int cache_len, int num_tokens, int num_heads,
                                 int head_dim);
 
+/* INT8 rows, provided by kv_cache_neon.c or kv_cache_x86.c. */
+void kv_cache_quantize_q8_kernel(int8_t *dst, float *scale, const float *src,
+                                 int n);
+float kv_cache_dot_q8_kernel(const int8_t *row, const float *x, int n);
+void kv_cache_accumulate_q8_kernel(float *out, const int8_t *row, float alpha,
+                                   float weight, int n);
+void kv_cache_dequantize_q8_kernel(float *dst, const int8_t *row, float scale,
+                                   int n);
+
 #ifdef __cplusplus
 }
 #endif
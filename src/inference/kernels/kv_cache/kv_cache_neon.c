@@ -3,6 +3,7 @@
  */
 
 #include "inference/kernels/kv_cache/kv_cache_kernels.h"
+#include <math.h>
 #include <string.h>
 
 #if defined(__ARM_NEON) || defined(__ARM_NEON__)
@@ -16,6 +17,9 @@ kv_cache_caps_t kv_cache_get_capabilities(void) {
   kv_cache_caps_t caps = {0};
 #if HAS_NEON
   caps.has_neon = true;
+#endif
+#if KV_CACHE_X86_AVX2
+  caps.has_avx2 = true;
 #endif
   return caps;
 }
@@ -93,6 +97,82 @@ void kv_cache_append_f16_kernel(uint16_t *key_cache, uint16_t *value_cache,
   }
 }
 
+void kv_cache_quantize_q8_kernel(int8_t *dst, float *scale, const float *src,
+                                 int n) {
+  float32x4_t max_v = vdupq_n_f32(0.0f);
+  int i = 0;
+  for (; i + 4 <= n; i += 4)
+    max_v = vmaxq_f32(max_v, vabsq_f32(vld1q_f32(src + i)));
+  float absmax = vmaxvq_f32(max_v);
+  for (; i < n; i++) {
+    float a = fabsf(src[i]);
+    if (a > absmax)
+      absmax = a;
+  }
+
+  float inv = absmax > 0.0f ? 127.0f / absmax : 0.0f;
+  float32x4_t inv_v = vdupq_n_f32(inv);
+  i = 0;
+  for (; i + 8 <= n; i += 8) {
+    int32x4_t lo = vcvtnq_s32_f32(vmulq_f32(vld1q_f32(src + i), inv_v));
+    int32x4_t hi = vcvtnq_s32_f32(vmulq_f32(vld1q_f32(src + i + 4), inv_v));
+    int16x8_t packed = vcombine_s16(vmovn_s32(lo), vmovn_s32(hi));
+    vst1_s8(dst + i, vmovn_s16(packed));
+  }
+  for (; i < n; i++)
+    dst[i] = (int8_t)lrintf(src[i] * inv);
+  *scale = absmax / 127.0f;
+}
+
+float kv_cache_dot_q8_kernel(const int8_t *row, const float *x, int n) {
+  float32x4_t sum0 = vdupq_n_f32(0.0f);
+  float32x4_t sum1 = vdupq_n_f32(0.0f);
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    int16x8_t r = vmovl_s8(vld1_s8(row + i));
+    float32x4_t lo = vcvtq_f32_s32(vmovl_s16(vget_low_s16(r)));
+    float32x4_t hi = vcvtq_f32_s32(vmovl_s16(vget_high_s16(r)));
+    sum0 = vfmaq_f32(sum0, lo, vld1q_f32(x + i));
+    sum1 = vfmaq_f32(sum1, hi, vld1q_f32(x + i + 4));
+  }
+  float sum = vaddvq_f32(vaddq_f32(sum0, sum1));
+  for (; i < n; i++)
+    sum += (float)row[i] * x[i];
+  return sum;
+}
+
+void kv_cache_accumulate_q8_kernel(float *out, const int8_t *row, float alpha,
+                                   float weight, int n) {
+  float32x4_t alpha_v = vdupq_n_f32(alpha);
+  float32x4_t weight_v = vdupq_n_f32(weight);
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    int16x8_t r = vmovl_s8(vld1_s8(row + i));
+    float32x4_t lo = vcvtq_f32_s32(vmovl_s16(vget_low_s16(r)));
+    float32x4_t hi = vcvtq_f32_s32(vmovl_s16(vget_high_s16(r)));
+    float32x4_t out_lo = vmulq_f32(vld1q_f32(out + i), alpha_v);
+    float32x4_t out_hi = vmulq_f32(vld1q_f32(out + i + 4), alpha_v);
+    vst1q_f32(out + i, vfmaq_f32(out_lo, lo, weight_v));
+    vst1q_f32(out + i + 4, vfmaq_f32(out_hi, hi, weight_v));
+  }
+  for (; i < n; i++)
+    out[i] = out[i] * alpha + (float)row[i] * weight;
+}
+
+void kv_cache_dequantize_q8_kernel(float *dst, const int8_t *row, float scale,
+                                   int n) {
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    int16x8_t r = vmovl_s8(vld1_s8(row + i));
+    float32x4_t lo = vcvtq_f32_s32(vmovl_s16(vget_low_s16(r)));
+    float32x4_t hi = vcvtq_f32_s32(vmovl_s16(vget_high_s16(r)));
+    vst1q_f32(dst + i, vmulq_n_f32(lo, scale));
+    vst1q_f32(dst + i + 4, vmulq_n_f32(hi, scale));
+  }
+  for (; i < n; i++)
+    dst[i] = (float)row[i] * scale;
+}
+
 #else // HAS_NEON
 
 void kv_cache_append_f32_kernel(float *key_cache, float *value_cache,
@@ -137,4 +217,40 @@ void kv_cache_append_f16_kernel(uint16_t *key_cache, uint16_t *value_cache,
   (void)head_dim;
 }
 
+#if !KV_CACHE_X86_AVX2
+
+void kv_cache_quantize_q8_kernel(int8_t *dst, float *scale, const float *src,
+                                 int n) {
+  (void)dst;
+  (void)scale;
+  (void)src;
+  (void)n;
+}
+
+float kv_cache_dot_q8_kernel(const int8_t *row, const float *x, int n) {
+  (void)row;
+  (void)x;
+  (void)n;
+  return 0.0f;
+}
+
+void kv_cache_accumulate_q8_kernel(float *out, const int8_t *row, float alpha,
+                                   float weight, int n) {
+  (void)out;
+  (void)row;
+  (void)alpha;
+  (void)weight;
+  (void)n;
+}
+
+void kv_cache_dequantize_q8_kernel(float *dst, const int8_t *row, float scale,
+                                   int n) {
+  (void)dst;
+  (void)row;
+  (void)scale;
+  (void)n;
+}
+
+#endif // !KV_CACHE_X86_AVX2
+
 #endif // HAS_NEON
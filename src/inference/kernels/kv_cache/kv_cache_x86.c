@@ -0,0 +1,104 @@
+/*
+ * KV Cache - AVX2 Implementation
+ *
+ * INT8 rows widen through 32-bit lanes: eight values per step are
+ * sign-extended, converted to FP32 and fused into the accumulator.
+ */
+
+#include "inference/kernels/kv_cache/kv_cache_kernels.h"
+#include <math.h>
+
+#if KV_CACHE_X86_AVX2
+
+#include <immintrin.h>
+
+static inline float hsum_ps(__m256 v) {
+  __m128 s = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+  s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+  s = _mm_add_ss(s, _mm_movehdup_ps(s));
+  return _mm_cvtss_f32(s);
+}
+
+static inline float hmax_ps(__m256 v) {
+  __m128 m = _mm_max_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+  m = _mm_max_ps(m, _mm_movehl_ps(m, m));
+  m = _mm_max_ss(m, _mm_movehdup_ps(m));
+  return _mm_cvtss_f32(m);
+}
+
+static inline __m256 load_q8x8(const int8_t *row) {
+  __m128i r = _mm_loadl_epi64((const __m128i *)row);
+  return _mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(r));
+}
+
+void kv_cache_quantize_q8_kernel(int8_t *dst, float *scale, const float *src,
+                                 int n) {
+  const __m256 sign = _mm256_set1_ps(-0.0f);
+  __m256 max_v = _mm256_setzero_ps();
+  int i = 0;
+  for (; i + 8 <= n; i += 8)
+    max_v = _mm256_max_ps(max_v,
+                          _mm256_andnot_ps(sign, _mm256_loadu_ps(src + i)));
+  float absmax = hmax_ps(max_v);
+  for (; i < n; i++) {
+    float a = fabsf(src[i]);
+    if (a > absmax)
+      absmax = a;
+  }
+
+  float inv = absmax > 0.0f ? 127.0f / absmax : 0.0f;
+  __m256 inv_v = _mm256_set1_ps(inv);
+  i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256 scaled = _mm256_mul_ps(_mm256_loadu_ps(src + i), inv_v);
+    __m256i q = _mm256_cvtps_epi32(scaled);
+    __m128i q16 = _mm_packs_epi32(_mm256_castsi256_si128(q),
+                                  _mm256_extracti128_si256(q, 1));
+    _mm_storel_epi64((__m128i *)(dst + i), _mm_packs_epi16(q16, q16));
+  }
+  for (; i < n; i++)
+    dst[i] = (int8_t)lrintf(src[i] * inv);
+  *scale = absmax / 127.0f;
+}
+
+float kv_cache_dot_q8_kernel(const int8_t *row, const float *x, int n) {
+  __m256 sum0 = _mm256_setzero_ps();
+  __m256 sum1 = _mm256_setzero_ps();
+  int i = 0;
+  for (; i + 16 <= n; i += 16) {
+    sum0 = _mm256_fmadd_ps(load_q8x8(row + i), _mm256_loadu_ps(x + i), sum0);
+    sum1 = _mm256_fmadd_ps(load_q8x8(row + i + 8), _mm256_loadu_ps(x + i + 8),
+                           sum1);
+  }
+  for (; i + 8 <= n; i += 8)
+    sum0 = _mm256_fmadd_ps(load_q8x8(row + i), _mm256_loadu_ps(x + i), sum0);
+  float sum = hsum_ps(_mm256_add_ps(sum0, sum1));
+  for (; i < n; i++)
+    sum += (float)row[i] * x[i];
+  return sum;
+}
+
+void kv_cache_accumulate_q8_kernel(float *out, const int8_t *row, float alpha,
+                                   float weight, int n) {
+  __m256 alpha_v = _mm256_set1_ps(alpha);
+  __m256 weight_v = _mm256_set1_ps(weight);
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256 o = _mm256_mul_ps(_mm256_loadu_ps(out + i), alpha_v);
+    _mm256_storeu_ps(out + i, _mm256_fmadd_ps(load_q8x8(row + i), weight_v, o));
+  }
+  for (; i < n; i++)
+    out[i] = out[i] * alpha + (float)row[i] * weight;
+}
+
+void kv_cache_dequantize_q8_kernel(float *dst, const int8_t *row, float scale,
+                                   int n) {
+  __m256 scale_v = _mm256_set1_ps(scale);
+  int i = 0;
+  for (; i + 8 <= n; i += 8)
+    _mm256_storeu_ps(dst + i, _mm256_mul_ps(load_q8x8(row + i), scale_v));
+  for (; i < n; i++)
+    dst[i] = (float)row[i] * scale;
+}
+
+#endif
@@ -0,0 +1,238 @@
+/*
+ * KV Cache - Page Pool and Block Tables
+ */
+
+#include "inference/kernels/kv_cache/kv_pages.h"
+#include "inference/kernels/kv_cache/kv_cache.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define KV_PAGE_ALIGN 64
+
+static bool pool_init(kv_pool_t *pool, int num_layers, int num_heads,
+                      int head_dim, size_t elem_size, bool quantized,
+                      int page_tokens, size_t budget_bytes) {
+  if (!pool || num_layers <= 0 || num_heads <= 0 || head_dim <= 0 ||
+      elem_size == 0 || page_tokens <= 0)
+    return false;
+
+  memset(pool, 0, sizeof(*pool));
+  pool->num_layers = num_layers;
+  pool->num_heads = num_heads;
+  pool->head_dim = head_dim;
+  pool->elem_size = elem_size;
+  pool->quantized = quantized;
+
+  while ((1 << pool->page_shift) < page_tokens)
+    pool->page_shift++;
+  pool->page_tokens = 1 << pool->page_shift;
+
+  pool->row_bytes = (size_t)num_heads * head_dim * elem_size;
+  pool->scale_row_bytes = quantized ? (size_t)num_heads * sizeof(float) : 0;
+  size_t bytes = (size_t)num_layers * 2 * pool->page_tokens *
+                 (pool->row_bytes + pool->scale_row_bytes);
+  pool->page_bytes = (bytes + KV_PAGE_ALIGN - 1) & ~(size_t)(KV_PAGE_ALIGN - 1);
+  return kv_pool_set_budget(pool, budget_bytes);
+}
+
+bool kv_pool_init(kv_pool_t *pool, int num_layers, int num_heads, int head_dim,
+                  size_t elem_size, int page_tokens, size_t budget_bytes) {
+  return pool_init(pool, num_layers, num_heads, head_dim, elem_size, false,
+                   page_tokens, budget_bytes);
+}
+
+bool kv_pool_init_q8(kv_pool_t *pool, int num_layers, int num_heads,
+                     int head_dim, int page_tokens, size_t budget_bytes) {
+  if (head_dim > KV_CACHE_Q8_MAX_HEAD_DIM)
+    return false;
+  return pool_init(pool, num_layers, num_heads, head_dim, sizeof(int8_t), true,
+                   page_tokens, budget_bytes);
+}
+
+void kv_pool_free(kv_pool_t *pool) {
+  if (!pool)
+    return;
+  kv_pool_trim(pool);
+  free(pool->free_pages);
+  memset(pool, 0, sizeof(*pool));
+}
+
+bool kv_pool_set_budget(kv_pool_t *pool, size_t budget_bytes) {
+  size_t max_pages = budget_bytes / pool->page_bytes;
+  if (budget_bytes &&
+      (max_pages == 0 || max_pages < kv_pool_pages_in_use(pool)))
+    return false;
+
+  pool->max_pages = budget_bytes ? max_pages : 0;
+  /* Recycled pages above the new cap are returned to the system. */
+  while (pool->max_pages && pool->num_pages > pool->max_pages &&
+         pool->num_free > 0) {
+    free(pool->free_pages[--pool->num_free]);
+    pool->num_pages--;
+  }
+  return true;
+}
+
+void kv_pool_trim(kv_pool_t *pool) {
+  while (pool->num_free > 0) {
+    free(pool->free_pages[--pool->num_free]);
+    pool->num_pages--;
+  }
+}
+
+size_t kv_pool_pages_in_use(const kv_pool_t *pool) {
+  return pool->num_pages - pool->num_free;
+}
+
+static void *pool_get_page(kv_pool_t *pool) {
+  if (pool->num_free > 0)
+    return pool->free_pages[--pool->num_free];
+  if (pool->max_pages && pool->num_pages >= pool->max_pages)
+    return NULL;
+
+  /* The free list can hold every page ever allocated, so grow it first. */
+  void **free_pages = (void **)realloc(
+      pool->free_pages, (pool->num_pages + 1) * sizeof(void *));
+  if (!free_pages)
+    return NULL;
+  pool->free_pages = free_pages;
+
+  void *page = aligned_alloc(KV_PAGE_ALIGN, pool->page_bytes);
+  if (page)
+    pool->num_pages++;
+  return page;
+}
+
+static void pool_put_page(kv_pool_t *pool, void *page) {
+  pool->free_pages[pool->num_free++] = page;
+}
+
+void kv_seq_init(kv_seq_t *seq, kv_pool_t *pool) {
+  memset(seq, 0, sizeof(*seq));
+  seq->pool = pool;
+}
+
+bool kv_seq_reserve(kv_seq_t *seq, int num_tokens) {
+  kv_pool_t *pool = seq->pool;
+  int needed = (num_tokens + pool->page_tokens - 1) >> pool->page_shift;
+  if (needed <= seq->num_pages)
+    return true;
+
+  if (needed > seq->capacity) {
+    int capacity = seq->capacity ? seq->capacity : 16;
+    while (capacity < needed)
+      capacity *= 2;
+    void **pages = (void **)realloc(seq->pages, capacity * sizeof(void *));
+    if (!pages)
+      return false;
+    seq->pages = pages;
+    seq->capacity = capacity;
+  }
+
+  while (seq->num_pages < needed) {
+    void *page = pool_get_page(pool);
+    if (!page)
+      return false;
+    seq->pages[seq->num_pages++] = page;
+  }
+  return true;
+}
+
+void kv_seq_truncate(kv_seq_t *seq, int num_tokens) {
+  kv_pool_t *pool = seq->pool;
+  int keep = (num_tokens + pool->page_tokens - 1) >> pool->page_shift;
+  while (seq->num_pages > keep)
+    pool_put_page(pool, seq->pages[--seq->num_pages]);
+}
+
+void kv_seq_free(kv_seq_t *seq) {
+  if (!seq || !seq->pool)
+    return;
+  kv_seq_truncate(seq, 0);
+  free(seq->pages);
+  memset(seq, 0, sizeof(*seq));
+}
+
+/* Rows from pos to the end of its page, capped at remaining. Appends are
+ * split into such runs, each handed to the flat kv_cache_append_* kernel. */
+static int page_run(const kv_layer_view_t *view, int pos, int remaining) {
+  int run = view->page_mask + 1 - (pos & view->page_mask);
+  return run < remaining ? run : remaining;
+}
+
+void kv_cache_append_paged_f32(const kv_layer_view_t *view, const float *key,
+                               const float *value, int cache_len,
+                               int num_tokens) {
+  size_t row = (size_t)view->num_heads * view->head_dim;
+  for (int done = 0; done < num_tokens;) {
+    int pos = cache_len + done;
+    int run = page_run(view, pos, num_tokens - done);
+    kv_cache_append_f32((float *)kv_view_key(view, pos),
+                        (float *)kv_view_value(view, pos), key + done * row,
+                        value + done * row, 0, run, view->num_heads,
+                        view->head_dim);
+    done += run;
+  }
+}
+
+void kv_cache_append_paged_f16(const kv_layer_view_t *view,
+                               const uint16_t *key, const uint16_t *value,
+                               int cache_len, int num_tokens) {
+  size_t row = (size_t)view->num_heads * view->head_dim;
+  for (int done = 0; done < num_tokens;) {
+    int pos = cache_len + done;
+    int run = page_run(view, pos, num_tokens - done);
+    kv_cache_append_f16((uint16_t *)kv_view_key(view, pos),
+                        (uint16_t *)kv_view_value(view, pos), key + done * row,
+                        value + done * row, 0, run, view->num_heads,
+                        view->head_dim);
+    done += run;
+  }
+}
+
+void kv_cache_append_paged_bf16(const kv_layer_view_t *view,
+                                const uint16_t *key, const uint16_t *value,
+                                int cache_len, int num_tokens) {
+  size_t row = (size_t)view->num_heads * view->head_dim;
+  for (int done = 0; done < num_tokens;) {
+    int pos = cache_len + done;
+    int run = page_run(view, pos, num_tokens - done);
+    kv_cache_append_bf16((uint16_t *)kv_view_key(view, pos),
+                         (uint16_t *)kv_view_value(view, pos), key + done * row,
+                         value + done * row, 0, run, view->num_heads,
+                         view->head_dim);
+    done += run;
+  }
+}
+
+void kv_cache_append_paged_q8_f32(const kv_layer_view_t *view,
+                                  const float *key, const float *value,
+                                  int cache_len, int num_tokens) {
+  size_t row = (size_t)view->num_heads * view->head_dim;
+  for (int done = 0; done < num_tokens;) {
+    int pos = cache_len + done;
+    int run = page_run(view, pos, num_tokens - done);
+    kv_cache_append_q8_f32(
+        (int8_t *)kv_view_key(view, pos), (int8_t *)kv_view_value(view, pos),
+        kv_view_key_scale(view, pos), kv_view_value_scale(view, pos),
+        key + done * row, value + done * row, 0, run, view->num_heads,
+        view->head_dim);
+    done += run;
+  }
+}
+
+void kv_cache_append_paged_q8_f16(const kv_layer_view_t *view,
+                                  const uint16_t *key, const uint16_t *value,
+                                  int cache_len, int num_tokens) {
+  size_t row = (size_t)view->num_heads * view->head_dim;
+  for (int done = 0; done < num_tokens;) {
+    int pos = cache_len + done;
+    int run = page_run(view, pos, num_tokens - done);
+    kv_cache_append_q8_f16(
+        (int8_t *)kv_view_key(view, pos), (int8_t *)kv_view_value(view, pos),
+        kv_view_key_scale(view, pos), kv_view_value_scale(view, pos),
+        key + done * row, value + done * row, 0, run, view->num_heads,
+        view->head_dim);
+    done += run;
+  }
+}
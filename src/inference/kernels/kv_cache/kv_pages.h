@@ -0,0 +1,179 @@
+/*
+ * KV Cache - Paged Storage
+ *
+ * Keys and values live in fixed-size pages of page_tokens positions that a
+ * shared pool hands out as a sequence grows. One page holds its block of
+ * positions for every layer, so each sequence needs a single block table.
+ * Pages are allocated on first use and recycled through a free list, so
+ * resident memory follows the context actually in use, up to the pool's
+ * byte budget.
+ *
+ * Page layout, for each layer in turn:
+ *   K [page_tokens, num_heads, head_dim]
+ *   V [page_tokens, num_heads, head_dim]
+ * and, for an INT8 pool (kv_pool_init_q8), the FP32 row scales after them:
+ *   K scales [page_tokens, num_heads]
+ *   V scales [page_tokens, num_heads]
+ */
+
+#ifndef KV_PAGES_H
+#define KV_PAGES_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define KV_PAGE_DEFAULT_TOKENS 32
+
+typedef struct {
+  int num_layers;
+  int num_heads;
+  int head_dim;
+  size_t elem_size;
+  bool quantized; /* int8 rows with per-token, per-head scales */
+  int page_tokens;
+  int page_shift;
+  size_t row_bytes;
+  size_t scale_row_bytes; /* 0 unless quantized */
+  size_t page_bytes;
+
+  size_t max_pages; /* 0 means no budget */
+  size_t num_pages; /* allocated, in use or free */
+  void **free_pages;
+  size_t num_free;
+} kv_pool_t;
+
+/* Block table of one sequence: pages[i] holds positions
+ * [i * page_tokens, (i + 1) * page_tokens). */
+typedef struct {
+  kv_pool_t *pool;
+  void **pages;
+  int num_pages;
+  int capacity;
+} kv_seq_t;
+
+/* One layer of a sequence, as read by the attention kernels. */
+typedef struct {
+  void *const *pages;
+  int page_shift;
+  int page_mask;
+  size_t row_bytes;
+  size_t k_offset;
+  size_t v_offset;
+  bool quantized;
+  size_t scale_row_bytes;
+  size_t k_scale_offset;
+  size_t v_scale_offset;
+  int num_heads;
+  int head_dim;
+} kv_layer_view_t;
+
+/*
+ * Create a pool of pages for a model shape. page_tokens is rounded up to a
+ * power of two; budget_bytes caps the memory of all pages, 0 for no cap.
+ */
+bool kv_pool_init(kv_pool_t *pool, int num_layers, int num_heads, int head_dim,
+                  size_t elem_size, int page_tokens, size_t budget_bytes);
+
+/* Same as kv_pool_init for a pool of INT8 rows (kv_cache_append_q8_*). */
+bool kv_pool_init_q8(kv_pool_t *pool, int num_layers, int num_heads,
+                     int head_dim, int page_tokens, size_t budget_bytes);
+
+/* Release the pool. Every sequence must have been freed first. */
+void kv_pool_free(kv_pool_t *pool);
+
+/* Change the byte budget. Fails if more pages than that are in use. */
+bool kv_pool_set_budget(kv_pool_t *pool, size_t budget_bytes);
+
+/* Return the memory of recycled pages to the system. */
+void kv_pool_trim(kv_pool_t *pool);
+
+/* Pages currently held by sequences. */
+size_t kv_pool_pages_in_use(const kv_pool_t *pool);
+
+void kv_seq_init(kv_seq_t *seq, kv_pool_t *pool);
+
+/* Make sure positions [0, num_tokens) have pages. Returns false when the
+ * pool's budget is exhausted; pages already held are kept. */
+bool kv_seq_reserve(kv_seq_t *seq, int num_tokens);
+
+/* Give back the pages past the first num_tokens positions. */
+void kv_seq_truncate(kv_seq_t *seq, int num_tokens);
+
+void kv_seq_free(kv_seq_t *seq);
+
+static inline kv_layer_view_t kv_seq_layer(const kv_seq_t *seq, int layer) {
+  const kv_pool_t *pool = seq->pool;
+  size_t block = (size_t)pool->page_tokens * pool->row_bytes;
+  size_t scale_block = (size_t)pool->page_tokens * pool->scale_row_bytes;
+  kv_layer_view_t view;
+  view.pages = seq->pages;
+  view.page_shift = pool->page_shift;
+  view.page_mask = pool->page_tokens - 1;
+  view.row_bytes = pool->row_bytes;
+  view.k_offset = (size_t)layer * 2 * (block + scale_block);
+  view.v_offset = view.k_offset + block;
+  view.quantized = pool->quantized;
+  view.scale_row_bytes = pool->scale_row_bytes;
+  view.k_scale_offset = view.v_offset + block;
+  view.v_scale_offset = view.k_scale_offset + scale_block;
+  view.num_heads = pool->num_heads;
+  view.head_dim = pool->head_dim;
+  return view;
+}
+
+/* Start of the [num_heads, head_dim] key / value row at a position. */
+static inline void *kv_view_key(const kv_layer_view_t *view, int pos) {
+  return (char *)view->pages[pos >> view->page_shift] + view->k_offset +
+         (size_t)(pos & view->page_mask) * view->row_bytes;
+}
+
+static inline void *kv_view_value(const kv_layer_view_t *view, int pos) {
+  return (char *)view->pages[pos >> view->page_shift] + view->v_offset +
+         (size_t)(pos & view->page_mask) * view->row_bytes;
+}
+
+/* The [num_heads] FP32 key / value scales at a position of an INT8 view. */
+static inline float *kv_view_key_scale(const kv_layer_view_t *view, int pos) {
+  return (float *)((char *)view->pages[pos >> view->page_shift] +
+                   view->k_scale_offset +
+                   (size_t)(pos & view->page_mask) * view->scale_row_bytes);
+}
+
+static inline float *kv_view_value_scale(const kv_layer_view_t *view,
+                                         int pos) {
+  return (float *)((char *)view->pages[pos >> view->page_shift] +
+                   view->v_scale_offset +
+                   (size_t)(pos & view->page_mask) * view->scale_row_bytes);
+}
+
+/*
+ * Append num_tokens rows of key/value ([num_tokens, num_heads, head_dim])
+ * at position cache_len through the block table. The pages must already be
+ * reserved. Each run inside a page goes through kv_cache_append_*.
+ */
+void kv_cache_append_paged_f32(const kv_layer_view_t *view, const float *key,
+                               const float *value, int cache_len,
+                               int num_tokens);
+void kv_cache_append_paged_f16(const kv_layer_view_t *view,
+                               const uint16_t *key, const uint16_t *value,
+                               int cache_len, int num_tokens);
+void kv_cache_append_paged_bf16(const kv_layer_view_t *view,
+                                const uint16_t *key, const uint16_t *value,
+                                int cache_len, int num_tokens);
+void kv_cache_append_paged_q8_f32(const kv_layer_view_t *view,
+                                  const float *key, const float *value,
+                                  int cache_len, int num_tokens);
+void kv_cache_append_paged_q8_f16(const kv_layer_view_t *view,
+                                  const uint16_t *key, const uint16_t *value,
+                                  int cache_len, int num_tokens);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // KV_PAGES_H
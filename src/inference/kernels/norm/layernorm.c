@@ -4,13 +4,16 @@
 
 #include "inference/kernels/norm/layernorm.h"
 #include "inference/kernels/norm/layernorm_kernels.h"
+#include "inference/kernels/threadpool/threadpool.h"
 #include <math.h>
+#include <stdbool.h>
 #include <string.h>
 
 /* ============ FP32 Implementation ============ */
 
-void rms_norm_f32(float *out, const float *input, const float *weight,
-                  float epsilon, int num_tokens, int hidden_size) {
+static void rms_norm_f32_serial(float *out, const float *input,
+                                const float *weight, float epsilon,
+                                int num_tokens, int hidden_size) {
   if (num_tokens <= 0 || hidden_size <= 0)
     return;
 
@@ -43,9 +46,10 @@ void rms_norm_f32(float *out, const float *input, const float *weight,
   }
 }
 
-void fused_add_rms_norm_f32(float *out, const float *input, float *residual,
-                            const float *weight, float epsilon, int num_tokens,
-                            int hidden_size) {
+static void fused_add_rms_norm_f32_serial(float *out, const float *input,
+                                          float *residual, const float *weight,
+                                          float epsilon, int num_tokens,
+                                          int hidden_size) {
   if (num_tokens <= 0 || hidden_size <= 0)
     return;
 
@@ -99,8 +103,9 @@ static inline float bf16_to_float(uint16_t bf16) {
   return result;
 }
 
-void rms_norm_bf16(uint16_t *out, const uint16_t *input, const uint16_t *weight,
-                   float epsilon, int num_tokens, int hidden_size) {
+static void rms_norm_bf16_serial(uint16_t *out, const uint16_t *input,
+                                 const uint16_t *weight, float epsilon,
+                                 int num_tokens, int hidden_size) {
   if (num_tokens <= 0 || hidden_size <= 0)
     return;
 
@@ -135,9 +140,11 @@ void rms_norm_bf16(uint16_t *out, const uint16_t *input, const uint16_t *weight,
   }
 }
 
-void fused_add_rms_norm_bf16(uint16_t *out, const uint16_t *input,
-                             uint16_t *residual, const uint16_t *weight,
-                             float epsilon, int num_tokens, int hidden_size) {
+static void fused_add_rms_norm_bf16_serial(uint16_t *out, const uint16_t *input,
+                                           uint16_t *residual,
+                                           const uint16_t *weight,
+                                           float epsilon, int num_tokens,
+                                           int hidden_size) {
   if (num_tokens <= 0 || hidden_size <= 0)
     return;
 
@@ -234,8 +241,9 @@ static inline float fp16_to_float(uint16_t fp16) {
   return result;
 }
 
-void rms_norm_f16(uint16_t *out, const uint16_t *input, const uint16_t *weight,
-                  float epsilon, int num_tokens, int hidden_size) {
+static void rms_norm_f16_serial(uint16_t *out, const uint16_t *input,
+                                const uint16_t *weight, float epsilon,
+                                int num_tokens, int hidden_size) {
   if (num_tokens <= 0 || hidden_size <= 0)
     return;
 
@@ -270,9 +278,10 @@ void rms_norm_f16(uint16_t *out, const uint16_t *input, const uint16_t *weight,
   }
 }
 
-void fused_add_rms_norm_f16(uint16_t *out, const uint16_t *input,
-                            uint16_t *residual, const uint16_t *weight,
-                            float epsilon, int num_tokens, int hidden_size) {
+static void fused_add_rms_norm_f16_serial(uint16_t *out, const uint16_t *input,
+                                          uint16_t *residual,
+                                          const uint16_t *weight, float epsilon,
+                                          int num_tokens, int hidden_size) {
   if (num_tokens <= 0 || hidden_size <= 0)
     return;
 
@@ -311,3 +320,144 @@ void fused_add_rms_norm_f16(uint16_t *out, const uint16_t *input,
     }
   }
 }
+
+/* ============ Row Parallelism ============ */
+
+/* Batches of at least NORM_PARALLEL_MIN_ELEMS elements are split by token
+ * rows on the shared thread pool. */
+#define NORM_PARALLEL_MIN_ELEMS (1 << 16)
+#define NORM_PARALLEL_GRAIN_ELEMS (1 << 14)
+
+typedef enum {
+  NORM_RMS_F32,
+  NORM_RMS_BF16,
+  NORM_RMS_F16,
+  NORM_FUSED_ADD_F32,
+  NORM_FUSED_ADD_BF16,
+  NORM_FUSED_ADD_F16,
+} norm_op_t;
+
+typedef struct {
+  norm_op_t op;
+  void *out;
+  const void *input;
+  void *residual;
+  const void *weight;
+  float epsilon;
+  int hidden_size;
+} norm_task_t;
+
+static void norm_rows(void *arg, int start, int end) {
+  const norm_task_t *t = (const norm_task_t *)arg;
+  size_t off = (size_t)start * t->hidden_size;
+  int n = end - start;
+
+  switch (t->op) {
+  case NORM_RMS_F32:
+    rms_norm_f32_serial((float *)t->out + off, (const float *)t->input + off,
+                        (const float *)t->weight, t->epsilon, n,
+                        t->hidden_size);
+    break;
+  case NORM_RMS_BF16:
+    rms_norm_bf16_serial((uint16_t *)t->out + off,
+                         (const uint16_t *)t->input + off,
+                         (const uint16_t *)t->weight, t->epsilon, n,
+                         t->hidden_size);
+    break;
+  case NORM_RMS_F16:
+    rms_norm_f16_serial((uint16_t *)t->out + off,
+                        (const uint16_t *)t->input + off,
+                        (const uint16_t *)t->weight, t->epsilon, n,
+                        t->hidden_size);
+    break;
+  case NORM_FUSED_ADD_F32:
+    fused_add_rms_norm_f32_serial((float *)t->out + off,
+                                  (const float *)t->input + off,
+                                  (float *)t->residual + off,
+                                  (const float *)t->weight, t->epsilon, n,
+                                  t->hidden_size);
+    break;
+  case NORM_FUSED_ADD_BF16:
+    fused_add_rms_norm_bf16_serial((uint16_t *)t->out + off,
+                                   (const uint16_t *)t->input + off,
+                                   (uint16_t *)t->residual + off,
+                                   (const uint16_t *)t->weight, t->epsilon, n,
+                                   t->hidden_size);
+    break;
+  case NORM_FUSED_ADD_F16:
+    fused_add_rms_norm_f16_serial((uint16_t *)t->out + off,
+                                  (const uint16_t *)t->input + off,
+                                  (uint16_t *)t->residual + off,
+                                  (const uint16_t *)t->weight, t->epsilon, n,
+                                  t->hidden_size);
+    break;
+  }
+}
+
+static bool norm_parallel(const norm_task_t *t, int num_tokens) {
+  int hidden_size = t->hidden_size;
+  if (num_tokens < 2 || hidden_size <= 0 ||
+      (long long)num_tokens * hidden_size < NORM_PARALLEL_MIN_ELEMS ||
+      threadpool_get_num_threads() <= 1)
+    return false;
+
+  int grain = (NORM_PARALLEL_GRAIN_ELEMS + hidden_size - 1) / hidden_size;
+  threadpool_parallel_for(0, num_tokens, grain, norm_rows, (void *)t);
+  return true;
+}
+
+/* ============ Public Entry Points ============ */
+
+void rms_norm_f32(float *out, const float *input, const float *weight,
+                  float epsilon, int num_tokens, int hidden_size) {
+  norm_task_t t = {NORM_RMS_F32, out, input, NULL, weight, epsilon,
+                   hidden_size};
+  if (!norm_parallel(&t, num_tokens))
+    rms_norm_f32_serial(out, input, weight, epsilon, num_tokens, hidden_size);
+}
+
+void fused_add_rms_norm_f32(float *out, const float *input, float *residual,
+                            const float *weight, float epsilon, int num_tokens,
+                            int hidden_size) {
+  norm_task_t t = {NORM_FUSED_ADD_F32, out, input, residual, weight, epsilon,
+                   hidden_size};
+  if (!norm_parallel(&t, num_tokens))
+    fused_add_rms_norm_f32_serial(out, input, residual, weight, epsilon,
+                                  num_tokens, hidden_size);
+}
+
+void rms_norm_bf16(uint16_t *out, const uint16_t *input, const uint16_t *weight,
+                   float epsilon, int num_tokens, int hidden_size) {
+  norm_task_t t = {NORM_RMS_BF16, out, input, NULL, weight, epsilon,
+                   hidden_size};
+  if (!norm_parallel(&t, num_tokens))
+    rms_norm_bf16_serial(out, input, weight, epsilon, num_tokens, hidden_size);
+}
+
+void fused_add_rms_norm_bf16(uint16_t *out, const uint16_t *input,
+                             uint16_t *residual, const uint16_t *weight,
+                             float epsilon, int num_tokens, int hidden_size) {
+  norm_task_t t = {NORM_FUSED_ADD_BF16, out, input, residual, weight, epsilon,
+                   hidden_size};
+  if (!norm_parallel(&t, num_tokens))
+    fused_add_rms_norm_bf16_serial(out, input, residual, weight, epsilon,
+                                   num_tokens, hidden_size);
+}
+
+void rms_norm_f16(uint16_t *out, const uint16_t *input, const uint16_t *weight,
+                  float epsilon, int num_tokens, int hidden_size) {
+  norm_task_t t = {NORM_RMS_F16, out, input, NULL, weight, epsilon,
+                   hidden_size};
+  if (!norm_parallel(&t, num_tokens))
+    rms_norm_f16_serial(out, input, weight, epsilon, num_tokens, hidden_size);
+}
+
+void fused_add_rms_norm_f16(uint16_t *out, const uint16_t *input,
+                            uint16_t *residual, const uint16_t *weight,
+                            float epsilon, int num_tokens, int hidden_size) {
+  norm_task_t t = {NORM_FUSED_ADD_F16, out, input, residual, weight, epsilon,
+                   hidden_size};
+  if (!norm_parallel(&t, num_tokens))
+    fused_add_rms_norm_f16_serial(out, input, residual, weight, epsilon,
+                                  num_tokens, hidden_size);
+}
@@ -1,14 +1,13 @@
 /*
- * Softmax - NEON Optimized + Multi-threaded Implementations with Thread Pool
+ * Softmax - NEON Optimized + Multi-threaded Implementations on the shared
+ * kernel thread pool
  */
 
 #include "inference/kernels/softmax/softmax_kernels.h"
+#include "inference/kernels/threadpool/threadpool.h"
 #include <math.h>
-#include <pthread.h>
-#include <stdatomic.h>
 #include <stdlib.h>
 #include <string.h>
-#include <unistd.h>
 
 #ifdef __APPLE__
 #include <Accelerate/Accelerate.h>
@@ -24,160 +23,12 @@
 #define HAS_NEON 0
 #endif
 
-#define MAX_THREADS 64
-
-typedef void (*work_fn_t)(void *arg, int start, int end);
-
-typedef struct {
-  pthread_t thread;
-  pthread_mutex_t mutex;
-  pthread_cond_t cond;
-  pthread_cond_t done_cond;
-  work_fn_t fn;
-  void *arg;
-  int start;
-  int end;
-  atomic_int busy;
-  atomic_int shutdown;
-} worker_t;
-
-typedef struct {
-  worker_t *workers;
-  int num_workers;
-  int initialized;
-  pthread_mutex_t init_mutex;
-} thread_pool_t;
-
-static thread_pool_t g_pool = {NULL, 0, 0, PTHREAD_MUTEX_INITIALIZER};
-static int g_num_threads = 0;
-
-static int get_cpu_count(void) {
-  int count = (int)sysconf(_SC_NPROCESSORS_ONLN);
-  return count > 0 ? count : 1;
-}
-
-static void *worker_thread(void *arg) {
-  worker_t *w = (worker_t *)arg;
-  while (1) {
-    pthread_mutex_lock(&w->mutex);
-    while (!atomic_load(&w->busy) && !atomic_load(&w->shutdown)) {
-      pthread_cond_wait(&w->cond, &w->mutex);
-    }
-    pthread_mutex_unlock(&w->mutex);
-
-    if (atomic_load(&w->shutdown))
-      break;
-
-    if (w->fn) {
-      w->fn(w->arg, w->start, w->end);
-    }
-
-    atomic_store(&w->busy, 0);
-    pthread_mutex_lock(&w->mutex);
-    pthread_cond_signal(&w->done_cond);
-    pthread_mutex_unlock(&w->mutex);
-  }
-  return NULL;
-}
-
-static void init_thread_pool(int num_threads) {
-  pthread_mutex_lock(&g_pool.init_mutex);
-  if (g_pool.initialized) {
-    pthread_mutex_unlock(&g_pool.init_mutex);
-    return;
-  }
-
-  if (num_threads > MAX_THREADS)
-    num_threads = MAX_THREADS;
-
-  g_pool.workers = (worker_t *)calloc(num_threads, sizeof(worker_t));
-  g_pool.num_workers = num_threads;
-
-  for (int i = 0; i < num_threads; i++) {
-    worker_t *w = &g_pool.workers[i];
-    pthread_mutex_init(&w->mutex, NULL);
-    pthread_cond_init(&w->cond, NULL);
-    pthread_cond_init(&w->done_cond, NULL);
-    atomic_store(&w->busy, 0);
-    atomic_store(&w->shutdown, 0);
-    pthread_create(&w->thread, NULL, worker_thread, w);
-  }
-
-  g_pool.initialized = 1;
-  pthread_mutex_unlock(&g_pool.init_mutex);
-}
-
-static void parallel_for(int start, int end, work_fn_t fn, void *arg) {
-  int total = end - start;
-  if (total <= 0)
-    return;
-
-  int num_threads = g_num_threads > 0 ? g_num_threads : get_cpu_count();
-
-  if (total < 8 || num_threads <= 1) {
-    fn(arg, start, end);
-    return;
-  }
-
-  if (!g_pool.initialized) {
-    init_thread_pool(num_threads);
-  }
-
-  int workers_to_use = num_threads - 1;
-  if (workers_to_use > g_pool.num_workers)
-    workers_to_use = g_pool.num_workers;
-  if (workers_to_use > total - 1)
-    workers_to_use = total - 1;
-
-  int chunk_size = (total + workers_to_use) / (workers_to_use + 1);
-  int current = start;
-
-  for (int i = 0; i < workers_to_use && current < end; i++) {
-    worker_t *w = &g_pool.workers[i];
-    int worker_end = current + chunk_size;
-    if (worker_end > end)
-      worker_end = end;
-
-    pthread_mutex_lock(&w->mutex);
-    w->fn = fn;
-    w->arg = arg;
-    w->start = current;
-    w->end = worker_end;
-    atomic_store(&w->busy, 1);
-    pthread_cond_signal(&w->cond);
-    pthread_mutex_unlock(&w->mutex);
-
-    current = worker_end;
-  }
-
-  if (current < end) {
-    fn(arg, current, end);
-  }
-
-  for (int i = 0; i < workers_to_use; i++) {
-    worker_t *w = &g_pool.workers[i];
-    pthread_mutex_lock(&w->mutex);
-    while (atomic_load(&w->busy)) {
-      pthread_cond_wait(&w->done_cond, &w->mutex);
-    }
-    pthread_mutex_unlock(&w->mutex);
-  }
-}
-
+/* Thread count is a property of the shared kernel thread pool. */
 void softmax_set_num_threads(int num_threads) {
-  if (num_threads <= 0) {
-    g_num_threads = get_cpu_count();
-  } else {
-    g_num_threads = num_threads;
-  }
+  threadpool_set_num_threads(num_threads);
 }
 
-int softmax_get_num_threads(void) {
-  if (g_num_threads == 0) {
-    g_num_threads = get_cpu_count();
-  }
-  return g_num_threads;
-}
+int softmax_get_num_threads(void) { return threadpool_get_num_threads(); }
 
 softmax_caps_t softmax_get_capabilities(void) {
   softmax_caps_t caps = {0};
@@ -189,6 +40,15 @@ softmax_caps_t softmax_get_capabilities(void) {
 
 #if HAS_NEON
 
+static void parallel_for(int start, int end, threadpool_fn fn, void *arg) {
+  if (end - start < 8) {
+    if (end > start)
+      fn(arg, start, end);
+    return;
+  }
+  threadpool_parallel_for(start, end, 1, fn, arg);
+}
+
 static inline float bf16_to_float(uint16_t bf16) {
   uint32_t bits = ((uint32_t)bf16) << 16;
   float result;
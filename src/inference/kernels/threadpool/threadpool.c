@@ -0,0 +1,326 @@
+/*
+ * Thread Pool - Parked Workers with Work-stealing Parallel-for
+ *
+ * A parallel-for cuts its range into chunks and deals them out as contiguous
+ * runs, one per participant. Each run is a lock-free deque packed into a
+ * single 64-bit word (lo | hi << 32): the owner pops chunks from lo, while a
+ * thief takes the upper half of a victim's run from hi and adopts it as its
+ * own. The submitting thread is participant 0, so a job completes even if no
+ * worker wakes up in time.
+ *
+ * Workers spin briefly on the job epoch after finishing, which keeps the
+ * back-to-back kernel launches of a forward pass free of syscalls, and then
+ * park on a condition variable.
+ */
+
+#include "inference/kernels/threadpool/threadpool.h"
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#endif
+
+#define THREADPOOL_MAX_THREADS 64
+#define THREADPOOL_CHUNKS_PER_THREAD 4
+#define THREADPOOL_SPIN_ITERS 20000
+#define THREADPOOL_YIELD_AFTER 256
+
+static int g_num_threads = 0;
+
+static int get_cpu_count(void) {
+#ifdef _WIN32
+  SYSTEM_INFO sysinfo;
+  GetSystemInfo(&sysinfo);
+  return sysinfo.dwNumberOfProcessors;
+#else
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+  return n > 0 ? (int)n : 1;
+#endif
+}
+
+void threadpool_set_num_threads(int num_threads) {
+  if (num_threads <= 0) {
+    g_num_threads = get_cpu_count();
+  } else {
+    g_num_threads = num_threads;
+  }
+}
+
+int threadpool_get_num_threads(void) {
+  if (g_num_threads == 0) {
+    g_num_threads = get_cpu_count();
+  }
+  return g_num_threads;
+}
+
+#ifdef _WIN32
+
+void threadpool_parallel_for(int start, int end, int grain, threadpool_fn fn,
+                             void *arg) {
+  (void)grain;
+  if (end > start)
+    fn(arg, start, end);
+}
+
+void threadpool_shutdown(void) {}
+
+#else
+
+static inline void cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__)
+  __asm__ __volatile__("yield");
+#endif
+}
+
+/* Busy-wait step: pause first, then give the CPU away so an oversubscribed
+ * machine can still schedule the threads being waited on. */
+static inline void spin_step(int spins) {
+  if (spins < THREADPOOL_YIELD_AFTER)
+    cpu_relax();
+  else
+    sched_yield();
+}
+
+typedef struct {
+  _Alignas(64) _Atomic uint64_t range;
+} tp_deque_t;
+
+typedef struct {
+  threadpool_fn fn;
+  void *arg;
+  int start, end, chunk;
+  tp_deque_t deques[THREADPOOL_MAX_THREADS];
+  _Alignas(64) atomic_int remaining;
+} tp_job_t;
+
+typedef struct {
+  pthread_t threads[THREADPOOL_MAX_THREADS];
+  int num_workers;
+  uint64_t generation;
+  pthread_mutex_t submit_mutex;
+  pthread_mutex_t park_mutex;
+  pthread_cond_t park_cond;
+  /* generation << 8 | participants; participants == 0 means idle. */
+  _Alignas(64) _Atomic uint64_t epoch;
+  atomic_int sleepers;
+  atomic_int active;
+  atomic_bool shutdown;
+  tp_job_t job;
+} tp_pool_t;
+
+static tp_pool_t g_pool = {
+    .submit_mutex = PTHREAD_MUTEX_INITIALIZER,
+    .park_mutex = PTHREAD_MUTEX_INITIALIZER,
+    .park_cond = PTHREAD_COND_INITIALIZER,
+};
+
+/* Set on workers and on a submitter while its job runs; nested parallel-fors
+ * on such threads run serially. */
+static _Thread_local bool tp_in_region = false;
+
+static inline uint64_t pack_range(uint32_t lo, uint32_t hi) {
+  return (uint64_t)lo | ((uint64_t)hi << 32);
+}
+
+static void tp_exec(tp_job_t *job, uint32_t c) {
+  int s = job->start + (int)c * job->chunk;
+  int e = s + job->chunk;
+  if (e > job->end)
+    e = job->end;
+  job->fn(job->arg, s, e);
+  atomic_fetch_sub(&job->remaining, 1);
+}
+
+static bool tp_pop(tp_deque_t *d, uint32_t *out) {
+  uint64_t r = atomic_load(&d->range);
+  for (;;) {
+    uint32_t lo = (uint32_t)r, hi = (uint32_t)(r >> 32);
+    if (lo >= hi)
+      return false;
+    if (atomic_compare_exchange_weak(&d->range, &r, pack_range(lo + 1, hi))) {
+      *out = lo;
+      return true;
+    }
+  }
+}
+
+/* Take the upper half of some other participant's run: run its first chunk
+ * now and keep the rest in our (empty) deque where it can be stolen again. */
+static bool tp_steal(tp_job_t *job, int self, int parts, uint32_t *out) {
+  for (int i = 1; i < parts; i++) {
+    tp_deque_t *victim = &job->deques[(self + i) % parts];
+    uint64_t r = atomic_load(&victim->range);
+    for (;;) {
+      uint32_t lo = (uint32_t)r, hi = (uint32_t)(r >> 32);
+      if (lo >= hi)
+        break;
+      uint32_t take = (hi - lo + 1) / 2;
+      if (atomic_compare_exchange_weak(&victim->range, &r,
+                                       pack_range(lo, hi - take))) {
+        *out = hi - take;
+        atomic_store(&job->deques[self].range, pack_range(hi - take + 1, hi));
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+static void tp_run(tp_job_t *job, int self, int parts) {
+  uint32_t c;
+  for (;;) {
+    if (tp_pop(&job->deques[self], &c) || tp_steal(job, self, parts, &c))
+      tp_exec(job, c);
+    else
+      return;
+  }
+}
+
+static uint64_t tp_wait(uint64_t seen) {
+  for (int i = 0; i < THREADPOOL_SPIN_ITERS; i++) {
+    uint64_t e = atomic_load(&g_pool.epoch);
+    if (e != seen || atomic_load(&g_pool.shutdown))
+      return e;
+    spin_step(i);
+  }
+
+  pthread_mutex_lock(&g_pool.park_mutex);
+  atomic_fetch_add(&g_pool.sleepers, 1);
+  while (atomic_load(&g_pool.epoch) == seen && !atomic_load(&g_pool.shutdown))
+    pthread_cond_wait(&g_pool.park_cond, &g_pool.park_mutex);
+  atomic_fetch_sub(&g_pool.sleepers, 1);
+  pthread_mutex_unlock(&g_pool.park_mutex);
+  return atomic_load(&g_pool.epoch);
+}
+
+static void *tp_worker_main(void *p) {
+  int self = (int)(intptr_t)p;
+  uint64_t seen = 0;
+  tp_in_region = true;
+
+  for (;;) {
+    uint64_t e = tp_wait(seen);
+    if (atomic_load(&g_pool.shutdown))
+      break;
+    seen = e;
+
+    int parts = (int)(e & 0xff);
+    if (self >= parts)
+      continue;
+
+    /* The submitter retires a job by moving the epoch on and then waiting
+     * for active to drain, so re-check the epoch after announcing ourselves. */
+    atomic_fetch_add(&g_pool.active, 1);
+    if (atomic_load(&g_pool.epoch) == e)
+      tp_run(&g_pool.job, self, parts);
+    atomic_fetch_sub(&g_pool.active, 1);
+  }
+  return NULL;
+}
+
+static int tp_ensure_workers(int n) {
+  while (g_pool.num_workers < n) {
+    int self = g_pool.num_workers + 1;
+    if (pthread_create(&g_pool.threads[g_pool.num_workers], NULL,
+                       tp_worker_main, (void *)(intptr_t)self) != 0)
+      break;
+    g_pool.num_workers++;
+  }
+  return g_pool.num_workers;
+}
+
+void threadpool_parallel_for(int start, int end, int grain, threadpool_fn fn,
+                             void *arg) {
+  int total = end - start;
+  if (total <= 0)
+    return;
+  if (grain < 1)
+    grain = 1;
+
+  int nt = threadpool_get_num_threads();
+  if (nt > THREADPOOL_MAX_THREADS)
+    nt = THREADPOOL_MAX_THREADS;
+
+  int target_chunks = nt * THREADPOOL_CHUNKS_PER_THREAD;
+  int chunk = (total + target_chunks - 1) / target_chunks;
+  if (chunk < grain)
+    chunk = grain;
+  int num_chunks = (total + chunk - 1) / chunk;
+  int parts = nt < num_chunks ? nt : num_chunks;
+
+  if (parts <= 1 || tp_in_region ||
+      pthread_mutex_trylock(&g_pool.submit_mutex) != 0) {
+    fn(arg, start, end);
+    return;
+  }
+
+  int workers = tp_ensure_workers(parts - 1);
+  if (parts > workers + 1)
+    parts = workers + 1;
+  if (parts <= 1) {
+    pthread_mutex_unlock(&g_pool.submit_mutex);
+    fn(arg, start, end);
+    return;
+  }
+
+  tp_job_t *job = &g_pool.job;
+  job->fn = fn;
+  job->arg = arg;
+  job->start = start;
+  job->end = end;
+  job->chunk = chunk;
+  atomic_store(&job->remaining, num_chunks);
+  for (int p = 0; p < parts; p++) {
+    uint32_t lo = (uint32_t)((int64_t)num_chunks * p / parts);
+    uint32_t hi = (uint32_t)((int64_t)num_chunks * (p + 1) / parts);
+    atomic_store(&job->deques[p].range, pack_range(lo, hi));
+  }
+
+  g_pool.generation++;
+  atomic_store(&g_pool.epoch, (g_pool.generation << 8) | (uint64_t)parts);
+  if (atomic_load(&g_pool.sleepers) > 0) {
+    pthread_mutex_lock(&g_pool.park_mutex);
+    pthread_cond_broadcast(&g_pool.park_cond);
+    pthread_mutex_unlock(&g_pool.park_mutex);
+  }
+
+  tp_in_region = true;
+  tp_run(job, 0, parts);
+  for (int spins = 0; atomic_load(&job->remaining) > 0; spins++)
+    spin_step(spins);
+
+  g_pool.generation++;
+  atomic_store(&g_pool.epoch, g_pool.generation << 8);
+  for (int spins = 0; atomic_load(&g_pool.active) > 0; spins++)
+    spin_step(spins);
+  tp_in_region = false;
+
+  pthread_mutex_unlock(&g_pool.submit_mutex);
+}
+
+void threadpool_shutdown(void) {
+  pthread_mutex_lock(&g_pool.submit_mutex);
+
+  pthread_mutex_lock(&g_pool.park_mutex);
+  atomic_store(&g_pool.shutdown, true);
+  pthread_cond_broadcast(&g_pool.park_cond);
+  pthread_mutex_unlock(&g_pool.park_mutex);
+
+  for (int i = 0; i < g_pool.num_workers; i++)
+    pthread_join(g_pool.threads[i], NULL);
+  g_pool.num_workers = 0;
+  atomic_store(&g_pool.shutdown, false);
+
+  pthread_mutex_unlock(&g_pool.submit_mutex);
+}
+
+#endif
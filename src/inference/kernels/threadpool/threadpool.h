@@ -0,0 +1,53 @@
+/*
+ * Process-wide Thread Pool for Inference Kernels
+ *
+ * A single set of parked worker threads shared by the gemm, attention,
+ * activation, norm and softmax kernels. Work is submitted as a parallel-for
+ * over an index range; the range is cut into grain-sized chunks that are
+ * dealt out to per-thread deques, and idle threads steal from the back of
+ * their neighbours' deques.
+ */
+
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Processes indices [start, end). May be called concurrently from several
+ * threads with disjoint ranges. */
+typedef void (*threadpool_fn)(void *arg, int start, int end);
+
+/*
+ * Number of threads (including the calling thread) a parallel-for may use.
+ * num_threads <= 0 resets to the number of online CPUs. Workers are started
+ * lazily on the first parallel-for that needs them.
+ */
+void threadpool_set_num_threads(int num_threads);
+int threadpool_get_num_threads(void);
+
+/*
+ * Run fn over [start, end) and return once every index has been processed.
+ *
+ * Args:
+ *   start, end: Index range
+ *   grain: Minimum number of indices per chunk (values < 1 mean 1)
+ *   fn: Chunk callback
+ *   arg: Passed through to fn
+ *
+ * The calling thread takes part in the work. Calls made from inside a running
+ * parallel-for, or while another thread owns the pool, run serially on the
+ * caller.
+ */
+void threadpool_parallel_for(int start, int end, int grain, threadpool_fn fn,
+                             void *arg);
+
+/* Stop and join all workers. The pool restarts on the next parallel-for. */
+void threadpool_shutdown(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* THREADPOOL_H */
@@ -188,6 +188,63 @@ bool qwen3_config_load(qwen3_config_t *config, const char *config_path) {
          config->num_hidden_layers > 0;
 }
 
+static int gguf_int(const gguf_file_t *gguf, const char *key, int fallback) {
+  const gguf_kv_t *kv = gguf_find_kv(gguf, key);
+  int64_t value;
+  return kv && gguf_kv_int(kv, &value) ? (int)value : fallback;
+}
+
+static float gguf_float(const gguf_file_t *gguf, const char *key,
+                        float fallback) {
+  const gguf_kv_t *kv = gguf_find_kv(gguf, key);
+  double value;
+  return kv && gguf_kv_float(kv, &value) ? (float)value : fallback;
+}
+
+bool qwen3_config_load_gguf(qwen3_config_t *config, const gguf_file_t *gguf) {
+  if (!config || !gguf)
+    return false;
+
+  memset(config, 0, sizeof(*config));
+
+  const gguf_kv_t *arch = gguf_find_kv(gguf, "general.architecture");
+  const char *name;
+  size_t len;
+  if (!arch || !gguf_kv_string(arch, &name, &len) || len != 5 ||
+      memcmp(name, "qwen3", 5) != 0) {
+    fprintf(stderr, "GGUF file is not a qwen3 model\n");
+    return false;
+  }
+
+  config->hidden_size = gguf_int(gguf, "qwen3.embedding_length", 0);
+  config->num_attention_heads = gguf_int(gguf, "qwen3.attention.head_count", 0);
+  config->num_key_value_heads =
+      gguf_int(gguf, "qwen3.attention.head_count_kv",
+               config->num_attention_heads);
+  config->num_hidden_layers = gguf_int(gguf, "qwen3.block_count", 0);
+  config->intermediate_size = gguf_int(gguf, "qwen3.feed_forward_length", 0);
+  config->max_position_embeddings = gguf_int(gguf, "qwen3.context_length", 0);
+  config->head_dim = gguf_int(gguf, "qwen3.attention.key_length", 0);
+  config->rope_theta = gguf_float(gguf, "qwen3.rope.freq_base", 10000.0f);
+  config->rms_norm_eps =
+      gguf_float(gguf, "qwen3.attention.layer_norm_rms_epsilon", 1e-6f);
+  strcpy(config->hidden_act, "silu");
+  config->bos_token_id = gguf_int(gguf, "tokenizer.ggml.bos_token_id", 0);
+  config->eos_token_id = gguf_int(gguf, "tokenizer.ggml.eos_token_id", 0);
+  config->tie_word_embeddings = !gguf_find_tensor(gguf, "output.weight");
+
+  /* Older converters leave out vocab_size; the embedding table has it. */
+  const gguf_tensor_t *embed = gguf_find_tensor(gguf, "token_embd.weight");
+  config->vocab_size = gguf_int(gguf, "qwen3.vocab_size",
+                                embed ? (int)embed->ne[1] : 0);
+
+  if (config->head_dim == 0 && config->num_attention_heads > 0)
+    config->head_dim = config->hidden_size / config->num_attention_heads;
+
+  return config->hidden_size > 0 && config->num_attention_heads > 0 &&
+         config->num_hidden_layers > 0 && config->vocab_size > 0;
+}
+
 void qwen3_config_free(qwen3_config_t *config) {
   if (config)
     memset(config, 0, sizeof(*config));
@@ -1,6 +1,7 @@
 #ifndef QWEN3_CONFIG_H
 #define QWEN3_CONFIG_H
 
+#include "inference/model_loader/gguf.h"
 #include <stdbool.h>
 #include <stddef.h>
 
@@ -23,6 +24,10 @@ typedef struct {
 } qwen3_config_t;
 
 bool qwen3_config_load(qwen3_config_t *config, const char *config_path);
+
+/* Fill config from the "qwen3.*" and tokenizer metadata of a GGUF file.
+ * The embeddings are tied when the file has no output.weight. */
+bool qwen3_config_load_gguf(qwen3_config_t *config, const gguf_file_t *gguf);
 void qwen3_config_free(qwen3_config_t *config);
 
 #endif
@@ -1,137 +1,185 @@
 #include "ffn.h"
 #include "inference/kernels/activation/activation.h"
 #include "inference/kernels/gemm/gemm.h"
-#include <stdlib.h>
-#include <string.h>
-
-static inline float fp16_to_float_ffn(uint16_t fp16) {
-  uint32_t sign = (fp16 & 0x8000) << 16;
-  uint32_t exp = (fp16 >> 10) & 0x1F;
-  uint32_t mant = fp16 & 0x3FF;
-
-  uint32_t f32_bits;
-  if (exp == 0) {
-    if (mant == 0) {
-      f32_bits = sign;
-    } else {
-      int e = -14;
-      while ((mant & 0x400) == 0) {
-        mant <<= 1;
-        e--;
-      }
-      mant &= 0x3FF;
-      f32_bits = sign | (((uint32_t)(e + 127)) << 23) | (mant << 13);
-    }
-  } else if (exp == 31) {
-    f32_bits = sign | 0x7F800000 | (mant << 13);
-  } else {
-    f32_bits = sign | (((uint32_t)(exp - 15 + 127)) << 23) | (mant << 13);
-  }
+#include "inference/kernels/convert/convert.h"
+#include "inference/kernels/threadpool/threadpool.h"
+#include <math.h>
+
+#if QWEN3_GATE_UP_BLOCK % GEMM_F16_PANEL != 0
+#error "gate/up blocks must start on a packed panel"
+#endif
+
+/*
+ * The gate/up projection with silu_and_mul as its epilogue. Items are the
+ * QWEN3_GATE_UP_BLOCK blocks of the fused matrix; a chunk of blocks is one
+ * contiguous run of rows, projected in a single GEMM into its own span of
+ * the gate_up buffer ([M, 2 * rows in the chunk]) and reduced to the
+ * activation while that span is still in cache. Unfused gate_proj and
+ * up_proj are grouped the same way: the chunk's gate rows fill the first
+ * half of its span and its up rows the second. GEMMs issued from inside the
+ * parallel-for run on the calling thread.
+ */
+typedef struct {
+  const void *input;
+  const qwen3_layer_weights_t *weights;
+  void *gate_up;
+  void *act;
+  int seq_len;
+  int hidden_size;
+  int intermediate_size;
+  const qwen3_plan_t *plan;
+} gate_up_ctx_t;
+
+/* Rows of the fused matrix that blocks [start, end) cover. */
+static void gate_up_rows(const gate_up_ctx_t *ctx, int start, int end,
+                         int *row0, int *rows) {
+  int I = ctx->intermediate_size;
+  int row1 = 2 * end * QWEN3_GATE_UP_BLOCK;
+  *row0 = 2 * start * QWEN3_GATE_UP_BLOCK;
+  *rows = (row1 < 2 * I ? row1 : 2 * I) - *row0;
+}
 
-  float result;
-  memcpy(&result, &f32_bits, sizeof(float));
-  return result;
+static int block_len(int intermediate_size, int block) {
+  int n = intermediate_size - block * QWEN3_GATE_UP_BLOCK;
+  return n < QWEN3_GATE_UP_BLOCK ? n : QWEN3_GATE_UP_BLOCK;
 }
 
-static inline uint16_t float_to_fp16_ffn(float x) {
-  uint32_t bits;
-  memcpy(&bits, &x, sizeof(float));
-  uint32_t sign = bits & 0x80000000;
-  uint32_t exp = (bits >> 23) & 0xFF;
-  uint32_t mant = bits & 0x7FFFFF;
-
-  if (exp == 0xFF) {
-    if (mant != 0)
-      return 0x7E00;
-    return (uint16_t)((sign >> 16) | 0x7C00);
+/* silu(gate) * up for the n units of a chunk of the unfused projections,
+ * whose outputs are [M, n] gate rows followed by [M, n] up rows. */
+static void silu_mul_parts_f32(float *act, int I, const float *out, int M,
+                               int n) {
+  for (int m = 0; m < M; m++) {
+    const float *gate = out + (size_t)m * n;
+    const float *up = out + (size_t)(M + m) * n;
+    for (int j = 0; j < n; j++)
+      act[(size_t)m * I + j] = gate[j] / (1.0f + expf(-gate[j])) * up[j];
   }
-  if (exp == 0 && mant == 0)
-    return (uint16_t)(sign >> 16);
-
-  int32_t new_exp = (int32_t)exp - 127 + 15;
-  if (new_exp <= 0)
-    return (uint16_t)(sign >> 16);
-  if (new_exp >= 31)
-    return (uint16_t)((sign >> 16) | 0x7C00);
-
-  uint16_t fp16_exp = (uint16_t)(new_exp << 10);
-  uint16_t fp16_mant = (uint16_t)(mant >> 13);
-  return (uint16_t)((sign >> 16) | fp16_exp | fp16_mant);
 }
 
-void qwen3_ffn_f32(float *output, const float *input, const float *gate_proj,
-                   const float *up_proj, const float *down_proj, int seq_len,
-                   int hidden_size, int intermediate_size) {
-  float *gate = (float *)malloc(seq_len * intermediate_size * sizeof(float));
-  float *up = (float *)malloc(seq_len * intermediate_size * sizeof(float));
-  if (!gate || !up) {
-    if (gate)
-      free(gate);
-    if (up)
-      free(up);
-    return;
+static void silu_mul_parts_f16(uint16_t *act, int I, const uint16_t *out,
+                               int M, int n) {
+  for (int m = 0; m < M; m++) {
+    const uint16_t *gate = out + (size_t)m * n;
+    const uint16_t *up = out + (size_t)(M + m) * n;
+    for (int j = 0; j < n; j++) {
+      float g = fp16_to_f32(gate[j]);
+      act[(size_t)m * I + j] =
+          f32_to_fp16(g / (1.0f + expf(-g)) * fp16_to_f32(up[j]));
+    }
   }
+}
 
-  gemm_f32(input, gate_proj, gate, seq_len, intermediate_size, hidden_size,
-           false, true);
-
-  gemm_f32(input, up_proj, up, seq_len, intermediate_size, hidden_size, false,
-           true);
-
-  silu_f32(gate, gate, seq_len, intermediate_size);
-
-  for (int i = 0; i < seq_len * intermediate_size; i++) {
-    gate[i] = gate[i] * up[i];
+static void gate_up_range_f32(void *arg, int start, int end) {
+  const gate_up_ctx_t *ctx = (const gate_up_ctx_t *)arg;
+  int M = ctx->seq_len, I = ctx->intermediate_size, K = ctx->hidden_size;
+  int row0, rows;
+  gate_up_rows(ctx, start, end, &row0, &rows);
+  float *out = (float *)ctx->gate_up + (size_t)M * row0;
+  float *act = (float *)ctx->act;
+  const qwen3_layer_weights_t *w = ctx->weights;
+
+  if (!w->gate_up_proj) {
+    int unit = start * QWEN3_GATE_UP_BLOCK, n = rows / 2;
+    size_t offset = (size_t)unit * K;
+    gemm_f32((const float *)ctx->input, (const float *)w->gate_proj + offset,
+             out, M, n, K, false, true);
+    gemm_f32((const float *)ctx->input, (const float *)w->up_proj + offset,
+             out + (size_t)M * n, M, n, K, false, true);
+    silu_mul_parts_f32(act + unit, I, out, M, n);
+    return;
   }
 
-  gemm_f32(gate, down_proj, output, seq_len, hidden_size, intermediate_size,
+  gemm_f32((const float *)ctx->input,
+           (const float *)w->gate_up_proj + (size_t)row0 * K, out, M, rows, K,
            false, true);
 
-  free(gate);
-  free(up);
+  for (int m = 0; m < M; m++) {
+    const float *row = out + (size_t)m * rows;
+    for (int b = start; b < end; b++)
+      silu_and_mul_f32(act + (size_t)m * I + b * QWEN3_GATE_UP_BLOCK,
+                       row + 2 * (b - start) * QWEN3_GATE_UP_BLOCK, 1,
+                       block_len(I, b));
+  }
 }
 
-void qwen3_ffn_f16(uint16_t *output, const uint16_t *input,
-                   const uint16_t *gate_proj, const uint16_t *up_proj,
-                   const uint16_t *down_proj, int seq_len, int hidden_size,
-                   int intermediate_size) {
-  uint16_t *gate =
-      (uint16_t *)malloc(seq_len * intermediate_size * sizeof(uint16_t));
-  uint16_t *up =
-      (uint16_t *)malloc(seq_len * intermediate_size * sizeof(uint16_t));
-  uint16_t *gate_up =
-      (uint16_t *)malloc(seq_len * intermediate_size * 2 * sizeof(uint16_t));
-  uint16_t *gate_out =
-      (uint16_t *)malloc(seq_len * intermediate_size * sizeof(uint16_t));
-  if (!gate || !up || !gate_up || !gate_out) {
-    if (gate)
-      free(gate);
-    if (up)
-      free(up);
-    if (gate_up)
-      free(gate_up);
-    if (gate_out)
-      free(gate_out);
+static void gate_up_range_f16(void *arg, int start, int end) {
+  const gate_up_ctx_t *ctx = (const gate_up_ctx_t *)arg;
+  int M = ctx->seq_len, I = ctx->intermediate_size, K = ctx->hidden_size;
+  int row0, rows;
+  gate_up_rows(ctx, start, end, &row0, &rows);
+  uint16_t *out = (uint16_t *)ctx->gate_up + (size_t)M * row0;
+  uint16_t *act = (uint16_t *)ctx->act;
+  const qwen3_layer_weights_t *w = ctx->weights;
+  const qwen3_plan_t *plan = ctx->plan;
+
+  if (!w->gate_up_proj) {
+    int unit = start * QWEN3_GATE_UP_BLOCK, n = rows / 2;
+    qwen3_linear_rows_f16((const uint16_t *)ctx->input, w->gate_proj, I, unit,
+                          out, M, n, K, plan->dtype, plan->packed);
+    qwen3_linear_rows_f16((const uint16_t *)ctx->input, w->up_proj, I, unit,
+                          out + (size_t)M * n, M, n, K, plan->dtype,
+                          plan->packed);
+    silu_mul_parts_f16(act + unit, I, out, M, n);
     return;
   }
 
-  gemm_f16(input, gate_proj, gate, seq_len, intermediate_size, hidden_size);
-  gemm_f16(input, up_proj, up, seq_len, intermediate_size, hidden_size);
+  qwen3_linear_rows_f16((const uint16_t *)ctx->input, w->gate_up_proj, 2 * I,
+                        row0, out, M, rows, K, plan->dtype, plan->packed);
 
-  for (int i = 0; i < seq_len; i++) {
-    memcpy(gate_up + i * 2 * intermediate_size, gate + i * intermediate_size,
-           intermediate_size * sizeof(uint16_t));
-    memcpy(gate_up + i * 2 * intermediate_size + intermediate_size,
-           up + i * intermediate_size, intermediate_size * sizeof(uint16_t));
+  for (int m = 0; m < M; m++) {
+    const uint16_t *row = out + (size_t)m * rows;
+    for (int b = start; b < end; b++)
+      silu_and_mul_f16(act + (size_t)m * I + b * QWEN3_GATE_UP_BLOCK,
+                       row + 2 * (b - start) * QWEN3_GATE_UP_BLOCK, 1,
+                       block_len(I, b));
   }
+}
 
-  silu_and_mul_f16(gate_out, gate_up, seq_len, intermediate_size);
+/* A single position is cut into about four runs of blocks per thread, few
+ * enough that each GEMV streams a long stretch of weights and enough for
+ * stealing to even out the threads; longer calls give each thread one run,
+ * which keeps the GEMMs large and reads the input once per thread. */
+static void gate_up_silu(gate_up_ctx_t *ctx, threadpool_fn fn) {
+  int blocks = (ctx->intermediate_size + QWEN3_GATE_UP_BLOCK - 1) /
+               QWEN3_GATE_UP_BLOCK;
+  int runs = threadpool_get_num_threads() * (ctx->seq_len > 1 ? 1 : 4);
+  threadpool_parallel_for(0, blocks, (blocks + runs - 1) / runs, fn, ctx);
+}
 
-  gemm_f16(gate_out, down_proj, output, seq_len, hidden_size,
-           intermediate_size);
+void qwen3_ffn_f32(float *output, const float *input,
+                   const qwen3_layer_weights_t *weights, int seq_len,
+                   int hidden_size, int intermediate_size,
+                   const qwen3_plan_t *plan) {
+  float *act = (float *)qwen3_plan_buffer(plan, QWEN3_BUF_ACT);
+  gate_up_ctx_t ctx = {input,
+                       weights,
+                       qwen3_plan_buffer(plan, QWEN3_BUF_GATE_UP),
+                       act,
+                       seq_len,
+                       hidden_size,
+                       intermediate_size,
+                       plan};
+  gate_up_silu(&ctx, gate_up_range_f32);
+
+  gemm_f32(act, (const float *)weights->down_proj, output, seq_len,
+           hidden_size, intermediate_size, false, true);
+}
 
-  free(gate);
-  free(up);
-  free(gate_up);
-  free(gate_out);
+void qwen3_ffn_f16(uint16_t *output, const uint16_t *input,
+                   const qwen3_layer_weights_t *weights, int seq_len,
+                   int hidden_size, int intermediate_size,
+                   const qwen3_plan_t *plan) {
+  uint16_t *act = (uint16_t *)qwen3_plan_buffer(plan, QWEN3_BUF_ACT);
+  gate_up_ctx_t ctx = {input,
+                       weights,
+                       qwen3_plan_buffer(plan, QWEN3_BUF_GATE_UP),
+                       act,
+                       seq_len,
+                       hidden_size,
+                       intermediate_size,
+                       plan};
+  gate_up_silu(&ctx, gate_up_range_f16);
+
+  qwen3_linear_f16(act, weights->down_proj, output, seq_len, hidden_size,
+                   intermediate_size, plan->dtype, plan->packed);
 }
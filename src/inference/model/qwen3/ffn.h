@@ -1,16 +1,21 @@
 #ifndef QWEN3_FFN_H
 #define QWEN3_FFN_H
 
+#include "plan.h"
 #include <stddef.h>
 #include <stdint.h>
 
-void qwen3_ffn_f32(float *output, const float *input, const float *gate_proj,
-                   const float *up_proj, const float *down_proj, int seq_len,
-                   int hidden_size, int intermediate_size);
+/* The gate/up projection is fused or in parts as described in weights.h;
+ * silu(gate) * up is applied as each block of it is computed. */
+void qwen3_ffn_f32(float *output, const float *input,
+                   const qwen3_layer_weights_t *weights, int seq_len,
+                   int hidden_size, int intermediate_size,
+                   const qwen3_plan_t *plan);
 
+/* Projections as for qwen3_attention_layer_f16. */
 void qwen3_ffn_f16(uint16_t *output, const uint16_t *input,
-                   const uint16_t *gate_proj, const uint16_t *up_proj,
-                   const uint16_t *down_proj, int seq_len, int hidden_size,
-                   int intermediate_size);
+                   const qwen3_layer_weights_t *weights, int seq_len,
+                   int hidden_size, int intermediate_size,
+                   const qwen3_plan_t *plan);
 
 #endif
@@ -0,0 +1,163 @@
+#include "plan.h"
+#include "attention_layer.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PLAN_ALIGN 64
+
+/* Steps of one forward pass. The layer steps repeat per layer, so a buffer
+ * that must survive from one layer to the next spans the whole pass. */
+typedef enum {
+  STEP_EMBED = 0,
+  STEP_ATTN_NORM,
+  STEP_QKV,
+  STEP_ATTN,
+  STEP_O_PROJ,
+  STEP_FFN_NORM,
+  STEP_GATE_UP,
+  STEP_DOWN,
+  STEP_RESIDUAL,
+  STEP_LM_HEAD,
+} plan_step_t;
+
+typedef struct {
+  size_t size;
+  plan_step_t first, last;
+} plan_buffer_t;
+
+static size_t align_up(size_t n) {
+  return (n + PLAN_ALIGN - 1) & ~(size_t)(PLAN_ALIGN - 1);
+}
+
+static void describe_buffers(plan_buffer_t *bufs, const qwen3_config_t *config,
+                             qwen3_dtype_t dtype, int max_tokens) {
+  size_t T = (size_t)max_tokens;
+  size_t H = (size_t)config->hidden_size;
+  size_t I = (size_t)config->intermediate_size;
+  size_t q_dim = (size_t)config->num_attention_heads * config->head_dim;
+  size_t kv_dim = (size_t)config->num_key_value_heads * config->head_dim;
+  bool f16 = qwen3_dtype_f16_act(dtype);
+  size_t elem = f16 ? sizeof(uint16_t) : sizeof(float);
+
+#define BUF(id, bytes, from, to)                                               \
+  bufs[id] = (plan_buffer_t){(bytes), (from), (to)}
+
+  BUF(QWEN3_BUF_TOKEN_IDS, T * sizeof(int64_t), STEP_EMBED, STEP_EMBED);
+  BUF(QWEN3_BUF_POSITION_IDS, T * sizeof(int64_t), STEP_EMBED, STEP_LM_HEAD);
+  BUF(QWEN3_BUF_HIDDEN_A, T * H * elem, STEP_EMBED, STEP_LM_HEAD);
+  BUF(QWEN3_BUF_HIDDEN_B, T * H * elem, STEP_EMBED, STEP_LM_HEAD);
+
+  BUF(QWEN3_BUF_RESIDUAL, T * H * elem, STEP_ATTN_NORM, STEP_RESIDUAL);
+  BUF(QWEN3_BUF_NORM_OUT, T * H * elem, STEP_ATTN_NORM, STEP_GATE_UP);
+  /* The f16 layer reuses the attention output for the FFN output. */
+  BUF(QWEN3_BUF_ATTN_OUT, T * H * elem, STEP_O_PROJ,
+      f16 ? STEP_RESIDUAL : STEP_FFN_NORM);
+
+  /* The fused projection's output. A single position uses q, k and v in
+   * place; longer calls split it into the Q, K and V buffers, of which K
+   * and V only live until they are appended to the cache. */
+  BUF(QWEN3_BUF_QKV, T * (q_dim + 2 * kv_dim) * elem, STEP_QKV, STEP_ATTN);
+  BUF(QWEN3_BUF_Q, T * q_dim * elem, STEP_QKV, STEP_ATTN);
+  BUF(QWEN3_BUF_K, T * kv_dim * elem, STEP_QKV, STEP_QKV);
+  BUF(QWEN3_BUF_V, T * kv_dim * elem, STEP_QKV, STEP_QKV);
+  BUF(QWEN3_BUF_ATTN_HEADS, T * q_dim * elem, STEP_ATTN, STEP_O_PROJ);
+  BUF(QWEN3_BUF_ATTN_SCRATCH,
+      qwen3_attention_scratch_bytes(config->num_attention_heads,
+                                    config->num_key_value_heads,
+                                    config->head_dim),
+      STEP_ATTN, STEP_ATTN);
+
+  /* The gate/up projection's output in its block layout; silu(gate) * up
+   * is written from it by the same step. */
+  BUF(QWEN3_BUF_GATE_UP, 2 * T * I * elem, STEP_GATE_UP, STEP_GATE_UP);
+  BUF(QWEN3_BUF_ACT, T * I * elem, STEP_GATE_UP, STEP_DOWN);
+  /* f32 logits go straight to the caller's buffer. */
+  BUF(QWEN3_BUF_LOGITS, f16 ? (size_t)config->vocab_size * elem : 0,
+      STEP_LM_HEAD, STEP_LM_HEAD);
+
+#undef BUF
+}
+
+static bool lifetimes_overlap(const plan_buffer_t *a, const plan_buffer_t *b) {
+  return a->first <= b->last && b->first <= a->last;
+}
+
+/*
+ * Greedy-by-size placement: the largest buffers are placed first, each at
+ * the lowest offset that does not collide with an already placed buffer
+ * whose lifetime overlaps its own.
+ */
+static size_t assign_offsets(const plan_buffer_t *bufs, size_t *offsets) {
+  int order[QWEN3_BUF_COUNT];
+  bool placed[QWEN3_BUF_COUNT] = {false};
+  size_t arena_size = 0;
+
+  for (int i = 0; i < QWEN3_BUF_COUNT; i++) {
+    int j = i;
+    while (j > 0 && bufs[order[j - 1]].size < bufs[i].size) {
+      order[j] = order[j - 1];
+      j--;
+    }
+    order[j] = i;
+  }
+
+  for (int n = 0; n < QWEN3_BUF_COUNT; n++) {
+    int id = order[n];
+    size_t size = align_up(bufs[id].size);
+    size_t offset = 0;
+
+    /* Bump past every conflicting neighbour until the slot is free. Each
+     * pass either finds the slot or moves strictly higher. */
+    bool moved = true;
+    while (moved) {
+      moved = false;
+      for (int other = 0; other < QWEN3_BUF_COUNT; other++) {
+        if (!placed[other] || !lifetimes_overlap(&bufs[id], &bufs[other]))
+          continue;
+        size_t lo = offsets[other];
+        size_t hi = lo + align_up(bufs[other].size);
+        if (offset < hi && lo < offset + size) {
+          offset = hi;
+          moved = true;
+        }
+      }
+    }
+
+    offsets[id] = offset;
+    placed[id] = true;
+    if (offset + size > arena_size)
+      arena_size = offset + size;
+  }
+  return arena_size;
+}
+
+bool qwen3_plan_init(qwen3_plan_t *plan, const qwen3_config_t *config,
+                     qwen3_dtype_t dtype, int max_tokens) {
+  if (!plan || !config || max_tokens <= 0)
+    return false;
+
+  memset(plan, 0, sizeof(*plan));
+  plan->max_tokens = max_tokens;
+  plan->dtype = dtype;
+
+  plan_buffer_t bufs[QWEN3_BUF_COUNT];
+  describe_buffers(bufs, config, dtype, max_tokens);
+  for (int i = 0; i < QWEN3_BUF_COUNT; i++)
+    plan->size[i] = bufs[i].size;
+  plan->arena_size = assign_offsets(bufs, plan->offset);
+
+  plan->arena = aligned_alloc(PLAN_ALIGN, plan->arena_size);
+  if (!plan->arena)
+    return false;
+  /* Fault every page in now rather than on the first forward pass. */
+  memset(plan->arena, 0, plan->arena_size);
+  return true;
+}
+
+void qwen3_plan_free(qwen3_plan_t *plan) {
+  if (!plan)
+    return;
+  free(plan->arena);
+  memset(plan, 0, sizeof(*plan));
+}
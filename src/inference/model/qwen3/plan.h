@@ -0,0 +1,64 @@
+#ifndef QWEN3_PLAN_H
+#define QWEN3_PLAN_H
+
+#include "config.h"
+#include "weights.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * Static execution plan for qwen3_forward.
+ *
+ * Every activation a forward pass touches is listed here with the span of
+ * steps it is live for. At load time the plan gives each buffer an offset
+ * in one arena, sized for max_tokens positions per call, so that buffers
+ * whose lifetimes never overlap share memory and no step allocates.
+ * Longer prompts are fed through the layers in max_tokens chunks.
+ */
+
+#define QWEN3_PLAN_DEFAULT_MAX_TOKENS 512
+
+typedef enum {
+  QWEN3_BUF_TOKEN_IDS = 0,
+  QWEN3_BUF_POSITION_IDS,
+  QWEN3_BUF_HIDDEN_A,
+  QWEN3_BUF_HIDDEN_B,
+  QWEN3_BUF_RESIDUAL,
+  QWEN3_BUF_NORM_OUT,
+  QWEN3_BUF_ATTN_OUT,
+  QWEN3_BUF_QKV,
+  QWEN3_BUF_Q,
+  QWEN3_BUF_K,
+  QWEN3_BUF_V,
+  QWEN3_BUF_ATTN_HEADS,
+  QWEN3_BUF_ATTN_SCRATCH,
+  QWEN3_BUF_GATE_UP,
+  QWEN3_BUF_ACT,
+  QWEN3_BUF_LOGITS,
+  QWEN3_BUF_COUNT
+} qwen3_buffer_t;
+
+typedef struct {
+  int max_tokens;
+  /* Model dtype; the layers pick their projection kernels from it. */
+  qwen3_dtype_t dtype;
+  /* The FP16 projections are prepacked (qwen3_weights_t.packed). */
+  bool packed;
+  size_t offset[QWEN3_BUF_COUNT];
+  size_t size[QWEN3_BUF_COUNT];
+  size_t arena_size;
+  void *arena;
+} qwen3_plan_t;
+
+/* Lay out the arena for calls of up to max_tokens positions and allocate it
+ * with every page already touched. */
+bool qwen3_plan_init(qwen3_plan_t *plan, const qwen3_config_t *config,
+                     qwen3_dtype_t dtype, int max_tokens);
+void qwen3_plan_free(qwen3_plan_t *plan);
+
+static inline void *qwen3_plan_buffer(const qwen3_plan_t *plan,
+                                      qwen3_buffer_t buf) {
+  return (char *)plan->arena + plan->offset[buf];
+}
+
+#endif
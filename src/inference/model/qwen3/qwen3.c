@@ -1,32 +1,66 @@
 #include "qwen3.h"
+#include "inference/kernels/convert/convert.h"
 #include "inference/kernels/embedding/embedding.h"
 #include "inference/kernels/gemm/gemm.h"
+#include "inference/kernels/kv_cache/kv_cache.h"
 #include "inference/kernels/norm/layernorm.h"
 #include "inference/kernels/rope/rope.h"
 #include "inference/kernels/sampling/sampling.h"
+#include "session.h"
 #include "transformer_layer.h"
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 bool qwen3_model_load(qwen3_model_t *model, const char *model_dir,
                       qwen3_dtype_t dtype) {
+  return qwen3_model_load_with_mode(model, model_dir, dtype, QWEN3_LOAD_MMAP);
+}
+
+bool qwen3_model_load_with_mode(qwen3_model_t *model, const char *model_dir,
+                                qwen3_dtype_t dtype, qwen3_load_mode_t mode) {
   if (!model || !model_dir)
     return false;
 
   memset(model, 0, sizeof(*model));
   model->dtype = dtype;
 
-  char config_path[512];
-  snprintf(config_path, sizeof(config_path), "%s/config.json", model_dir);
-  if (!qwen3_config_load(&model->config, config_path)) {
-    fprintf(stderr, "Failed to load config from %s\n", config_path);
-    return false;
-  }
-
+  /* A GGUF file carries its config as metadata next to the tensors. */
   char model_path[512];
-  snprintf(model_path, sizeof(model_path), "%s/model.safetensors", model_dir);
-  if (!qwen3_weights_load(&model->weights, &model->config, model_path, dtype)) {
+  size_t dir_len = strlen(model_dir);
+  if (dir_len > 5 && strcmp(model_dir + dir_len - 5, ".gguf") == 0) {
+    gguf_file_t gguf;
+    if (!gguf_open(&gguf, model_dir))
+      return false;
+    bool loaded = qwen3_config_load_gguf(&model->config, &gguf);
+    gguf_close(&gguf);
+    if (!loaded) {
+      fprintf(stderr, "Failed to load config from %s\n", model_dir);
+      return false;
+    }
+    snprintf(model_path, sizeof(model_path), "%s", model_dir);
+  } else {
+    char config_path[512];
+    snprintf(config_path, sizeof(config_path), "%s/config.json", model_dir);
+    if (!qwen3_config_load(&model->config, config_path)) {
+      fprintf(stderr, "Failed to load config from %s\n", config_path);
+      return false;
+    }
+
+    /* Sharded checkpoints ship an index naming the file of every tensor. */
+    snprintf(model_path, sizeof(model_path),
+             "%s/model.safetensors.index.json", model_dir);
+    FILE *index_file = fopen(model_path, "rb");
+    if (index_file) {
+      fclose(index_file);
+    } else {
+      snprintf(model_path, sizeof(model_path), "%s/model.safetensors",
+               model_dir);
+    }
+  }
+  if (!qwen3_weights_load_with_mode(&model->weights, &model->config,
+                                    model_path, dtype, mode)) {
     fprintf(stderr, "Failed to load weights from %s\n", model_path);
     qwen3_config_free(&model->config);
     return false;
@@ -34,34 +68,27 @@ bool qwen3_model_load(qwen3_model_t *model, const char *model_dir,
 
   model->max_seq_len = model->config.max_position_embeddings;
 
-  model->key_cache =
-      (void **)calloc(model->config.num_hidden_layers, sizeof(void *));
-  model->value_cache =
-      (void **)calloc(model->config.num_hidden_layers, sizeof(void *));
   model->cache_len =
       (int *)calloc(model->config.num_hidden_layers, sizeof(int));
-
-  if (!model->key_cache || !model->value_cache || !model->cache_len) {
+  model->cache_tokens = (int *)malloc(model->max_seq_len * sizeof(int));
+  if (!model->cache_len || !model->cache_tokens) {
     qwen3_model_free(model);
     return false;
   }
 
-  int kv_cache_size = model->max_seq_len * model->config.num_key_value_heads *
-                      model->config.head_dim;
   size_t elem_size =
-      (dtype == QWEN3_DTYPE_F16) ? sizeof(uint16_t) : sizeof(float);
-  for (int i = 0; i < model->config.num_hidden_layers; i++) {
-    model->key_cache[i] = calloc(kv_cache_size, elem_size);
-    model->value_cache[i] = calloc(kv_cache_size, elem_size);
-    if (!model->key_cache[i] || !model->value_cache[i]) {
-      qwen3_model_free(model);
-      return false;
-    }
+      qwen3_dtype_f16_act(dtype) ? sizeof(uint16_t) : sizeof(float);
+  if (!kv_pool_init(&model->kv_pool, model->config.num_hidden_layers,
+                    model->config.num_key_value_heads, model->config.head_dim,
+                    elem_size, KV_PAGE_DEFAULT_TOKENS, 0)) {
+    qwen3_model_free(model);
+    return false;
   }
+  kv_seq_init(&model->kv_seq, &model->kv_pool);
 
   int rot_dim = model->config.head_dim;
   int cache_size = model->max_seq_len * rot_dim * 2;
-  if (dtype == QWEN3_DTYPE_F16) {
+  if (qwen3_dtype_f16_act(dtype)) {
     float *cos_sin_f32 = (float *)malloc(cache_size * sizeof(float));
     if (!cos_sin_f32) {
       qwen3_model_free(model);
@@ -88,12 +115,14 @@ bool qwen3_model_load(qwen3_model_t *model, const char *model_dir,
                                    model->config.rope_theta);
   }
 
-  model->temp_buffer_size = model->config.hidden_size * 8;
-  model->temp_buffer = malloc(model->temp_buffer_size * elem_size);
-  if (!model->temp_buffer) {
+  int max_tokens = QWEN3_PLAN_DEFAULT_MAX_TOKENS;
+  if (max_tokens > model->max_seq_len)
+    max_tokens = model->max_seq_len;
+  if (!qwen3_plan_init(&model->plan, &model->config, dtype, max_tokens)) {
     qwen3_model_free(model);
     return false;
   }
+  model->plan.packed = model->weights.packed;
 
   return true;
 }
@@ -105,98 +134,328 @@ void qwen3_model_free(qwen3_model_t *model) {
   qwen3_config_free(&model->config);
   qwen3_weights_free(&model->weights);
 
-  if (model->key_cache) {
-    for (int i = 0; i < model->config.num_hidden_layers; i++) {
-      if (model->key_cache[i])
-        free(model->key_cache[i]);
-    }
-    free(model->key_cache);
-  }
-
-  if (model->value_cache) {
-    for (int i = 0; i < model->config.num_hidden_layers; i++) {
-      if (model->value_cache[i])
-        free(model->value_cache[i]);
-    }
-    free(model->value_cache);
-  }
+  kv_seq_free(&model->kv_seq);
+  kv_pool_free(&model->kv_pool);
 
   if (model->cache_len)
     free(model->cache_len);
+  if (model->cache_tokens)
+    free(model->cache_tokens);
 
   if (model->cos_sin_cache)
     free(model->cos_sin_cache);
 
-  if (model->temp_buffer)
-    free(model->temp_buffer);
+  qwen3_plan_free(&model->plan);
 
   memset(model, 0, sizeof(*model));
 }
 
 void qwen3_model_reset_cache(qwen3_model_t *model) {
-  if (!model || !model->cache_len)
+  qwen3_model_truncate_cache(model, 0);
+  if (model)
+    memset(&model->cache_gap, 0, sizeof(model->cache_gap));
+}
+
+void qwen3_model_truncate_cache(qwen3_model_t *model, int num_tokens) {
+  if (!model || !model->cache_len || num_tokens < 0)
+    return;
+  if (num_tokens >= model->cache_len[0])
     return;
   for (int i = 0; i < model->config.num_hidden_layers; i++) {
-    model->cache_len[i] = 0;
+    model->cache_len[i] = num_tokens;
   }
+  kv_seq_truncate(&model->kv_seq, num_tokens);
+  /* Nothing cached follows the gap any more. */
+  if (num_tokens <= model->cache_gap.at)
+    memset(&model->cache_gap, 0, sizeof(model->cache_gap));
 }
 
-bool qwen3_forward(qwen3_model_t *model, float *logits, const int *token_ids,
-                   int num_tokens) {
-  if (!model || !logits || !token_ids || num_tokens <= 0)
+static uint64_t hash_tokens(uint64_t hash, const int *tokens, int n) {
+  for (int i = 0; i < n; i++) {
+    uint32_t token = (uint32_t)tokens[i];
+    for (int b = 0; b < 4; b++) {
+      hash ^= (token >> (8 * b)) & 0xff;
+      hash *= 0x100000001b3ull;
+    }
+  }
+  return hash;
+}
+
+/* Record that n more history tokens, following whatever the gap already
+ * covers, were dropped after the first keep cached positions. */
+static void grow_gap(qwen3_model_t *model, int keep, const int *tokens,
+                     int n) {
+  qwen3_cache_gap_t *gap = &model->cache_gap;
+  if (gap->len > 0 && gap->at != keep) {
+    /* Two gaps cannot be matched against a prompt; give up on the old one
+     * and match cache_tokens as they stand. */
+    memset(gap, 0, sizeof(*gap));
+    return;
+  }
+  if (gap->len == 0) {
+    gap->at = keep;
+    gap->hash = 0xcbf29ce484222325ull;
+  }
+  gap->hash = hash_tokens(gap->hash, tokens, n);
+  gap->len += n;
+}
+
+/* Keys are re-rotated in FP32 whatever the cache stores. */
+static void load_key_row(const qwen3_model_t *model,
+                         const kv_layer_view_t *view, int pos, float *out) {
+  int n = view->num_heads * view->head_dim;
+  if (view->quantized) {
+    const int8_t *q = (const int8_t *)kv_view_key(view, pos);
+    const float *scale = kv_view_key_scale(view, pos);
+    for (int i = 0; i < n; i++)
+      out[i] = q[i] * scale[i / view->head_dim];
+  } else if (qwen3_dtype_f16_act(model->dtype)) {
+    convert_f16_to_f32((const uint16_t *)kv_view_key(view, pos), out, n);
+  } else {
+    memcpy(out, kv_view_key(view, pos), n * sizeof(float));
+  }
+}
+
+static void store_key_row(const qwen3_model_t *model,
+                          const kv_layer_view_t *view, int pos,
+                          const float *row) {
+  int n = view->num_heads * view->head_dim;
+  if (view->quantized) {
+    int8_t *q = (int8_t *)kv_view_key(view, pos);
+    float *scale = kv_view_key_scale(view, pos);
+    for (int h = 0; h < view->num_heads; h++)
+      kv_cache_quantize_q8(q + h * view->head_dim, &scale[h],
+                           row + h * view->head_dim, view->head_dim);
+  } else if (qwen3_dtype_f16_act(model->dtype)) {
+    convert_f32_to_f16(row, (uint16_t *)kv_view_key(view, pos), n);
+  } else {
+    memcpy(kv_view_key(view, pos), row, n * sizeof(float));
+  }
+}
+
+bool qwen3_model_shift_cache(qwen3_model_t *model, int keep, int discard) {
+  if (!model || !model->cache_len || keep < 0 || discard <= 0)
+    return false;
+  int len = model->cache_len[0];
+  if (keep + discard > len)
     return false;
 
-  int64_t *token_ids_i64 = (int64_t *)malloc(num_tokens * sizeof(int64_t));
-  if (!token_ids_i64)
+  const qwen3_config_t *config = &model->config;
+  int head_dim = config->head_dim;
+  int row = config->num_key_value_heads * head_dim;
+
+  /* A key cached at position p carries the rotation p * theta_i. Moving it
+   * to p - discard means rotating back by discard * theta_i: one cos/sin
+   * row, computed as rope_compute_cos_sin_cache_f32 would, with its sines
+   * negated. */
+  float *rotate_back = (float *)malloc((size_t)(head_dim + row) *
+                                       sizeof(float));
+  if (!rotate_back)
     return false;
-  for (int i = 0; i < num_tokens; i++) {
-    token_ids_i64[i] = token_ids[i];
+  float *key = rotate_back + head_dim;
+  int half_dim = head_dim / 2;
+  for (int i = 0; i < half_dim; i++) {
+    float freq =
+        1.0f / powf(config->rope_theta, (float)(2 * i) / (float)head_dim);
+    float angle = (float)discard * freq;
+    rotate_back[i] = cosf(angle);
+    rotate_back[half_dim + i] = -sinf(angle);
+  }
+  int64_t position = 0;
+
+  for (int layer = 0; layer < config->num_hidden_layers; layer++) {
+    kv_layer_view_t view = kv_seq_layer(&model->kv_seq, layer);
+    for (int src = keep + discard; src < len; src++) {
+      int dst = src - discard;
+      load_key_row(model, &view, src, key);
+      rope_f32(&position, key, NULL, rotate_back, 1,
+               config->num_key_value_heads, 0, head_dim, head_dim, true);
+      store_key_row(model, &view, dst, key);
+
+      memcpy(kv_view_value(&view, dst), kv_view_value(&view, src),
+             view.row_bytes);
+      if (view.quantized)
+        memcpy(kv_view_value_scale(&view, dst),
+               kv_view_value_scale(&view, src), view.scale_row_bytes);
+    }
   }
+  free(rotate_back);
+
+  grow_gap(model, keep, model->cache_tokens + keep, discard);
+  memmove(model->cache_tokens + keep, model->cache_tokens + keep + discard,
+          (len - keep - discard) * sizeof(int));
+  qwen3_model_truncate_cache(model, len - discard);
+  return true;
+}
+
+/* Make room for num_tokens more positions by shifting out half of what
+ * follows the kept prefix, or more if num_tokens needs it. */
+static bool shift_for(qwen3_model_t *model, int num_tokens) {
+  if (model->kv_policy == QWEN3_KV_STREAMING)
+    return true;
+  int len = model->cache_len[0];
+  int need = len + num_tokens - model->max_seq_len;
+  if (need <= 0)
+    return true;
+  if (!model->context_shift)
+    return false;
 
-  int64_t *position_ids = (int64_t *)malloc(num_tokens * sizeof(int64_t));
-  if (!position_ids) {
-    free(token_ids_i64);
+  int keep = model->context_keep < len ? model->context_keep : len;
+  int discard = (len - keep) / 2;
+  if (discard < need)
+    discard = need;
+  if (keep + discard > len)
     return false;
+  return qwen3_model_shift_cache(model, keep, discard);
+}
+
+void qwen3_model_set_context_shift(qwen3_model_t *model, bool enable,
+                                   int keep) {
+  if (!model)
+    return;
+  model->context_shift = enable;
+  model->context_keep = keep > 0 ? keep : 0;
+}
+
+bool qwen3_model_set_kv_policy(qwen3_model_t *model, qwen3_kv_policy_t policy,
+                               int sink_tokens, int window_tokens) {
+  if (!model || !model->cache_len)
+    return false;
+  if (policy == QWEN3_KV_STREAMING &&
+      (sink_tokens < 0 || window_tokens <= 0 ||
+       sink_tokens > model->max_seq_len - window_tokens))
+    return false;
+  model->kv_policy = policy;
+  model->kv_sink = policy == QWEN3_KV_STREAMING ? sink_tokens : 0;
+  model->kv_window = policy == QWEN3_KV_STREAMING ? window_tokens : 0;
+  return true;
+}
+
+/* Every shift re-rotates a surviving key in FP32 and stores it back, which
+ * rounds it again (and re-quantizes it in an INT8 cache), so the error grows
+ * with the number of shifts a key lives through. The streaming policy drops
+ * at least window / KV_STREAM_SHIFTS positions at a time to cap that number
+ * whatever the window. */
+#define KV_STREAM_SHIFTS 8
+
+/* Under the streaming policy, make room for num_tokens more positions by
+ * dropping the oldest ones after the sinks. Whole pages go at once, so the
+ * re-rotation is paid once per page instead of once per token. num_tokens
+ * must not exceed the window. */
+static bool stream_for(qwen3_model_t *model, int num_tokens) {
+  int len = model->cache_len[0];
+  int need = len + num_tokens - (model->kv_sink + model->kv_window);
+  if (need <= 0)
+    return true;
+
+  int page = model->kv_pool.page_tokens;
+  if (need < model->kv_window / KV_STREAM_SHIFTS)
+    need = model->kv_window / KV_STREAM_SHIFTS;
+  int discard = (need + page - 1) / page * page;
+  if (discard > len - model->kv_sink)
+    discard = len - model->kv_sink;
+  return qwen3_model_shift_cache(model, model->kv_sink, discard);
+}
+
+bool qwen3_model_reserve_cache(qwen3_model_t *model, int num_tokens) {
+  while (!kv_seq_reserve(&model->kv_seq, num_tokens)) {
+    if (!qwen3_sessions_evict_lru(model->sessions))
+      return false;
   }
-  int start_pos = 0;
-  if (model->cache_len && model->cache_len[0] > 0) {
-    start_pos = model->cache_len[0];
+  return true;
+}
+
+bool qwen3_model_set_max_tokens(qwen3_model_t *model, int max_tokens) {
+  if (!model || max_tokens <= 0 || max_tokens > model->max_seq_len)
+    return false;
+  qwen3_plan_free(&model->plan);
+  if (!qwen3_plan_init(&model->plan, &model->config, model->dtype,
+                       max_tokens))
+    return false;
+  model->plan.packed = model->weights.packed;
+  return true;
+}
+
+bool qwen3_model_set_kv_budget(qwen3_model_t *model, size_t budget_bytes) {
+  if (!model || !model->kv_seq.pool)
+    return false;
+  return kv_pool_set_budget(&model->kv_pool, budget_bytes);
+}
+
+bool qwen3_model_set_kv_int8(qwen3_model_t *model, bool enable) {
+  if (!model || !model->kv_seq.pool || model->sessions)
+    return false;
+  if (model->kv_pool.quantized == enable)
+    return true;
+  if (model->cache_len[0] > 0)
+    return false;
+
+  /* Keep the byte budget: the same memory now holds more positions. */
+  kv_pool_t *pool = &model->kv_pool;
+  size_t budget = pool->max_pages * pool->page_bytes;
+  int layers = pool->num_layers;
+  int heads = pool->num_heads;
+  int head_dim = pool->head_dim;
+  size_t elem_size = qwen3_dtype_f16_act(model->dtype) ? sizeof(uint16_t)
+                                                     : sizeof(float);
+
+  kv_seq_free(&model->kv_seq);
+  kv_pool_free(pool);
+  if (enable && kv_pool_init_q8(pool, layers, heads, head_dim,
+                                KV_PAGE_DEFAULT_TOKENS, budget)) {
+    kv_seq_init(&model->kv_seq, pool);
+    return true;
   }
+
+  /* Disabling, or a head size INT8 rows do not support. A budget smaller
+   * than one full-precision page is dropped rather than left unusable. */
+  if (!kv_pool_init(pool, layers, heads, head_dim, elem_size,
+                    KV_PAGE_DEFAULT_TOKENS, budget))
+    kv_pool_init(pool, layers, heads, head_dim, elem_size,
+                 KV_PAGE_DEFAULT_TOKENS, 0);
+  kv_seq_init(&model->kv_seq, pool);
+  return !enable;
+}
+
+/*
+ * One pass of up to plan.max_tokens positions through every layer. All
+ * activations come from the plan's arena; logits, when requested, are
+ * projected from the last position only.
+ */
+static void forward_chunk(qwen3_model_t *model, float *logits,
+                          const int *token_ids, int num_tokens) {
+  const qwen3_plan_t *plan = &model->plan;
+  const qwen3_config_t *config = &model->config;
+  int H = config->hidden_size;
+
+  int64_t *token_ids_i64 =
+      (int64_t *)qwen3_plan_buffer(plan, QWEN3_BUF_TOKEN_IDS);
+  int64_t *position_ids =
+      (int64_t *)qwen3_plan_buffer(plan, QWEN3_BUF_POSITION_IDS);
+  int start_pos = model->cache_len[0];
   for (int i = 0; i < num_tokens; i++) {
+    token_ids_i64[i] = token_ids[i];
     position_ids[i] = start_pos + i;
   }
+  memcpy(model->cache_tokens + start_pos, token_ids, num_tokens * sizeof(int));
 
-  if (model->dtype == QWEN3_DTYPE_F16) {
-    uint16_t *hidden = (uint16_t *)malloc(
-        num_tokens * model->config.hidden_size * sizeof(uint16_t));
-    if (!hidden) {
-      free(token_ids_i64);
-      free(position_ids);
-      return false;
-    }
+  if (qwen3_dtype_f16_act(model->dtype)) {
+    uint16_t *layer_input =
+        (uint16_t *)qwen3_plan_buffer(plan, QWEN3_BUF_HIDDEN_A);
+    uint16_t *layer_output =
+        (uint16_t *)qwen3_plan_buffer(plan, QWEN3_BUF_HIDDEN_B);
 
-    embedding_lookup_f16(
-        hidden, token_ids_i64, (uint16_t *)model->weights.embed_tokens,
-        num_tokens, model->config.vocab_size, model->config.hidden_size, -1);
-    free(token_ids_i64);
-
-    uint16_t *layer_input = hidden;
-    uint16_t *layer_output = (uint16_t *)malloc(
-        num_tokens * model->config.hidden_size * sizeof(uint16_t));
-    if (!layer_output) {
-      free(hidden);
-      free(position_ids);
-      return false;
-    }
+    embedding_lookup_f16(layer_input, token_ids_i64,
+                         (uint16_t *)model->weights.embed_tokens, num_tokens,
+                         config->vocab_size, H, -1);
 
-    for (int layer_idx = 0; layer_idx < model->config.num_hidden_layers;
+    for (int layer_idx = 0; layer_idx < config->num_hidden_layers;
          layer_idx++) {
+      kv_layer_view_t kv = kv_seq_layer(&model->kv_seq, layer_idx);
       qwen3_transformer_layer_f16(
-          layer_output, layer_input, &model->weights.layers[layer_idx],
-          (uint16_t *)model->key_cache[layer_idx],
-          (uint16_t *)model->value_cache[layer_idx], position_ids,
-          (uint16_t *)model->cos_sin_cache, &model->config, num_tokens,
-          model->cache_len[layer_idx], layer_idx);
+          layer_output, layer_input, &model->weights.layers[layer_idx], &kv,
+          position_ids, (uint16_t *)model->cos_sin_cache, config, num_tokens,
+          model->cache_len[layer_idx], layer_idx, plan);
 
       model->cache_len[layer_idx] += num_tokens;
 
@@ -205,72 +464,35 @@ bool qwen3_forward(qwen3_model_t *model, float *logits, const int *token_ids,
       layer_output = tmp;
     }
 
-    uint16_t *final_hidden = layer_input;
-
-    if (model->config.num_hidden_layers % 2 == 0) {
-      free(layer_output);
-    }
-
-    rms_norm_f16(final_hidden, final_hidden, (uint16_t *)model->weights.norm,
-                 model->config.rms_norm_eps, num_tokens,
-                 model->config.hidden_size);
-
-    uint16_t *all_logits_f16 = (uint16_t *)malloc(
-        num_tokens * model->config.vocab_size * sizeof(uint16_t));
-    if (!all_logits_f16) {
-      free(hidden);
-      free(position_ids);
-      if (model->config.num_hidden_layers % 2 == 0) {
-        free(layer_output);
-      }
-      return false;
-    }
-
-    gemm_f16(final_hidden, (uint16_t *)model->weights.lm_head, all_logits_f16,
-             num_tokens, model->config.vocab_size, model->config.hidden_size);
-
-    uint16_t *last_token_logits_f16 =
-        all_logits_f16 + (num_tokens - 1) * model->config.vocab_size;
-    f16_array_to_f32(last_token_logits_f16, logits, model->config.vocab_size);
+    if (!logits)
+      return;
 
-    free(all_logits_f16);
-    free(hidden);
-    free(position_ids);
+    uint16_t *last_hidden = layer_input + (size_t)(num_tokens - 1) * H;
+    rms_norm_f16(last_hidden, last_hidden, (uint16_t *)model->weights.norm,
+                 config->rms_norm_eps, 1, H);
 
-    if (model->config.num_hidden_layers % 2 == 1) {
-      free(layer_output);
-    }
+    /* Only the last position is sampled, so lm_head runs as a GEMV against
+     * its [vocab, hidden] rows, which are embed_tokens for tied models. */
+    uint16_t *logits_f16 =
+        (uint16_t *)qwen3_plan_buffer(plan, QWEN3_BUF_LOGITS);
+    gemm_f16_transpose_b(last_hidden, (uint16_t *)model->weights.lm_head,
+                         logits_f16, 1, config->vocab_size, H);
+    f16_array_to_f32(logits_f16, logits, config->vocab_size);
   } else {
-    float *hidden =
-        (float *)malloc(num_tokens * model->config.hidden_size * sizeof(float));
-    if (!hidden) {
-      free(token_ids_i64);
-      free(position_ids);
-      return false;
-    }
+    float *layer_input = (float *)qwen3_plan_buffer(plan, QWEN3_BUF_HIDDEN_A);
+    float *layer_output = (float *)qwen3_plan_buffer(plan, QWEN3_BUF_HIDDEN_B);
 
-    embedding_lookup_f32(
-        hidden, token_ids_i64, (float *)model->weights.embed_tokens, num_tokens,
-        model->config.vocab_size, model->config.hidden_size, -1);
-    free(token_ids_i64);
-
-    float *layer_input = hidden;
-    float *layer_output =
-        (float *)malloc(num_tokens * model->config.hidden_size * sizeof(float));
-    if (!layer_output) {
-      free(hidden);
-      free(position_ids);
-      return false;
-    }
+    embedding_lookup_f32(layer_input, token_ids_i64,
+                         (float *)model->weights.embed_tokens, num_tokens,
+                         config->vocab_size, H, -1);
 
-    for (int layer_idx = 0; layer_idx < model->config.num_hidden_layers;
+    for (int layer_idx = 0; layer_idx < config->num_hidden_layers;
          layer_idx++) {
+      kv_layer_view_t kv = kv_seq_layer(&model->kv_seq, layer_idx);
       qwen3_transformer_layer_f32(
-          layer_output, layer_input, &model->weights.layers[layer_idx],
-          (float *)model->key_cache[layer_idx],
-          (float *)model->value_cache[layer_idx], position_ids,
-          (float *)model->cos_sin_cache, &model->config, num_tokens,
-          model->cache_len[layer_idx], layer_idx);
+          layer_output, layer_input, &model->weights.layers[layer_idx], &kv,
+          position_ids, (float *)model->cos_sin_cache, config, num_tokens,
+          model->cache_len[layer_idx], layer_idx, plan);
 
       model->cache_len[layer_idx] += num_tokens;
 
@@ -279,59 +501,149 @@ bool qwen3_forward(qwen3_model_t *model, float *logits, const int *token_ids,
       layer_output = tmp;
     }
 
-    float *final_hidden = layer_input;
+    if (!logits)
+      return;
 
-    if (model->config.num_hidden_layers % 2 == 0) {
-      free(layer_output);
-    }
+    float *last_hidden = layer_input + (size_t)(num_tokens - 1) * H;
+    rms_norm_f32(last_hidden, last_hidden, (float *)model->weights.norm,
+                 config->rms_norm_eps, 1, H);
 
-    rms_norm_f32(final_hidden, final_hidden, (float *)model->weights.norm,
-                 model->config.rms_norm_eps, num_tokens,
-                 model->config.hidden_size);
-
-    float *all_logits =
-        (float *)malloc(num_tokens * model->config.vocab_size * sizeof(float));
-    if (!all_logits) {
-      free(hidden);
-      free(position_ids);
-      if (model->config.num_hidden_layers % 2 == 0) {
-        free(layer_output);
-      }
+    gemm_f32(last_hidden, (float *)model->weights.lm_head, logits, 1,
+             config->vocab_size, H, false, true);
+  }
+}
+
+bool qwen3_forward(qwen3_model_t *model, float *logits, const int *token_ids,
+                   int num_tokens) {
+  if (!model || !logits || !token_ids || num_tokens <= 0)
+    return false;
+  if (!model->plan.arena || !model->cache_len)
+    return false;
+
+  /* Prompts longer than the plan was laid out for run chunk by chunk; the
+   * KV cache carries the context across chunks. */
+  int max_tokens = model->plan.max_tokens;
+  bool streaming = model->kv_policy == QWEN3_KV_STREAMING;
+  if (streaming) {
+    /* The window moves between chunks, so a chunk must fit in it. */
+    if (max_tokens > model->kv_window)
+      max_tokens = model->kv_window;
+  } else {
+    if (model->cache_len[0] + num_tokens > model->max_seq_len)
+      return false;
+    if (!qwen3_model_reserve_cache(model, model->cache_len[0] + num_tokens)) {
+      fprintf(stderr, "KV cache budget exhausted at %d tokens\n",
+              model->cache_len[0] + num_tokens);
       return false;
     }
+  }
 
-    gemm_f32((float *)model->weights.lm_head, final_hidden, all_logits,
-             model->config.vocab_size, num_tokens, model->config.hidden_size,
-             false, true);
+  for (int done = 0; done < num_tokens; done += max_tokens) {
+    int n = num_tokens - done < max_tokens ? num_tokens - done : max_tokens;
+    bool last = done + n == num_tokens;
+    if (streaming) {
+      if (!stream_for(model, n) ||
+          !qwen3_model_reserve_cache(model, model->cache_len[0] + n)) {
+        fprintf(stderr, "KV cache budget exhausted at %d tokens\n",
+                model->cache_len[0] + n);
+        return false;
+      }
+    }
+    forward_chunk(model, last ? logits : NULL, token_ids + done, n);
+  }
 
-    memcpy(logits, all_logits + (num_tokens - 1) * model->config.vocab_size,
-           model->config.vocab_size * sizeof(float));
+  return true;
+}
 
-    free(all_logits);
-    free(hidden);
-    free(position_ids);
+/* Cached positions that input continues, and in *consumed how many input
+ * tokens they stand for: more than the positions when the input still
+ * holds the tokens of cache_gap. At least one input token is left over. */
+static int cached_prefix(const qwen3_model_t *model, const int *input, int n,
+                         int *consumed) {
+  const qwen3_cache_gap_t *gap = &model->cache_gap;
+  int len = model->cache_len[0];
+  int limit = gap->len > 0 ? gap->at : len;
+  int i = 0;
+  while (i < limit && i < n - 1 && model->cache_tokens[i] == input[i])
+    i++;
+  *consumed = i;
+  if (gap->len == 0 || i < gap->at || gap->at + gap->len >= n ||
+      hash_tokens(0xcbf29ce484222325ull, input + gap->at, gap->len) !=
+          gap->hash)
+    return i;
+
+  int skip = gap->len;
+  while (i < len && i + skip < n - 1 &&
+         model->cache_tokens[i] == input[i + skip])
+    i++;
+  *consumed = i + skip;
+  return i;
+}
 
-    if (model->config.num_hidden_layers % 2 == 1) {
-      free(layer_output);
-    }
+/* With context shift on, a prompt longer than the room after the kept
+ * prefix cannot be made to fit by shifting the cache alone. Shift out all
+ * of the cache past the prefix and drop the prompt's own oldest tokens
+ * after it, recording both in cache_gap, so that half of the room stays
+ * free as after any other shift. */
+static bool fit_prompt(qwen3_model_t *model, float *logits,
+                       const int **tokens, int *num_tokens) {
+  if (model->kv_policy == QWEN3_KV_STREAMING || !model->context_shift)
+    return true;
+  int keep = model->context_keep;
+  int len = model->cache_len[0];
+  if (len + *num_tokens <= model->max_seq_len || keep >= model->max_seq_len)
+    return true;
+
+  /* The prefix always stays, so any of it not cached yet runs first. */
+  if (len < keep) {
+    int n = keep - len;
+    if (n > *num_tokens - 1)
+      n = *num_tokens - 1;
+    if (n > 0 && !qwen3_forward(model, logits, *tokens, n))
+      return false;
+    *tokens += n;
+    *num_tokens -= n;
+    len += n;
   }
+  if (len < keep || keep + *num_tokens <= model->max_seq_len)
+    return true;
 
+  if (len > keep && !qwen3_model_shift_cache(model, keep, len - keep))
+    return false;
+  int fit = (model->max_seq_len - keep) / 2;
+  int drop = *num_tokens - (fit > 0 ? fit : 1);
+  grow_gap(model, keep, *tokens, drop);
+  *tokens += drop;
+  *num_tokens -= drop;
   return true;
 }
 
 int qwen3_generate(qwen3_model_t *model, int *output_tokens, int max_tokens,
                    const int *input_tokens, int num_input_tokens,
                    float temperature, int top_k, float top_p) {
-  if (!model || !output_tokens || !input_tokens || num_input_tokens <= 0)
+  if (!model || !model->cache_len || !output_tokens || !input_tokens ||
+      num_input_tokens <= 0)
     return 0;
 
-  qwen3_model_reset_cache(model);
+  /* In a chat each prompt repeats the previous turns, whose K/V are still
+   * cached. Keep that shared prefix, but always run at least the last
+   * prompt token so there are logits to sample from. */
+  int consumed;
+  int reuse = cached_prefix(model, input_tokens, num_input_tokens, &consumed);
+  qwen3_cache_gap_t gap = model->cache_gap;
+  qwen3_model_truncate_cache(model, reuse);
+  if (consumed > reuse)
+    model->cache_gap = gap; /* the prompt resumes after the gap */
 
   float *logits = (float *)malloc(model->config.vocab_size * sizeof(float));
   if (!logits)
     return 0;
 
-  if (!qwen3_forward(model, logits, input_tokens, num_input_tokens)) {
+  const int *prompt = input_tokens + consumed;
+  int num_prompt = num_input_tokens - consumed;
+  if (!fit_prompt(model, logits, &prompt, &num_prompt) ||
+      !shift_for(model, num_prompt) ||
+      !qwen3_forward(model, logits, prompt, num_prompt)) {
     free(logits);
     return 0;
   }
@@ -352,7 +664,8 @@ int qwen3_generate(qwen3_model_t *model, int *output_tokens, int max_tokens,
       break;
 
     int single_token[1] = {current_token};
-    if (!qwen3_forward(model, logits, single_token, 1))
+    if (!shift_for(model, 1) ||
+        !qwen3_forward(model, logits, single_token, 1))
       break;
   }
 
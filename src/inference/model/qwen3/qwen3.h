@@ -2,36 +2,134 @@
 #define QWEN3_H
 
 #include "config.h"
+#include "inference/kernels/kv_cache/kv_pages.h"
+#include "plan.h"
 #include "weights.h"
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct qwen3_sessions;
+
+typedef enum {
+  /* Positions are appended until max_seq_len or the KV budget. */
+  QWEN3_KV_APPEND = 0,
+  /* Attention sinks plus a rolling window; see qwen3_model_set_kv_policy. */
+  QWEN3_KV_STREAMING = 1,
+} qwen3_kv_policy_t;
+
+/* Tokens of the caller's history that a shift dropped from the cache:
+ * history [at, at + len) is not cached, so cache position at holds history
+ * token at + len. hash (FNV-1a over the token IDs) lets qwen3_generate
+ * check that a prompt still contains them. len is 0 when nothing was
+ * dropped. */
+typedef struct {
+  int at;
+  int len;
+  uint64_t hash;
+} qwen3_cache_gap_t;
+
 typedef struct {
   qwen3_config_t config;
   qwen3_weights_t weights;
   qwen3_dtype_t dtype;
 
-  void **key_cache;
-  void **value_cache;
+  /* K/V pages are allocated as the context grows. */
+  kv_pool_t kv_pool;
+  kv_seq_t kv_seq;
   int *cache_len;
+  /* Token IDs whose K/V are in the cache, cache_len[0] of them. */
+  int *cache_tokens;
+  qwen3_cache_gap_t cache_gap;
   int max_seq_len;
+  /* Set by qwen3_sessions_init; evicted from when the budget runs out. */
+  struct qwen3_sessions *sessions;
+  /* See qwen3_model_set_context_shift. */
+  bool context_shift;
+  int context_keep;
+  /* See qwen3_model_set_kv_policy. */
+  qwen3_kv_policy_t kv_policy;
+  int kv_sink;
+  int kv_window;
 
   void *cos_sin_cache;
 
-  void *temp_buffer;
-  size_t temp_buffer_size;
+  qwen3_plan_t plan;
 } qwen3_model_t;
 
 bool qwen3_model_load(qwen3_model_t *model, const char *model_dir,
                       qwen3_dtype_t dtype);
+bool qwen3_model_load_with_mode(qwen3_model_t *model, const char *model_dir,
+                                qwen3_dtype_t dtype, qwen3_load_mode_t mode);
 void qwen3_model_free(qwen3_model_t *model);
 void qwen3_model_reset_cache(qwen3_model_t *model);
 
+/* Drop every cached position from num_tokens on, keeping the prefix. */
+void qwen3_model_truncate_cache(qwen3_model_t *model, int num_tokens);
+
+/* Make sure the cache has pages for num_tokens positions, evicting other
+ * sessions' caches if the budget is exhausted. */
+bool qwen3_model_reserve_cache(qwen3_model_t *model, int num_tokens);
+
+/* Re-plan the activation arena for forward calls of up to max_tokens
+ * positions. Longer calls are split into chunks of that size. */
+bool qwen3_model_set_max_tokens(qwen3_model_t *model, int max_tokens);
+
+/* Cap the memory of the KV cache, 0 for no cap beyond max_seq_len. Forward
+ * calls that would need more fail. Fails if the cache already holds more. */
+bool qwen3_model_set_kv_budget(qwen3_model_t *model, size_t budget_bytes);
+
+/* Store K/V as INT8 with per-token, per-head scales, halving the cache of
+ * an F16 model. Only possible while the cache is empty and no session
+ * manager is attached; the byte budget carries over. */
+bool qwen3_model_set_kv_int8(qwen3_model_t *model, bool enable);
+
+/*
+ * Drop cached positions [keep, keep + discard) and move the rest down,
+ * re-rotating their keys so they read as the new positions. The cache then
+ * holds cache_len - discard positions and cache_tokens is compacted to
+ * match, so a caller can keep generating without a re-prefill. The dropped
+ * tokens are recorded in cache_gap, so qwen3_generate still reuses the
+ * cache for a prompt that repeats the whole history.
+ */
+bool qwen3_model_shift_cache(qwen3_model_t *model, int keep, int discard);
+
+/* Let qwen3_generate shift the context instead of stopping when it would
+ * outgrow max_seq_len. The first keep positions (a system prompt) always
+ * stay; half of the rest is discarded per shift. Off by default. */
+void qwen3_model_set_context_shift(qwen3_model_t *model, bool enable,
+                                   int keep);
+
+/*
+ * Choose how the cache grows. Under QWEN3_KV_STREAMING the first
+ * sink_tokens positions always stay and at most window_tokens follow them:
+ * qwen3_forward drops the oldest positions after the sinks, whole pages and
+ * at least an eighth of the window at a time, and re-rotates the rest so
+ * positions stay within sink + window. Each key is thus re-rotated (and
+ * re-quantized in an INT8 cache) about eight times at most.
+ * Memory and per-token attention cost are then bounded however long the
+ * generation runs. Fails if sink + window exceeds max_seq_len.
+ */
+bool qwen3_model_set_kv_policy(qwen3_model_t *model, qwen3_kv_policy_t policy,
+                               int sink_tokens, int window_tokens);
+
 bool qwen3_forward(qwen3_model_t *model, float *logits, const int *token_ids,
                    int num_tokens);
+/* Prefills only the part of input_tokens not already in the cache: the
+ * longest common prefix with the cached tokens is kept, reading across
+ * cache_gap when the prompt still holds the tokens a shift dropped. With
+ * context shift on, a prompt too long to fit after the kept prefix loses
+ * its oldest tokens past that prefix, as a shift would have dropped them. */
 int qwen3_generate(qwen3_model_t *model, int *output_tokens, int max_tokens,
                    const int *input_tokens, int num_input_tokens,
                    float temperature, int top_k, float top_p);
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif
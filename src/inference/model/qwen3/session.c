@@ -0,0 +1,328 @@
+#include "session.h"
+#include "snapshot.h"
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#define SPILL_MAGIC 0x53564B51u /* "QKVS" */
+#define SPILL_VERSION 1
+
+/* Spill files are scratch space owned by the manager: whole pages are
+ * written as they sit in memory and the file is removed once restored. */
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  int32_t num_layers;
+  int32_t num_heads;
+  int32_t head_dim;
+  int32_t elem_size;
+  int32_t page_tokens;
+  int32_t len;
+} spill_header_t;
+
+static void spill_path(const qwen3_sessions_t *mgr, const char *id, char *out,
+                       size_t size) {
+  char name[QWEN3_SESSION_ID_MAX];
+  size_t i = 0;
+  for (; id[i] && i + 1 < sizeof(name); i++) {
+    unsigned char c = (unsigned char)id[i];
+    name[i] = (isalnum(c) || c == '-' || c == '_') ? (char)c : '_';
+  }
+  name[i] = '\0';
+  snprintf(out, size, "%s/%s.kvspill", mgr->spill_dir, name);
+}
+
+static int find_session(const qwen3_sessions_t *mgr, const char *id) {
+  for (int i = 0; i < mgr->num_sessions; i++) {
+    if (strcmp(mgr->sessions[i].id, id) == 0)
+      return i;
+  }
+  return -1;
+}
+
+static int add_session(qwen3_sessions_t *mgr, const char *id) {
+  if (mgr->num_sessions == mgr->capacity) {
+    int capacity = mgr->capacity ? mgr->capacity * 2 : 8;
+    qwen3_session_t *sessions = (qwen3_session_t *)realloc(
+        mgr->sessions, capacity * sizeof(qwen3_session_t));
+    if (!sessions)
+      return -1;
+    mgr->sessions = sessions;
+    mgr->capacity = capacity;
+  }
+
+  qwen3_session_t *s = &mgr->sessions[mgr->num_sessions];
+  memset(s, 0, sizeof(*s));
+  snprintf(s->id, sizeof(s->id), "%s", id);
+  kv_seq_init(&s->kv_seq, &mgr->model->kv_pool);
+  return mgr->num_sessions++;
+}
+
+static void release_session(qwen3_sessions_t *mgr, qwen3_session_t *s) {
+  kv_seq_free(&s->kv_seq);
+  kv_seq_init(&s->kv_seq, &mgr->model->kv_pool);
+  s->len = 0;
+  memset(&s->gap, 0, sizeof(s->gap));
+  if (s->spilled) {
+    char path[1024];
+    spill_path(mgr, s->id, path, sizeof(path));
+    remove(path);
+    s->spilled = false;
+  }
+}
+
+/* Move the model's current cache into s, leaving the model empty. */
+static void detach_model(qwen3_sessions_t *mgr, qwen3_session_t *s) {
+  qwen3_model_t *model = mgr->model;
+  int len = model->cache_len[0];
+
+  int *tokens = (int *)realloc(s->tokens, (len ? len : 1) * sizeof(int));
+  if (!tokens) {
+    /* Without its tokens the cache cannot be matched again; drop it. */
+    qwen3_model_reset_cache(model);
+    s->len = 0;
+    memset(&s->gap, 0, sizeof(s->gap));
+    return;
+  }
+  memcpy(tokens, model->cache_tokens, len * sizeof(int));
+  s->tokens = tokens;
+  s->len = len;
+  s->gap = model->cache_gap;
+  memset(&model->cache_gap, 0, sizeof(model->cache_gap));
+
+  kv_seq_free(&s->kv_seq);
+  s->kv_seq = model->kv_seq;
+  kv_seq_init(&model->kv_seq, &model->kv_pool);
+  for (int i = 0; i < model->config.num_hidden_layers; i++)
+    model->cache_len[i] = 0;
+}
+
+static void set_model_len(qwen3_model_t *model, const qwen3_session_t *s) {
+  memcpy(model->cache_tokens, s->tokens, s->len * sizeof(int));
+  for (int i = 0; i < model->config.num_hidden_layers; i++)
+    model->cache_len[i] = s->len;
+  model->cache_gap = s->gap;
+}
+
+/* Move s's in-memory cache into the (empty) model. */
+static void attach_model(qwen3_sessions_t *mgr, qwen3_session_t *s) {
+  qwen3_model_t *model = mgr->model;
+  kv_seq_free(&model->kv_seq);
+  model->kv_seq = s->kv_seq;
+  kv_seq_init(&s->kv_seq, &model->kv_pool);
+  set_model_len(model, s);
+}
+
+static bool spill_session(qwen3_sessions_t *mgr, qwen3_session_t *s) {
+  const kv_pool_t *pool = &mgr->model->kv_pool;
+  int num_pages = (s->len + pool->page_tokens - 1) >> pool->page_shift;
+  if (num_pages > s->kv_seq.num_pages)
+    return false;
+
+  char path[1024];
+  spill_path(mgr, s->id, path, sizeof(path));
+  FILE *f = fopen(path, "wb");
+  if (!f)
+    return false;
+
+  spill_header_t header = {SPILL_MAGIC,
+                           SPILL_VERSION,
+                           pool->num_layers,
+                           pool->num_heads,
+                           pool->head_dim,
+                           (int32_t)pool->elem_size,
+                           pool->page_tokens,
+                           s->len};
+  bool ok = fwrite(&header, sizeof(header), 1, f) == 1 &&
+            fwrite(s->tokens, sizeof(int), s->len, f) == (size_t)s->len;
+  for (int i = 0; ok && i < num_pages; i++)
+    ok = fwrite(s->kv_seq.pages[i], pool->page_bytes, 1, f) == 1;
+  if (fclose(f) != 0)
+    ok = false;
+
+  if (!ok) {
+    remove(path);
+    return false;
+  }
+
+  kv_seq_free(&s->kv_seq);
+  kv_seq_init(&s->kv_seq, &mgr->model->kv_pool);
+  s->spilled = true;
+  return true;
+}
+
+/* Read a spilled session straight into the (empty) model. */
+static bool restore_session(qwen3_sessions_t *mgr, qwen3_session_t *s) {
+  qwen3_model_t *model = mgr->model;
+  const kv_pool_t *pool = &model->kv_pool;
+  char path[1024];
+  spill_path(mgr, s->id, path, sizeof(path));
+  FILE *f = fopen(path, "rb");
+  if (!f)
+    return false;
+
+  spill_header_t header;
+  bool ok = fread(&header, sizeof(header), 1, f) == 1 &&
+            header.magic == SPILL_MAGIC && header.version == SPILL_VERSION &&
+            header.num_layers == pool->num_layers &&
+            header.num_heads == pool->num_heads &&
+            header.head_dim == pool->head_dim &&
+            header.elem_size == (int32_t)pool->elem_size &&
+            header.page_tokens == pool->page_tokens &&
+            header.len == s->len && s->len <= model->max_seq_len;
+  ok = ok && fread(s->tokens, sizeof(int), s->len, f) == (size_t)s->len;
+
+  ok = ok && qwen3_model_reserve_cache(model, s->len);
+  for (int i = 0; ok && i < model->kv_seq.num_pages; i++)
+    ok = fread(model->kv_seq.pages[i], pool->page_bytes, 1, f) == 1;
+  fclose(f);
+
+  /* cache_len is still 0 here, so a reset would not return the pages. */
+  if (ok)
+    set_model_len(model, s);
+  else
+    kv_seq_truncate(&model->kv_seq, 0);
+  return ok;
+}
+
+bool qwen3_sessions_init(qwen3_sessions_t *mgr, qwen3_model_t *model,
+                         size_t budget_bytes, const char *spill_dir) {
+  if (!mgr || !model || !model->cache_len)
+    return false;
+
+  memset(mgr, 0, sizeof(*mgr));
+  mgr->model = model;
+  mgr->active = -1;
+  if (spill_dir && spill_dir[0]) {
+    snprintf(mgr->spill_dir, sizeof(mgr->spill_dir), "%s", spill_dir);
+    mkdir(mgr->spill_dir, 0755);
+  }
+
+  if (!kv_pool_set_budget(&model->kv_pool, budget_bytes))
+    return false;
+  model->sessions = mgr;
+  return true;
+}
+
+void qwen3_sessions_free(qwen3_sessions_t *mgr) {
+  if (!mgr)
+    return;
+  for (int i = 0; i < mgr->num_sessions; i++) {
+    release_session(mgr, &mgr->sessions[i]);
+    free(mgr->sessions[i].tokens);
+  }
+  free(mgr->sessions);
+  if (mgr->model && mgr->model->sessions == mgr)
+    mgr->model->sessions = NULL;
+  memset(mgr, 0, sizeof(*mgr));
+}
+
+bool qwen3_sessions_activate(qwen3_sessions_t *mgr, const char *chat_id) {
+  if (!mgr || !chat_id)
+    return false;
+
+  int idx = find_session(mgr, chat_id);
+  if (idx >= 0 && idx == mgr->active) {
+    mgr->sessions[idx].last_used = ++mgr->clock;
+    return true;
+  }
+
+  /* A context built outside any session has no owner to keep it. */
+  if (mgr->active >= 0)
+    detach_model(mgr, &mgr->sessions[mgr->active]);
+  else
+    qwen3_model_reset_cache(mgr->model);
+
+  if (idx < 0)
+    idx = add_session(mgr, chat_id);
+  mgr->active = idx;
+  if (idx < 0)
+    return false;
+
+  qwen3_session_t *s = &mgr->sessions[idx];
+  s->last_used = ++mgr->clock;
+  if (!s->spilled) {
+    attach_model(mgr, s);
+    return true;
+  }
+
+  if (!restore_session(mgr, s)) {
+    /* Cold start: the chat is simply prefilled again. */
+    qwen3_model_reset_cache(mgr->model);
+    fprintf(stderr, "Could not restore KV cache for chat %s\n", s->id);
+  }
+  release_session(mgr, s);
+  return true;
+}
+
+void qwen3_sessions_chat_loaded(void *userdata, const char *chat_id,
+                                const char *kv_path) {
+  qwen3_sessions_t *mgr = (qwen3_sessions_t *)userdata;
+  if (!qwen3_sessions_activate(mgr, chat_id)) {
+    fprintf(stderr, "Could not activate KV cache for chat %s\n",
+            chat_id ? chat_id : "(null)");
+    return;
+  }
+
+  /* Nothing kept in memory or spilled: resume from the chat's snapshot. */
+  struct stat st;
+  if (mgr->model->cache_len[0] == 0 && kv_path && kv_path[0] &&
+      stat(kv_path, &st) == 0 && !qwen3_kv_snapshot_load(mgr->model, kv_path))
+    fprintf(stderr, "Ignoring KV snapshot %s\n", kv_path);
+}
+
+void qwen3_sessions_chat_saved(void *userdata, const char *chat_id,
+                               const char *kv_path) {
+  qwen3_sessions_t *mgr = (qwen3_sessions_t *)userdata;
+  if (!mgr || !chat_id || !kv_path || mgr->active < 0 ||
+      strcmp(mgr->sessions[mgr->active].id, chat_id) != 0 ||
+      mgr->model->cache_len[0] == 0)
+    return;
+  if (!qwen3_kv_snapshot_save(mgr->model, kv_path))
+    fprintf(stderr, "Could not save KV snapshot %s\n", kv_path);
+}
+
+void qwen3_sessions_drop(qwen3_sessions_t *mgr, const char *chat_id) {
+  if (!mgr || !chat_id)
+    return;
+  int idx = find_session(mgr, chat_id);
+  if (idx < 0)
+    return;
+
+  if (idx == mgr->active) {
+    qwen3_model_reset_cache(mgr->model);
+    mgr->active = -1;
+  }
+  release_session(mgr, &mgr->sessions[idx]);
+  free(mgr->sessions[idx].tokens);
+
+  int last = --mgr->num_sessions;
+  if (idx != last) {
+    mgr->sessions[idx] = mgr->sessions[last];
+    if (mgr->active == last)
+      mgr->active = idx;
+  }
+}
+
+bool qwen3_sessions_evict_lru(qwen3_sessions_t *mgr) {
+  if (!mgr)
+    return false;
+
+  int victim = -1;
+  for (int i = 0; i < mgr->num_sessions; i++) {
+    if (i == mgr->active || mgr->sessions[i].kv_seq.num_pages == 0)
+      continue;
+    if (victim < 0 ||
+        mgr->sessions[i].last_used < mgr->sessions[victim].last_used)
+      victim = i;
+  }
+  if (victim < 0)
+    return false;
+
+  qwen3_session_t *s = &mgr->sessions[victim];
+  if (!mgr->spill_dir[0] || !spill_session(mgr, s))
+    release_session(mgr, s);
+  return true;
+}
@@ -0,0 +1,83 @@
+#ifndef QWEN3_SESSION_H
+#define QWEN3_SESSION_H
+
+#include "qwen3.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Per-chat KV caches for one model.
+ *
+ * Each chat ID owns a KV cache and the tokens that produced it. Activating
+ * a chat swaps its cache into the model, so returning to a chat only
+ * prefills what is new since it was last used. All sessions draw pages from
+ * the model's pool under one byte budget. When a forward pass runs out of
+ * budget, the least recently used inactive session is evicted: it is
+ * spilled to spill_dir when one is set, and dropped otherwise. A spilled
+ * session is read back the next time it is activated.
+ */
+
+#define QWEN3_SESSION_ID_MAX 64
+
+typedef struct {
+  char id[QWEN3_SESSION_ID_MAX];
+  kv_seq_t kv_seq;
+  int *tokens;
+  int len;
+  qwen3_cache_gap_t gap;
+  uint64_t last_used;
+  bool spilled;
+} qwen3_session_t;
+
+typedef struct qwen3_sessions {
+  qwen3_model_t *model;
+  qwen3_session_t *sessions;
+  int num_sessions;
+  int capacity;
+  int active; /* index into sessions, -1 for none */
+  uint64_t clock;
+  char spill_dir[512];
+} qwen3_sessions_t;
+
+/* budget_bytes caps the KV memory of all sessions together, 0 for no cap.
+ * spill_dir may be NULL to drop evicted sessions instead. */
+bool qwen3_sessions_init(qwen3_sessions_t *mgr, qwen3_model_t *model,
+                         size_t budget_bytes, const char *spill_dir);
+void qwen3_sessions_free(qwen3_sessions_t *mgr);
+
+/* Make chat_id the model's context, restoring its cache if one is kept.
+ * Call this when a chat is opened, before generating. */
+bool qwen3_sessions_activate(qwen3_sessions_t *mgr, const char *chat_id);
+
+/* ChatHooks handlers, registered with the manager as userdata:
+ *   ChatHooks hooks = {qwen3_sessions_chat_loaded, qwen3_sessions_chat_saved,
+ *                      &mgr};
+ *   chat_set_hooks(&hooks);
+ * chat_loaded activates the chat that chat_load just read and, when the
+ * manager keeps no cache for it, loads the snapshot at kv_path. chat_saved
+ * writes the active chat's cache to kv_path whenever the chat is saved.
+ * Nothing in this tree registers them yet: the TUI only talks to remote
+ * APIs, so they serve an embedder that runs this engine behind the chat
+ * store. */
+void qwen3_sessions_chat_loaded(void *mgr, const char *chat_id,
+                                const char *kv_path);
+void qwen3_sessions_chat_saved(void *mgr, const char *chat_id,
+                               const char *kv_path);
+
+/* Forget a chat's cache, in memory and on disk. */
+void qwen3_sessions_drop(qwen3_sessions_t *mgr, const char *chat_id);
+
+/* Evict the least recently used inactive session that still holds pages.
+ * Returns false when there is none. */
+bool qwen3_sessions_evict_lru(qwen3_sessions_t *mgr);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,217 @@
+#include "snapshot.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define SNAPSHOT_ALIGN 64
+
+static uint64_t fnv1a(uint64_t hash, const void *data, size_t size) {
+  const unsigned char *p = (const unsigned char *)data;
+  for (size_t i = 0; i < size; i++) {
+    hash ^= p[i];
+    hash *= 0x100000001b3ull;
+  }
+  return hash;
+}
+
+uint64_t qwen3_model_fingerprint(const qwen3_model_t *model) {
+  const qwen3_config_t *c = &model->config;
+  int32_t shape[] = {c->hidden_size,
+                     c->num_attention_heads,
+                     c->num_key_value_heads,
+                     c->num_hidden_layers,
+                     c->intermediate_size,
+                     c->vocab_size,
+                     c->head_dim,
+                     (int32_t)model->dtype};
+  float params[] = {c->rope_theta, c->rms_norm_eps};
+
+  uint64_t hash = 0xcbf29ce484222325ull;
+  hash = fnv1a(hash, shape, sizeof(shape));
+  hash = fnv1a(hash, params, sizeof(params));
+
+  /* Fine-tunes share a shape; the final norm and an embedding row tell
+   * them apart without reading the whole checkpoint. */
+  size_t elem_size =
+      qwen3_dtype_f16_act(model->dtype) ? sizeof(uint16_t) : sizeof(float);
+  size_t row = (size_t)c->hidden_size * elem_size;
+  if (model->weights.norm)
+    hash = fnv1a(hash, model->weights.norm, row);
+  if (model->weights.embed_tokens)
+    hash = fnv1a(hash, model->weights.embed_tokens, row);
+  return hash;
+}
+
+static size_t tokens_bytes(int num_tokens) {
+  size_t bytes = (size_t)num_tokens * sizeof(int32_t);
+  return (bytes + SNAPSHOT_ALIGN - 1) & ~(size_t)(SNAPSHOT_ALIGN - 1);
+}
+
+static void fill_header(const qwen3_model_t *model, int num_tokens,
+                        qwen3_kv_snapshot_header_t *header) {
+  memset(header, 0, sizeof(*header));
+  header->magic = QWEN3_KV_SNAPSHOT_MAGIC;
+  header->version = QWEN3_KV_SNAPSHOT_VERSION;
+  header->fingerprint = qwen3_model_fingerprint(model);
+  header->num_layers = model->kv_pool.num_layers;
+  header->num_kv_heads = model->kv_pool.num_heads;
+  header->head_dim = model->kv_pool.head_dim;
+  header->elem_size = (int32_t)model->kv_pool.elem_size;
+  header->num_tokens = num_tokens;
+}
+
+/* Rows from pos to the end of its page, capped at remaining. */
+static int page_run(const kv_layer_view_t *view, int pos, int remaining) {
+  int run = view->page_mask + 1 - (pos & view->page_mask);
+  return run < remaining ? run : remaining;
+}
+
+/* Rows of one kind (K, V or their scales) live at offset in every page,
+ * row_bytes apart. */
+typedef struct {
+  size_t offset;
+  size_t row_bytes;
+} row_kind_t;
+
+static int row_kinds(const kv_layer_view_t *view, row_kind_t kinds[4]) {
+  kinds[0] = (row_kind_t){view->k_offset, view->row_bytes};
+  kinds[1] = (row_kind_t){view->v_offset, view->row_bytes};
+  if (!view->quantized)
+    return 2;
+  kinds[2] = (row_kind_t){view->k_scale_offset, view->scale_row_bytes};
+  kinds[3] = (row_kind_t){view->v_scale_offset, view->scale_row_bytes};
+  return 4;
+}
+
+static char *row_addr(const kv_layer_view_t *view, row_kind_t kind, int pos) {
+  return (char *)view->pages[pos >> view->page_shift] + kind.offset +
+         (size_t)(pos & view->page_mask) * kind.row_bytes;
+}
+
+static bool write_rows(FILE *f, const kv_layer_view_t *view, row_kind_t kind,
+                       int num_tokens) {
+  for (int pos = 0; pos < num_tokens;) {
+    int run = page_run(view, pos, num_tokens - pos);
+    if (fwrite(row_addr(view, kind, pos), kind.row_bytes, run, f) !=
+        (size_t)run)
+      return false;
+    pos += run;
+  }
+  return true;
+}
+
+static const char *read_rows(const kv_layer_view_t *view, row_kind_t kind,
+                             int num_tokens, const char *src) {
+  for (int pos = 0; pos < num_tokens;) {
+    int run = page_run(view, pos, num_tokens - pos);
+    memcpy(row_addr(view, kind, pos), src, run * kind.row_bytes);
+    src += run * kind.row_bytes;
+    pos += run;
+  }
+  return src;
+}
+
+bool qwen3_kv_snapshot_save(const qwen3_model_t *model, const char *path) {
+  if (!model || !model->cache_len || !path)
+    return false;
+
+  int num_tokens = model->cache_len[0];
+  qwen3_kv_snapshot_header_t header;
+  fill_header(model, num_tokens, &header);
+
+  char tmp_path[1024];
+  snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+  FILE *f = fopen(tmp_path, "wb");
+  if (!f)
+    return false;
+
+  bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+
+  /* Token IDs go out as int32 with zero padding so the K/V rows start
+   * aligned in the mapping. */
+  char pad[SNAPSHOT_ALIGN] = {0};
+  for (int i = 0; ok && i < num_tokens; i++) {
+    int32_t token = model->cache_tokens[i];
+    ok = fwrite(&token, sizeof(token), 1, f) == 1;
+  }
+  size_t padding = tokens_bytes(num_tokens) - num_tokens * sizeof(int32_t);
+  if (ok && padding)
+    ok = fwrite(pad, 1, padding, f) == padding;
+
+  for (int layer = 0; ok && layer < header.num_layers; layer++) {
+    kv_layer_view_t view = kv_seq_layer(&model->kv_seq, layer);
+    row_kind_t kinds[4];
+    int num_kinds = row_kinds(&view, kinds);
+    for (int k = 0; ok && k < num_kinds; k++)
+      ok = write_rows(f, &view, kinds[k], num_tokens);
+  }
+
+  if (fclose(f) != 0)
+    ok = false;
+  if (ok && rename(tmp_path, path) != 0)
+    ok = false;
+  if (!ok)
+    unlink(tmp_path);
+  return ok;
+}
+
+bool qwen3_kv_snapshot_load(qwen3_model_t *model, const char *path) {
+  if (!model || !model->cache_len || !path)
+    return false;
+  qwen3_model_reset_cache(model);
+
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return false;
+  struct stat st;
+  if (fstat(fd, &st) != 0 ||
+      (size_t)st.st_size < sizeof(qwen3_kv_snapshot_header_t)) {
+    close(fd);
+    return false;
+  }
+  size_t size = (size_t)st.st_size;
+  void *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED)
+    return false;
+#ifdef MADV_SEQUENTIAL
+  madvise(map, size, MADV_SEQUENTIAL);
+#endif
+
+  qwen3_kv_snapshot_header_t expected, header;
+  memcpy(&header, map, sizeof(header));
+  fill_header(model, header.num_tokens, &expected);
+
+  const kv_pool_t *pool = &model->kv_pool;
+  bool ok = memcmp(&header, &expected, sizeof(header)) == 0 &&
+            header.num_tokens >= 0 && header.num_tokens <= model->max_seq_len;
+  int num_tokens = ok ? header.num_tokens : 0;
+  size_t rows =
+      (size_t)num_tokens * (pool->row_bytes + pool->scale_row_bytes);
+  ok = ok && size == sizeof(header) + tokens_bytes(num_tokens) +
+                         (size_t)header.num_layers * 2 * rows;
+  ok = ok && qwen3_model_reserve_cache(model, num_tokens);
+
+  if (ok) {
+    const char *src = (const char *)map + sizeof(header);
+    memcpy(model->cache_tokens, src, num_tokens * sizeof(int32_t));
+    src += tokens_bytes(num_tokens);
+    for (int layer = 0; layer < header.num_layers; layer++) {
+      kv_layer_view_t view = kv_seq_layer(&model->kv_seq, layer);
+      row_kind_t kinds[4];
+      int num_kinds = row_kinds(&view, kinds);
+      for (int k = 0; k < num_kinds; k++)
+        src = read_rows(&view, kinds[k], num_tokens, src);
+    }
+    for (int i = 0; i < model->config.num_hidden_layers; i++)
+      model->cache_len[i] = num_tokens;
+  } else {
+    kv_seq_truncate(&model->kv_seq, 0);
+  }
+
+  munmap(map, size);
+  return ok;
+}
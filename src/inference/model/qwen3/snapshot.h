@@ -0,0 +1,64 @@
+#ifndef QWEN3_SNAPSHOT_H
+#define QWEN3_SNAPSHOT_H
+
+#include "qwen3.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * KV cache snapshots.
+ *
+ * A snapshot holds the model's cache as it stands: the cached token IDs and,
+ * for each layer, the K rows and then the V rows of those positions. Only
+ * cache_len positions are written, so the file does not depend on the page
+ * size. Loading maps the file and copies the rows into freshly reserved
+ * pages, which makes reopening a long chat cost I/O instead of a prefill.
+ * The mapping is not used in place: a pool page holds its block of
+ * positions for every layer while the file keeps each layer contiguous,
+ * and the pages are rewritten by later appends and shifts.
+ *
+ * File layout, little-endian:
+ *   qwen3_kv_snapshot_header_t
+ *   int32 tokens[num_tokens], zero-padded to a multiple of 64 bytes
+ *   for each layer: K [num_tokens, num_kv_heads, head_dim]
+ *                   V [num_tokens, num_kv_heads, head_dim]
+ *                   and, for an INT8 cache (elem_size 1), the FP32
+ *                   K and V scales [num_tokens, num_kv_heads]
+ */
+
+#define QWEN3_KV_SNAPSHOT_MAGIC 0x564B3351u /* "Q3KV" */
+#define QWEN3_KV_SNAPSHOT_VERSION 1
+
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  /* qwen3_model_fingerprint of the model that wrote the cache. */
+  uint64_t fingerprint;
+  int32_t num_layers;
+  int32_t num_kv_heads;
+  int32_t head_dim;
+  int32_t elem_size;
+  int32_t num_tokens;
+  int32_t reserved;
+} qwen3_kv_snapshot_header_t;
+
+/* Hash of the model's shape, compute dtype and a sample of its weights. A
+ * snapshot is only loaded into a model with the same fingerprint. */
+uint64_t qwen3_model_fingerprint(const qwen3_model_t *model);
+
+/* Write the model's cache to path. The file is replaced atomically. */
+bool qwen3_kv_snapshot_save(const qwen3_model_t *model, const char *path);
+
+/* Replace the model's cache with the snapshot at path. On failure the cache
+ * is left empty. */
+bool qwen3_kv_snapshot_load(qwen3_model_t *model, const char *path);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
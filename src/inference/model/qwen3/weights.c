@@ -1,457 +1,1012 @@
 #include "weights.h"
+#include "inference/kernels/convert/convert.h"
+#include "inference/kernels/gemm/gemm.h"
+#include "inference/kernels/threadpool/threadpool.h"
+#include "inference/model_loader/gguf.h"
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #define SAFETENSORS_CPP_IMPLEMENTATION
 #include "inference/model_loader/safetensors.hh"
 
-static inline uint16_t float_to_fp16(float x) {
-  uint32_t bits;
-  memcpy(&bits, &x, sizeof(float));
-  uint32_t sign = bits & 0x80000000;
-  uint32_t exp = (bits >> 23) & 0xFF;
-  uint32_t mant = bits & 0x7FFFFF;
-
-  if (exp == 0xFF) {
-    if (mant != 0)
-      return 0x7E00;
-    return (uint16_t)((sign >> 16) | 0x7C00);
-  }
-  if (exp == 0 && mant == 0)
-    return (uint16_t)(sign >> 16);
-
-  int32_t new_exp = (int32_t)exp - 127 + 15;
-  if (new_exp <= 0)
-    return (uint16_t)(sign >> 16);
-  if (new_exp >= 31)
-    return (uint16_t)((sign >> 16) | 0x7C00);
-
-  uint16_t fp16_exp = (uint16_t)(new_exp << 10);
-  uint16_t fp16_mant = (uint16_t)(mant >> 13);
-  return (uint16_t)((sign >> 16) | fp16_exp | fp16_mant);
-}
-
-static inline float fp16_to_float(uint16_t fp16) {
-  uint32_t sign = (fp16 & 0x8000) << 16;
-  uint32_t exp = (fp16 >> 10) & 0x1F;
-  uint32_t mant = fp16 & 0x3FF;
-  uint32_t f32_bits;
-  if (exp == 0) {
-    if (mant == 0) {
-      f32_bits = sign;
-    } else {
-      int e = -14;
-      while ((mant & 0x400) == 0) {
-        mant <<= 1;
-        e--;
-      }
-      mant &= 0x3FF;
-      f32_bits = sign | (((uint32_t)(e + 127)) << 23) | (mant << 13);
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <unordered_map>
+
+/*
+ * A checkpoint is one or more mapped safetensors files, or a single GGUF
+ * file. Sharded checkpoints come with a model.safetensors.index.json whose
+ * weight_map names the shard holding each tensor; a single
+ * model.safetensors is a checkpoint with one shard.
+ */
+typedef struct {
+  std::vector<std::string> paths;
+  std::vector<safetensors::safetensors_t *> shards;
+  std::unordered_map<std::string, int> tensor_shard;
+  gguf_file_t *gguf;
+} weight_files_t;
+
+static bool has_suffix(const std::string &s, const char *suffix) {
+  size_t n = strlen(suffix);
+  return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+}
+
+static bool read_shard_index(const std::string &index_path,
+                             weight_files_t *files) {
+  std::ifstream in(index_path.c_str(), std::ios::binary);
+  if (!in) {
+    fprintf(stderr, "Failed to open %s\n", index_path.c_str());
+    return false;
+  }
+  std::stringstream ss;
+  ss << in.rdbuf();
+  std::string json = ss.str();
+
+  const char *p = json.c_str();
+  ::minijson::value root;
+  if (::minijson::parse(p, root) != ::minijson::no_error) {
+    fprintf(stderr, "Failed to parse %s\n", index_path.c_str());
+    return false;
+  }
+
+  const ::minijson::object *obj = root.as<::minijson::object>();
+  ::minijson::value weight_map;
+  if (!obj || !obj->at("weight_map", &weight_map) ||
+      !weight_map.as<::minijson::object>()) {
+    fprintf(stderr, "%s has no weight_map\n", index_path.c_str());
+    return false;
+  }
+
+  std::string dir;
+  size_t slash = index_path.find_last_of('/');
+  if (slash != std::string::npos)
+    dir = index_path.substr(0, slash + 1);
+
+  std::unordered_map<std::string, int> shard_ids;
+  const ::minijson::object *map = weight_map.as<::minijson::object>();
+  for (size_t i = 0; i < map->size(); i++) {
+    ::minijson::value file;
+    map->at(i, &file);
+    const std::string *name = file.as<std::string>();
+    if (!name) {
+      fprintf(stderr, "Invalid weight_map entry for %s\n",
+              map->keys()[i].c_str());
+      return false;
     }
-  } else if (exp == 31) {
-    f32_bits = sign | 0x7F800000 | (mant << 13);
-  } else {
-    f32_bits = sign | (((uint32_t)(exp - 15 + 127)) << 23) | (mant << 13);
-  }
-  float result;
-  memcpy(&result, &f32_bits, sizeof(float));
-  return result;
-}
-
-static inline float bf16_to_float(uint16_t bf16) {
-  uint32_t bits = ((uint32_t)bf16) << 16;
-  float f;
-  memcpy(&f, &bits, sizeof(float));
-  return f;
-}
-
-static inline uint16_t bf16_to_fp16(uint16_t bf16) {
-  return float_to_fp16(bf16_to_float(bf16));
-}
-
-static uint16_t *load_tensor_f16(const safetensors::safetensors_t *st,
-                                 const char *tensor_name, size_t *out_size,
-                                 bool transpose, int rows, int cols) {
-  const auto &keys = st->tensors.keys();
-  for (size_t i = 0; i < keys.size(); i++) {
-    if (keys[i] == tensor_name) {
-      safetensors::tensor_t tensor;
-      st->tensors.at(i, &tensor);
-
-      size_t tensor_size = safetensors::get_shape_size(tensor);
-      uint16_t *data = (uint16_t *)malloc(tensor_size * sizeof(uint16_t));
-      if (!data)
-        return NULL;
-
-      const uint8_t *src = st->databuffer_addr + tensor.data_offsets[0];
-
-      if (tensor.dtype == safetensors::dtype::kFLOAT16) {
-        if (transpose && rows > 0 && cols > 0) {
-          const uint16_t *src_f16 = (const uint16_t *)src;
-          for (int r = 0; r < rows; r++) {
-            for (int c = 0; c < cols; c++) {
-              data[c * rows + r] = src_f16[r * cols + c];
-            }
-          }
-        } else {
-          memcpy(data, src, tensor_size * sizeof(uint16_t));
-        }
-      } else if (tensor.dtype == safetensors::dtype::kBFLOAT16) {
-        const uint16_t *src_bf16 = (const uint16_t *)src;
-        if (transpose && rows > 0 && cols > 0) {
-          for (int r = 0; r < rows; r++) {
-            for (int c = 0; c < cols; c++) {
-              data[c * rows + r] = bf16_to_fp16(src_bf16[r * cols + c]);
-            }
-          }
-        } else {
-          for (size_t j = 0; j < tensor_size; j++) {
-            data[j] = bf16_to_fp16(src_bf16[j]);
-          }
-        }
-      } else if (tensor.dtype == safetensors::dtype::kFLOAT32) {
-        const float *src_f32 = (const float *)src;
-        if (transpose && rows > 0 && cols > 0) {
-          for (int r = 0; r < rows; r++) {
-            for (int c = 0; c < cols; c++) {
-              data[c * rows + r] = float_to_fp16(src_f32[r * cols + c]);
-            }
-          }
-        } else {
-          for (size_t j = 0; j < tensor_size; j++) {
-            data[j] = float_to_fp16(src_f32[j]);
-          }
-        }
-      } else {
-        free(data);
-        return NULL;
-      }
 
-      if (out_size)
-        *out_size = tensor_size;
-      return data;
+    auto it = shard_ids.find(*name);
+    if (it == shard_ids.end()) {
+      it = shard_ids.emplace(*name, (int)files->paths.size()).first;
+      files->paths.push_back(dir + *name);
     }
+    files->tensor_shard[map->keys()[i]] = it->second;
+  }
+
+  return !files->paths.empty();
+}
+
+typedef struct {
+  weight_files_t *files;
+  std::vector<std::string> errors;
+} map_shards_ctx_t;
+
+static void map_shards(void *arg, int start, int end) {
+  map_shards_ctx_t *ctx = (map_shards_ctx_t *)arg;
+  for (int i = start; i < end; i++) {
+    safetensors::safetensors_t *st = ctx->files->shards[i];
+    std::string warn, err;
+    if (!safetensors::mmap_from_file(ctx->files->paths[i], st, &warn, &err) ||
+        !safetensors::validate_data_offsets(*st, err))
+      ctx->errors[i] = ctx->files->paths[i] + ": " + err;
+  }
+}
+
+/* Shards are mapped concurrently: mmap_from_file pre-faults the whole file,
+ * so this is where the disk reads happen. */
+static bool open_weight_files(weight_files_t *files, const char *model_path) {
+  std::string path(model_path);
+  if (has_suffix(path, ".gguf")) {
+    files->gguf = new gguf_file_t();
+    if (!gguf_open(files->gguf, model_path))
+      return false;
+    gguf_prefetch(files->gguf);
+    return true;
+  }
+  if (has_suffix(path, ".json")) {
+    if (!read_shard_index(path, files))
+      return false;
+  } else {
+    files->paths.push_back(path);
   }
-  return NULL;
-}
-
-static float *load_tensor_f32(const safetensors::safetensors_t *st,
-                              const char *tensor_name, size_t *out_size,
-                              bool transpose, int rows, int cols) {
-  const auto &keys = st->tensors.keys();
-  for (size_t i = 0; i < keys.size(); i++) {
-    if (keys[i] == tensor_name) {
-      safetensors::tensor_t tensor;
-      st->tensors.at(i, &tensor);
-
-      size_t tensor_size = safetensors::get_shape_size(tensor);
-      float *data = (float *)malloc(tensor_size * sizeof(float));
-      if (!data)
-        return NULL;
-
-      const uint8_t *src = st->databuffer_addr + tensor.data_offsets[0];
-
-      if (tensor.dtype == safetensors::dtype::kFLOAT32) {
-        const float *src_f32 = (const float *)src;
-        if (transpose && rows > 0 && cols > 0) {
-          for (int r = 0; r < rows; r++) {
-            for (int c = 0; c < cols; c++) {
-              data[c * rows + r] = src_f32[r * cols + c];
-            }
-          }
-        } else {
-          memcpy(data, src, tensor_size * sizeof(float));
-        }
-      } else if (tensor.dtype == safetensors::dtype::kFLOAT16) {
-        const uint16_t *src_f16 = (const uint16_t *)src;
-        if (transpose && rows > 0 && cols > 0) {
-          for (int r = 0; r < rows; r++) {
-            for (int c = 0; c < cols; c++) {
-              data[c * rows + r] = fp16_to_float(src_f16[r * cols + c]);
-            }
-          }
-        } else {
-          for (size_t j = 0; j < tensor_size; j++) {
-            data[j] = fp16_to_float(src_f16[j]);
-          }
-        }
-      } else if (tensor.dtype == safetensors::dtype::kBFLOAT16) {
-        const uint16_t *src_bf16 = (const uint16_t *)src;
-        if (transpose && rows > 0 && cols > 0) {
-          for (int r = 0; r < rows; r++) {
-            for (int c = 0; c < cols; c++) {
-              data[c * rows + r] = bf16_to_float(src_bf16[r * cols + c]);
-            }
-          }
-        } else {
-          for (size_t j = 0; j < tensor_size; j++) {
-            data[j] = bf16_to_float(src_bf16[j]);
-          }
-        }
-      } else {
-        free(data);
-        return NULL;
-      }
 
-      if (out_size)
-        *out_size = tensor_size;
-      return data;
+  for (size_t i = 0; i < files->paths.size(); i++)
+    files->shards.push_back(new safetensors::safetensors_t());
+
+  map_shards_ctx_t ctx = {files, std::vector<std::string>(files->paths.size())};
+  threadpool_parallel_for(0, (int)files->paths.size(), 1, map_shards, &ctx);
+
+  for (size_t i = 0; i < ctx.errors.size(); i++) {
+    if (!ctx.errors[i].empty()) {
+      fprintf(stderr, "Failed to load model: %s\n", ctx.errors[i].c_str());
+      return false;
     }
   }
-  return NULL;
+  return true;
 }
 
-static bool load_layer_weights_f16(qwen3_layer_weights_t *layer_weights,
-                                   const safetensors::safetensors_t *st,
-                                   int layer_idx,
-                                   const qwen3_config_t *config) {
-  char tensor_name[256];
-  size_t dummy;
-  int hidden = config->hidden_size;
-  int q_dim = config->num_attention_heads * config->head_dim;
-  int kv_dim = config->num_key_value_heads * config->head_dim;
-  int inter = config->intermediate_size;
+/* A tensor in the mapping of either format, shape outermost first. GGUF
+ * block-quantized tensors have no safetensors dtype; they set gguf_blocks
+ * and are decoded with gguf_dequantize. */
+typedef struct {
+  const uint8_t *data;
+  std::vector<size_t> shape;
+  safetensors::dtype dtype;
+  bool gguf_blocks;
+  gguf_tensor_type_t gguf_type;
+} tensor_view_t;
 
-  snprintf(tensor_name, sizeof(tensor_name),
-           "model.layers.%d.self_attn.q_proj.weight", layer_idx);
-  layer_weights->q_proj =
-      load_tensor_f16(st, tensor_name, &dummy, true, q_dim, hidden);
-  if (!layer_weights->q_proj)
-    return false;
+/* llama.cpp's names for the tensors of a Qwen3 checkpoint. */
+static std::string gguf_tensor_name(const std::string &name) {
+  static const struct {
+    const char *hf, *gguf;
+  } names[] = {
+      {"model.embed_tokens.weight", "token_embd.weight"},
+      {"model.norm.weight", "output_norm.weight"},
+      {"lm_head.weight", "output.weight"},
+      {"self_attn.q_proj.weight", "attn_q.weight"},
+      {"self_attn.k_proj.weight", "attn_k.weight"},
+      {"self_attn.v_proj.weight", "attn_v.weight"},
+      {"self_attn.o_proj.weight", "attn_output.weight"},
+      {"self_attn.q_norm.weight", "attn_q_norm.weight"},
+      {"self_attn.k_norm.weight", "attn_k_norm.weight"},
+      {"mlp.gate_proj.weight", "ffn_gate.weight"},
+      {"mlp.up_proj.weight", "ffn_up.weight"},
+      {"mlp.down_proj.weight", "ffn_down.weight"},
+      {"input_layernorm.weight", "attn_norm.weight"},
+      {"post_attention_layernorm.weight", "ffn_norm.weight"},
+  };
 
-  snprintf(tensor_name, sizeof(tensor_name),
-           "model.layers.%d.self_attn.k_proj.weight", layer_idx);
-  layer_weights->k_proj =
-      load_tensor_f16(st, tensor_name, &dummy, true, kv_dim, hidden);
-  if (!layer_weights->k_proj)
-    return false;
+  std::string prefix, suffix = name;
+  int layer, n = 0;
+  if (sscanf(name.c_str(), "model.layers.%d.%n", &layer, &n) == 1 && n > 0) {
+    prefix = "blk." + std::to_string(layer) + ".";
+    suffix = name.substr(n);
+  }
+  for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+    if (suffix == names[i].hf)
+      return prefix + names[i].gguf;
+  }
+  return name;
+}
 
-  snprintf(tensor_name, sizeof(tensor_name),
-           "model.layers.%d.self_attn.v_proj.weight", layer_idx);
-  layer_weights->v_proj =
-      load_tensor_f16(st, tensor_name, &dummy, true, kv_dim, hidden);
-  if (!layer_weights->v_proj)
+static bool find_gguf_tensor(const gguf_file_t *gguf, const std::string &name,
+                             tensor_view_t *view) {
+  const gguf_tensor_t *t =
+      gguf_find_tensor(gguf, gguf_tensor_name(name).c_str());
+  if (!t)
     return false;
+  view->data = t->data;
+  view->shape.clear();
+  for (int d = t->n_dims - 1; d >= 0; d--)
+    view->shape.push_back((size_t)t->ne[d]);
+  view->gguf_blocks = false;
+  view->gguf_type = t->type;
+  switch (t->type) {
+  case GGUF_TENSOR_F32:
+    view->dtype = safetensors::dtype::kFLOAT32;
+    break;
+  case GGUF_TENSOR_F16:
+    view->dtype = safetensors::dtype::kFLOAT16;
+    break;
+  case GGUF_TENSOR_BF16:
+    view->dtype = safetensors::dtype::kBFLOAT16;
+    break;
+  default:
+    view->dtype = safetensors::dtype::kUINT8;
+    view->gguf_blocks = true;
+    break;
+  }
+  return true;
+}
 
-  snprintf(tensor_name, sizeof(tensor_name),
-           "model.layers.%d.self_attn.o_proj.weight", layer_idx);
-  layer_weights->o_proj =
-      load_tensor_f16(st, tensor_name, &dummy, true, hidden, q_dim);
-  if (!layer_weights->o_proj)
-    return false;
+static bool find_tensor(const weight_files_t *files,
+                        const std::string &tensor_name, tensor_view_t *view) {
+  if (files->gguf)
+    return find_gguf_tensor(files->gguf, tensor_name, view);
 
-  snprintf(tensor_name, sizeof(tensor_name),
-           "model.layers.%d.self_attn.q_norm.weight", layer_idx);
-  layer_weights->q_norm = load_tensor_f16(st, tensor_name, &dummy, false, 0, 0);
-  if (!layer_weights->q_norm)
+  int shard = 0;
+  if (files->shards.size() > 1) {
+    auto it = files->tensor_shard.find(tensor_name);
+    if (it == files->tensor_shard.end())
+      return false;
+    shard = it->second;
+  }
+  const safetensors::safetensors_t *st = files->shards[shard];
+  safetensors::tensor_t tensor;
+  if (!st->tensors.at(tensor_name, &tensor))
     return false;
+  view->data = st->databuffer_addr + tensor.data_offsets[0];
+  view->shape = tensor.shape;
+  view->dtype = tensor.dtype;
+  view->gguf_blocks = false;
+  return true;
+}
 
-  snprintf(tensor_name, sizeof(tensor_name),
-           "model.layers.%d.self_attn.k_norm.weight", layer_idx);
-  layer_weights->k_norm = load_tensor_f16(st, tensor_name, &dummy, false, 0, 0);
-  if (!layer_weights->k_norm)
-    return false;
+static size_t view_elems(const tensor_view_t &view) {
+  size_t n = 1;
+  for (size_t d : view.shape)
+    n *= d;
+  return n;
+}
 
-  snprintf(tensor_name, sizeof(tensor_name),
-           "model.layers.%d.mlp.gate_proj.weight", layer_idx);
-  layer_weights->gate_proj =
-      load_tensor_f16(st, tensor_name, &dummy, true, inter, hidden);
-  if (!layer_weights->gate_proj)
-    return false;
+static std::string view_type_str(const tensor_view_t &view) {
+  if (view.gguf_blocks)
+    return gguf_type_name(view.gguf_type);
+  return safetensors::get_dtype_str(view.dtype);
+}
 
-  snprintf(tensor_name, sizeof(tensor_name),
-           "model.layers.%d.mlp.up_proj.weight", layer_idx);
-  layer_weights->up_proj =
-      load_tensor_f16(st, tensor_name, &dummy, true, inter, hidden);
-  if (!layer_weights->up_proj)
+static bool convert_dtype_of(safetensors::dtype dtype, convert_dtype_t *out) {
+  switch (dtype) {
+  case safetensors::dtype::kFLOAT32:
+    *out = CONVERT_DTYPE_F32;
+    return true;
+  case safetensors::dtype::kFLOAT16:
+    *out = CONVERT_DTYPE_F16;
+    return true;
+  case safetensors::dtype::kBFLOAT16:
+    *out = CONVERT_DTYPE_BF16;
+    return true;
+  default:
     return false;
+  }
+}
 
-  snprintf(tensor_name, sizeof(tensor_name),
-           "model.layers.%d.mlp.down_proj.weight", layer_idx);
-  layer_weights->down_proj =
-      load_tensor_f16(st, tensor_name, &dummy, true, hidden, inter);
-  if (!layer_weights->down_proj)
-    return false;
+/* One entry per tensor to load; slot points into qwen3_weights_t. src is
+ * left NULL once the slot borrows the mapped data and needs no conversion.
+ * It is encoded as src_dtype, or as GGUF blocks of src_blocks when that is
+ * set. Jobs with quantize set are rows x cols projections of a Q8 model, or
+ * of a Q4 model when q4 is set. raw marks a checkpoint that already stores
+ * them quantized, with scale_src pointing at its Q8 scales. A fused job is
+ * one part_rows x cols part of the fused_rows x cols projection in its slot,
+ * which the first part to resolve allocates; its rows land at dest_row. An
+ * unfused part has only part_rows set, to check its shape. */
+typedef struct {
+  std::string name;
+  void **slot;
+  const uint8_t *src;
+  convert_dtype_t src_dtype;
+  bool blocks;
+  gguf_tensor_type_t src_blocks;
+  size_t count;
+  bool quantize;
+  bool q4;
+  bool raw;
+  size_t rows, cols;
+  const uint8_t *scale_src;
+  convert_dtype_t scale_dtype;
+  bool fused;
+  bool interleave;
+  int part;
+  size_t part_rows;
+  size_t row_base;
+  size_t fused_rows;
+} tensor_job_t;
 
-  snprintf(tensor_name, sizeof(tensor_name),
-           "model.layers.%d.input_layernorm.weight", layer_idx);
-  layer_weights->attn_norm =
-      load_tensor_f16(st, tensor_name, &dummy, false, 0, 0);
-  if (!layer_weights->attn_norm)
-    return false;
+/* Stacked parts start at row_base; interleaved ones are part 0 (gate) or 1
+ * (up) of the QWEN3_GATE_UP_BLOCK blocks described in weights.h. */
+static size_t dest_row(const tensor_job_t &job, size_t row) {
+  if (!job.fused)
+    return row;
+  if (!job.interleave)
+    return job.row_base + row;
+  size_t block = row / QWEN3_GATE_UP_BLOCK;
+  size_t n = job.rows - block * QWEN3_GATE_UP_BLOCK;
+  if (n > QWEN3_GATE_UP_BLOCK)
+    n = QWEN3_GATE_UP_BLOCK;
+  return block * 2 * QWEN3_GATE_UP_BLOCK + job.part * n +
+         row % QWEN3_GATE_UP_BLOCK;
+}
 
-  snprintf(tensor_name, sizeof(tensor_name),
-           "model.layers.%d.post_attention_layernorm.weight", layer_idx);
-  layer_weights->ffn_norm =
-      load_tensor_f16(st, tensor_name, &dummy, false, 0, 0);
-  if (!layer_weights->ffn_norm)
+/* A pre-quantized projection: I8 rows plus "<name>_scale" with one scale per
+ * row. */
+static bool resolve_q8_scales(const weight_files_t *files, tensor_job_t *job) {
+  std::string name = job->name + "_scale";
+  tensor_view_t view;
+  if (!find_tensor(files, name, &view)) {
+    fprintf(stderr, "Tensor %s is I8 but %s was not found\n",
+            job->name.c_str(), name.c_str());
     return false;
-
+  }
+  if (view.gguf_blocks || !convert_dtype_of(view.dtype, &job->scale_dtype) ||
+      view_elems(view) != job->rows) {
+    fprintf(stderr, "Tensor %s must hold %zu float scales\n", name.c_str(),
+            job->rows);
+    return false;
+  }
+  job->scale_src = view.data;
   return true;
 }
 
-static bool load_layer_weights_f32(qwen3_layer_weights_t *layer_weights,
-                                   const safetensors::safetensors_t *st,
-                                   int layer_idx,
-                                   const qwen3_config_t *config) {
-  (void)config;
-  char tensor_name[256];
-  size_t dummy;
+/* Take the source encoding from view: a convert dtype, or GGUF blocks that
+ * gguf_dequantize can decode. */
+static bool set_source_type(tensor_job_t *job, const tensor_view_t &view) {
+  if (view.gguf_blocks) {
+    job->blocks = true;
+    job->src_blocks = view.gguf_type;
+    if (gguf_can_dequantize(view.gguf_type))
+      return true;
+  } else if (convert_dtype_of(view.dtype, &job->src_dtype)) {
+    return true;
+  }
+  fprintf(stderr, "Tensor %s has unsupported dtype %s\n", job->name.c_str(),
+          view_type_str(view).c_str());
+  return false;
+}
 
-  snprintf(tensor_name, sizeof(tensor_name),
-           "model.layers.%d.self_attn.q_proj.weight", layer_idx);
-  layer_weights->q_proj = load_tensor_f32(st, tensor_name, &dummy, false, 0, 0);
-  if (!layer_weights->q_proj)
-    return false;
+/* Byte offset of element i of the source; block-aligned for GGUF blocks. */
+static size_t source_offset(const tensor_job_t &job, size_t i) {
+  if (job.blocks)
+    return i / gguf_type_block_elems(job.src_blocks) *
+           gguf_type_block_bytes(job.src_blocks);
+  return i * convert_dtype_size(job.src_dtype);
+}
 
-  snprintf(tensor_name, sizeof(tensor_name),
-           "model.layers.%d.self_attn.k_proj.weight", layer_idx);
-  layer_weights->k_proj = load_tensor_f32(st, tensor_name, &dummy, false, 0, 0);
-  if (!layer_weights->k_proj)
-    return false;
+static void decode_source(float *dst, const tensor_job_t &job, size_t i,
+                          size_t n) {
+  if (job.blocks)
+    gguf_dequantize(dst, job.src + source_offset(job, i), job.src_blocks, n);
+  else
+    convert_array(dst, CONVERT_DTYPE_F32, job.src + source_offset(job, i),
+                  job.src_dtype, n);
+}
 
-  snprintf(tensor_name, sizeof(tensor_name),
-           "model.layers.%d.self_attn.v_proj.weight", layer_idx);
-  layer_weights->v_proj = load_tensor_f32(st, tensor_name, &dummy, false, 0, 0);
-  if (!layer_weights->v_proj)
-    return false;
+static size_t q4_row_bytes(size_t cols) {
+  return cols / GEMM_Q4_GROUP * sizeof(gemm_q4_block_t);
+}
 
-  snprintf(tensor_name, sizeof(tensor_name),
-           "model.layers.%d.self_attn.o_proj.weight", layer_idx);
-  layer_weights->o_proj = load_tensor_f32(st, tensor_name, &dummy, false, 0, 0);
-  if (!layer_weights->o_proj)
-    return false;
+/* GGUF Q4_1 is gemm_q4_block_t bit for bit. */
+static_assert(sizeof(gemm_q4_block_t) == 20, "Q4 block must match Q4_1");
 
-  snprintf(tensor_name, sizeof(tensor_name),
-           "model.layers.%d.self_attn.q_norm.weight", layer_idx);
-  layer_weights->q_norm = load_tensor_f32(st, tensor_name, &dummy, false, 0, 0);
-  if (!layer_weights->q_norm)
-    return false;
+static size_t q8_rows(const tensor_job_t &job) {
+  return job.fused ? job.fused_rows : job.rows;
+}
 
-  snprintf(tensor_name, sizeof(tensor_name),
-           "model.layers.%d.self_attn.k_norm.weight", layer_idx);
-  layer_weights->k_norm = load_tensor_f32(st, tensor_name, &dummy, false, 0, 0);
-  if (!layer_weights->k_norm)
+static bool resolve_fused(tensor_job_t *job, const uint8_t *src,
+                          size_t elem_size) {
+  if (job->rows != job->part_rows) {
+    fprintf(stderr, "Tensor %s has %zu rows, expected %zu\n",
+            job->name.c_str(), job->rows, job->part_rows);
     return false;
+  }
+  job->src = src;
+  if (*job->slot)
+    return true;
 
-  snprintf(tensor_name, sizeof(tensor_name),
-           "model.layers.%d.mlp.gate_proj.weight", layer_idx);
-  layer_weights->gate_proj =
-      load_tensor_f32(st, tensor_name, &dummy, false, 0, 0);
-  if (!layer_weights->gate_proj)
+  size_t row_bytes = job->cols * elem_size;
+  if (job->quantize)
+    row_bytes = job->q4 ? q4_row_bytes(job->cols) : sizeof(float) + job->cols;
+  *job->slot = malloc(job->fused_rows * row_bytes);
+  if (!*job->slot) {
+    fprintf(stderr, "Failed to allocate %s\n", job->name.c_str());
     return false;
+  }
+  return true;
+}
 
-  snprintf(tensor_name, sizeof(tensor_name),
-           "model.layers.%d.mlp.up_proj.weight", layer_idx);
-  layer_weights->up_proj =
-      load_tensor_f32(st, tensor_name, &dummy, false, 0, 0);
-  if (!layer_weights->up_proj)
+/* A quantized projection is one allocation: the Q8 scales followed by the
+ * INT8 rows, or the Q4 blocks. Q4 blocks the file already stores in
+ * gemm_q4_block_t layout (quantize_model output, GGUF Q4_1) are borrowed
+ * from the mapping when borrow is set. */
+static bool resolve_quant_tensor(const weight_files_t *files,
+                                 tensor_job_t *job, const tensor_view_t &view,
+                                 bool borrow) {
+  bool q4_blocks = job->q4 && !view.gguf_blocks &&
+                   view.dtype == safetensors::dtype::kUINT8 &&
+                   view.shape.size() == 3 &&
+                   view.shape[2] == sizeof(gemm_q4_block_t);
+  if (view.shape.size() != 2 && !q4_blocks) {
+    fprintf(stderr, "Tensor %s is not a matrix\n", job->name.c_str());
     return false;
+  }
+  job->rows = view.shape[0];
+  job->cols = q4_blocks ? view.shape[1] * GEMM_Q4_GROUP : view.shape[1];
+  job->count = job->rows;
 
-  snprintf(tensor_name, sizeof(tensor_name),
-           "model.layers.%d.mlp.down_proj.weight", layer_idx);
-  layer_weights->down_proj =
-      load_tensor_f32(st, tensor_name, &dummy, false, 0, 0);
-  if (!layer_weights->down_proj)
+  if (q4_blocks || (job->q4 && view.gguf_blocks &&
+                    view.gguf_type == GGUF_TENSOR_Q4_1)) {
+    job->raw = true;
+  } else if (!job->q4 && !view.gguf_blocks &&
+             view.dtype == safetensors::dtype::kINT8) {
+    if (!resolve_q8_scales(files, job))
+      return false;
+    job->raw = true;
+  } else if (!set_source_type(job, view)) {
     return false;
-
-  snprintf(tensor_name, sizeof(tensor_name),
-           "model.layers.%d.input_layernorm.weight", layer_idx);
-  layer_weights->attn_norm =
-      load_tensor_f32(st, tensor_name, &dummy, false, 0, 0);
-  if (!layer_weights->attn_norm)
+  }
+  if (job->q4 && job->cols % GEMM_Q4_GROUP != 0) {
+    fprintf(stderr, "Tensor %s has %zu columns, not a multiple of %d\n",
+            job->name.c_str(), job->cols, GEMM_Q4_GROUP);
     return false;
+  }
+  if (job->fused)
+    return resolve_fused(job, view.data, 0);
 
-  snprintf(tensor_name, sizeof(tensor_name),
-           "model.layers.%d.post_attention_layernorm.weight", layer_idx);
-  layer_weights->ffn_norm =
-      load_tensor_f32(st, tensor_name, &dummy, false, 0, 0);
-  if (!layer_weights->ffn_norm)
-    return false;
+  if (job->q4 && job->raw && borrow &&
+      (uintptr_t)view.data % alignof(gemm_q4_block_t) == 0) {
+    *job->slot = (void *)view.data;
+    job->src = NULL;
+    return true;
+  }
 
+  size_t bytes = job->q4 ? job->rows * q4_row_bytes(job->cols)
+                         : job->rows * sizeof(float) + job->rows * job->cols;
+  *job->slot = malloc(bytes);
+  if (!*job->slot) {
+    fprintf(stderr, "Failed to allocate %s\n", job->name.c_str());
+    return false;
+  }
+  job->src = view.data;
   return true;
 }
 
-bool qwen3_weights_load(qwen3_weights_t *weights, const qwen3_config_t *config,
-                        const char *model_path, qwen3_dtype_t dtype) {
-  if (!weights || !config || !model_path)
+/* Point the slot at the mapped tensor when it already has the wanted dtype
+ * and a suitably aligned offset; otherwise allocate the destination.
+ * borrow_q4 lets a Q4 model borrow projections stored as Q4 blocks. */
+static bool resolve_tensor(const weight_files_t *files, tensor_job_t *job,
+                           convert_dtype_t want, bool borrow, bool borrow_q4) {
+  tensor_view_t view;
+  if (!find_tensor(files, job->name, &view)) {
+    fprintf(stderr, "Tensor %s not found\n", job->name.c_str());
+    return false;
+  }
+  if (job->quantize)
+    return resolve_quant_tensor(files, job, view, borrow_q4);
+  if (!set_source_type(job, view))
     return false;
 
-  memset(weights, 0, sizeof(*weights));
-  weights->dtype = dtype;
-
-  safetensors::safetensors_t st;
-  std::string warn, err;
-  bool ret = safetensors::mmap_from_file(model_path, &st, &warn, &err);
-  if (!ret) {
-    fprintf(stderr, "Failed to load model: %s\n", err.c_str());
+  size_t elem_size = convert_dtype_size(want);
+  if (job->fused) {
+    if (view.shape.size() != 2) {
+      fprintf(stderr, "Tensor %s is not a matrix\n", job->name.c_str());
+      return false;
+    }
+    job->rows = view.shape[0];
+    job->cols = view.shape[1];
+    job->count = job->rows;
+    return resolve_fused(job, view.data, elem_size);
+  }
+  if (job->part_rows &&
+      (view.shape.size() != 2 || view.shape[0] != job->part_rows)) {
+    fprintf(stderr, "Tensor %s is not a matrix of %zu rows\n",
+            job->name.c_str(), job->part_rows);
     return false;
   }
+  job->count = view_elems(view);
+
+  if (borrow && !job->blocks && job->src_dtype == want &&
+      (uintptr_t)view.data % elem_size == 0) {
+    *job->slot = (void *)view.data;
+    job->src = NULL;
+    return true;
+  }
 
-  if (!safetensors::validate_data_offsets(st, err)) {
-    fprintf(stderr, "Invalid safetensors file: %s\n", err.c_str());
+  *job->slot = malloc(job->count * elem_size);
+  if (!*job->slot) {
+    fprintf(stderr, "Failed to allocate %s\n", job->name.c_str());
     return false;
   }
+  job->src = view.data;
+  return true;
+}
 
-  int vocab = config->vocab_size;
-  int hidden = config->hidden_size;
+/* Large tensors are cut into pieces so that a single embedding table does not
+ * serialize the load on one thread. */
+#define LOAD_PIECE_ELEMS ((size_t)1 << 20)
 
-  if (dtype == QWEN3_DTYPE_F16) {
-    weights->embed_tokens =
-        load_tensor_f16(&st, "model.embed_tokens.weight", NULL, false, 0, 0);
-    if (!weights->embed_tokens) {
-      fprintf(stderr, "Failed to load embed_tokens\n");
-      return false;
-    }
+typedef struct {
+  size_t job;
+  size_t offset;
+  size_t count;
+} convert_piece_t;
 
-    weights->norm =
-        load_tensor_f16(&st, "model.norm.weight", NULL, false, 0, 0);
-    if (!weights->norm) {
-      fprintf(stderr, "Failed to load norm\n");
-      return false;
-    }
+typedef struct {
+  const std::vector<tensor_job_t> *jobs;
+  const std::vector<convert_piece_t> *pieces;
+  convert_dtype_t dtype;
+} convert_pieces_ctx_t;
 
-    const char *lm_head_name = config->tie_word_embeddings
-                                   ? "model.embed_tokens.weight"
-                                   : "lm_head.weight";
-    weights->lm_head =
-        load_tensor_f16(&st, lm_head_name, NULL, true, vocab, hidden);
-    if (!weights->lm_head) {
-      if (config->tie_word_embeddings) {
-        weights->lm_head = weights->embed_tokens;
-      } else {
-        fprintf(stderr, "Failed to load lm_head\n");
-        return false;
+static std::vector<float> rows_to_f32(const tensor_job_t &job, size_t row,
+                                      size_t rows) {
+  std::vector<float> buf(rows * job.cols);
+  decode_source(buf.data(), job, row * job.cols, rows * job.cols);
+  return buf;
+}
+
+/* Pieces of quantized and fused projections are whole rows: offset and
+ * count count rows. Pieces of an interleaved part stay within one block. */
+static void quantize_rows(const tensor_job_t &job, size_t row, size_t rows) {
+  if (job.q4) {
+    size_t row_bytes = q4_row_bytes(job.cols);
+    char *dst = (char *)*job.slot + dest_row(job, row) * row_bytes;
+    if (job.raw) {
+      memcpy(dst, job.src + row * row_bytes, rows * row_bytes);
+      return;
+    }
+    /* Q4_0 is q * d - 8 * d, which Q4 holds exactly with m = -8 * d. */
+    if (job.blocks && job.src_blocks == GGUF_TENSOR_Q4_0) {
+      const uint8_t *src = job.src + source_offset(job, row * job.cols);
+      gemm_q4_block_t *blocks = (gemm_q4_block_t *)dst;
+      for (size_t b = 0; b < rows * job.cols / GEMM_Q4_GROUP; b++) {
+        memcpy(&blocks[b].d, src, sizeof(uint16_t));
+        blocks[b].m = f32_to_fp16(-8.0f * fp16_to_f32(blocks[b].d));
+        memcpy(blocks[b].qs, src + sizeof(uint16_t), sizeof(blocks[b].qs));
+        src += sizeof(uint16_t) + sizeof(blocks[b].qs);
       }
+      return;
     }
-  } else {
-    weights->embed_tokens =
-        load_tensor_f32(&st, "model.embed_tokens.weight", NULL, false, 0, 0);
-    if (!weights->embed_tokens) {
-      fprintf(stderr, "Failed to load embed_tokens\n");
-      return false;
+    std::vector<float> buf = rows_to_f32(job, row, rows);
+    gemm_quantize_q4((gemm_q4_block_t *)dst, buf.data(), (int)rows,
+                     (int)job.cols);
+    return;
+  }
+
+  float *scales = (float *)*job.slot + dest_row(job, row);
+  int8_t *dst = (int8_t *)((float *)*job.slot + q8_rows(job)) +
+                dest_row(job, row) * job.cols;
+
+  if (job.raw) {
+    memcpy(dst, job.src + row * job.cols, rows * job.cols);
+    convert_array(scales, CONVERT_DTYPE_F32,
+                  job.scale_src + row * convert_dtype_size(job.scale_dtype),
+                  job.scale_dtype, rows);
+    return;
+  }
+
+  std::vector<float> buf = rows_to_f32(job, row, rows);
+  gemm_quantize_q8(dst, scales, buf.data(), (int)rows, (int)job.cols);
+}
+
+static void convert_fused_rows(const tensor_job_t &job, size_t row,
+                               size_t rows, convert_dtype_t dtype) {
+  size_t dst_size = convert_dtype_size(dtype);
+  char *dst = (char *)*job.slot + dest_row(job, row) * job.cols * dst_size;
+  if (job.blocks) {
+    std::vector<float> buf = rows_to_f32(job, row, rows);
+    convert_array(dst, dtype, buf.data(), CONVERT_DTYPE_F32,
+                  rows * job.cols);
+    return;
+  }
+  convert_array(dst, dtype,
+                job.src + row * job.cols * convert_dtype_size(job.src_dtype),
+                job.src_dtype, rows * job.cols);
+}
+
+static void convert_pieces(void *arg, int start, int end) {
+  convert_pieces_ctx_t *ctx = (convert_pieces_ctx_t *)arg;
+  size_t dst_size = convert_dtype_size(ctx->dtype);
+  for (int i = start; i < end; i++) {
+    const convert_piece_t &piece = (*ctx->pieces)[i];
+    const tensor_job_t &job = (*ctx->jobs)[piece.job];
+    if (job.quantize) {
+      quantize_rows(job, piece.offset, piece.count);
+      continue;
+    }
+    if (job.fused) {
+      convert_fused_rows(job, piece.offset, piece.count, ctx->dtype);
+      continue;
     }
+    if (job.blocks) {
+      std::vector<float> buf(piece.count);
+      decode_source(buf.data(), job, piece.offset, piece.count);
+      convert_array((char *)*job.slot + piece.offset * dst_size, ctx->dtype,
+                    buf.data(), CONVERT_DTYPE_F32, piece.count);
+      continue;
+    }
+    convert_array((char *)*job.slot + piece.offset * dst_size, ctx->dtype,
+                  job.src + piece.offset * convert_dtype_size(job.src_dtype),
+                  job.src_dtype, piece.count);
+  }
+}
+
+static void add_job(std::vector<tensor_job_t> *jobs, const char *name,
+                    void **slot, bool quantize = false, bool q4 = false) {
+  tensor_job_t job = tensor_job_t();
+  job.name = name;
+  job.slot = slot;
+  job.src_dtype = CONVERT_DTYPE_F32;
+  job.quantize = quantize;
+  job.q4 = q4;
+  jobs->push_back(job);
+}
+
+/* Part of a fused projection: rows [row_base, row_base + rows) of a
+ * fused_rows matrix, or with interleave the gate (part 0) or up (part 1)
+ * rows of the gate/up blocks. */
+static void add_fused_job(std::vector<tensor_job_t> *jobs, const char *name,
+                          void **slot, qwen3_dtype_t dtype, size_t rows,
+                          size_t row_base, size_t fused_rows,
+                          bool interleave = false, int part = 0) {
+  add_job(jobs, name, slot, qwen3_dtype_quantized(dtype),
+          dtype == QWEN3_DTYPE_Q4);
+  tensor_job_t &job = jobs->back();
+  job.fused = true;
+  job.interleave = interleave;
+  job.part = part;
+  job.part_rows = rows;
+  job.row_base = row_base;
+  job.fused_rows = fused_rows;
+}
 
-    weights->norm =
-        load_tensor_f32(&st, "model.norm.weight", NULL, false, 0, 0);
-    if (!weights->norm) {
-      fprintf(stderr, "Failed to load norm\n");
+/* An unfused q/k/v or gate/up part, held in its own slot. */
+static void add_part_job(std::vector<tensor_job_t> *jobs, const char *name,
+                         void **slot, size_t rows) {
+  add_job(jobs, name, slot);
+  jobs->back().part_rows = rows;
+}
+
+static void add_layer_jobs(std::vector<tensor_job_t> *jobs,
+                           qwen3_layer_weights_t *layer_weights, int layer_idx,
+                           qwen3_dtype_t dtype, const qwen3_config_t *config,
+                           bool fuse) {
+  static const struct {
+    const char *suffix;
+    size_t offset;
+    bool projection;
+  } tensors[] = {
+      {"self_attn.o_proj.weight", offsetof(qwen3_layer_weights_t, o_proj),
+       true},
+      {"self_attn.q_norm.weight", offsetof(qwen3_layer_weights_t, q_norm),
+       false},
+      {"self_attn.k_norm.weight", offsetof(qwen3_layer_weights_t, k_norm),
+       false},
+      {"mlp.down_proj.weight", offsetof(qwen3_layer_weights_t, down_proj),
+       true},
+      {"input_layernorm.weight", offsetof(qwen3_layer_weights_t, attn_norm),
+       false},
+      {"post_attention_layernorm.weight",
+       offsetof(qwen3_layer_weights_t, ffn_norm), false},
+  };
+  char tensor_name[256];
+
+  for (size_t i = 0; i < sizeof(tensors) / sizeof(tensors[0]); i++) {
+    snprintf(tensor_name, sizeof(tensor_name), "model.layers.%d.%s",
+             layer_idx, tensors[i].suffix);
+    add_job(jobs, tensor_name,
+            (void **)((char *)layer_weights + tensors[i].offset),
+            qwen3_dtype_quantized(dtype) && tensors[i].projection,
+            dtype == QWEN3_DTYPE_Q4);
+  }
+
+  size_t q_dim = (size_t)config->num_attention_heads * config->head_dim;
+  size_t kv_dim = (size_t)config->num_key_value_heads * config->head_dim;
+  size_t inter = (size_t)config->intermediate_size;
+  const struct {
+    const char *suffix;
+    size_t rows, row_base;
+    void **slot;
+  } qkv[] = {
+      {"self_attn.q_proj.weight", q_dim, 0, &layer_weights->q_proj},
+      {"self_attn.k_proj.weight", kv_dim, q_dim, &layer_weights->k_proj},
+      {"self_attn.v_proj.weight", kv_dim, q_dim + kv_dim,
+       &layer_weights->v_proj},
+  };
+  for (size_t i = 0; i < sizeof(qkv) / sizeof(qkv[0]); i++) {
+    snprintf(tensor_name, sizeof(tensor_name), "model.layers.%d.%s",
+             layer_idx, qkv[i].suffix);
+    if (fuse)
+      add_fused_job(jobs, tensor_name, &layer_weights->qkv_proj, dtype,
+                    qkv[i].rows, qkv[i].row_base, q_dim + 2 * kv_dim);
+    else
+      add_part_job(jobs, tensor_name, qkv[i].slot, qkv[i].rows);
+  }
+  const char *gate_up[] = {"mlp.gate_proj.weight", "mlp.up_proj.weight"};
+  void **gate_up_slots[] = {&layer_weights->gate_proj,
+                            &layer_weights->up_proj};
+  for (int part = 0; part < 2; part++) {
+    snprintf(tensor_name, sizeof(tensor_name), "model.layers.%d.%s",
+             layer_idx, gate_up[part]);
+    if (fuse)
+      add_fused_job(jobs, tensor_name, &layer_weights->gate_up_proj, dtype,
+                    inter, 0, 2 * inter, true, part);
+    else
+      add_part_job(jobs, tensor_name, gate_up_slots[part], inter);
+  }
+}
+
+static bool in_mapping(const weight_files_t *files, const void *ptr) {
+  const uint8_t *p = (const uint8_t *)ptr;
+  if (files->gguf) {
+    const uint8_t *map = (const uint8_t *)files->gguf->map;
+    return map && p >= map && p < map + files->gguf->map_size;
+  }
+  for (size_t i = 0; i < files->shards.size(); i++) {
+    const safetensors::safetensors_t *st = files->shards[i];
+    if (st->mmap_addr && p >= st->mmap_addr &&
+        p < st->mmap_addr + st->mmap_size)
+      return true;
+  }
+  return false;
+}
+
+static void release_mapping(qwen3_weights_t *weights) {
+  weight_files_t *files = (weight_files_t *)weights->mapping;
+  if (!files)
+    return;
+  for (size_t i = 0; i < files->shards.size(); i++)
+    delete files->shards[i];
+  if (files->gguf) {
+    gguf_close(files->gguf);
+    delete files->gguf;
+  }
+  delete files;
+  weights->mapping = NULL;
+}
+
+/*
+ * Packed projections (QWEN3_LOAD_PACKED). The sidecar holds a
+ * packed_header_t and then every layer's projections in
+ * gemm_pack_f16_b layout, layer by layer in the order of
+ * packed_projections, each at a PACKED_ALIGN aligned offset. The header key
+ * hashes the layout name, the model dimensions and the size, mtime and
+ * leading bytes of every weight file, so a sidecar made for other kernels or
+ * from another checkpoint is rebuilt instead of misread.
+ */
+#define PACKED_MAGIC "SLTPACK1"
+#define PACKED_VERSION 2
+#define PACKED_ALIGN 64
+#define PACKED_KEY_BYTES ((size_t)64 << 10)
+
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t count;
+  uint64_t key;
+  uint64_t size;
+} packed_header_t;
+
+static_assert(sizeof(packed_header_t) <= PACKED_ALIGN,
+              "packed header must fit before the first panel");
+
+typedef struct {
+  void **slot;
+  int N, K;
+  size_t offset;
+  const uint16_t *src;
+  uint16_t *dst;
+} packed_proj_t;
+
+static size_t packed_align(size_t n) {
+  return (n + PACKED_ALIGN - 1) & ~(size_t)(PACKED_ALIGN - 1);
+}
+
+/* The projections to pack and their offsets; *size is the sidecar size. */
+static std::vector<packed_proj_t>
+packed_projections(qwen3_weights_t *weights, const qwen3_config_t *config,
+                   size_t *size) {
+  int hidden = config->hidden_size;
+  int q_dim = config->num_attention_heads * config->head_dim;
+  int kv_dim = config->num_key_value_heads * config->head_dim;
+  int inter = config->intermediate_size;
+  std::vector<packed_proj_t> projs;
+  size_t offset = PACKED_ALIGN;
+
+  for (int i = 0; i < weights->num_layers; i++) {
+    qwen3_layer_weights_t *layer = &weights->layers[i];
+    const struct {
+      void **slot;
+      int N, K;
+    } shapes[] = {
+        {&layer->qkv_proj, q_dim + 2 * kv_dim, hidden},
+        {&layer->o_proj, hidden, q_dim},
+        {&layer->gate_up_proj, 2 * inter, hidden},
+        {&layer->down_proj, hidden, inter},
+    };
+    for (size_t j = 0; j < sizeof(shapes) / sizeof(shapes[0]); j++) {
+      packed_proj_t proj = packed_proj_t();
+      proj.slot = shapes[j].slot;
+      proj.N = shapes[j].N;
+      proj.K = shapes[j].K;
+      proj.offset = offset;
+      offset += packed_align(gemm_f16_packed_size(proj.N, proj.K));
+      projs.push_back(proj);
+    }
+  }
+  *size = offset;
+  return projs;
+}
+
+static uint64_t fnv1a(uint64_t h, const void *data, size_t n) {
+  const uint8_t *p = (const uint8_t *)data;
+  for (size_t i = 0; i < n; i++)
+    h = (h ^ p[i]) * 0x100000001b3ull;
+  return h;
+}
+
+static bool packed_cache_key(const weight_files_t *files,
+                             const char *model_path,
+                             const qwen3_config_t *config, uint64_t *key) {
+  const char *layout = gemm_f16_packed_layout();
+  uint64_t h = fnv1a(0xcbf29ce484222325ull, layout, strlen(layout));
+  int dims[] = {config->hidden_size,         config->num_attention_heads,
+                config->num_key_value_heads, config->num_hidden_layers,
+                config->intermediate_size,   config->head_dim};
+  h = fnv1a(h, dims, sizeof(dims));
+
+  std::vector<std::string> paths = files->paths;
+  if (files->gguf)
+    paths.push_back(model_path);
+  std::vector<uint8_t> head(PACKED_KEY_BYTES);
+  for (const std::string &path : paths) {
+    FILE *f = fopen(path.c_str(), "rb");
+    struct stat st;
+    if (!f || fstat(fileno(f), &st) != 0) {
+      if (f)
+        fclose(f);
+      fprintf(stderr, "Failed to stat %s\n", path.c_str());
       return false;
     }
+    uint64_t stamp[2] = {(uint64_t)st.st_size, (uint64_t)st.st_mtime};
+    h = fnv1a(h, stamp, sizeof(stamp));
+    h = fnv1a(h, head.data(), fread(head.data(), 1, head.size(), f));
+    fclose(f);
+  }
+  *key = h;
+  return true;
+}
+
+static void *map_packed_cache(const std::string &path, uint64_t key,
+                              size_t count, size_t size) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return NULL;
+  struct stat st;
+  void *map = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && (size_t)st.st_size == size)
+    map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED)
+    return NULL;
+
+  const packed_header_t *header = (const packed_header_t *)map;
+  if (memcmp(header->magic, PACKED_MAGIC, sizeof(header->magic)) != 0 ||
+      header->version != PACKED_VERSION || header->count != count ||
+      header->key != key || header->size != size) {
+    munmap(map, size);
+    return NULL;
+  }
+  posix_madvise(map, size, POSIX_MADV_WILLNEED);
+  return map;
+}
+
+static void pack_projections(void *arg, int start, int end) {
+  std::vector<packed_proj_t> *projs = (std::vector<packed_proj_t> *)arg;
+  for (int i = start; i < end; i++) {
+    packed_proj_t &proj = (*projs)[i];
+    gemm_pack_f16_b(proj.dst, proj.src, proj.N, proj.K);
+  }
+}
 
-    const char *lm_head_name = config->tie_word_embeddings
-                                   ? "model.embed_tokens.weight"
-                                   : "lm_head.weight";
-    weights->lm_head = load_tensor_f32(&st, lm_head_name, NULL, false, 0, 0);
-    if (!weights->lm_head) {
-      if (config->tie_word_embeddings) {
-        weights->lm_head = weights->embed_tokens;
-      } else {
-        fprintf(stderr, "Failed to load lm_head\n");
+/* Pack into a temporary file next to path and rename it into place, so a
+ * concurrent load never maps a half-written sidecar. */
+static bool write_packed_cache(const std::string &path, uint64_t key,
+                               std::vector<packed_proj_t> *projs,
+                               size_t size) {
+  std::string tmp = path + ".tmp." + std::to_string((long)getpid());
+  int fd = open(tmp.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0)
+    return false;
+  void *map = MAP_FAILED;
+  if (ftruncate(fd, (off_t)size) == 0)
+    map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (map == MAP_FAILED) {
+    close(fd);
+    unlink(tmp.c_str());
+    return false;
+  }
+
+  for (packed_proj_t &proj : *projs)
+    proj.dst = (uint16_t *)((uint8_t *)map + proj.offset);
+  threadpool_parallel_for(0, (int)projs->size(), 1, pack_projections, projs);
+
+  packed_header_t header = packed_header_t();
+  memcpy(header.magic, PACKED_MAGIC, sizeof(header.magic));
+  header.version = PACKED_VERSION;
+  header.count = (uint32_t)projs->size();
+  header.key = key;
+  header.size = size;
+  memcpy(map, &header, sizeof(header));
+
+  bool ok = munmap(map, size) == 0;
+  ok = close(fd) == 0 && ok;
+  if (!ok || rename(tmp.c_str(), path.c_str()) != 0) {
+    unlink(tmp.c_str());
+    return false;
+  }
+  return true;
+}
+
+static void free_tensor(const qwen3_weights_t *weights, void *ptr);
+
+/* Replace the row-major projections with packed ones: from the sidecar,
+ * written first if needed, or packed in memory when it cannot be. */
+static bool pack_weights(qwen3_weights_t *weights,
+                         std::vector<packed_proj_t> *projs,
+                         const std::string &path, uint64_t key, size_t size) {
+  for (packed_proj_t &proj : *projs)
+    proj.src = (const uint16_t *)*proj.slot;
+
+  void *map = NULL;
+  if (write_packed_cache(path, key, projs, size))
+    map = map_packed_cache(path, key, projs->size(), size);
+  if (!map)
+    fprintf(stderr, "Could not write %s; packing weights in memory\n",
+            path.c_str());
+
+  if (map) {
+    weights->packed_map = map;
+    weights->packed_map_size = size;
+    for (packed_proj_t &proj : *projs)
+      proj.dst = (uint16_t *)((uint8_t *)map + proj.offset);
+  } else {
+    /* A failed write_packed_cache or map_packed_cache leaves dst pointing
+     * into the sidecar mapping, which is gone by now. */
+    for (packed_proj_t &proj : *projs)
+      proj.dst = NULL;
+    for (size_t i = 0; i < projs->size(); i++) {
+      packed_proj_t &proj = (*projs)[i];
+      size_t bytes = packed_align(gemm_f16_packed_size(proj.N, proj.K));
+      proj.dst = (uint16_t *)aligned_alloc(PACKED_ALIGN, bytes);
+      if (!proj.dst) {
+        fprintf(stderr, "Failed to allocate packed weights\n");
+        for (size_t j = 0; j < i; j++)
+          free((*projs)[j].dst);
         return false;
       }
     }
+    threadpool_parallel_for(0, (int)projs->size(), 1, pack_projections,
+                            projs);
+  }
+
+  /* Once packed, a slot owns its panels; packed_map ones are released with
+   * the sidecar. */
+  for (packed_proj_t &proj : *projs) {
+    free_tensor(weights, (void *)proj.src);
+    *proj.slot = proj.dst;
+  }
+  return true;
+}
+
+bool qwen3_weights_load(qwen3_weights_t *weights, const qwen3_config_t *config,
+                        const char *model_path, qwen3_dtype_t dtype) {
+  return qwen3_weights_load_with_mode(weights, config, model_path, dtype,
+                                      QWEN3_LOAD_MMAP);
+}
+
+bool qwen3_weights_load_with_mode(qwen3_weights_t *weights,
+                                  const qwen3_config_t *config,
+                                  const char *model_path, qwen3_dtype_t dtype,
+                                  qwen3_load_mode_t mode) {
+  if (!weights || !config || !model_path)
+    return false;
+
+  memset(weights, 0, sizeof(*weights));
+  weights->dtype = dtype;
+  weights->load_mode = mode;
+
+  /* Owned by the weights until the load finishes, so that the error paths
+   * below can all go through qwen3_weights_free. */
+  weight_files_t *files = new weight_files_t();
+  weights->mapping = files;
+
+  if (!open_weight_files(files, model_path)) {
+    qwen3_weights_free(weights);
+    return false;
   }
 
   weights->num_layers = config->num_hidden_layers;
@@ -459,67 +1014,184 @@ bool qwen3_weights_load(qwen3_weights_t *weights, const qwen3_config_t *config,
       config->num_hidden_layers, sizeof(qwen3_layer_weights_t));
   if (!weights->layers) {
     fprintf(stderr, "Failed to allocate layer weights\n");
+    qwen3_weights_free(weights);
     return false;
   }
 
-  for (int i = 0; i < config->num_hidden_layers; i++) {
-    bool success;
-    if (dtype == QWEN3_DTYPE_F16) {
-      success = load_layer_weights_f16(&weights->layers[i], &st, i, config);
-    } else {
-      success = load_layer_weights_f32(&weights->layers[i], &st, i, config);
+  std::vector<tensor_job_t> jobs;
+  add_job(&jobs, "model.embed_tokens.weight", &weights->embed_tokens);
+  add_job(&jobs, "model.norm.weight", &weights->norm);
+  /* lm_head is [vocab, hidden] like embed_tokens, so tied weights share it. */
+  if (!config->tie_word_embeddings)
+    add_job(&jobs, "lm_head.weight", &weights->lm_head);
+  weights->packed = mode == QWEN3_LOAD_PACKED && dtype == QWEN3_DTYPE_F16 &&
+                    gemm_f16_packed_layout() != NULL;
+  /* Fusing copies the parts, which a mapped F32 or F16 model would
+   * otherwise borrow; the layers run them as grouped GEMMs instead. */
+  bool fuse = mode == QWEN3_LOAD_COPY || weights->packed ||
+              qwen3_dtype_quantized(dtype);
+  for (int i = 0; i < config->num_hidden_layers; i++)
+    add_layer_jobs(&jobs, &weights->layers[i], i, dtype, config, fuse);
+
+  /* A sidecar that matches fills the projection slots before any job runs;
+   * their jobs are dropped. */
+  std::vector<packed_proj_t> projs;
+  std::string packed_path = std::string(model_path) + ".packed";
+  uint64_t packed_key = 0;
+  size_t packed_size = 0;
+  if (weights->packed) {
+    projs = packed_projections(weights, config, &packed_size);
+    if (!packed_cache_key(files, model_path, config, &packed_key)) {
+      qwen3_weights_free(weights);
+      return false;
+    }
+    void *map =
+        map_packed_cache(packed_path, packed_key, projs.size(), packed_size);
+    if (map) {
+      weights->packed_map = map;
+      weights->packed_map_size = packed_size;
+      for (packed_proj_t &proj : projs)
+        *proj.slot = (uint8_t *)map + proj.offset;
+      jobs.erase(std::remove_if(jobs.begin(), jobs.end(),
+                                [](const tensor_job_t &job) {
+                                  return *job.slot != NULL;
+                                }),
+                 jobs.end());
     }
-    if (!success) {
-      fprintf(stderr, "Failed to load layer %d weights\n", i);
+  }
+
+  convert_dtype_t want =
+      qwen3_dtype_f16_act(dtype) ? CONVERT_DTYPE_F16 : CONVERT_DTYPE_F32;
+  /* A quantized model keeps no part of the file unless the file holds its
+   * Q4 blocks, so full-precision pages do not stay resident behind the much
+   * smaller quantized copies. */
+  bool mapped = mode != QWEN3_LOAD_COPY;
+  bool borrow = mapped && !qwen3_dtype_quantized(dtype);
+  std::vector<convert_piece_t> pieces;
+  for (size_t i = 0; i < jobs.size(); i++) {
+    if (!resolve_tensor(files, &jobs[i], want, borrow, mapped)) {
       qwen3_weights_free(weights);
       return false;
     }
+    if (jobs[i].fused && i > 0 && jobs[i - 1].slot == jobs[i].slot &&
+        jobs[i - 1].cols != jobs[i].cols) {
+      fprintf(stderr, "Tensor %s has %zu columns, expected %zu\n",
+              jobs[i].name.c_str(), jobs[i].cols, jobs[i - 1].cols);
+      qwen3_weights_free(weights);
+      return false;
+    }
+    if (!jobs[i].src)
+      continue;
+    size_t step = LOAD_PIECE_ELEMS;
+    if (jobs[i].quantize || jobs[i].fused)
+      step = jobs[i].cols < LOAD_PIECE_ELEMS ? LOAD_PIECE_ELEMS / jobs[i].cols
+                                              : 1;
+    while (jobs[i].interleave && QWEN3_GATE_UP_BLOCK % step != 0)
+      step = step > QWEN3_GATE_UP_BLOCK ? QWEN3_GATE_UP_BLOCK : step - 1;
+    for (size_t off = 0; off < jobs[i].count; off += step) {
+      size_t n = jobs[i].count - off;
+      convert_piece_t piece = {i, off, n < step ? n : step};
+      pieces.push_back(piece);
+    }
+  }
+
+  /* Pieces are independent, so conversion runs on the kernel thread pool;
+   * stealing evens out the mix of full pieces and tiny norms. */
+  convert_pieces_ctx_t ctx = {&jobs, &pieces, want};
+  threadpool_parallel_for(0, (int)pieces.size(), 1, convert_pieces, &ctx);
+
+  if (weights->packed && !weights->packed_map &&
+      !pack_weights(weights, &projs, packed_path, packed_key, packed_size)) {
+    qwen3_weights_free(weights);
+    return false;
   }
 
+  if (config->tie_word_embeddings)
+    weights->lm_head = weights->embed_tokens;
+
+  /* Nothing points into the files (copy mode, no dtype matched, or only
+   * packed projections did): unmap. */
+  bool borrowed = false;
+  for (const tensor_job_t &job : jobs)
+    borrowed = borrowed || in_mapping(files, *job.slot);
+  if (!borrowed)
+    release_mapping(weights);
+
   return true;
 }
 
+/* Tensors borrowed from the mapping or the packed sidecar are released
+ * with it. */
+static void free_tensor(const qwen3_weights_t *weights, void *ptr) {
+  if (!ptr)
+    return;
+  const weight_files_t *files = (const weight_files_t *)weights->mapping;
+  if (files && in_mapping(files, ptr))
+    return;
+  const uint8_t *map = (const uint8_t *)weights->packed_map;
+  if (map && (const uint8_t *)ptr >= map &&
+      (const uint8_t *)ptr < map + weights->packed_map_size)
+    return;
+  free(ptr);
+}
+
 void qwen3_weights_free(qwen3_weights_t *weights) {
   if (!weights)
     return;
 
-  if (weights->embed_tokens)
-    free(weights->embed_tokens);
+  free_tensor(weights, weights->embed_tokens);
+  free_tensor(weights, weights->norm);
 
-  if (weights->norm)
-    free(weights->norm);
-
-  if (weights->lm_head && weights->lm_head != weights->embed_tokens)
-    free(weights->lm_head);
+  if (weights->lm_head != weights->embed_tokens)
+    free_tensor(weights, weights->lm_head);
 
   if (weights->layers) {
     for (int i = 0; i < weights->num_layers; i++) {
       qwen3_layer_weights_t *layer = &weights->layers[i];
-      if (layer->q_proj)
-        free(layer->q_proj);
-      if (layer->k_proj)
-        free(layer->k_proj);
-      if (layer->v_proj)
-        free(layer->v_proj);
-      if (layer->o_proj)
-        free(layer->o_proj);
-      if (layer->q_norm)
-        free(layer->q_norm);
-      if (layer->k_norm)
-        free(layer->k_norm);
-      if (layer->gate_proj)
-        free(layer->gate_proj);
-      if (layer->up_proj)
-        free(layer->up_proj);
-      if (layer->down_proj)
-        free(layer->down_proj);
-      if (layer->attn_norm)
-        free(layer->attn_norm);
-      if (layer->ffn_norm)
-        free(layer->ffn_norm);
+      free_tensor(weights, layer->qkv_proj);
+      free_tensor(weights, layer->o_proj);
+      free_tensor(weights, layer->q_norm);
+      free_tensor(weights, layer->k_norm);
+      free_tensor(weights, layer->gate_up_proj);
+      free_tensor(weights, layer->down_proj);
+      free_tensor(weights, layer->attn_norm);
+      free_tensor(weights, layer->ffn_norm);
+      free_tensor(weights, layer->q_proj);
+      free_tensor(weights, layer->k_proj);
+      free_tensor(weights, layer->v_proj);
+      free_tensor(weights, layer->gate_proj);
+      free_tensor(weights, layer->up_proj);
     }
     free(weights->layers);
   }
 
+  release_mapping(weights);
+  if (weights->packed_map)
+    munmap(weights->packed_map, weights->packed_map_size);
   memset(weights, 0, sizeof(*weights));
 }
+
+void qwen3_linear_f16(const uint16_t *x, const void *w, uint16_t *y, int M,
+                      int N, int K, qwen3_dtype_t dtype, bool packed) {
+  qwen3_linear_rows_f16(x, w, N, 0, y, M, N, K, dtype, packed);
+}
+
+/* Packed panels are K * GEMM_F16_PANEL elements, so a panel-aligned row0
+ * starts at the same offset as in the row-major layout. */
+void qwen3_linear_rows_f16(const uint16_t *x, const void *w, int w_rows,
+                           int row0, uint16_t *y, int M, int N, int K,
+                           qwen3_dtype_t dtype, bool packed) {
+  if (dtype == QWEN3_DTYPE_Q8) {
+    const float *scales = (const float *)w;
+    const int8_t *rows = (const int8_t *)(scales + w_rows);
+    gemm_q8_f16(x, rows + (size_t)row0 * K, scales + row0, y, M, N, K);
+  } else if (dtype == QWEN3_DTYPE_Q4) {
+    const gemm_q4_block_t *blocks = (const gemm_q4_block_t *)w;
+    gemm_q4_f16(x, blocks + (size_t)row0 * (K / GEMM_Q4_GROUP), y, M, N, K);
+  } else if (packed) {
+    gemm_f16_packed_b(x, (const uint16_t *)w + (size_t)row0 * K, y, M, N, K);
+  } else {
+    gemm_f16_transpose_b(x, (const uint16_t *)w + (size_t)row0 * K, y, M, N,
+                         K);
+  }
+}
@@ -13,35 +13,132 @@ extern "C" {
 typedef enum {
   QWEN3_DTYPE_F32 = 0,
   QWEN3_DTYPE_F16 = 1,
+  /* INT8 projection weights with an FP32 scale per output channel; norms,
+   * embeddings, lm_head, activations and the KV cache are FP16. */
+  QWEN3_DTYPE_Q8 = 2,
+  /* Like Q8 with 4-bit projections in groups of 32 (gemm_q4_block_t). */
+  QWEN3_DTYPE_Q4 = 3,
 } qwen3_dtype_t;
 
+/* Activations are FP16 for every dtype but F32. */
+static inline bool qwen3_dtype_f16_act(qwen3_dtype_t dtype) {
+  return dtype != QWEN3_DTYPE_F32;
+}
+
+/* Projection weights are quantized at load for Q8 and Q4. */
+static inline bool qwen3_dtype_quantized(qwen3_dtype_t dtype) {
+  return dtype == QWEN3_DTYPE_Q8 || dtype == QWEN3_DTYPE_Q4;
+}
+
+typedef enum {
+  /* Copy every tensor into its own allocation and close the file. */
+  QWEN3_LOAD_COPY = 0,
+  /* Keep the file mapped and reference tensors whose on-disk dtype already
+   * matches the compute dtype straight from the read-only mapping; only the
+   * remaining tensors are converted into private buffers. Processes loading
+   * the same file share its page cache. */
+  QWEN3_LOAD_MMAP = 1,
+  /* QWEN3_LOAD_MMAP with the FP16 projections of a QWEN3_DTYPE_F16 model in
+   * the panel layout of gemm_pack_f16_b, read from the sidecar file
+   * "<model_path>.packed". A missing or stale sidecar is rebuilt; when it
+   * cannot be written the panels are packed into private buffers. Other
+   * dtypes, and builds whose kernels have no packed layout, load as
+   * QWEN3_LOAD_MMAP. */
+  QWEN3_LOAD_PACKED = 2,
+} qwen3_load_mode_t;
+
+/*
+ * Projection matrices keep the checkpoint's [out, in] layout unless they are
+ * packed (see QWEN3_LOAD_PACKED). Under QWEN3_LOAD_MMAP an F32 or F16 model
+ * borrows every projection whose dtype matches from the mapping; the
+ * fusion below would copy them, so it is skipped there.
+ * Under QWEN3_DTYPE_Q8 each projection is one allocation holding the [out]
+ * FP32 row scales followed by the [out, in] INT8 rows. They are quantized at
+ * load, or copied when the checkpoint already stores an I8 tensor with an
+ * "<name>_scale" tensor of [out] scales next to it. Under QWEN3_DTYPE_Q4 a
+ * projection is [out, in / 32] gemm_q4_block_t; a checkpoint may store them
+ * as a U8 tensor of shape [out, in / 32, sizeof(gemm_q4_block_t)] (see
+ * examples/quantize_model.cc). Those blocks, and GGUF Q4_1 tensors, which
+ * share the layout, are the only part of a quantized model borrowed from
+ * the mapping; otherwise the file is closed once loaded.
+ *
+ * model_path may also name a .gguf file. Its F32/F16/BF16 tensors load like
+ * safetensors ones; block-quantized tensors are dequantized at load, except
+ * that a Q4 model takes Q4_0 and Q4_1 projections without requantizing.
+ */
+
+/*
+ * Otherwise the projections that read the same input are fused at load.
+ * qkv_proj is q_proj, k_proj and v_proj stacked into one
+ * [q_dim + 2 * kv_dim, hidden] matrix. gate_up_proj holds the gate_proj
+ * and up_proj rows interleaved in blocks of QWEN3_GATE_UP_BLOCK: block b is
+ * gate rows [b * B, b * B + n) followed by the same up rows, n being B
+ * except in a short last block, so that any whole run of blocks can go
+ * through one GEMM and silu_and_mul without the rest of the matrix.
+ */
+#define QWEN3_GATE_UP_BLOCK 64
+
+/* qkv_proj and gate_up_proj are NULL when the parts are not fused; q_proj,
+ * k_proj, v_proj, gate_proj and up_proj are set instead. */
 typedef struct {
-  void *q_proj;
-  void *k_proj;
-  void *v_proj;
+  void *qkv_proj;
   void *o_proj;
   void *q_norm;
   void *k_norm;
-  void *gate_proj;
-  void *up_proj;
+  void *gate_up_proj;
   void *down_proj;
   void *attn_norm;
   void *ffn_norm;
+  void *q_proj;
+  void *k_proj;
+  void *v_proj;
+  void *gate_proj;
+  void *up_proj;
 } qwen3_layer_weights_t;
 
 typedef struct {
   void *embed_tokens;
   void *norm;
+  /* [vocab, hidden]; the same pointer as embed_tokens when the embeddings
+   * are tied, so qwen3_weights_free releases it only once. */
   void *lm_head;
   qwen3_layer_weights_t *layers;
   int num_layers;
   qwen3_dtype_t dtype;
+  qwen3_load_mode_t load_mode;
+  /* The layer projections are in gemm_pack_f16_b layout. */
+  bool packed;
+  void *mapping;
+  /* The mapped sidecar of a packed load, when it could be used. */
+  void *packed_map;
+  size_t packed_map_size;
 } qwen3_weights_t;
 
+/*
+ * model_path is either a single .safetensors file or a sharded checkpoint's
+ * model.safetensors.index.json, whose shards are resolved relative to it.
+ * Loads with QWEN3_LOAD_MMAP.
+ */
 bool qwen3_weights_load(qwen3_weights_t *weights, const qwen3_config_t *config,
                         const char *model_path, qwen3_dtype_t dtype);
+bool qwen3_weights_load_with_mode(qwen3_weights_t *weights,
+                                  const qwen3_config_t *config,
+                                  const char *model_path, qwen3_dtype_t dtype,
+                                  qwen3_load_mode_t mode);
 void qwen3_weights_free(qwen3_weights_t *weights);
 
+/* y[M, N] = x[M, K] * W^T for a projection W [N, K] loaded as dtype, which
+ * is QWEN3_DTYPE_F16, QWEN3_DTYPE_Q8 or QWEN3_DTYPE_Q4; packed is
+ * qwen3_weights_t.packed. */
+void qwen3_linear_f16(const uint16_t *x, const void *w, uint16_t *y, int M,
+                      int N, int K, qwen3_dtype_t dtype, bool packed);
+
+/* The same for rows [row0, row0 + N) of a projection of w_rows rows. When
+ * packed, row0 is a multiple of GEMM_F16_PANEL. */
+void qwen3_linear_rows_f16(const uint16_t *x, const void *w, int w_rows,
+                           int row0, uint16_t *y, int M, int N, int K,
+                           qwen3_dtype_t dtype, bool packed);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,717 @@
+/*
+ * GGUF Model File Reader
+ *
+ * The block decoders follow ggml's reference dequantization; the layouts
+ * are spelled out next to each one.
+ */
+
+#include "inference/model_loader/gguf.h"
+#include "inference/kernels/convert/convert.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Bounds-checked cursor over the mapped header. */
+typedef struct {
+  const uint8_t *p;
+  const uint8_t *end;
+} reader_t;
+
+static bool read_bytes(reader_t *r, void *dst, size_t n) {
+  if ((size_t)(r->end - r->p) < n)
+    return false;
+  memcpy(dst, r->p, n);
+  r->p += n;
+  return true;
+}
+
+static bool read_u32(reader_t *r, uint32_t *out) {
+  return read_bytes(r, out, sizeof(*out));
+}
+
+static bool read_u64(reader_t *r, uint64_t *out) {
+  return read_bytes(r, out, sizeof(*out));
+}
+
+static bool read_string(reader_t *r, const char **str, size_t *len) {
+  uint64_t n;
+  if (!read_u64(r, &n) || (uint64_t)(r->end - r->p) < n)
+    return false;
+  *str = (const char *)r->p;
+  *len = (size_t)n;
+  r->p += n;
+  return true;
+}
+
+/* Encoded size of a scalar value; 0 for strings and arrays. */
+static size_t scalar_size(gguf_value_type_t type) {
+  switch (type) {
+  case GGUF_VALUE_UINT8:
+  case GGUF_VALUE_INT8:
+  case GGUF_VALUE_BOOL:
+    return 1;
+  case GGUF_VALUE_UINT16:
+  case GGUF_VALUE_INT16:
+    return 2;
+  case GGUF_VALUE_UINT32:
+  case GGUF_VALUE_INT32:
+  case GGUF_VALUE_FLOAT32:
+    return 4;
+  case GGUF_VALUE_UINT64:
+  case GGUF_VALUE_INT64:
+  case GGUF_VALUE_FLOAT64:
+    return 8;
+  default:
+    return 0;
+  }
+}
+
+static bool skip_value(reader_t *r, gguf_value_type_t type, int depth) {
+  if (type == GGUF_VALUE_STRING) {
+    const char *s;
+    size_t len;
+    return read_string(r, &s, &len);
+  }
+  if (type != GGUF_VALUE_ARRAY) {
+    size_t size = scalar_size(type);
+    if (size == 0 || (size_t)(r->end - r->p) < size)
+      return false;
+    r->p += size;
+    return true;
+  }
+
+  uint32_t elem_type;
+  uint64_t len;
+  if (depth > 4 || !read_u32(r, &elem_type) || !read_u64(r, &len))
+    return false;
+  size_t size = scalar_size((gguf_value_type_t)elem_type);
+  if (size) {
+    if ((uint64_t)(r->end - r->p) / size < len)
+      return false;
+    r->p += len * size;
+    return true;
+  }
+  for (uint64_t i = 0; i < len; i++) {
+    if (!skip_value(r, (gguf_value_type_t)elem_type, depth + 1))
+      return false;
+  }
+  return true;
+}
+
+static bool parse_kv(reader_t *r, gguf_kv_t *kv) {
+  uint32_t type;
+  if (!read_string(r, &kv->key, &kv->key_len) || !read_u32(r, &type))
+    return false;
+  kv->type = (gguf_value_type_t)type;
+  kv->data = r->p;
+  if (kv->type != GGUF_VALUE_ARRAY)
+    return skip_value(r, kv->type, 0);
+
+  reader_t array = *r;
+  uint32_t elem_type;
+  if (!read_u32(&array, &elem_type) || !read_u64(&array, &kv->array_len))
+    return false;
+  kv->array_type = (gguf_value_type_t)elem_type;
+  kv->data = array.p;
+  return skip_value(r, GGUF_VALUE_ARRAY, 0);
+}
+
+static bool parse_tensor_info(reader_t *r, gguf_tensor_t *tensor,
+                              uint64_t *offset) {
+  const char *name;
+  size_t name_len;
+  uint32_t n_dims, type;
+  if (!read_string(r, &name, &name_len) || name_len >= GGUF_MAX_NAME ||
+      !read_u32(r, &n_dims) || n_dims == 0 || n_dims > GGUF_MAX_DIMS)
+    return false;
+  memcpy(tensor->name, name, name_len);
+  tensor->name[name_len] = '\0';
+  tensor->n_dims = (int)n_dims;
+  for (int d = 0; d < GGUF_MAX_DIMS; d++) {
+    tensor->ne[d] = 1;
+    if ((uint32_t)d < n_dims && !read_u64(r, &tensor->ne[d]))
+      return false;
+  }
+  if (!read_u32(r, &type) || !read_u64(r, offset))
+    return false;
+  tensor->type = (gguf_tensor_type_t)type;
+  return true;
+}
+
+/* Byte size of a tensor of a known type, or 0 if its shape does not fit the
+ * type's blocks or overflows. */
+static size_t tensor_bytes(const gguf_tensor_t *tensor) {
+  size_t block = gguf_type_block_elems(tensor->type);
+  if (block == 0 || tensor->ne[0] % block != 0)
+    return 0;
+  uint64_t blocks = tensor->ne[0] / block;
+  for (int d = 1; d < GGUF_MAX_DIMS; d++) {
+    if (tensor->ne[d] && blocks > UINT64_MAX / tensor->ne[d])
+      return 0;
+    blocks *= tensor->ne[d];
+  }
+  size_t bytes = gguf_type_block_bytes(tensor->type);
+  if (blocks > SIZE_MAX / bytes)
+    return 0;
+  return (size_t)blocks * bytes;
+}
+
+static bool parse_file(gguf_file_t *file, const char *path) {
+  reader_t r = {(const uint8_t *)file->map,
+                (const uint8_t *)file->map + file->map_size};
+  uint32_t magic;
+  uint64_t num_tensors, num_kv;
+  if (!read_u32(&r, &magic) || magic != GGUF_MAGIC ||
+      !read_u32(&r, &file->version)) {
+    fprintf(stderr, "%s is not a GGUF file\n", path);
+    return false;
+  }
+  if (file->version != 2 && file->version != 3) {
+    fprintf(stderr, "%s: unsupported GGUF version %u\n", path, file->version);
+    return false;
+  }
+  /* Every entry takes more than 8 bytes, which bounds the allocations. */
+  size_t remaining = (size_t)(r.end - r.p);
+  if (!read_u64(&r, &num_tensors) || !read_u64(&r, &num_kv) ||
+      num_tensors > remaining / 8 || num_kv > remaining / 8) {
+    fprintf(stderr, "%s: truncated GGUF header\n", path);
+    return false;
+  }
+
+  file->kv = (gguf_kv_t *)calloc(num_kv ? num_kv : 1, sizeof(gguf_kv_t));
+  file->tensors = (gguf_tensor_t *)calloc(num_tensors ? num_tensors : 1,
+                                          sizeof(gguf_tensor_t));
+  uint64_t *offsets =
+      (uint64_t *)calloc(num_tensors ? num_tensors : 1, sizeof(uint64_t));
+  if (!file->kv || !file->tensors || !offsets) {
+    free(offsets);
+    fprintf(stderr, "%s: out of memory\n", path);
+    return false;
+  }
+
+  bool ok = true;
+  for (; ok && file->num_kv < num_kv; file->num_kv++)
+    ok = parse_kv(&r, &file->kv[file->num_kv]);
+  for (; ok && file->num_tensors < num_tensors; file->num_tensors++)
+    ok = parse_tensor_info(&r, &file->tensors[file->num_tensors],
+                           &offsets[file->num_tensors]);
+  if (!ok) {
+    free(offsets);
+    fprintf(stderr, "%s: malformed GGUF header\n", path);
+    return false;
+  }
+
+  int64_t alignment = GGUF_DEFAULT_ALIGNMENT;
+  const gguf_kv_t *align_kv = gguf_find_kv(file, "general.alignment");
+  if (align_kv && (!gguf_kv_int(align_kv, &alignment) || alignment <= 0 ||
+                   (alignment & (alignment - 1)) != 0)) {
+    free(offsets);
+    fprintf(stderr, "%s: invalid general.alignment\n", path);
+    return false;
+  }
+
+  size_t header_size = (size_t)(r.p - (const uint8_t *)file->map);
+  size_t data_start = (header_size + (size_t)alignment - 1) &
+                      ~((size_t)alignment - 1);
+  if (data_start > file->map_size)
+    data_start = file->map_size;
+  file->data = (const uint8_t *)file->map + data_start;
+  file->data_size = file->map_size - data_start;
+
+  for (size_t i = 0; i < file->num_tensors; i++) {
+    gguf_tensor_t *tensor = &file->tensors[i];
+    tensor->size = tensor_bytes(tensor);
+    if (offsets[i] % (uint64_t)alignment != 0 ||
+        offsets[i] > file->data_size ||
+        tensor->size > file->data_size - offsets[i]) {
+      fprintf(stderr, "%s: tensor %s lies outside the data section\n", path,
+              tensor->name);
+      free(offsets);
+      return false;
+    }
+    tensor->data = file->data + offsets[i];
+  }
+  free(offsets);
+  return true;
+}
+
+bool gguf_open(gguf_file_t *file, const char *path) {
+  memset(file, 0, sizeof(*file));
+
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    fprintf(stderr, "Failed to open %s\n", path);
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+    close(fd);
+    fprintf(stderr, "%s is empty\n", path);
+    return false;
+  }
+  void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    fprintf(stderr, "Failed to map %s\n", path);
+    return false;
+  }
+  file->map = map;
+  file->map_size = (size_t)st.st_size;
+
+  if (!parse_file(file, path)) {
+    gguf_close(file);
+    return false;
+  }
+  return true;
+}
+
+void gguf_close(gguf_file_t *file) {
+  if (!file)
+    return;
+  if (file->map)
+    munmap(file->map, file->map_size);
+  free(file->kv);
+  free(file->tensors);
+  memset(file, 0, sizeof(*file));
+}
+
+void gguf_prefetch(const gguf_file_t *file) {
+  if (file->map)
+    posix_madvise(file->map, file->map_size, POSIX_MADV_WILLNEED);
+}
+
+const gguf_kv_t *gguf_find_kv(const gguf_file_t *file, const char *key) {
+  size_t len = strlen(key);
+  for (size_t i = 0; i < file->num_kv; i++) {
+    const gguf_kv_t *kv = &file->kv[i];
+    if (kv->key_len == len && memcmp(kv->key, key, len) == 0)
+      return kv;
+  }
+  return NULL;
+}
+
+const gguf_tensor_t *gguf_find_tensor(const gguf_file_t *file,
+                                      const char *name) {
+  for (size_t i = 0; i < file->num_tensors; i++) {
+    if (strcmp(file->tensors[i].name, name) == 0)
+      return &file->tensors[i];
+  }
+  return NULL;
+}
+
+static bool decode_int(gguf_value_type_t type, const uint8_t *p,
+                       int64_t *out) {
+  switch (type) {
+  case GGUF_VALUE_UINT8:
+  case GGUF_VALUE_BOOL:
+    *out = *p;
+    return true;
+  case GGUF_VALUE_INT8:
+    *out = (int8_t)*p;
+    return true;
+  case GGUF_VALUE_UINT16: {
+    uint16_t v;
+    memcpy(&v, p, sizeof(v));
+    *out = v;
+    return true;
+  }
+  case GGUF_VALUE_INT16: {
+    int16_t v;
+    memcpy(&v, p, sizeof(v));
+    *out = v;
+    return true;
+  }
+  case GGUF_VALUE_UINT32: {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    *out = v;
+    return true;
+  }
+  case GGUF_VALUE_INT32: {
+    int32_t v;
+    memcpy(&v, p, sizeof(v));
+    *out = v;
+    return true;
+  }
+  case GGUF_VALUE_UINT64:
+  case GGUF_VALUE_INT64: {
+    int64_t v;
+    memcpy(&v, p, sizeof(v));
+    *out = v;
+    return true;
+  }
+  default:
+    return false;
+  }
+}
+
+bool gguf_kv_int(const gguf_kv_t *kv, int64_t *out) {
+  return decode_int(kv->type, kv->data, out);
+}
+
+bool gguf_kv_float(const gguf_kv_t *kv, double *out) {
+  if (kv->type == GGUF_VALUE_FLOAT32) {
+    float v;
+    memcpy(&v, kv->data, sizeof(v));
+    *out = v;
+    return true;
+  }
+  if (kv->type == GGUF_VALUE_FLOAT64) {
+    memcpy(out, kv->data, sizeof(*out));
+    return true;
+  }
+  int64_t v;
+  if (!gguf_kv_int(kv, &v))
+    return false;
+  *out = (double)v;
+  return true;
+}
+
+bool gguf_kv_string(const gguf_kv_t *kv, const char **str, size_t *len) {
+  if (kv->type != GGUF_VALUE_STRING)
+    return false;
+  uint64_t n;
+  memcpy(&n, kv->data, sizeof(n));
+  *str = (const char *)kv->data + sizeof(n);
+  *len = (size_t)n;
+  return true;
+}
+
+bool gguf_kv_array_int(const gguf_kv_t *kv, uint64_t i, int64_t *out) {
+  size_t size = scalar_size(kv->array_type);
+  if (kv->type != GGUF_VALUE_ARRAY || size == 0 || i >= kv->array_len)
+    return false;
+  return decode_int(kv->array_type, kv->data + i * size, out);
+}
+
+/* The array was bounds-checked when the header was parsed. */
+bool gguf_kv_strings(const gguf_kv_t *kv, const char **strs, size_t *lens) {
+  if (kv->type != GGUF_VALUE_ARRAY || kv->array_type != GGUF_VALUE_STRING)
+    return false;
+  const uint8_t *p = kv->data;
+  for (uint64_t i = 0; i < kv->array_len; i++) {
+    uint64_t n;
+    memcpy(&n, p, sizeof(n));
+    strs[i] = (const char *)p + sizeof(n);
+    lens[i] = (size_t)n;
+    p += sizeof(n) + n;
+  }
+  return true;
+}
+
+#define QK 32
+#define QK_K 256
+
+size_t gguf_type_block_elems(gguf_tensor_type_t type) {
+  switch (type) {
+  case GGUF_TENSOR_F32:
+  case GGUF_TENSOR_F16:
+  case GGUF_TENSOR_BF16:
+  case GGUF_TENSOR_I8:
+  case GGUF_TENSOR_I16:
+  case GGUF_TENSOR_I32:
+  case GGUF_TENSOR_I64:
+  case GGUF_TENSOR_F64:
+    return 1;
+  case GGUF_TENSOR_Q4_0:
+  case GGUF_TENSOR_Q4_1:
+  case GGUF_TENSOR_Q5_0:
+  case GGUF_TENSOR_Q5_1:
+  case GGUF_TENSOR_Q8_0:
+  case GGUF_TENSOR_Q8_1:
+    return QK;
+  case GGUF_TENSOR_Q2_K:
+  case GGUF_TENSOR_Q3_K:
+  case GGUF_TENSOR_Q4_K:
+  case GGUF_TENSOR_Q5_K:
+  case GGUF_TENSOR_Q6_K:
+  case GGUF_TENSOR_Q8_K:
+    return QK_K;
+  default:
+    return 0;
+  }
+}
+
+size_t gguf_type_block_bytes(gguf_tensor_type_t type) {
+  switch (type) {
+  case GGUF_TENSOR_F32:
+  case GGUF_TENSOR_I32:
+    return 4;
+  case GGUF_TENSOR_F16:
+  case GGUF_TENSOR_BF16:
+  case GGUF_TENSOR_I16:
+    return 2;
+  case GGUF_TENSOR_I8:
+    return 1;
+  case GGUF_TENSOR_I64:
+  case GGUF_TENSOR_F64:
+    return 8;
+  case GGUF_TENSOR_Q4_0:
+    return 2 + QK / 2;
+  case GGUF_TENSOR_Q4_1:
+    return 4 + QK / 2;
+  case GGUF_TENSOR_Q5_0:
+    return 2 + 4 + QK / 2;
+  case GGUF_TENSOR_Q5_1:
+    return 4 + 4 + QK / 2;
+  case GGUF_TENSOR_Q8_0:
+    return 2 + QK;
+  case GGUF_TENSOR_Q8_1:
+    return 4 + QK;
+  case GGUF_TENSOR_Q2_K:
+    return QK_K / 16 + QK_K / 4 + 4;
+  case GGUF_TENSOR_Q3_K:
+    return QK_K / 8 + QK_K / 4 + 12 + 2;
+  case GGUF_TENSOR_Q4_K:
+    return 4 + 12 + QK_K / 2;
+  case GGUF_TENSOR_Q5_K:
+    return 4 + 12 + QK_K / 8 + QK_K / 2;
+  case GGUF_TENSOR_Q6_K:
+    return QK_K / 2 + QK_K / 4 + QK_K / 16 + 2;
+  case GGUF_TENSOR_Q8_K:
+    return 4 + QK_K + QK_K / 8;
+  default:
+    return 0;
+  }
+}
+
+const char *gguf_type_name(gguf_tensor_type_t type) {
+  switch (type) {
+  case GGUF_TENSOR_F32:
+    return "F32";
+  case GGUF_TENSOR_F16:
+    return "F16";
+  case GGUF_TENSOR_Q4_0:
+    return "Q4_0";
+  case GGUF_TENSOR_Q4_1:
+    return "Q4_1";
+  case GGUF_TENSOR_Q5_0:
+    return "Q5_0";
+  case GGUF_TENSOR_Q5_1:
+    return "Q5_1";
+  case GGUF_TENSOR_Q8_0:
+    return "Q8_0";
+  case GGUF_TENSOR_Q8_1:
+    return "Q8_1";
+  case GGUF_TENSOR_Q2_K:
+    return "Q2_K";
+  case GGUF_TENSOR_Q3_K:
+    return "Q3_K";
+  case GGUF_TENSOR_Q4_K:
+    return "Q4_K";
+  case GGUF_TENSOR_Q5_K:
+    return "Q5_K";
+  case GGUF_TENSOR_Q6_K:
+    return "Q6_K";
+  case GGUF_TENSOR_Q8_K:
+    return "Q8_K";
+  case GGUF_TENSOR_I8:
+    return "I8";
+  case GGUF_TENSOR_I16:
+    return "I16";
+  case GGUF_TENSOR_I32:
+    return "I32";
+  case GGUF_TENSOR_I64:
+    return "I64";
+  case GGUF_TENSOR_F64:
+    return "F64";
+  case GGUF_TENSOR_BF16:
+    return "BF16";
+  default:
+    return "unknown";
+  }
+}
+
+size_t gguf_tensor_elems(const gguf_tensor_t *tensor) {
+  size_t n = 1;
+  for (int d = 0; d < GGUF_MAX_DIMS; d++)
+    n *= (size_t)tensor->ne[d];
+  return n;
+}
+
+static float load_f16(const uint8_t *p) {
+  uint16_t h;
+  memcpy(&h, p, sizeof(h));
+  return fp16_to_f32(h);
+}
+
+/* Q4_0: f16 d, 16 bytes of nibbles; x[j] = (low nibble of qs[j] - 8) * d
+ * and x[j + 16] = (high nibble - 8) * d. Q4_1 adds an f16 m after d and
+ * stores x = q * d + m. */
+static void dequant_q4(float *y, const uint8_t *b, size_t nb, bool has_min) {
+  size_t bytes = has_min ? 4 + QK / 2 : 2 + QK / 2;
+  for (size_t i = 0; i < nb; i++, b += bytes, y += QK) {
+    float d = load_f16(b);
+    float m = has_min ? load_f16(b + 2) : 0.0f;
+    int zero = has_min ? 0 : 8;
+    const uint8_t *qs = b + (has_min ? 4 : 2);
+    for (int j = 0; j < QK / 2; j++) {
+      y[j] = (float)((qs[j] & 0xF) - zero) * d + m;
+      y[j + QK / 2] = (float)((qs[j] >> 4) - zero) * d + m;
+    }
+  }
+}
+
+/* Q5_0 / Q5_1: Q4_0 / Q4_1 plus a 32-bit qh after the scales holding the
+ * fifth bit of each weight; Q5_0 is centred on 16. */
+static void dequant_q5(float *y, const uint8_t *b, size_t nb, bool has_min) {
+  size_t head = has_min ? 4 : 2;
+  size_t bytes = head + 4 + QK / 2;
+  for (size_t i = 0; i < nb; i++, b += bytes, y += QK) {
+    float d = load_f16(b);
+    float m = has_min ? load_f16(b + 2) : 0.0f;
+    int zero = has_min ? 0 : 16;
+    uint32_t qh;
+    memcpy(&qh, b + head, sizeof(qh));
+    const uint8_t *qs = b + head + 4;
+    for (int j = 0; j < QK / 2; j++) {
+      int x0 = (qs[j] & 0xF) | (((qh >> j) << 4) & 0x10);
+      int x1 = (qs[j] >> 4) | ((qh >> (j + 12)) & 0x10);
+      y[j] = (float)(x0 - zero) * d + m;
+      y[j + QK / 2] = (float)(x1 - zero) * d + m;
+    }
+  }
+}
+
+/* Q8_0: f16 d and 32 int8 weights. */
+static void dequant_q8_0(float *y, const uint8_t *b, size_t nb) {
+  for (size_t i = 0; i < nb; i++, b += 2 + QK, y += QK) {
+    float d = load_f16(b);
+    const int8_t *qs = (const int8_t *)(b + 2);
+    for (int j = 0; j < QK; j++)
+      y[j] = (float)qs[j] * d;
+  }
+}
+
+/* 6-bit scale and min of sub-block j packed into the 12 scale bytes of a
+ * Q4_K / Q5_K block. */
+static void scale_min_k4(int j, const uint8_t *q, int *sc, int *m) {
+  if (j < 4) {
+    *sc = q[j] & 63;
+    *m = q[j + 4] & 63;
+  } else {
+    *sc = (q[j + 4] & 0xF) | ((q[j - 4] >> 6) << 4);
+    *m = (q[j + 4] >> 4) | ((q[j] >> 6) << 4);
+  }
+}
+
+/* Q4_K: f16 d, f16 dmin, 12 scale bytes, 128 bytes of nibbles. Each 64
+ * weights use 32 bytes: low nibbles for the first 32 (sub-block 2k), high
+ * nibbles for the next 32 (sub-block 2k + 1); x = d * sc * q - dmin * m.
+ * Q5_K inserts 32 bytes of qh before the nibbles: bit 2k / 2k + 1 of qh[l]
+ * is the fifth bit of weight l of those two sub-blocks. */
+static void dequant_q45_k(float *y, const uint8_t *b, size_t nb, bool q5) {
+  size_t bytes = q5 ? 4 + 12 + QK_K / 8 + QK_K / 2 : 4 + 12 + QK_K / 2;
+  for (size_t i = 0; i < nb; i++, b += bytes) {
+    float d = load_f16(b);
+    float dmin = load_f16(b + 2);
+    const uint8_t *scales = b + 4;
+    const uint8_t *qh = b + 16;
+    const uint8_t *ql = b + 16 + (q5 ? QK_K / 8 : 0);
+    for (int k = 0; k < 4; k++, ql += 32) {
+      int sc, m;
+      scale_min_k4(2 * k, scales, &sc, &m);
+      float d1 = d * (float)sc, m1 = dmin * (float)m;
+      scale_min_k4(2 * k + 1, scales, &sc, &m);
+      float d2 = d * (float)sc, m2 = dmin * (float)m;
+      for (int l = 0; l < 32; l++) {
+        int hi1 = q5 && ((qh[l] >> (2 * k)) & 1) ? 16 : 0;
+        *y++ = d1 * (float)((ql[l] & 0xF) + hi1) - m1;
+      }
+      for (int l = 0; l < 32; l++) {
+        int hi2 = q5 && ((qh[l] >> (2 * k + 1)) & 1) ? 16 : 0;
+        *y++ = d2 * (float)((ql[l] >> 4) + hi2) - m2;
+      }
+    }
+  }
+}
+
+/* Q6_K: 128 bytes of low nibbles, 64 bytes of 2-bit high parts, 16 int8
+ * scales (one per 16 weights) and f16 d; x = d * scale * (q - 32). */
+static void dequant_q6_k(float *y, const uint8_t *b, size_t nb) {
+  for (size_t i = 0; i < nb; i++, b += QK_K / 2 + QK_K / 4 + QK_K / 16 + 2) {
+    const uint8_t *ql = b;
+    const uint8_t *qh = b + QK_K / 2;
+    const int8_t *sc = (const int8_t *)(b + QK_K / 2 + QK_K / 4);
+    float d = load_f16(b + QK_K / 2 + QK_K / 4 + QK_K / 16);
+    for (int n = 0; n < QK_K; n += 128, y += 128) {
+      for (int l = 0; l < 32; l++) {
+        int is = l / 16;
+        int q1 = ((ql[l] & 0xF) | ((qh[l] & 3) << 4)) - 32;
+        int q2 = ((ql[l + 32] & 0xF) | (((qh[l] >> 2) & 3) << 4)) - 32;
+        int q3 = ((ql[l] >> 4) | (((qh[l] >> 4) & 3) << 4)) - 32;
+        int q4 = ((ql[l + 32] >> 4) | (((qh[l] >> 6) & 3) << 4)) - 32;
+        y[l] = d * (float)sc[is] * (float)q1;
+        y[l + 32] = d * (float)sc[is + 2] * (float)q2;
+        y[l + 64] = d * (float)sc[is + 4] * (float)q3;
+        y[l + 96] = d * (float)sc[is + 6] * (float)q4;
+      }
+      ql += 64;
+      qh += 32;
+      sc += 8;
+    }
+  }
+}
+
+bool gguf_can_dequantize(gguf_tensor_type_t type) {
+  switch (type) {
+  case GGUF_TENSOR_F32:
+  case GGUF_TENSOR_F16:
+  case GGUF_TENSOR_BF16:
+  case GGUF_TENSOR_Q4_0:
+  case GGUF_TENSOR_Q4_1:
+  case GGUF_TENSOR_Q5_0:
+  case GGUF_TENSOR_Q5_1:
+  case GGUF_TENSOR_Q8_0:
+  case GGUF_TENSOR_Q4_K:
+  case GGUF_TENSOR_Q5_K:
+  case GGUF_TENSOR_Q6_K:
+    return true;
+  default:
+    return false;
+  }
+}
+
+bool gguf_dequantize(float *dst, const void *src, gguf_tensor_type_t type,
+                     size_t n) {
+  const uint8_t *b = (const uint8_t *)src;
+  size_t block = gguf_type_block_elems(type);
+  if (!gguf_can_dequantize(type) || n % block != 0)
+    return false;
+
+  switch (type) {
+  case GGUF_TENSOR_F32:
+    convert_array(dst, CONVERT_DTYPE_F32, b, CONVERT_DTYPE_F32, n);
+    return true;
+  case GGUF_TENSOR_F16:
+    convert_array(dst, CONVERT_DTYPE_F32, b, CONVERT_DTYPE_F16, n);
+    return true;
+  case GGUF_TENSOR_BF16:
+    convert_array(dst, CONVERT_DTYPE_F32, b, CONVERT_DTYPE_BF16, n);
+    return true;
+  case GGUF_TENSOR_Q4_0:
+  case GGUF_TENSOR_Q4_1:
+    dequant_q4(dst, b, n / block, type == GGUF_TENSOR_Q4_1);
+    return true;
+  case GGUF_TENSOR_Q5_0:
+  case GGUF_TENSOR_Q5_1:
+    dequant_q5(dst, b, n / block, type == GGUF_TENSOR_Q5_1);
+    return true;
+  case GGUF_TENSOR_Q8_0:
+    dequant_q8_0(dst, b, n / block);
+    return true;
+  case GGUF_TENSOR_Q4_K:
+  case GGUF_TENSOR_Q5_K:
+    dequant_q45_k(dst, b, n / block, type == GGUF_TENSOR_Q5_K);
+    return true;
+  case GGUF_TENSOR_Q6_K:
+    dequant_q6_k(dst, b, n / block);
+    return true;
+  default:
+    return false;
+  }
+}
@@ -0,0 +1,149 @@
+/*
+ * GGUF Model File Reader
+ *
+ * Maps a GGUF file (versions 2 and 3) read-only and indexes it in place:
+ * metadata values and tensor data are views into the mapping, so nothing is
+ * copied until a caller converts a tensor. Little-endian files only.
+ *
+ * Tensor dimensions follow ggml: ne[0] is the contiguous one, so a matrix
+ * with ne = {in, out} is stored as out rows of in elements, the same layout
+ * as a [out, in] safetensors tensor.
+ */
+
+#ifndef GGUF_H
+#define GGUF_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define GGUF_MAGIC 0x46554747u /* "GGUF" */
+#define GGUF_DEFAULT_ALIGNMENT 32
+#define GGUF_MAX_DIMS 4
+#define GGUF_MAX_NAME 64
+
+typedef enum {
+  GGUF_VALUE_UINT8 = 0,
+  GGUF_VALUE_INT8 = 1,
+  GGUF_VALUE_UINT16 = 2,
+  GGUF_VALUE_INT16 = 3,
+  GGUF_VALUE_UINT32 = 4,
+  GGUF_VALUE_INT32 = 5,
+  GGUF_VALUE_FLOAT32 = 6,
+  GGUF_VALUE_BOOL = 7,
+  GGUF_VALUE_STRING = 8,
+  GGUF_VALUE_ARRAY = 9,
+  GGUF_VALUE_UINT64 = 10,
+  GGUF_VALUE_INT64 = 11,
+  GGUF_VALUE_FLOAT64 = 12,
+} gguf_value_type_t;
+
+/* ggml tensor types; the numbering is part of the file format. */
+typedef enum {
+  GGUF_TENSOR_F32 = 0,
+  GGUF_TENSOR_F16 = 1,
+  GGUF_TENSOR_Q4_0 = 2,
+  GGUF_TENSOR_Q4_1 = 3,
+  GGUF_TENSOR_Q5_0 = 6,
+  GGUF_TENSOR_Q5_1 = 7,
+  GGUF_TENSOR_Q8_0 = 8,
+  GGUF_TENSOR_Q8_1 = 9,
+  GGUF_TENSOR_Q2_K = 10,
+  GGUF_TENSOR_Q3_K = 11,
+  GGUF_TENSOR_Q4_K = 12,
+  GGUF_TENSOR_Q5_K = 13,
+  GGUF_TENSOR_Q6_K = 14,
+  GGUF_TENSOR_Q8_K = 15,
+  GGUF_TENSOR_I8 = 24,
+  GGUF_TENSOR_I16 = 25,
+  GGUF_TENSOR_I32 = 26,
+  GGUF_TENSOR_I64 = 27,
+  GGUF_TENSOR_F64 = 28,
+  GGUF_TENSOR_BF16 = 30,
+} gguf_tensor_type_t;
+
+typedef struct {
+  /* Not NUL-terminated. */
+  const char *key;
+  size_t key_len;
+  gguf_value_type_t type;
+  /* The encoded value; for arrays, the first element. */
+  const uint8_t *data;
+  gguf_value_type_t array_type;
+  uint64_t array_len;
+} gguf_kv_t;
+
+typedef struct {
+  char name[GGUF_MAX_NAME];
+  int n_dims;
+  uint64_t ne[GGUF_MAX_DIMS];
+  gguf_tensor_type_t type;
+  const uint8_t *data;
+  /* 0 for types gguf_type_block_bytes does not know. */
+  size_t size;
+} gguf_tensor_t;
+
+typedef struct {
+  void *map;
+  size_t map_size;
+  uint32_t version;
+  gguf_kv_t *kv;
+  size_t num_kv;
+  gguf_tensor_t *tensors;
+  size_t num_tensors;
+  /* Tensor data section, aligned to general.alignment. */
+  const uint8_t *data;
+  size_t data_size;
+} gguf_file_t;
+
+/* Map path and index its header. On failure an error is printed to stderr
+ * and file is left closed. */
+bool gguf_open(gguf_file_t *file, const char *path);
+void gguf_close(gguf_file_t *file);
+
+/* Start reading the tensor data in the background. */
+void gguf_prefetch(const gguf_file_t *file);
+
+const gguf_kv_t *gguf_find_kv(const gguf_file_t *file, const char *key);
+const gguf_tensor_t *gguf_find_tensor(const gguf_file_t *file,
+                                      const char *name);
+
+/* Scalar accessors; false when the value has another type. Integers are
+ * accepted as floats, and bools as integers. */
+bool gguf_kv_int(const gguf_kv_t *kv, int64_t *out);
+bool gguf_kv_float(const gguf_kv_t *kv, double *out);
+bool gguf_kv_string(const gguf_kv_t *kv, const char **str, size_t *len);
+
+/* Element i of an integer array. */
+bool gguf_kv_array_int(const gguf_kv_t *kv, uint64_t i, int64_t *out);
+
+/* Point strs[i] / lens[i] at each of the kv->array_len strings of a string
+ * array. The strings are not NUL-terminated. */
+bool gguf_kv_strings(const gguf_kv_t *kv, const char **strs, size_t *lens);
+
+/* Elements per block and bytes per block; 0 for types not handled here. */
+size_t gguf_type_block_elems(gguf_tensor_type_t type);
+size_t gguf_type_block_bytes(gguf_tensor_type_t type);
+const char *gguf_type_name(gguf_tensor_type_t type);
+
+size_t gguf_tensor_elems(const gguf_tensor_t *tensor);
+
+/* F32, F16, BF16 and the Q4_0, Q4_1, Q5_0, Q5_1, Q8_0, Q4_K, Q5_K and Q6_K
+ * block types. */
+bool gguf_can_dequantize(gguf_tensor_type_t type);
+
+/* dst[0, n) = src decoded to FP32. src points at a block boundary and n is
+ * a multiple of the block size. Returns false for types
+ * gguf_can_dequantize rejects. */
+bool gguf_dequantize(float *dst, const void *src, gguf_tensor_type_t type,
+                     size_t n);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* GGUF_H */
@@ -39,6 +39,7 @@
 #include <array>
 #include <map>
 #include <string>
+#include <unordered_map>
 #include <vector>
 #include <cstdint>
 
@@ -91,69 +92,102 @@ class ordered_dict {
       return false;
     }
 
-    if (!_m.count(_keys[idx])) {
-      // This should not happen though.
-      return false;
-    }
-
-    (*dst) = _m.at(_keys[idx]);
+    (*dst) = _values[idx];
 
     return true;
   }
 
-  bool count(const std::string &key) const { return _m.count(key); }
+  bool count(const std::string &key) const { return _index.count(key); }
 
   void insert(const std::string &key, const T &value) {
-    if (_m.count(key)) {
-      // overwrite existing value
-    } else {
-      _keys.push_back(key);
-    }
-
-    _m[key] = value;
+    T tmp(value);
+    insert(key, std::move(tmp));
   }
 
   void insert(const std::string &key, T &&value) {
-    if (_m.count(key)) {
+    auto it = _index.find(key);
+    if (it != _index.end()) {
       // overwrite existing value
-    } else {
-      _keys.push_back(key);
+      _values[it->second] = std::move(value);
+      return;
     }
 
-    _m[key] = std::move(value);
+    size_t idx = _keys.size();
+    _keys.push_back(key);
+    _values.push_back(std::move(value));
+    _index.emplace(key, idx);
+    _sorted.emplace(key, idx);
   }
 
   bool at(const std::string &key, T *dst) const {
-    if (!_m.count(key)) {
-      // This should not happen though.
+    size_t idx;
+    if (!find(key, &idx)) {
+      return false;
+    }
+
+    (*dst) = _values[idx];
+
+    return true;
+  }
+
+  // O(1) name -> insertion index lookup.
+  bool find(const std::string &key, size_t *idx) const {
+    auto it = _index.find(key);
+    if (it == _index.end()) {
       return false;
     }
 
-    (*dst) = _m.at(key);
+    (*idx) = it->second;
 
     return true;
   }
 
+  // Insertion indices of all keys starting with `prefix`, in key order.
+  // e.g. "model.layers.3." selects one transformer layer.
+  std::vector<size_t> find_prefix(const std::string &prefix) const {
+    std::vector<size_t> out;
+    for (auto it = _sorted.lower_bound(prefix); it != _sorted.end(); ++it) {
+      if (it->first.compare(0, prefix.size(), prefix) != 0) {
+        break;
+      }
+      out.push_back(it->second);
+    }
+    return out;
+  }
+
   const std::vector<std::string> &keys() const { return _keys; }
 
-  size_t size() const { return _m.size(); }
+  size_t size() const { return _keys.size(); }
 
   bool erase(const std::string &key) {
-    // simple linear search
-    for (size_t i = 0; i < _keys.size(); i++) {
-      if (_keys[i] == key) {
-        _keys.erase(_keys.begin() + i);
-        _m.erase(key);
-        return true;
-      }
+    auto it = _index.find(key);
+    if (it == _index.end()) {
+      return false;
     }
 
-    return false;
+    size_t idx = it->second;
+    _keys.erase(_keys.begin() + idx);
+    _values.erase(_values.begin() + idx);
+    _index.erase(it);
+    _sorted.erase(key);
+
+    // Later entries moved down by one.
+    for (auto &kv : _index) {
+      if (kv.second > idx) kv.second--;
+    }
+    for (auto &kv : _sorted) {
+      if (kv.second > idx) kv.second--;
+    }
+
+    return true;
   }
 
  private:
   std::vector<std::string> _keys;
-  std::map<std::string, T> _m;
+  std::vector<T> _values;
+  // Built as keys are inserted while the header is parsed.
+  std::unordered_map<std::string, size_t> _index;
+  std::map<std::string, size_t> _sorted;
 };
 
 } // namespace minijson
@@ -445,6 +445,27 @@ static bool parse_merges_txt(GPT2BPETokenizer *tok, const char *txt) {
   return true;
 }
 
+static void finish_load(GPT2BPETokenizer *tok) {
+  build_vocab_hash(tok);
+  build_merge_hash(tok);
+
+  for (size_t i = 0; i < tok->vocab_size; i++) {
+    if (tok->tokens[i].token) {
+      if (strcmp(tok->tokens[i].token, "<|endoftext|>") == 0) {
+        if (tok->unk_id < 0)
+          tok->unk_id = (int)i;
+        if (tok->eos_id < 0)
+          tok->eos_id = (int)i;
+      }
+    }
+  }
+
+  build_vocab_trie(tok);
+  init_bpe_cache(tok);
+
+  tok->loaded = true;
+}
+
 bool gpt2_load(GPT2BPETokenizer *tok, const char *vocab_path,
                const char *merges_path) {
   size_t vocab_len, merges_len;
@@ -472,27 +493,60 @@ bool gpt2_load(GPT2BPETokenizer *tok, const char *vocab_path,
   free(vocab_json);
   free(merges_txt);
 
-  build_vocab_hash(tok);
-  build_merge_hash(tok);
+  finish_load(tok);
+  return true;
+}
 
-  for (size_t i = 0; i < tok->vocab_size; i++) {
-    if (tok->tokens[i].token) {
-      if (strcmp(tok->tokens[i].token, "<|endoftext|>") == 0) {
-        if (tok->unk_id < 0)
-          tok->unk_id = (int)i;
-        if (tok->eos_id < 0)
-          tok->eos_id = (int)i;
-      }
-    }
+bool gpt2_load_from_strings(GPT2BPETokenizer *tok, const char *const *tokens,
+                            const size_t *token_lens, size_t vocab_size,
+                            const char *const *merges,
+                            const size_t *merge_lens, size_t num_merges) {
+  if (vocab_size > GPT2_MAX_VOCAB_SIZE || num_merges > GPT2_MAX_MERGES)
+    return false;
+
+  tok->tokens = calloc(vocab_size ? vocab_size : 1, sizeof(GPT2Token));
+  tok->merges = calloc(num_merges ? num_merges : 1, sizeof(GPT2Merge));
+  if (!tok->tokens || !tok->merges)
+    return false;
+
+  for (size_t i = 0; i < vocab_size; i++) {
+    if (token_lens[i] > UINT16_MAX)
+      continue;
+    tok->tokens[i].token = malloc(token_lens[i] + 1);
+    if (!tok->tokens[i].token)
+      continue;
+    memcpy(tok->tokens[i].token, tokens[i], token_lens[i]);
+    tok->tokens[i].token[token_lens[i]] = '\0';
+    tok->tokens[i].len = (uint16_t)token_lens[i];
   }
+  tok->vocab_size = vocab_size;
 
-  build_vocab_trie(tok);
-  init_bpe_cache(tok);
+  size_t count = 0;
+  for (size_t i = 0; i < num_merges; i++) {
+    const char *space = memchr(merges[i], ' ', merge_lens[i]);
+    if (!space)
+      continue;
+    size_t first_len = (size_t)(space - merges[i]);
+    size_t second_len = merge_lens[i] - first_len - 1;
+    if (first_len == 0 || second_len == 0 ||
+        first_len >= GPT2_MAX_TOKEN_LEN || second_len >= GPT2_MAX_TOKEN_LEN)
+      continue;
 
-  tok->loaded = true;
+    GPT2Merge *m = &tok->merges[count++];
+    memcpy(m->first, merges[i], first_len);
+    m->first[first_len] = '\0';
+    m->first_len = (uint16_t)first_len;
+    memcpy(m->second, space + 1, second_len);
+    m->second[second_len] = '\0';
+    m->second_len = (uint16_t)second_len;
+  }
+  tok->num_merges = count;
+
+  finish_load(tok);
   return true;
 }
 
+
 int gpt2_token_to_id(const GPT2BPETokenizer *tok, const char *token) {
   if (!tok->vocab_hash)
     return -1;
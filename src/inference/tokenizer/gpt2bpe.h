@@ -69,6 +69,17 @@ void gpt2_free(GPT2BPETokenizer *tok);
 bool gpt2_load(GPT2BPETokenizer *tok, const char *vocab_path,
                const char *merges_path);
 
+/*
+ * Load from strings already in memory, such as the tokenizer embedded in a
+ * GGUF file. tokens[i] is token i spelled as in vocab.json and merges[i] is
+ * the merge of rank i as a "first second" line of merges.txt. The strings
+ * need not be NUL-terminated.
+ */
+bool gpt2_load_from_strings(GPT2BPETokenizer *tok, const char *const *tokens,
+                            const size_t *token_lens, size_t vocab_size,
+                            const char *const *merges,
+                            const size_t *merge_lens, size_t num_merges);
+
 int gpt2_encode(const GPT2BPETokenizer *tok, const char *text,
                 uint32_t *out_ids, size_t max_ids);
 
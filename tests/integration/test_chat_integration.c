@@ -238,6 +238,76 @@ TEST(chat_save_and_load_with_roles) {
   PASS();
 }
 
+static int g_load_calls, g_save_calls;
+static char g_hook_id[64], g_load_kv_path[1024], g_save_kv_path[1024];
+
+static void record_load(void *userdata, const char *id, const char *kv_path) {
+  (void)userdata;
+  g_load_calls++;
+  snprintf(g_hook_id, sizeof(g_hook_id), "%s", id);
+  snprintf(g_load_kv_path, sizeof(g_load_kv_path), "%s", kv_path);
+}
+
+static void record_save(void *userdata, const char *id, const char *kv_path) {
+  (void)userdata;
+  g_save_calls++;
+  snprintf(g_hook_id, sizeof(g_hook_id), "%s", id);
+  snprintf(g_save_kv_path, sizeof(g_save_kv_path), "%s", kv_path);
+}
+
+TEST(chat_hooks_run_on_save_and_load) {
+  setup_test_environment();
+
+  ChatHooks hooks = {record_load, record_save, NULL};
+  chat_set_hooks(&hooks);
+  g_load_calls = g_save_calls = 0;
+
+  ChatHistory h;
+  history_init(&h);
+  history_add(&h, "You: Hello");
+  char *id = chat_generate_id();
+  ASSERT_NOT_NULL(id);
+  ASSERT_TRUE(chat_save(&h, id, "Hook Test", NULL, "TestChar"));
+  ASSERT_EQ_INT(1, g_save_calls);
+  ASSERT_EQ_STR(id, g_hook_id);
+
+  char expected[1024];
+  ASSERT_TRUE(chat_kv_snapshot_path(id, "TestChar", expected, sizeof(expected)));
+  ASSERT_EQ_STR(expected, g_save_kv_path);
+
+  ChatHistory loaded;
+  history_init(&loaded);
+  char char_path[256];
+  ASSERT_TRUE(chat_load(&loaded, id, "TestChar", char_path, sizeof(char_path)));
+  ASSERT_EQ_INT(1, g_load_calls);
+  ASSERT_EQ_STR(id, g_hook_id);
+  ASSERT_EQ_STR(expected, g_load_kv_path);
+
+  /* Found by searching every character directory: same snapshot path. */
+  ChatHistory searched;
+  history_init(&searched);
+  ASSERT_TRUE(chat_load(&searched, id, NULL, char_path, sizeof(char_path)));
+  ASSERT_EQ_INT(2, g_load_calls);
+  ASSERT_EQ_STR(expected, g_load_kv_path);
+
+  /* A failed load leaves the engine on its current chat. */
+  ChatHistory missing;
+  history_init(&missing);
+  ASSERT_FALSE(chat_load(&missing, "no-such-chat", "TestChar", char_path,
+                         sizeof(char_path)));
+  ASSERT_EQ_INT(2, g_load_calls);
+
+  chat_set_hooks(NULL);
+  history_free(&h);
+  history_free(&loaded);
+  history_free(&searched);
+  history_free(&missing);
+  free(id);
+
+  teardown_test_environment();
+  PASS();
+}
+
 void run_chat_integration_tests(void) {
   TEST_SUITE("Chat Integration");
   RUN_TEST(chat_save_and_load_roundtrip);
@@ -251,4 +321,5 @@ void run_chat_integration_tests(void) {
   RUN_TEST(chat_sanitize_dirname_special_chars);
   RUN_TEST(chat_character_list_load_empty);
   RUN_TEST(chat_save_and_load_with_roles);
+  RUN_TEST(chat_hooks_run_on_save_and_load);
 }
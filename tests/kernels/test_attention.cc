@@ -4,6 +4,7 @@
 
 extern "C" {
 #include "inference/kernels/attention/attention.h"
+#include "inference/kernels/convert/convert.h"
 #include "test_framework.h"
 }
 
@@ -221,6 +222,182 @@ TEST(flash_attention_mha_f32_basic) {
   ASSERT(out_min >= 0.0f && out_max <= 1.0f);
 }
 
+/*
+ * Checks flash_attention_paged_* against reference_attention_f32 run per
+ * (query, head) over the keys up to the query's position. cached positions
+ * are already in the cache when the chunk of seq_len queries arrives, as in
+ * a chunked prefill. A single query goes through the split-K decode kernel,
+ * which must give the same bits on one thread and on four. With int8 the
+ * cache is quantized and the reference sees the dequantized keys and
+ * values.
+ */
+static void check_paged_attention(bool f16, int num_heads, int num_kv_heads,
+                                  int head_dim, int cached, int seq_len,
+                                  float tolerance, bool int8 = false) {
+  const int kv_len = cached + seq_len;
+  const int q_dim = num_heads * head_dim;
+  const int row = num_kv_heads * head_dim;
+  const int group = num_heads / num_kv_heads;
+  const float scale = 1.0f / sqrtf((float)head_dim);
+
+  /* Values pass through F16 in that variant, so the reference sees the
+   * rounded ones. */
+  auto round = [f16](float x) {
+    return f16 ? fp16_to_f32(f32_to_fp16(x)) : x;
+  };
+  std::vector<float> q(seq_len * q_dim), k(kv_len * row), v(kv_len * row);
+  for (size_t i = 0; i < q.size(); i++)
+    q[i] = round((float)((i * 7) % 23) / 11.0f - 1.0f);
+  for (size_t i = 0; i < k.size(); i++) {
+    k[i] = round((float)((i * 5) % 19) / 9.0f - 1.0f);
+    v[i] = round((float)((i * 3) % 17) / 8.0f - 1.0f);
+  }
+
+  kv_pool_t pool;
+  if (int8)
+    ASSERT_TRUE(kv_pool_init_q8(&pool, 1, num_kv_heads, head_dim, 16, 0));
+  else
+    ASSERT_TRUE(kv_pool_init(&pool, 1, num_kv_heads, head_dim,
+                             f16 ? sizeof(uint16_t) : sizeof(float), 16, 0));
+  kv_seq_t seq;
+  kv_seq_init(&seq, &pool);
+  ASSERT_TRUE(kv_seq_reserve(&seq, kv_len));
+  kv_layer_view_t view = kv_seq_layer(&seq, 0);
+  if (int8) {
+    kv_cache_append_paged_q8_f32(&view, k.data(), v.data(), 0, kv_len);
+    for (int pos = 0; pos < kv_len; pos++) {
+      for (int i = 0; i < row; i++) {
+        int kv_head = i / head_dim;
+        k[pos * row + i] = ((const int8_t *)kv_view_key(&view, pos))[i] *
+                           kv_view_key_scale(&view, pos)[kv_head];
+        v[pos * row + i] = ((const int8_t *)kv_view_value(&view, pos))[i] *
+                           kv_view_value_scale(&view, pos)[kv_head];
+      }
+    }
+  }
+  for (int pos = 0; pos < kv_len && !int8; pos++) {
+    for (int i = 0; i < row; i++) {
+      if (f16) {
+        ((uint16_t *)kv_view_key(&view, pos))[i] =
+            f32_to_fp16(k[pos * row + i]);
+        ((uint16_t *)kv_view_value(&view, pos))[i] =
+            f32_to_fp16(v[pos * row + i]);
+      } else {
+        ((float *)kv_view_key(&view, pos))[i] = k[pos * row + i];
+        ((float *)kv_view_value(&view, pos))[i] = v[pos * row + i];
+      }
+    }
+  }
+
+  std::vector<int64_t> positions(seq_len);
+  for (int i = 0; i < seq_len; i++)
+    positions[i] = cached + i;
+  std::vector<float> scratch(
+      seq_len == 1
+          ? flash_attention_decode_scratch_floats(num_heads, head_dim)
+          : flash_attention_paged_scratch_floats(head_dim, group));
+  std::vector<float> out(seq_len * q_dim);
+  std::vector<uint16_t> q16(q.size()), out16(out.size());
+  for (size_t i = 0; i < q.size(); i++)
+    q16[i] = f32_to_fp16(q[i]);
+
+  /* Work is split by head, tile and cache chunk, never by thread, so the
+   * output must not depend on the thread count. */
+  int saved_threads = attention_get_num_threads();
+  std::vector<float> single(out.size());
+  for (int threads = 1; threads <= 4; threads += 3) {
+    attention_set_num_threads(threads);
+    if (seq_len == 1 && f16)
+      flash_attention_decode_paged_f16(out16.data(), q16.data(), &view,
+                                       kv_len, num_heads, scale,
+                                       scratch.data());
+    else if (seq_len == 1)
+      flash_attention_decode_paged_f32(out.data(), q.data(), &view, kv_len,
+                                       num_heads, scale, scratch.data());
+    else if (f16)
+      flash_attention_paged_f16(out16.data(), q16.data(), &view,
+                                positions.data(), seq_len, kv_len, num_heads,
+                                scale, scratch.data());
+    else
+      flash_attention_paged_f32(out.data(), q.data(), &view,
+                                positions.data(), seq_len, kv_len, num_heads,
+                                scale, scratch.data());
+    if (f16) {
+      for (size_t i = 0; i < out.size(); i++)
+        out[i] = fp16_to_f32(out16[i]);
+    }
+    if (threads == 1)
+      single = out;
+  }
+  attention_set_num_threads(saved_threads);
+  ASSERT_TRUE(memcmp(single.data(), out.data(), out.size() * sizeof(float)) ==
+              0);
+
+  std::vector<float> k_head(kv_len * head_dim), v_head(kv_len * head_dim);
+  std::vector<float> expected(head_dim);
+  float max_diff = 0.0f;
+  for (int h = 0; h < num_heads; h++) {
+    int kv_head = h / group;
+    for (int pos = 0; pos < kv_len; pos++) {
+      memcpy(&k_head[pos * head_dim], &k[pos * row + kv_head * head_dim],
+             head_dim * sizeof(float));
+      memcpy(&v_head[pos * head_dim], &v[pos * row + kv_head * head_dim],
+             head_dim * sizeof(float));
+    }
+    for (int i = 0; i < seq_len; i++) {
+      reference_attention_f32(expected.data(), &q[i * q_dim + h * head_dim],
+                              k_head.data(), v_head.data(), 1, cached + i + 1,
+                              head_dim, scale, nullptr);
+      for (int d = 0; d < head_dim; d++) {
+        float diff = fabsf(out[i * q_dim + h * head_dim + d] - expected[d]);
+        if (diff > max_diff)
+          max_diff = diff;
+      }
+    }
+  }
+  ASSERT_TRUE(max_diff < tolerance);
+
+  kv_seq_free(&seq);
+  kv_pool_free(&pool);
+}
+
+/* Four query heads per KV head; head_dim 76 leaves a tail after the SIMD
+ * blocks, and the chunk starts mid-page and spans partial key tiles. */
+TEST(flash_attention_paged_f32_gqa) {
+  check_paged_attention(false, 8, 2, 76, 40, 50, 1e-5f);
+}
+
+TEST(flash_attention_paged_f16_gqa) {
+  check_paged_attention(true, 4, 2, 128, 7, 70, 4e-3f);
+}
+
+/* Up to 64 (query, head) rows share a tile; 16 heads per KV head leave
+ * room for only four queries per tile. */
+TEST(flash_attention_paged_f32_wide_group) {
+  check_paged_attention(false, 16, 1, 64, 0, 37, 1e-5f);
+}
+
+/* 1000 positions split four ways; the group's heads share each tile. */
+TEST(flash_attention_decode_f32_split) {
+  check_paged_attention(false, 8, 2, 76, 999, 1, 1e-5f);
+}
+
+/* Long enough to hit the split cap, so chunks grow past the minimum. */
+TEST(flash_attention_decode_f16_long) {
+  check_paged_attention(true, 4, 2, 128, 20000, 1, 4e-3f);
+}
+
+/* An INT8 cache goes through the same tiles, dequantized as they load. */
+TEST(flash_attention_paged_int8_gqa) {
+  check_paged_attention(false, 8, 2, 64, 40, 50, 1e-5f, true);
+  check_paged_attention(true, 4, 2, 128, 7, 70, 4e-3f, true);
+}
+
+TEST(flash_attention_decode_int8_split) {
+  check_paged_attention(false, 8, 2, 64, 999, 1, 1e-5f, true);
+  check_paged_attention(true, 4, 2, 128, 999, 1, 4e-3f, true);
+}
+
 extern "C" void run_attention_tests(void) {
   TEST_SUITE("Flash Attention");
   RUN_TEST(flash_attention_f32_basic);
@@ -228,4 +405,11 @@ extern "C" void run_attention_tests(void) {
   RUN_TEST(flash_attention_f32_causal_mask);
   RUN_TEST(flash_attention_f32_output_range);
   RUN_TEST(flash_attention_mha_f32_basic);
+  RUN_TEST(flash_attention_paged_f32_gqa);
+  RUN_TEST(flash_attention_paged_f16_gqa);
+  RUN_TEST(flash_attention_paged_f32_wide_group);
+  RUN_TEST(flash_attention_decode_f32_split);
+  RUN_TEST(flash_attention_decode_f16_long);
+  RUN_TEST(flash_attention_paged_int8_gqa);
+  RUN_TEST(flash_attention_decode_int8_split);
 }
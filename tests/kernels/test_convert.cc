@@ -0,0 +1,197 @@
+/*
+ * Dtype Conversion Unit Tests
+ */
+
+#include "test_framework.h"
+
+extern "C" {
+#include "inference/kernels/convert/convert.h"
+#include "inference/kernels/threadpool/threadpool.h"
+}
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+static float bits_to_float(uint32_t bits) {
+  float f;
+  memcpy(&f, &bits, sizeof(f));
+  return f;
+}
+
+/* Values spread over FP16 subnormals, normals and overflow. */
+static std::vector<float> random_floats(size_t n, unsigned seed) {
+  std::vector<float> v(n);
+  srand(seed);
+  for (size_t i = 0; i < n; i++) {
+    float mant = (float)rand() / (float)RAND_MAX + 0.5f;
+    int exp = rand() % 48 - 30;
+    v[i] = ldexpf(rand() % 2 ? mant : -mant, exp);
+  }
+  return v;
+}
+
+static bool is_fp16_nan(uint16_t h) {
+  return (h & 0x7C00) == 0x7C00 && (h & 0x3FF) != 0;
+}
+
+TEST(convert_scalar_rounding_cases) {
+  ASSERT_EQ(0x3C00, f32_to_fp16(1.0f));
+  ASSERT_EQ(0x8000, f32_to_fp16(-0.0f));
+  ASSERT_EQ(0x7BFF, f32_to_fp16(65504.0f));
+  ASSERT_EQ(0x7C00, f32_to_fp16(65520.0f));
+  ASSERT_EQ(0xFC00, f32_to_fp16(-INFINITY));
+  ASSERT_TRUE(is_fp16_nan(f32_to_fp16(NAN)));
+
+  /* Ties go to the even mantissa. */
+  ASSERT_EQ(0x3C00, f32_to_fp16(1.0f + ldexpf(1.0f, -11)));
+  ASSERT_EQ(0x3C02, f32_to_fp16(1.0f + 3.0f * ldexpf(1.0f, -11)));
+  ASSERT_EQ(0x3C01, f32_to_fp16(1.0f + ldexpf(1.0f, -11) + ldexpf(1.0f, -20)));
+
+  /* Subnormals. */
+  ASSERT_EQ(0x0001, f32_to_fp16(ldexpf(1.0f, -24)));
+  ASSERT_EQ(0x0000, f32_to_fp16(ldexpf(1.0f, -25)));
+  ASSERT_EQ(0x0001, f32_to_fp16(1.5f * ldexpf(1.0f, -25)));
+  ASSERT_EQ(0x0400, f32_to_fp16(ldexpf(1.0f, -14)));
+  ASSERT_NEAR(ldexpf(1.0f, -24), fp16_to_f32(0x0001), 0.0f);
+
+  ASSERT_EQ(0x3F80, f32_to_bf16(1.0f));
+  ASSERT_EQ(0x3F80, f32_to_bf16(1.0f + ldexpf(1.0f, -8)));
+  ASSERT_EQ(0x3F82, f32_to_bf16(1.0f + 3.0f * ldexpf(1.0f, -8)));
+  ASSERT_EQ(0x7F80, f32_to_bf16(bits_to_float(0x7F7FFFFF)));
+  uint16_t nan = f32_to_bf16(bits_to_float(0x7F800001));
+  ASSERT_TRUE((nan & 0x7F80) == 0x7F80 && (nan & 0x7F) != 0);
+  PASS();
+}
+
+TEST(convert_f16_round_trips_every_value) {
+  std::vector<uint16_t> halves(65536), back(65536);
+  std::vector<float> floats(65536);
+  for (size_t i = 0; i < halves.size(); i++)
+    halves[i] = (uint16_t)i;
+
+  convert_f16_to_f32(halves.data(), floats.data(), halves.size());
+  convert_f32_to_f16(floats.data(), back.data(), floats.size());
+
+  int mismatches = 0;
+  for (size_t i = 0; i < halves.size(); i++) {
+    if (is_fp16_nan(halves[i])) {
+      if (!is_fp16_nan(back[i]) || !std::isnan(floats[i]))
+        mismatches++;
+    } else if (back[i] != halves[i] || floats[i] != fp16_to_f32(halves[i])) {
+      mismatches++;
+    }
+  }
+  ASSERT_EQ(0, mismatches);
+  PASS();
+}
+
+/* The vector bodies must agree bit for bit with the scalar helpers. */
+static int check_arrays(size_t n, unsigned seed) {
+  std::vector<float> f32 = random_floats(n, seed);
+  std::vector<uint16_t> f16(n), bf16(n), u16(n);
+  std::vector<float> out(n);
+  int mismatches = 0;
+
+  convert_f32_to_f16(f32.data(), f16.data(), n);
+  for (size_t i = 0; i < n; i++)
+    mismatches += f16[i] != f32_to_fp16(f32[i]);
+
+  convert_f32_to_bf16(f32.data(), bf16.data(), n);
+  for (size_t i = 0; i < n; i++)
+    mismatches += bf16[i] != f32_to_bf16(f32[i]);
+
+  convert_f16_to_f32(f16.data(), out.data(), n);
+  for (size_t i = 0; i < n; i++)
+    mismatches += out[i] != fp16_to_f32(f16[i]);
+
+  convert_bf16_to_f32(bf16.data(), out.data(), n);
+  for (size_t i = 0; i < n; i++)
+    mismatches += out[i] != bf16_to_f32(bf16[i]);
+
+  convert_bf16_to_f16(bf16.data(), u16.data(), n);
+  for (size_t i = 0; i < n; i++)
+    mismatches += u16[i] != f32_to_fp16(bf16_to_f32(bf16[i]));
+
+  convert_array(u16.data(), CONVERT_DTYPE_BF16, f16.data(), CONVERT_DTYPE_F16,
+                n);
+  for (size_t i = 0; i < n; i++)
+    mismatches += u16[i] != f32_to_bf16(fp16_to_f32(f16[i]));
+
+  convert_array(out.data(), CONVERT_DTYPE_F32, f32.data(), CONVERT_DTYPE_F32,
+                n);
+  mismatches += memcmp(out.data(), f32.data(), n * sizeof(float)) != 0;
+  return mismatches;
+}
+
+TEST(convert_arrays_match_scalar) {
+  size_t sizes[] = {0, 1, 7, 8, 15, 16, 17, 1037};
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+    ASSERT_EQ(0, check_arrays(sizes[i], 42 + (unsigned)i));
+  PASS();
+}
+
+TEST(convert_arrays_multithreaded) {
+  int saved = threadpool_get_num_threads();
+  threadpool_set_num_threads(4);
+  int mismatches = check_arrays((1 << 20) + 13, 7);
+  threadpool_set_num_threads(saved);
+  ASSERT_EQ(0, mismatches);
+  PASS();
+}
+
+static int check_transpose(size_t rows, size_t cols, convert_dtype_t dst_dtype,
+                           convert_dtype_t src_dtype) {
+  std::vector<float> f32 = random_floats(rows * cols, (unsigned)(rows + cols));
+  std::vector<uint8_t> src(rows * cols * convert_dtype_size(src_dtype));
+  std::vector<uint8_t> dst(rows * cols * convert_dtype_size(dst_dtype));
+  std::vector<uint8_t> expect(dst.size());
+  convert_array(src.data(), src_dtype, f32.data(), CONVERT_DTYPE_F32,
+                rows * cols);
+
+  size_t ssz = convert_dtype_size(src_dtype);
+  size_t dsz = convert_dtype_size(dst_dtype);
+  for (size_t r = 0; r < rows; r++) {
+    for (size_t c = 0; c < cols; c++)
+      convert_array(&expect[(c * rows + r) * dsz], dst_dtype,
+                    &src[(r * cols + c) * ssz], src_dtype, 1);
+  }
+
+  convert_transpose(dst.data(), dst_dtype, src.data(), src_dtype, rows, cols);
+  return memcmp(dst.data(), expect.data(), dst.size()) != 0;
+}
+
+TEST(convert_transpose_shapes) {
+  size_t shapes[][2] = {{1, 1}, {1, 40}, {3, 70}, {33, 31}, {64, 64}, {100, 37}};
+  for (size_t i = 0; i < sizeof(shapes) / sizeof(shapes[0]); i++) {
+    size_t rows = shapes[i][0], cols = shapes[i][1];
+    ASSERT_EQ(0, check_transpose(rows, cols, CONVERT_DTYPE_F16,
+                                 CONVERT_DTYPE_BF16));
+    ASSERT_EQ(0, check_transpose(rows, cols, CONVERT_DTYPE_F32,
+                                 CONVERT_DTYPE_F16));
+    ASSERT_EQ(0, check_transpose(rows, cols, CONVERT_DTYPE_F32,
+                                 CONVERT_DTYPE_F32));
+  }
+  PASS();
+}
+
+TEST(convert_transpose_multithreaded) {
+  int saved = threadpool_get_num_threads();
+  threadpool_set_num_threads(4);
+  int mismatches =
+      check_transpose(600, 517, CONVERT_DTYPE_F16, CONVERT_DTYPE_F32);
+  threadpool_set_num_threads(saved);
+  ASSERT_EQ(0, mismatches);
+  PASS();
+}
+
+extern "C" void run_convert_tests(void) {
+  TEST_SUITE("Dtype Conversion");
+  RUN_TEST(convert_scalar_rounding_cases);
+  RUN_TEST(convert_f16_round_trips_every_value);
+  RUN_TEST(convert_arrays_match_scalar);
+  RUN_TEST(convert_arrays_multithreaded);
+  RUN_TEST(convert_transpose_shapes);
+  RUN_TEST(convert_transpose_multithreaded);
+}
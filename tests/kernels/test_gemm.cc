@@ -1,6 +1,7 @@
 #include "test_framework.h"
 #include <cmath>
 #include <cstring>
+#include <vector>
 
 #include "inference/model_loader/safetensors.hh"
 
@@ -22,6 +23,222 @@ static void naive_matmul_f32(const float *A, const float *B, float *C, int M,
   }
 }
 
+static void naive_matmul_f32_trans(const float *A, const float *B, float *C,
+                                   int M, int N, int K, bool transpose_A,
+                                   bool transpose_B) {
+  for (int i = 0; i < M; i++) {
+    for (int j = 0; j < N; j++) {
+      double sum = 0.0;
+      for (int k = 0; k < K; k++) {
+        float a = transpose_A ? A[k * M + i] : A[i * K + k];
+        float b = transpose_B ? B[j * K + k] : B[k * N + j];
+        sum += (double)a * b;
+      }
+      C[i * N + j] = (float)sum;
+    }
+  }
+}
+
+static float check_gemm_f32_trans(int M, int N, int K, bool transpose_A,
+                                  bool transpose_B) {
+  float *A = (float *)malloc(M * K * sizeof(float));
+  float *B = (float *)malloc(K * N * sizeof(float));
+  float *C = (float *)malloc(M * N * sizeof(float));
+  float *expected = (float *)malloc(M * N * sizeof(float));
+
+  for (int i = 0; i < M * K; i++)
+    A[i] = (float)((i * 7) % 29) * 0.03f - 0.4f;
+  for (int i = 0; i < K * N; i++)
+    B[i] = (float)((i * 5) % 19) * 0.05f - 0.5f;
+
+  gemm_f32(A, B, C, M, N, K, transpose_A, transpose_B);
+  naive_matmul_f32_trans(A, B, expected, M, N, K, transpose_A, transpose_B);
+
+  float max_err = 0.0f;
+  for (int i = 0; i < M * N; i++) {
+    float err = fabsf(expected[i] - C[i]);
+    if (err > max_err)
+      max_err = err;
+  }
+
+  free(A);
+  free(B);
+  free(C);
+  free(expected);
+  return max_err;
+}
+
+/* Runs gemm_f16 (or gemm_f16_transpose_b with B stored [N, K]) on
+ * FP16-rounded inputs and returns the worst error relative to a
+ * double-precision reference computed from the same rounded values. */
+static float check_gemm_f16(int M, int N, int K, bool transpose_B) {
+  float *A = (float *)malloc(M * K * sizeof(float));
+  float *B = (float *)malloc(K * N * sizeof(float));
+  float *expected = (float *)malloc(M * N * sizeof(float));
+  float *C = (float *)malloc(M * N * sizeof(float));
+  uint16_t *A_f16 = (uint16_t *)malloc(M * K * sizeof(uint16_t));
+  uint16_t *B_f16 = (uint16_t *)malloc(K * N * sizeof(uint16_t));
+  uint16_t *C_f16 = (uint16_t *)malloc(M * N * sizeof(uint16_t));
+
+  for (int i = 0; i < M * K; i++)
+    A[i] = (float)((i * 7) % 29) * 0.03f - 0.4f;
+  for (int i = 0; i < K * N; i++)
+    B[i] = (float)((i * 5) % 19) * 0.05f - 0.5f;
+
+  f32_array_to_f16(A, A_f16, M * K);
+  f32_array_to_f16(B, B_f16, K * N);
+  f16_array_to_f32(A_f16, A, M * K);
+  f16_array_to_f32(B_f16, B, K * N);
+
+  if (transpose_B)
+    gemm_f16_transpose_b(A_f16, B_f16, C_f16, M, N, K);
+  else
+    gemm_f16(A_f16, B_f16, C_f16, M, N, K);
+  f16_array_to_f32(C_f16, C, M * N);
+  naive_matmul_f32_trans(A, B, expected, M, N, K, false, transpose_B);
+
+  float max_err = 0.0f;
+  for (int i = 0; i < M * N; i++) {
+    float err = fabsf(expected[i] - C[i]) / (fabsf(expected[i]) + 1.0f);
+    if (err > max_err)
+      max_err = err;
+  }
+
+  free(A);
+  free(B);
+  free(expected);
+  free(C);
+  free(A_f16);
+  free(B_f16);
+  free(C_f16);
+  return max_err;
+}
+
+/* Packs B [N, K] with gemm_pack_f16_b and checks gemm_f16_packed_b against
+ * the unpacked product. */
+static float check_gemm_f16_packed(int M, int N, int K) {
+  std::vector<float> A(M * K), B(N * K), expected(M * N), C(M * N);
+  std::vector<uint16_t> A_f16(M * K), B_f16(N * K), C_f16(M * N);
+  std::vector<uint16_t> packed(gemm_f16_packed_size(N, K) / sizeof(uint16_t));
+
+  for (int i = 0; i < M * K; i++)
+    A[i] = (float)((i * 7) % 29) * 0.03f - 0.4f;
+  for (int i = 0; i < N * K; i++)
+    B[i] = (float)((i * 5) % 19) * 0.05f - 0.5f;
+
+  f32_array_to_f16(A.data(), A_f16.data(), M * K);
+  f32_array_to_f16(B.data(), B_f16.data(), N * K);
+  f16_array_to_f32(A_f16.data(), A.data(), M * K);
+  f16_array_to_f32(B_f16.data(), B.data(), N * K);
+
+  gemm_pack_f16_b(packed.data(), B_f16.data(), N, K);
+  gemm_f16_packed_b(A_f16.data(), packed.data(), C_f16.data(), M, N, K);
+  f16_array_to_f32(C_f16.data(), C.data(), M * N);
+  naive_matmul_f32_trans(A.data(), B.data(), expected.data(), M, N, K, false,
+                         true);
+
+  float max_err = 0.0f;
+  for (int i = 0; i < M * N; i++) {
+    float err = fabsf(expected[i] - C[i]) / (fabsf(expected[i]) + 1.0f);
+    if (err > max_err)
+      max_err = err;
+  }
+  return max_err;
+}
+
+/* Quantizes B [N, K] with gemm_quantize_q8, runs gemm_q8_f32 or gemm_q8_f16
+ * and returns the worst error relative to a double-precision product of A
+ * with the dequantized B. */
+static float check_gemm_q8(int M, int N, int K, bool f16) {
+  std::vector<float> A(M * K), B(N * K), C(M * N), scales(N);
+  std::vector<int8_t> Bq(N * K);
+  std::vector<uint16_t> A_f16(M * K), C_f16(M * N);
+
+  for (int i = 0; i < M * K; i++)
+    A[i] = (float)((i * 7) % 29) * 0.03f - 0.4f;
+  for (int i = 0; i < N * K; i++)
+    B[i] = ((float)((i * 5) % 19) * 0.05f - 0.5f) * (1.0f + (i / K) % 3);
+
+  gemm_quantize_q8(Bq.data(), scales.data(), B.data(), N, K);
+  for (int n = 0; n < N; n++) {
+    for (int k = 0; k < K; k++) {
+      float deq = Bq[n * K + k] * scales[n];
+      if (fabsf(deq - B[n * K + k]) > scales[n] * 0.5f + 1e-6f)
+        return 1.0f;
+      B[n * K + k] = deq;
+    }
+  }
+
+  if (f16) {
+    f32_array_to_f16(A.data(), A_f16.data(), M * K);
+    f16_array_to_f32(A_f16.data(), A.data(), M * K);
+    gemm_q8_f16(A_f16.data(), Bq.data(), scales.data(), C_f16.data(), M, N,
+                K);
+    f16_array_to_f32(C_f16.data(), C.data(), M * N);
+  } else {
+    gemm_q8_f32(A.data(), Bq.data(), scales.data(), C.data(), M, N, K);
+  }
+
+  std::vector<float> expected(M * N);
+  naive_matmul_f32_trans(A.data(), B.data(), expected.data(), M, N, K, false,
+                         true);
+  float max_err = 0.0f;
+  for (int i = 0; i < M * N; i++) {
+    float err = fabsf(expected[i] - C[i]) / (fabsf(expected[i]) + 1.0f);
+    if (err > max_err)
+      max_err = err;
+  }
+  return max_err;
+}
+
+static float check_gemm_q4(int M, int N, int K, bool f16) {
+  int groups = K / GEMM_Q4_GROUP;
+  std::vector<float> A(M * K), B(N * K), C(M * N);
+  std::vector<gemm_q4_block_t> Bq(N * groups);
+  std::vector<uint16_t> A_f16(M * K), C_f16(M * N);
+
+  for (int i = 0; i < M * K; i++)
+    A[i] = (float)((i * 7) % 29) * 0.03f - 0.4f;
+  for (int i = 0; i < N * K; i++)
+    B[i] = ((float)((i * 5) % 19) * 0.05f - 0.3f) * (1.0f + (i / K) % 3);
+
+  gemm_quantize_q4(Bq.data(), B.data(), N, K);
+  for (int n = 0; n < N; n++) {
+    for (int k = 0; k < K; k++) {
+      const gemm_q4_block_t &b = Bq[n * groups + k / GEMM_Q4_GROUP];
+      int i = k % GEMM_Q4_GROUP;
+      int q = i < 16 ? b.qs[i] & 15 : b.qs[i - 16] >> 4;
+      float d, m;
+      f16_array_to_f32(&b.d, &d, 1);
+      f16_array_to_f32(&b.m, &m, 1);
+      float deq = q * d + m;
+      if (fabsf(deq - B[n * K + k]) > d * 0.5f + fabsf(m) * 1e-3f + 1e-6f)
+        return 1.0f;
+      B[n * K + k] = deq;
+    }
+  }
+
+  if (f16) {
+    f32_array_to_f16(A.data(), A_f16.data(), M * K);
+    f16_array_to_f32(A_f16.data(), A.data(), M * K);
+    gemm_q4_f16(A_f16.data(), Bq.data(), C_f16.data(), M, N, K);
+    f16_array_to_f32(C_f16.data(), C.data(), M * N);
+  } else {
+    gemm_q4_f32(A.data(), Bq.data(), C.data(), M, N, K);
+  }
+
+  std::vector<float> expected(M * N);
+  naive_matmul_f32_trans(A.data(), B.data(), expected.data(), M, N, K, false,
+                         true);
+  float max_err = 0.0f;
+  for (int i = 0; i < M * N; i++) {
+    float err = fabsf(expected[i] - C[i]) / (fabsf(expected[i]) + 1.0f);
+    if (err > max_err)
+      max_err = err;
+  }
+  return max_err;
+}
+
 static void extract_hadamard_tensor(const char *key, int expected_dim,
                                     float **out_data, int *out_size) {
   safetensors::safetensors_t st;
@@ -360,6 +577,179 @@ TEST(gemm_f32_large_512x256) {
   PASS();
 }
 
+TEST(gemm_f32_transpose_combinations) {
+  /* Odd sizes exercise panel edges; K > 256 crosses a K block. */
+  const int M = 37, N = 45, K = 300;
+  ASSERT_TRUE(check_gemm_f32_trans(M, N, K, false, false) < 1e-3f);
+  ASSERT_TRUE(check_gemm_f32_trans(M, N, K, true, false) < 1e-3f);
+  ASSERT_TRUE(check_gemm_f32_trans(M, N, K, false, true) < 1e-3f);
+  ASSERT_TRUE(check_gemm_f32_trans(M, N, K, true, true) < 1e-3f);
+  PASS();
+}
+
+TEST(gemm_f32_m1_transpose_b) {
+  ASSERT_TRUE(check_gemm_f32_trans(1, 131, 77, false, true) < 1e-3f);
+  ASSERT_TRUE(check_gemm_f32_trans(1, 131, 77, true, false) < 1e-3f);
+  PASS();
+}
+
+TEST(gemm_f32_multithreaded_transpose_b) {
+  int saved = gemm_get_num_threads();
+  gemm_set_num_threads(4);
+  float err_nt = check_gemm_f32_trans(150, 200, 96, false, true);
+  float err_nn = check_gemm_f32_trans(130, 70, 520, false, false);
+  gemm_set_num_threads(saved);
+  ASSERT_TRUE(err_nt < 1e-3f);
+  ASSERT_TRUE(err_nn < 1e-3f);
+  PASS();
+}
+
+TEST(gemm_f16_odd_sizes_multi_k_block) {
+  ASSERT_TRUE(check_gemm_f16(37, 45, 300, false) < 2e-3f);
+  ASSERT_TRUE(check_gemm_f16(7, 19, 5, false) < 2e-3f);
+  PASS();
+}
+
+TEST(gemm_f16_m1_decode_path) {
+  ASSERT_TRUE(check_gemm_f16(1, 131, 77, false) < 2e-3f);
+  ASSERT_TRUE(check_gemm_f16(1, 64, 512, false) < 2e-3f);
+  PASS();
+}
+
+TEST(gemm_f16_multithreaded) {
+  int saved = gemm_get_num_threads();
+  gemm_set_num_threads(4);
+  float err = check_gemm_f16(130, 200, 520, false);
+  gemm_set_num_threads(saved);
+  ASSERT_TRUE(err < 2e-3f);
+  PASS();
+}
+
+TEST(gemm_f16_transpose_b_shapes) {
+  ASSERT_TRUE(check_gemm_f16(1, 131, 77, true) < 2e-3f);
+  ASSERT_TRUE(check_gemm_f16(7, 19, 5, true) < 2e-3f);
+  ASSERT_TRUE(check_gemm_f16(37, 45, 300, true) < 2e-3f);
+  PASS();
+}
+
+TEST(gemm_f16_transpose_b_multithreaded) {
+  int saved = gemm_get_num_threads();
+  gemm_set_num_threads(4);
+  float err_decode = check_gemm_f16(1, 515, 264, true);
+  float err_prefill = check_gemm_f16(130, 200, 520, true);
+  gemm_set_num_threads(saved);
+  ASSERT_TRUE(err_decode < 2e-3f);
+  ASSERT_TRUE(err_prefill < 2e-3f);
+  PASS();
+}
+
+/* M <= GEMM_GEMV_MAX_M takes the unpacked small-M path; K = 1100 gives
+ * several column blocks, and N leaves a partial last block. */
+TEST(gemm_small_m_paths) {
+  for (int M = 2; M <= GEMM_GEMV_MAX_M + 1; M++) {
+    ASSERT_TRUE(check_gemm_f32_trans(M, 131, 77, false, true) < 1e-3f);
+    ASSERT_TRUE(check_gemm_f32_trans(M, 131, 77, false, false) < 1e-3f);
+    ASSERT_TRUE(check_gemm_f32_trans(M, 70, 33, true, true) < 1e-3f);
+    ASSERT_TRUE(check_gemm_f16(M, 131, 77, true) < 2e-3f);
+    ASSERT_TRUE(check_gemm_f16(M, 131, 77, false) < 2e-3f);
+  }
+  ASSERT_TRUE(check_gemm_f32_trans(3, 515, 1100, false, true) < 1e-2f);
+  ASSERT_TRUE(check_gemm_f16(3, 515, 1100, true) < 2e-3f);
+  PASS();
+}
+
+TEST(gemm_small_m_multithreaded) {
+  int saved = gemm_get_num_threads();
+  gemm_set_num_threads(4);
+  float err_f32 = check_gemm_f32_trans(1, 515, 1100, false, true);
+  float err_f32_nn = check_gemm_f32_trans(4, 515, 264, false, false);
+  float err_f16 = check_gemm_f16(2, 515, 1100, true);
+  float err_f16_nn = check_gemm_f16(1, 515, 264, false);
+  gemm_set_num_threads(saved);
+  ASSERT_TRUE(err_f32 < 1e-2f);
+  ASSERT_TRUE(err_f32_nn < 1e-3f);
+  ASSERT_TRUE(err_f16 < 2e-3f);
+  ASSERT_TRUE(err_f16_nn < 2e-3f);
+  PASS();
+}
+
+/* Prepacked B through the GEMV path (M <= 4) and the blocked path, with a
+ * K tail, several K blocks and a zero-padded last panel. */
+TEST(gemm_f16_packed_shapes) {
+  ASSERT_EQ_SIZE(2 * 16 * 5 * sizeof(uint16_t), gemm_f16_packed_size(19, 5));
+  ASSERT_TRUE(check_gemm_f16_packed(1, 131, 77) < 2e-3f);
+  ASSERT_TRUE(check_gemm_f16_packed(1, 64, 1030) < 2e-3f);
+  ASSERT_TRUE(check_gemm_f16_packed(3, 515, 1100) < 2e-3f);
+  ASSERT_TRUE(check_gemm_f16_packed(7, 19, 5) < 2e-3f);
+  ASSERT_TRUE(check_gemm_f16_packed(37, 45, 300) < 2e-3f);
+  PASS();
+}
+
+TEST(gemm_f16_packed_multithreaded) {
+  int saved = gemm_get_num_threads();
+  gemm_set_num_threads(4);
+  float err_decode = check_gemm_f16_packed(1, 515, 264);
+  float err_prefill = check_gemm_f16_packed(130, 200, 520);
+  gemm_set_num_threads(saved);
+  ASSERT_TRUE(err_decode < 2e-3f);
+  ASSERT_TRUE(err_prefill < 2e-3f);
+  PASS();
+}
+
+/* GEMV path (M <= 4) and the packed path, both activation types, with a
+ * K tail and a partial last column panel. */
+TEST(gemm_q8_shapes) {
+  for (int f16 = 0; f16 <= 1; f16++) {
+    float tol = f16 ? 2e-3f : 1e-4f;
+    ASSERT_TRUE(check_gemm_q8(1, 131, 77, f16) < tol);
+    ASSERT_TRUE(check_gemm_q8(1, 67, 1041, f16) < tol);
+    ASSERT_TRUE(check_gemm_q8(3, 515, 1100, f16) < tol);
+    ASSERT_TRUE(check_gemm_q8(7, 19, 5, f16) < tol);
+    ASSERT_TRUE(check_gemm_q8(37, 45, 300, f16) < tol);
+  }
+  PASS();
+}
+
+TEST(gemm_q8_multithreaded) {
+  int saved = gemm_get_num_threads();
+  gemm_set_num_threads(4);
+  float err_decode = check_gemm_q8(1, 515, 1100, true);
+  float err_prefill = check_gemm_q8(130, 200, 520, true);
+  float err_f32 = check_gemm_q8(70, 300, 264, false);
+  gemm_set_num_threads(saved);
+  ASSERT_TRUE(err_decode < 2e-3f);
+  ASSERT_TRUE(err_prefill < 2e-3f);
+  ASSERT_TRUE(err_f32 < 1e-4f);
+  PASS();
+}
+
+/* 4-bit blocks through the GEMV path and the dequantizing packed path,
+ * including a partial last column panel and an odd row count. */
+TEST(gemm_q4_shapes) {
+  for (int f16 = 0; f16 <= 1; f16++) {
+    float tol = f16 ? 2e-3f : 1e-4f;
+    ASSERT_TRUE(check_gemm_q4(1, 131, 64, f16) < tol);
+    ASSERT_TRUE(check_gemm_q4(1, 67, 1056, f16) < tol);
+    ASSERT_TRUE(check_gemm_q4(3, 515, 1088, f16) < tol);
+    ASSERT_TRUE(check_gemm_q4(7, 19, 32, f16) < tol);
+    ASSERT_TRUE(check_gemm_q4(37, 45, 288, f16) < tol);
+  }
+  PASS();
+}
+
+TEST(gemm_q4_multithreaded) {
+  int saved = gemm_get_num_threads();
+  gemm_set_num_threads(4);
+  float err_decode = check_gemm_q4(1, 515, 1088, true);
+  float err_prefill = check_gemm_q4(130, 200, 512, true);
+  float err_f32 = check_gemm_q4(70, 300, 256, false);
+  gemm_set_num_threads(saved);
+  ASSERT_TRUE(err_decode < 2e-3f);
+  ASSERT_TRUE(err_prefill < 2e-3f);
+  ASSERT_TRUE(err_f32 < 1e-4f);
+  PASS();
+}
+
 extern "C" {
 void run_gemm_tests(void) {
   TEST_SUITE("GEMM (FP32/FP16/BF16)");
@@ -376,5 +766,21 @@ void run_gemm_tests(void) {
   RUN_TEST(gemm_f32_tail_m23_n19);
   RUN_TEST(gemm_f32_large_256x256);
   RUN_TEST(gemm_f32_large_512x256);
+  RUN_TEST(gemm_f32_transpose_combinations);
+  RUN_TEST(gemm_f32_m1_transpose_b);
+  RUN_TEST(gemm_f32_multithreaded_transpose_b);
+  RUN_TEST(gemm_f16_odd_sizes_multi_k_block);
+  RUN_TEST(gemm_f16_m1_decode_path);
+  RUN_TEST(gemm_f16_multithreaded);
+  RUN_TEST(gemm_f16_transpose_b_shapes);
+  RUN_TEST(gemm_f16_transpose_b_multithreaded);
+  RUN_TEST(gemm_small_m_paths);
+  RUN_TEST(gemm_small_m_multithreaded);
+  RUN_TEST(gemm_f16_packed_shapes);
+  RUN_TEST(gemm_f16_packed_multithreaded);
+  RUN_TEST(gemm_q8_shapes);
+  RUN_TEST(gemm_q8_multithreaded);
+  RUN_TEST(gemm_q4_shapes);
+  RUN_TEST(gemm_q4_multithreaded);
 }
 }
@@ -6,11 +6,13 @@
 
 extern "C" {
 #include "inference/kernels/kv_cache/kv_cache.h"
+#include "inference/kernels/kv_cache/kv_pages.h"
 }
 
 #include <cmath>
 #include <cstdlib>
 #include <cstring>
+#include <vector>
 
 static void assert_array_near(const float *expected, const float *actual,
                               size_t count, float epsilon) {
@@ -239,6 +241,236 @@ TEST(kv_cache_f32_large) {
   free(value);
 }
 
+TEST(kv_pages_append_across_pages) {
+  const int num_layers = 2;
+  const int num_heads = 2;
+  const int head_dim = 4;
+  const int row = num_heads * head_dim;
+
+  kv_pool_t pool;
+  ASSERT_TRUE(kv_pool_init(&pool, num_layers, num_heads, head_dim,
+                           sizeof(float), 3, 0));
+  ASSERT_EQ(4, pool.page_tokens);
+
+  kv_seq_t seq;
+  kv_seq_init(&seq, &pool);
+
+  std::vector<float> key(11 * row), value(11 * row);
+  for (size_t i = 0; i < key.size(); i++) {
+    key[i] = (float)i;
+    value[i] = -(float)i;
+  }
+
+  /* Uneven appends so runs start mid-page and span page boundaries. */
+  int chunks[] = {3, 7, 1};
+  int len = 0;
+  for (int c = 0; c < 3; c++) {
+    ASSERT_TRUE(kv_seq_reserve(&seq, len + chunks[c]));
+    kv_layer_view_t view = kv_seq_layer(&seq, 1);
+    kv_cache_append_paged_f32(&view, key.data() + len * row,
+                              value.data() + len * row, len, chunks[c]);
+    len += chunks[c];
+  }
+  ASSERT_EQ(3, seq.num_pages);
+
+  kv_layer_view_t view = kv_seq_layer(&seq, 1);
+  for (int pos = 0; pos < len; pos++) {
+    ASSERT_ARRAY_NEAR(key.data() + pos * row,
+                      (const float *)kv_view_key(&view, pos), row, 0.0f);
+    ASSERT_ARRAY_NEAR(value.data() + pos * row,
+                      (const float *)kv_view_value(&view, pos), row, 0.0f);
+  }
+
+  kv_seq_free(&seq);
+  kv_pool_free(&pool);
+}
+
+TEST(kv_pages_f16_matches_flat_cache) {
+  const int num_heads = 4;
+  const int head_dim = 16;
+  const int num_tokens = 45;
+  const int row = num_heads * head_dim;
+
+  std::vector<uint16_t> key(num_tokens * row), value(num_tokens * row);
+  for (size_t i = 0; i < key.size(); i++) {
+    key[i] = float_to_fp16_scalar((float)(i % 97) / 8.0f);
+    value[i] = float_to_fp16_scalar(-(float)(i % 89) / 8.0f);
+  }
+
+  std::vector<uint16_t> flat_k(key.size()), flat_v(value.size());
+  kv_cache_append_f16(flat_k.data(), flat_v.data(), key.data(), value.data(),
+                      0, num_tokens, num_heads, head_dim);
+
+  kv_pool_t pool;
+  ASSERT_TRUE(kv_pool_init(&pool, 3, num_heads, head_dim, sizeof(uint16_t),
+                           KV_PAGE_DEFAULT_TOKENS, 0));
+  kv_seq_t seq;
+  kv_seq_init(&seq, &pool);
+  ASSERT_TRUE(kv_seq_reserve(&seq, num_tokens));
+  kv_layer_view_t view = kv_seq_layer(&seq, 2);
+  kv_cache_append_paged_f16(&view, key.data(), value.data(), 0, num_tokens);
+
+  int mismatches = 0;
+  for (int pos = 0; pos < num_tokens; pos++) {
+    mismatches += memcmp(kv_view_key(&view, pos), &flat_k[pos * row],
+                         row * sizeof(uint16_t)) != 0;
+    mismatches += memcmp(kv_view_value(&view, pos), &flat_v[pos * row],
+                         row * sizeof(uint16_t)) != 0;
+  }
+  ASSERT_EQ(0, mismatches);
+
+  kv_seq_free(&seq);
+  kv_pool_free(&pool);
+}
+
+TEST(kv_pages_budget_and_reuse) {
+  kv_pool_t pool;
+  ASSERT_TRUE(kv_pool_init(&pool, 1, 1, 8, sizeof(float), 4, 0));
+  ASSERT_TRUE(kv_pool_set_budget(&pool, 3 * pool.page_bytes));
+
+  kv_seq_t seq;
+  kv_seq_init(&seq, &pool);
+  ASSERT_TRUE(kv_seq_reserve(&seq, 12));
+  ASSERT_EQ_SIZE(3, kv_pool_pages_in_use(&pool));
+  ASSERT_FALSE(kv_seq_reserve(&seq, 13));
+  ASSERT_FALSE(kv_pool_set_budget(&pool, 2 * pool.page_bytes));
+
+  /* Truncated pages go back to the pool and are handed out again. */
+  void *third = seq.pages[2];
+  kv_seq_truncate(&seq, 5);
+  ASSERT_EQ(2, seq.num_pages);
+  ASSERT_EQ_SIZE(2, kv_pool_pages_in_use(&pool));
+  ASSERT_TRUE(kv_seq_reserve(&seq, 9));
+  ASSERT_TRUE(seq.pages[2] == third);
+  ASSERT_EQ_SIZE(3, pool.num_pages);
+
+  kv_seq_truncate(&seq, 0);
+  kv_pool_trim(&pool);
+  ASSERT_EQ_SIZE(0, pool.num_pages);
+
+  kv_seq_free(&seq);
+  kv_pool_free(&pool);
+}
+
+TEST(kv_cache_q8_roundtrip) {
+  const int num_heads = 2;
+  const int head_dim = 37;
+  const int num_tokens = 3;
+  const int row = num_heads * head_dim;
+
+  std::vector<float> key(num_tokens * row), value(num_tokens * row);
+  for (size_t i = 0; i < key.size(); i++) {
+    key[i] = sinf((float)i * 0.37f) * 3.0f;
+    value[i] = cosf((float)i * 0.11f) * 0.25f;
+  }
+  /* An all-zero row must stay zero. */
+  for (int d = 0; d < head_dim; d++)
+    value[row + d] = 0.0f;
+
+  std::vector<int8_t> k_cache((num_tokens + 1) * row);
+  std::vector<int8_t> v_cache((num_tokens + 1) * row);
+  std::vector<float> k_scale((num_tokens + 1) * num_heads);
+  std::vector<float> v_scale((num_tokens + 1) * num_heads);
+  kv_cache_append_q8_f32(k_cache.data(), v_cache.data(), k_scale.data(),
+                         v_scale.data(), key.data(), value.data(), 1,
+                         num_tokens, num_heads, head_dim);
+
+  for (int t = 0; t < num_tokens; t++) {
+    for (int h = 0; h < num_heads; h++) {
+      int r = (t + 1) * num_heads + h;
+      const float *k_src = &key[(t * num_heads + h) * head_dim];
+      const float *v_src = &value[(t * num_heads + h) * head_dim];
+      std::vector<float> k_deq(head_dim), v_deq(head_dim);
+      for (int d = 0; d < head_dim; d++) {
+        k_deq[d] = k_cache[r * head_dim + d] * k_scale[r];
+        v_deq[d] = v_cache[r * head_dim + d] * v_scale[r];
+      }
+      /* Round to nearest: at most half a step off. */
+      ASSERT_ARRAY_NEAR(k_src, k_deq.data(), head_dim,
+                        k_scale[r] * 0.5f + 1e-6f);
+      ASSERT_ARRAY_NEAR(v_src, v_deq.data(), head_dim,
+                        v_scale[r] * 0.5f + 1e-6f);
+    }
+  }
+  ASSERT_TRUE(v_scale[2 * num_heads] == 0.0f);
+}
+
+TEST(kv_cache_q8_dot_and_accumulate) {
+  const int n = 45;
+  std::vector<int8_t> row(n);
+  std::vector<float> x(n), out(n), expected(n);
+  for (int i = 0; i < n; i++) {
+    row[i] = (int8_t)((i * 37) % 255 - 127);
+    x[i] = (float)(i % 7) - 3.0f;
+    out[i] = (float)i * 0.5f;
+  }
+
+  float dot = 0.0f;
+  for (int i = 0; i < n; i++) {
+    dot += row[i] * x[i];
+    expected[i] = out[i] * 0.75f + row[i] * 0.125f;
+  }
+  ASSERT_NEAR(dot, kv_cache_dot_q8(row.data(), x.data(), n), 1e-3f);
+
+  kv_cache_accumulate_q8(out.data(), row.data(), 0.75f, 0.125f, n);
+  ASSERT_ARRAY_NEAR(expected.data(), out.data(), n, 1e-4f);
+
+  for (int i = 0; i < n; i++)
+    expected[i] = row[i] * 0.125f;
+  kv_cache_dequantize_q8(out.data(), row.data(), 0.125f, n);
+  ASSERT_ARRAY_NEAR(expected.data(), out.data(), n, 1e-6f);
+}
+
+TEST(kv_pages_q8_matches_flat_cache) {
+  const int num_heads = 2;
+  const int head_dim = 16;
+  const int num_tokens = 41;
+  const int row = num_heads * head_dim;
+
+  std::vector<uint16_t> key(num_tokens * row), value(num_tokens * row);
+  for (size_t i = 0; i < key.size(); i++) {
+    key[i] = float_to_fp16_scalar((float)(i % 97) / 8.0f - 6.0f);
+    value[i] = float_to_fp16_scalar(-(float)(i % 89) / 16.0f);
+  }
+
+  std::vector<int8_t> flat_k(key.size()), flat_v(value.size());
+  std::vector<float> flat_ks(num_tokens * num_heads);
+  std::vector<float> flat_vs(num_tokens * num_heads);
+  kv_cache_append_q8_f16(flat_k.data(), flat_v.data(), flat_ks.data(),
+                         flat_vs.data(), key.data(), value.data(), 0,
+                         num_tokens, num_heads, head_dim);
+
+  kv_pool_t pool;
+  ASSERT_TRUE(kv_pool_init_q8(&pool, 2, num_heads, head_dim, 16, 0));
+  kv_seq_t seq;
+  kv_seq_init(&seq, &pool);
+  ASSERT_TRUE(kv_seq_reserve(&seq, num_tokens));
+  kv_layer_view_t view = kv_seq_layer(&seq, 1);
+  ASSERT_TRUE(view.quantized);
+  /* Append in two calls so one run ends mid-page. */
+  kv_cache_append_paged_q8_f16(&view, key.data(), value.data(), 0, 20);
+  kv_cache_append_paged_q8_f16(&view, key.data() + 20 * row,
+                               value.data() + 20 * row, 20, num_tokens - 20);
+
+  int mismatches = 0;
+  for (int pos = 0; pos < num_tokens; pos++) {
+    mismatches +=
+        memcmp(kv_view_key(&view, pos), &flat_k[pos * row], row) != 0;
+    mismatches +=
+        memcmp(kv_view_value(&view, pos), &flat_v[pos * row], row) != 0;
+    mismatches += memcmp(kv_view_key_scale(&view, pos),
+                         &flat_ks[pos * num_heads],
+                         num_heads * sizeof(float)) != 0;
+    mismatches += memcmp(kv_view_value_scale(&view, pos),
+                         &flat_vs[pos * num_heads],
+                         num_heads * sizeof(float)) != 0;
+  }
+  ASSERT_EQ(0, mismatches);
+
+  kv_seq_free(&seq);
+  kv_pool_free(&pool);
+}
+
 extern "C" void run_kv_cache_tests(void) {
   TEST_SUITE("KV Cache");
   RUN_TEST(kv_cache_f32_single_token);
@@ -247,4 +479,10 @@ extern "C" void run_kv_cache_tests(void) {
   RUN_TEST(kv_cache_bf16_basic);
   RUN_TEST(kv_cache_f16_basic);
   RUN_TEST(kv_cache_f32_large);
+  RUN_TEST(kv_pages_append_across_pages);
+  RUN_TEST(kv_pages_f16_matches_flat_cache);
+  RUN_TEST(kv_pages_budget_and_reuse);
+  RUN_TEST(kv_cache_q8_roundtrip);
+  RUN_TEST(kv_cache_q8_dot_and_accumulate);
+  RUN_TEST(kv_pages_q8_matches_flat_cache);
 }
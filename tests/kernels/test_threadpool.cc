@@ -0,0 +1,163 @@
+/*
+ * Thread Pool Unit Tests
+ */
+
+#include "test_framework.h"
+
+extern "C" {
+#include "inference/kernels/attention/attention.h"
+#include "inference/kernels/gemm/gemm.h"
+#include "inference/kernels/threadpool/threadpool.h"
+}
+
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+
+typedef struct {
+  int *counts;
+} count_ctx_t;
+
+static void count_range(void *arg, int start, int end) {
+  count_ctx_t *ctx = (count_ctx_t *)arg;
+  for (int i = start; i < end; i++)
+    ctx->counts[i]++;
+}
+
+static bool every_index_once(const int *counts, int n) {
+  for (int i = 0; i < n; i++) {
+    if (counts[i] != 1)
+      return false;
+  }
+  return true;
+}
+
+TEST(threadpool_covers_every_index_once) {
+  int saved = threadpool_get_num_threads();
+  threadpool_set_num_threads(4);
+
+  const int n = 100003;
+  int *counts = (int *)calloc(n, sizeof(int));
+  count_ctx_t ctx = {counts};
+  threadpool_parallel_for(0, n, 7, count_range, &ctx);
+  bool ok = every_index_once(counts, n);
+
+  memset(counts, 0, n * sizeof(int));
+  threadpool_parallel_for(10, n, 1, count_range, &ctx);
+  bool ok_offset = counts[9] == 0 && every_index_once(counts + 10, n - 10);
+
+  threadpool_set_num_threads(saved);
+  free(counts);
+  ASSERT_TRUE(ok);
+  ASSERT_TRUE(ok_offset);
+  PASS();
+}
+
+TEST(threadpool_empty_and_tiny_ranges) {
+  int counts[4] = {0, 0, 0, 0};
+  count_ctx_t ctx = {counts};
+  threadpool_parallel_for(3, 3, 1, count_range, &ctx);
+  threadpool_parallel_for(3, 1, 1, count_range, &ctx);
+  ASSERT_EQ(0, counts[0] + counts[1] + counts[2] + counts[3]);
+
+  threadpool_parallel_for(0, 4, 100, count_range, &ctx);
+  ASSERT_TRUE(every_index_once(counts, 4));
+  PASS();
+}
+
+typedef struct {
+  std::atomic<long long> *sum;
+} sum_ctx_t;
+
+static void sum_range(void *arg, int start, int end) {
+  sum_ctx_t *ctx = (sum_ctx_t *)arg;
+  long long local = 0;
+  for (int i = start; i < end; i++)
+    local += i;
+  ctx->sum->fetch_add(local);
+}
+
+TEST(threadpool_repeated_small_jobs) {
+  int saved = threadpool_get_num_threads();
+  threadpool_set_num_threads(4);
+
+  std::atomic<long long> sum(0);
+  sum_ctx_t ctx = {&sum};
+  for (int iter = 0; iter < 5000; iter++)
+    threadpool_parallel_for(0, 64, 1, sum_range, &ctx);
+
+  threadpool_set_num_threads(saved);
+  ASSERT_TRUE(sum.load() == 5000LL * (63 * 64 / 2));
+  PASS();
+}
+
+typedef struct {
+  int *counts;
+  int inner;
+} nested_ctx_t;
+
+static void nested_range(void *arg, int start, int end) {
+  nested_ctx_t *ctx = (nested_ctx_t *)arg;
+  for (int i = start; i < end; i++) {
+    count_ctx_t inner = {ctx->counts + (size_t)i * ctx->inner};
+    threadpool_parallel_for(0, ctx->inner, 1, count_range, &inner);
+  }
+}
+
+TEST(threadpool_nested_calls_run_inline) {
+  int saved = threadpool_get_num_threads();
+  threadpool_set_num_threads(4);
+
+  const int outer = 16, inner = 257;
+  int *counts = (int *)calloc(outer * inner, sizeof(int));
+  nested_ctx_t ctx = {counts, inner};
+  threadpool_parallel_for(0, outer, 1, nested_range, &ctx);
+  bool ok = every_index_once(counts, outer * inner);
+
+  threadpool_set_num_threads(saved);
+  free(counts);
+  ASSERT_TRUE(ok);
+  PASS();
+}
+
+TEST(threadpool_shutdown_and_restart) {
+  int saved = threadpool_get_num_threads();
+  threadpool_set_num_threads(3);
+
+  const int n = 4096;
+  int *counts = (int *)calloc(n, sizeof(int));
+  count_ctx_t ctx = {counts};
+  threadpool_parallel_for(0, n, 16, count_range, &ctx);
+  threadpool_shutdown();
+  memset(counts, 0, n * sizeof(int));
+  threadpool_parallel_for(0, n, 16, count_range, &ctx);
+  bool ok = every_index_once(counts, n);
+
+  threadpool_set_num_threads(saved);
+  free(counts);
+  ASSERT_TRUE(ok);
+  PASS();
+}
+
+TEST(threadpool_kernel_thread_settings_are_shared) {
+  int saved = threadpool_get_num_threads();
+
+  gemm_set_num_threads(3);
+  ASSERT_EQ(3, threadpool_get_num_threads());
+  attention_set_num_threads(5);
+  ASSERT_EQ(5, gemm_get_num_threads());
+  ASSERT_EQ(5, attention_get_num_threads());
+
+  threadpool_set_num_threads(saved);
+  PASS();
+}
+
+extern "C" void run_threadpool_tests(void) {
+  TEST_SUITE("Thread Pool");
+  RUN_TEST(threadpool_covers_every_index_once);
+  RUN_TEST(threadpool_empty_and_tiny_ranges);
+  RUN_TEST(threadpool_repeated_small_jobs);
+  RUN_TEST(threadpool_nested_calls_run_inline);
+  RUN_TEST(threadpool_shutdown_and_restart);
+  RUN_TEST(threadpool_kernel_thread_settings_are_shared);
+}
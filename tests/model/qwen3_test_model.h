@@ -0,0 +1,234 @@
+#ifndef QWEN3_TEST_MODEL_H
+#define QWEN3_TEST_MODEL_H
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ftw.h>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+#include "inference/model/qwen3/qwen3.h"
+
+/*
+ * A tiny random Qwen3 checkpoint for model-level tests: 2 layers, hidden
+ * size 64, 4 query and 2 KV heads of 16, a tied 256-token vocabulary and
+ * 512 positions. It is written once per process as config.json plus an F32
+ * model.safetensors under a scratch directory that is removed at exit;
+ * tests may keep their own files (spills, snapshots) there too.
+ */
+#define TEST_QWEN3_VOCAB 256
+#define TEST_QWEN3_LAYERS 2
+#define TEST_QWEN3_KV_DIM 32
+#define TEST_QWEN3_MAX_POSITIONS 512
+
+inline const char *test_qwen3_dir(void) {
+  static char dir[64];
+  if (!dir[0])
+    snprintf(dir, sizeof(dir), "/tmp/sillytui_qwen3_%d", (int)getpid());
+  return dir;
+}
+
+inline std::string test_qwen3_path(const char *name) {
+  return std::string(test_qwen3_dir()) + "/" + name;
+}
+
+inline int test_qwen3_remove_entry(const char *path, const struct stat *st,
+                                   int type, struct FTW *ftw) {
+  (void)st;
+  (void)type;
+  (void)ftw;
+  return remove(path);
+}
+
+inline void test_qwen3_cleanup(void) {
+  nftw(test_qwen3_dir(), test_qwen3_remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+}
+
+struct test_qwen3_writer {
+  std::string header = "{";
+  std::vector<float> data;
+  uint32_t seed = 12345;
+  /* Store the values rounded to BF16 instead of as F32. */
+  bool bf16 = false;
+
+  float next(float scale) {
+    seed = seed * 1664525u + 1013904223u;
+    return ((float)(seed >> 8) / 16777216.0f * 2.0f - 1.0f) * scale;
+  }
+
+  size_t bytes(void) const { return data.size() * (bf16 ? 2 : 4); }
+
+  void tensor(const std::string &name, int rows, int cols, float scale,
+              float fill = 0.0f) {
+    size_t begin = bytes();
+    int count = cols > 0 ? rows * cols : rows;
+    for (int i = 0; i < count; i++)
+      data.push_back(scale > 0.0f ? next(scale) : fill);
+    const char *dtype = bf16 ? "BF16" : "F32";
+    char entry[256];
+    if (cols > 0)
+      snprintf(entry, sizeof(entry),
+               "\"%s\":{\"dtype\":\"%s\",\"shape\":[%d,%d],"
+               "\"data_offsets\":[%zu,%zu]},",
+               name.c_str(), dtype, rows, cols, begin, bytes());
+    else
+      snprintf(entry, sizeof(entry),
+               "\"%s\":{\"dtype\":\"%s\",\"shape\":[%d],"
+               "\"data_offsets\":[%zu,%zu]},",
+               name.c_str(), dtype, rows, begin, bytes());
+    header += entry;
+  }
+
+  void vector(const std::string &name, int n) { tensor(name, n, 0, 0, 1.0f); }
+
+  bool write(const std::string &path) {
+    header.back() = '}';
+    while (header.size() % 8)
+      header += ' ';
+    std::vector<uint16_t> rounded;
+    for (size_t i = 0; bf16 && i < data.size(); i++) {
+      uint32_t bits;
+      memcpy(&bits, &data[i], sizeof(bits));
+      bits += 0x7fffu + ((bits >> 16) & 1);
+      rounded.push_back((uint16_t)(bits >> 16));
+    }
+    FILE *f = fopen(path.c_str(), "wb");
+    if (!f)
+      return false;
+    uint64_t header_size = header.size();
+    bool ok = fwrite(&header_size, sizeof(header_size), 1, f) == 1 &&
+              fwrite(header.data(), 1, header.size(), f) == header.size();
+    if (bf16)
+      ok = ok && fwrite(rounded.data(), sizeof(uint16_t), rounded.size(), f) ==
+                     rounded.size();
+    else
+      ok = ok && fwrite(data.data(), sizeof(float), data.size(), f) ==
+                     data.size();
+    return fclose(f) == 0 && ok;
+  }
+};
+
+/* Writes the checkpoint into dir: one model.safetensors, or with shards > 1
+ * the global tensors in the first file and each layer's in one of the rest,
+ * named by a model.safetensors.index.json. The weights are the same either
+ * way, up to rounding when they are stored as BF16. */
+inline bool test_qwen3_write_checkpoint(const std::string &dir, int shards,
+                                        bool bf16 = false) {
+  const int H = 64, heads = 4, head_dim = 16, I = 128;
+  mkdir(dir.c_str(), 0755);
+
+  std::vector<test_qwen3_writer> w(shards);
+  std::vector<std::string> files(shards);
+  std::string weight_map;
+  for (int i = 0; i < shards; i++) {
+    w[i].bf16 = bf16;
+    char name[64];
+    snprintf(name, sizeof(name), "model-%05d-of-%05d.safetensors", i + 1,
+             shards);
+    files[i] = shards > 1 ? name : "model.safetensors";
+  }
+  /* One random stream across shards, so every layout holds the same data. */
+  uint32_t seed = w[0].seed;
+  auto put = [&](int shard, const std::string &name, int rows, int cols,
+                 float scale) {
+    w[shard].seed = seed;
+    if (scale > 0.0f)
+      w[shard].tensor(name, rows, cols, scale);
+    else
+      w[shard].vector(name, rows);
+    seed = w[shard].seed;
+    weight_map += "\"" + name + "\": \"" + files[shard] + "\", ";
+  };
+
+  put(0, "model.embed_tokens.weight", TEST_QWEN3_VOCAB, H, 0.5f);
+  put(0, "model.norm.weight", H, 0, 0.0f);
+  for (int l = 0; l < TEST_QWEN3_LAYERS; l++) {
+    std::string p = "model.layers." + std::to_string(l) + ".";
+    int s = shards > 1 ? 1 + l % (shards - 1) : 0;
+    put(s, p + "self_attn.q_proj.weight", heads * head_dim, H, 0.1f);
+    put(s, p + "self_attn.k_proj.weight", TEST_QWEN3_KV_DIM, H, 0.1f);
+    put(s, p + "self_attn.v_proj.weight", TEST_QWEN3_KV_DIM, H, 0.1f);
+    put(s, p + "self_attn.o_proj.weight", H, heads * head_dim, 0.1f);
+    put(s, p + "self_attn.q_norm.weight", head_dim, 0, 0.0f);
+    put(s, p + "self_attn.k_norm.weight", head_dim, 0, 0.0f);
+    put(s, p + "mlp.gate_proj.weight", I, H, 0.1f);
+    put(s, p + "mlp.up_proj.weight", I, H, 0.1f);
+    put(s, p + "mlp.down_proj.weight", H, I, 0.1f);
+    put(s, p + "input_layernorm.weight", H, 0, 0.0f);
+    put(s, p + "post_attention_layernorm.weight", H, 0, 0.0f);
+  }
+  for (int i = 0; i < shards; i++) {
+    if (!w[i].write(dir + "/" + files[i]))
+      return false;
+  }
+
+  std::vector<std::pair<std::string, std::string>> outputs;
+  if (shards > 1) {
+    weight_map.resize(weight_map.size() - 2);
+    outputs.push_back({"model.safetensors.index.json",
+                       "{\"weight_map\": {" + weight_map + "}}\n"});
+  }
+  char config[1024];
+  snprintf(config, sizeof(config),
+           "{\"hidden_size\": %d, \"num_attention_heads\": %d, "
+           "\"num_key_value_heads\": %d, \"head_dim\": %d, "
+           "\"intermediate_size\": %d, \"num_hidden_layers\": %d, "
+           "\"vocab_size\": %d, \"max_position_embeddings\": %d, "
+           "\"rms_norm_eps\": 1e-06, \"rope_theta\": 1000000.0, "
+           "\"tie_word_embeddings\": true, \"hidden_act\": \"silu\", "
+           "\"attention_bias\": false, \"bos_token_id\": 1, "
+           "\"eos_token_id\": 2}\n",
+           H, heads, TEST_QWEN3_KV_DIM / head_dim, head_dim, I,
+           TEST_QWEN3_LAYERS, TEST_QWEN3_VOCAB, TEST_QWEN3_MAX_POSITIONS);
+  outputs.push_back({"config.json", config});
+  for (const auto &out : outputs) {
+    FILE *f = fopen((dir + "/" + out.first).c_str(), "w");
+    if (!f)
+      return false;
+    bool ok = fputs(out.second.c_str(), f) >= 0;
+    if (fclose(f) != 0 || !ok)
+      return false;
+  }
+  return true;
+}
+
+inline bool test_qwen3_write(void) {
+  static int written = -1;
+  if (written >= 0)
+    return written == 1;
+  written = 0;
+  mkdir(test_qwen3_dir(), 0755);
+  atexit(test_qwen3_cleanup);
+  if (!test_qwen3_write_checkpoint(test_qwen3_dir(), 1))
+    return false;
+  written = 1;
+  return true;
+}
+
+inline bool test_qwen3_load(qwen3_model_t *model, qwen3_dtype_t dtype) {
+  return test_qwen3_write() &&
+         qwen3_model_load(model, test_qwen3_dir(), dtype);
+}
+
+/* Deterministic token IDs, different for each seed. */
+inline void test_qwen3_tokens(int *tokens, int n, int seed) {
+  for (int i = 0; i < n; i++)
+    tokens[i] = (i * (2 * seed + 11) + 3 * seed + 5) % TEST_QWEN3_VOCAB;
+}
+
+inline float test_qwen3_max_diff(const float *a, const float *b, int n) {
+  float max_diff = 0.0f;
+  for (int i = 0; i < n; i++) {
+    float d = a[i] > b[i] ? a[i] - b[i] : b[i] - a[i];
+    if (d > max_diff)
+      max_diff = d;
+  }
+  return max_diff;
+}
+
+#endif
@@ -0,0 +1,358 @@
+#include "test_framework.h"
+#include "qwen3_test_model.h"
+
+#include "inference/kernels/convert/convert.h"
+#include "inference/kernels/kv_cache/kv_cache.h"
+
+/* Largest difference between the layer-0 K and V rows of two F32 caches.
+ * Layer 0 rows depend only on the token and its position, so a shifted
+ * cache must match one built from the surviving tokens there; deeper
+ * layers still carry what the discarded tokens contributed. */
+static float layer0_diff(const qwen3_model_t *a, const qwen3_model_t *b,
+                         int len) {
+  kv_layer_view_t va = kv_seq_layer(&a->kv_seq, 0);
+  kv_layer_view_t vb = kv_seq_layer(&b->kv_seq, 0);
+  float max_diff = 0.0f;
+  for (int pos = 0; pos < len; pos++) {
+    float k = test_qwen3_max_diff((const float *)kv_view_key(&va, pos),
+                                  (const float *)kv_view_key(&vb, pos),
+                                  TEST_QWEN3_KV_DIM);
+    float v = test_qwen3_max_diff((const float *)kv_view_value(&va, pos),
+                                  (const float *)kv_view_value(&vb, pos),
+                                  TEST_QWEN3_KV_DIM);
+    max_diff = k > max_diff ? k : max_diff;
+    max_diff = v > max_diff ? v : max_diff;
+  }
+  return max_diff;
+}
+
+TEST(qwen3_shift_cache_matches_fresh_prefill) {
+  qwen3_model_t model, fresh;
+  ASSERT_TRUE(test_qwen3_load(&model, QWEN3_DTYPE_F32));
+  ASSERT_TRUE(test_qwen3_load(&fresh, QWEN3_DTYPE_F32));
+  const int keep = 4, discard = 40, len = 100;
+  int tokens[len], surviving[len - discard];
+  test_qwen3_tokens(tokens, len, 8);
+  memcpy(surviving, tokens, keep * sizeof(int));
+  memcpy(surviving + keep, tokens + keep + discard,
+         (len - keep - discard) * sizeof(int));
+  static float logits[TEST_QWEN3_VOCAB];
+
+  ASSERT_TRUE(qwen3_forward(&model, logits, tokens, len));
+  ASSERT_TRUE(qwen3_model_shift_cache(&model, keep, discard));
+  ASSERT_TRUE(qwen3_forward(&fresh, logits, surviving, len - discard));
+
+  ASSERT_EQ_INT(len - discard, model.cache_len[0]);
+  ASSERT_EQ_INT(len - discard, model.cache_len[TEST_QWEN3_LAYERS - 1]);
+  ASSERT_TRUE(memcmp(model.cache_tokens, surviving,
+                     (len - discard) * sizeof(int)) == 0);
+  ASSERT_EQ_SIZE(2, kv_pool_pages_in_use(&model.kv_pool));
+  ASSERT_TRUE(layer0_diff(&model, &fresh, len - discard) < 1e-4f);
+
+  qwen3_model_free(&model);
+  qwen3_model_free(&fresh);
+  PASS();
+}
+
+/* Under streaming the cache holds the sinks, then the newest tokens. */
+static bool streaming_layout(const qwen3_model_t *model, const int *fed,
+                             int num_fed, int sink) {
+  int len = model->cache_len[0];
+  int tail = len - sink;
+  return memcmp(model->cache_tokens, fed, sink * sizeof(int)) == 0 &&
+         memcmp(model->cache_tokens + sink, fed + num_fed - tail,
+                tail * sizeof(int)) == 0;
+}
+
+TEST(qwen3_streaming_keeps_sinks_and_window) {
+  qwen3_model_t model, fresh;
+  ASSERT_TRUE(test_qwen3_load(&model, QWEN3_DTYPE_F32));
+  ASSERT_TRUE(test_qwen3_load(&fresh, QWEN3_DTYPE_F32));
+  const int sink = 4, window = 64, page = KV_PAGE_DEFAULT_TOKENS;
+  ASSERT_TRUE(qwen3_model_set_kv_policy(&model, QWEN3_KV_STREAMING, sink,
+                                        window));
+  /* Together longer than the model's position limit. */
+  const int prefill = 150, steps = 450;
+  static int fed[prefill + steps];
+  test_qwen3_tokens(fed, prefill, 9);
+  static float logits[TEST_QWEN3_VOCAB];
+
+  /* A prompt longer than the window streams through in window-sized
+   * chunks. */
+  ASSERT_TRUE(qwen3_forward(&model, logits, fed, prefill));
+  ASSERT_TRUE(model.cache_len[0] <= sink + window);
+  ASSERT_TRUE(streaming_layout(&model, fed, prefill, sink));
+
+  /* Decoding past the window drops a page at a time after the sinks. */
+  int num_fed = prefill;
+  int expected = model.cache_len[0];
+  for (int s = 0; s < steps; s++) {
+    int token = (s * 53 + 11) % TEST_QWEN3_VOCAB;
+    fed[num_fed] = token;
+    ASSERT_TRUE(qwen3_forward(&model, logits, &token, 1));
+    num_fed++;
+    if (expected + 1 > sink + window)
+      expected -= page;
+    expected++;
+    ASSERT_EQ_INT(expected, model.cache_len[0]);
+    ASSERT_EQ_INT(expected, model.cache_len[TEST_QWEN3_LAYERS - 1]);
+    ASSERT_TRUE(kv_pool_pages_in_use(&model.kv_pool) <=
+                (size_t)(sink + window + page - 1) / page);
+  }
+  ASSERT_TRUE(streaming_layout(&model, fed, num_fed, sink));
+
+  /* Positions were renumbered, so layer 0 matches a fresh prefill of what
+   * is left. */
+  int len = model.cache_len[0];
+  ASSERT_TRUE(qwen3_forward(&fresh, logits, model.cache_tokens, len));
+  ASSERT_TRUE(layer0_diff(&model, &fresh, len) < 1e-4f);
+
+  qwen3_model_free(&model);
+  qwen3_model_free(&fresh);
+  PASS();
+}
+
+/* Layer-0 key row at pos as FP32, whatever the cache stores. */
+static void layer0_key(const qwen3_model_t *model, int pos, float *out) {
+  kv_layer_view_t view = kv_seq_layer(&model->kv_seq, 0);
+  const void *row = kv_view_key(&view, pos);
+  if (view.quantized) {
+    for (int h = 0; h < view.num_heads; h++)
+      kv_cache_dequantize_q8(out + h * view.head_dim,
+                             (const int8_t *)row + h * view.head_dim,
+                             kv_view_key_scale(&view, pos)[h], view.head_dim);
+  } else if (model->dtype == QWEN3_DTYPE_F16) {
+    convert_f16_to_f32((const uint16_t *)row, out, TEST_QWEN3_KV_DIM);
+  } else {
+    memcpy(out, row, TEST_QWEN3_KV_DIM * sizeof(float));
+  }
+}
+
+/* Stream far past a wide window, so the oldest surviving keys have been
+ * re-rotated and stored back by several shifts, and return their largest
+ * layer-0 difference from a fresh prefill of the same tokens. */
+static float shifted_key_error(qwen3_dtype_t dtype, bool int8) {
+  qwen3_model_t model, fresh;
+  if (!test_qwen3_load(&model, dtype))
+    return 1e9f;
+  if (!test_qwen3_load(&fresh, dtype)) {
+    qwen3_model_free(&model);
+    return 1e9f;
+  }
+  float max_diff = 1e9f;
+  static float logits[TEST_QWEN3_VOCAB];
+  bool ok = qwen3_model_set_kv_int8(&model, int8) &&
+            qwen3_model_set_kv_int8(&fresh, int8) &&
+            qwen3_model_set_kv_policy(&model, QWEN3_KV_STREAMING, 4, 448);
+  for (int s = 0; ok && s < 3000; s++) {
+    int token = (s * 53 + 11) % TEST_QWEN3_VOCAB;
+    ok = qwen3_forward(&model, logits, &token, 1);
+  }
+  int len = model.cache_len[0];
+  if (ok && qwen3_forward(&fresh, logits, model.cache_tokens, len)) {
+    float a[TEST_QWEN3_KV_DIM], b[TEST_QWEN3_KV_DIM];
+    max_diff = 0.0f;
+    for (int pos = 4; pos < 4 + 64; pos++) {
+      layer0_key(&model, pos, a);
+      layer0_key(&fresh, pos, b);
+      float d = test_qwen3_max_diff(a, b, TEST_QWEN3_KV_DIM);
+      max_diff = d > max_diff ? d : max_diff;
+    }
+  }
+  qwen3_model_free(&model);
+  qwen3_model_free(&fresh);
+  return max_diff;
+}
+
+TEST(qwen3_streaming_bounds_requantization_drift) {
+  /* Keys are around 3 in magnitude, where an FP16 ulp is 0.002 and an INT8
+   * step about 0.025. Dropping a page at a time, the oldest keys in this
+   * window would be stored back 14 times; dropping an eighth of the window
+   * halves that and keeps them within a few ulps or steps of a fresh
+   * prefill. */
+  ASSERT_TRUE(shifted_key_error(QWEN3_DTYPE_F32, false) < 1e-4f);
+  ASSERT_TRUE(shifted_key_error(QWEN3_DTYPE_F16, false) < 8e-3f);
+  ASSERT_TRUE(shifted_key_error(QWEN3_DTYPE_F32, true) < 0.1f);
+  PASS();
+}
+
+static const float kSentinel = 0.123456f;
+
+/* Mark the layer-1 V row of the newest cached position. A turn that reuses
+ * the cache keeps it, shifts included; a re-prefill rewrites it. */
+static void mark_newest(qwen3_model_t *model) {
+  kv_layer_view_t view = kv_seq_layer(&model->kv_seq, 1);
+  ((float *)kv_view_value(&view, model->cache_len[0] - 1))[0] = kSentinel;
+}
+
+static bool marked(const qwen3_model_t *model) {
+  kv_layer_view_t view = kv_seq_layer(&model->kv_seq, 1);
+  for (int pos = 0; pos < model->cache_len[0]; pos++) {
+    if (((const float *)kv_view_value(&view, pos))[0] == kSentinel)
+      return true;
+  }
+  return false;
+}
+
+/* The cache holds the first gap.at history tokens, then the newest ones,
+ * and the gap accounts for the rest. A closing EOS is never run. */
+static bool cache_follows_history(const qwen3_model_t *model,
+                                  const int *history, int n) {
+  int len = model->cache_len[0];
+  int at = model->cache_gap.len > 0 ? model->cache_gap.at : len;
+  int cached =
+      history[n - 1] == model->config.eos_token_id ? n - 1 : n;
+  return len + model->cache_gap.len == cached &&
+         memcmp(model->cache_tokens, history, at * sizeof(int)) == 0 &&
+         memcmp(model->cache_tokens + at, history + cached - (len - at),
+                (len - at) * sizeof(int)) == 0;
+}
+
+/* Chat turns that each pass the whole history to qwen3_generate. */
+static void run_chat(qwen3_model_t *model, int *history, int turns,
+                     int user_tokens, int max_new) {
+  int n = 0;
+  int out[64];
+  bool shifted = false;
+  for (int t = 0; t < turns; t++) {
+    test_qwen3_tokens(history + n, user_tokens, t + 10);
+    n += user_tokens;
+    if (t > 0)
+      mark_newest(model);
+    int generated =
+        qwen3_generate(model, out, max_new, history, n, 0.0f, 1, 1.0f);
+    ASSERT_TRUE(generated > 0);
+    if (t > 0)
+      ASSERT_TRUE(marked(model));
+    memcpy(history + n, out, generated * sizeof(int));
+    n += generated;
+    ASSERT_TRUE(cache_follows_history(model, history, n));
+    shifted = shifted || model->cache_gap.len > 0;
+  }
+  ASSERT_TRUE(shifted);
+}
+
+/* Greedy generation from a fresh model, for comparison. */
+static int fresh_generate(int *out, int max_new, const int *prompt, int n) {
+  qwen3_model_t fresh;
+  if (!test_qwen3_load(&fresh, QWEN3_DTYPE_F32))
+    return -1;
+  int generated = qwen3_generate(&fresh, out, max_new, prompt, n, 0.0f, 1, 1.0f);
+  qwen3_model_free(&fresh);
+  return generated;
+}
+
+TEST(qwen3_generate_reuses_cached_prefix) {
+  qwen3_model_t model;
+  ASSERT_TRUE(test_qwen3_load(&model, QWEN3_DTYPE_F32));
+  static int history[40 + 8 + 20];
+  int out[8], expected[8];
+  test_qwen3_tokens(history, 40, 15);
+
+  int generated = qwen3_generate(&model, out, 8, history, 40, 0.0f, 1, 1.0f);
+  ASSERT_TRUE(generated > 0);
+  int n = 40;
+  memcpy(history + n, out, generated * sizeof(int));
+  n += generated;
+  test_qwen3_tokens(history + n, 20, 16);
+  n += 20;
+
+  /* The next turn repeats the first: only its new tokens run, and it
+   * generates what a fresh prefill of the whole history would. */
+  mark_newest(&model);
+  generated = qwen3_generate(&model, out, 8, history, n, 0.0f, 1, 1.0f);
+  ASSERT_TRUE(marked(&model));
+  ASSERT_EQ_INT(generated, fresh_generate(expected, 8, history, n));
+  ASSERT_TRUE(memcmp(out, expected, generated * sizeof(int)) == 0);
+  ASSERT_TRUE(memcmp(model.cache_tokens, history, n * sizeof(int)) == 0);
+
+  /* A prompt that differs at position 10 keeps only the first 10. */
+  history[10] ^= 1;
+  mark_newest(&model);
+  generated = qwen3_generate(&model, out, 8, history, n, 0.0f, 1, 1.0f);
+  ASSERT_FALSE(marked(&model));
+  ASSERT_EQ_INT(generated, fresh_generate(expected, 8, history, n));
+  ASSERT_TRUE(memcmp(out, expected, generated * sizeof(int)) == 0);
+  ASSERT_TRUE(memcmp(model.cache_tokens, history, n * sizeof(int)) == 0);
+
+  qwen3_model_free(&model);
+  PASS();
+}
+
+TEST(qwen3_generate_reuses_cache_after_context_shift) {
+  qwen3_model_t model;
+  ASSERT_TRUE(test_qwen3_load(&model, QWEN3_DTYPE_F32));
+  qwen3_model_set_context_shift(&model, true, 4);
+  static int history[16 * (100 + 40)];
+  run_chat(&model, history, 16, 100, 40);
+  qwen3_model_free(&model);
+  PASS();
+}
+
+TEST(qwen3_generate_reuses_cache_while_streaming) {
+  qwen3_model_t model;
+  ASSERT_TRUE(test_qwen3_load(&model, QWEN3_DTYPE_F32));
+  ASSERT_TRUE(qwen3_model_set_kv_policy(&model, QWEN3_KV_STREAMING, 4, 128));
+  static int history[12 * (40 + 30)];
+  run_chat(&model, history, 12, 40, 30);
+  ASSERT_TRUE(model.cache_len[0] <= 4 + 128);
+  qwen3_model_free(&model);
+  PASS();
+}
+
+TEST(qwen3_generate_shifts_a_prompt_longer_than_the_context) {
+  qwen3_model_t model;
+  ASSERT_TRUE(test_qwen3_load(&model, QWEN3_DTYPE_F32));
+  qwen3_model_set_context_shift(&model, true, 4);
+  const int prompt = TEST_QWEN3_MAX_POSITIONS + 200;
+  static int history[prompt + 64 + 20 + 64];
+  test_qwen3_tokens(history, prompt, 11);
+  int out[64];
+
+  /* The first 4 tokens stay; the oldest after them go, leaving half the
+   * room past the prefix free. */
+  int generated =
+      qwen3_generate(&model, out, 32, history, prompt, 0.0f, 1, 1.0f);
+  ASSERT_TRUE(generated > 0);
+  int n = prompt;
+  memcpy(history + n, out, generated * sizeof(int));
+  n += generated;
+  ASSERT_EQ_INT(4, model.cache_gap.at);
+  ASSERT_TRUE(model.cache_len[0] <= 4 + (TEST_QWEN3_MAX_POSITIONS - 4) / 2 +
+                                        generated);
+  ASSERT_TRUE(cache_follows_history(&model, history, n));
+
+  /* The next turn, with the whole history, continues the cache. */
+  test_qwen3_tokens(history + n, 20, 12);
+  n += 20;
+  mark_newest(&model);
+  generated = qwen3_generate(&model, out, 32, history, n, 0.0f, 1, 1.0f);
+  ASSERT_TRUE(generated > 0);
+  ASSERT_TRUE(marked(&model));
+  memcpy(history + n, out, generated * sizeof(int));
+  n += generated;
+  ASSERT_TRUE(cache_follows_history(&model, history, n));
+
+  /* A different history of the same length does not match the gap. */
+  history[10] ^= 1;
+  mark_newest(&model);
+  generated = qwen3_generate(&model, out, 8, history, n, 0.0f, 1, 1.0f);
+  ASSERT_TRUE(generated > 0);
+  ASSERT_FALSE(marked(&model));
+
+  qwen3_model_free(&model);
+  PASS();
+}
+
+extern "C" {
+void run_qwen3_context_tests(void) {
+  TEST_SUITE("Qwen3 Context");
+  RUN_TEST(qwen3_shift_cache_matches_fresh_prefill);
+  RUN_TEST(qwen3_streaming_keeps_sinks_and_window);
+  RUN_TEST(qwen3_streaming_bounds_requantization_drift);
+  RUN_TEST(qwen3_generate_reuses_cached_prefix);
+  RUN_TEST(qwen3_generate_reuses_cache_after_context_shift);
+  RUN_TEST(qwen3_generate_reuses_cache_while_streaming);
+  RUN_TEST(qwen3_generate_shifts_a_prompt_longer_than_the_context);
+}
+}
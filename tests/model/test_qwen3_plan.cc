@@ -0,0 +1,133 @@
+#include "test_framework.h"
+#include "qwen3_test_model.h"
+
+#define ARRAY_LEN(a) ((int)(sizeof(a) / sizeof((a)[0])))
+
+static size_t plan_end(const qwen3_plan_t *plan, int buf) {
+  return plan->offset[buf] + plan->size[buf];
+}
+
+static bool disjoint(const qwen3_plan_t *plan, int a, int b) {
+  return plan->size[a] == 0 || plan->size[b] == 0 ||
+         plan_end(plan, a) <= plan->offset[b] ||
+         plan_end(plan, b) <= plan->offset[a];
+}
+
+/* Live for the whole pass, so they may share with nothing. */
+static const int kPassBuffers[] = {QWEN3_BUF_POSITION_IDS, QWEN3_BUF_HIDDEN_A,
+                                   QWEN3_BUF_HIDDEN_B};
+
+/* Buffers that one step of a layer reads and writes, or that carry a value
+ * past a step another buffer is written in. */
+static const int kLivePairs[][2] = {
+    {QWEN3_BUF_RESIDUAL, QWEN3_BUF_NORM_OUT},
+    {QWEN3_BUF_RESIDUAL, QWEN3_BUF_QKV},
+    {QWEN3_BUF_RESIDUAL, QWEN3_BUF_Q},
+    {QWEN3_BUF_RESIDUAL, QWEN3_BUF_K},
+    {QWEN3_BUF_RESIDUAL, QWEN3_BUF_V},
+    {QWEN3_BUF_RESIDUAL, QWEN3_BUF_ATTN_HEADS},
+    {QWEN3_BUF_RESIDUAL, QWEN3_BUF_ATTN_SCRATCH},
+    {QWEN3_BUF_RESIDUAL, QWEN3_BUF_ATTN_OUT},
+    {QWEN3_BUF_RESIDUAL, QWEN3_BUF_GATE_UP},
+    {QWEN3_BUF_RESIDUAL, QWEN3_BUF_ACT},
+    {QWEN3_BUF_NORM_OUT, QWEN3_BUF_QKV},
+    {QWEN3_BUF_NORM_OUT, QWEN3_BUF_Q},
+    {QWEN3_BUF_NORM_OUT, QWEN3_BUF_K},
+    {QWEN3_BUF_NORM_OUT, QWEN3_BUF_V},
+    {QWEN3_BUF_QKV, QWEN3_BUF_Q},
+    {QWEN3_BUF_QKV, QWEN3_BUF_K},
+    {QWEN3_BUF_QKV, QWEN3_BUF_V},
+    {QWEN3_BUF_Q, QWEN3_BUF_K},
+    {QWEN3_BUF_Q, QWEN3_BUF_V},
+    {QWEN3_BUF_K, QWEN3_BUF_V},
+    {QWEN3_BUF_QKV, QWEN3_BUF_ATTN_HEADS},
+    {QWEN3_BUF_Q, QWEN3_BUF_ATTN_HEADS},
+    {QWEN3_BUF_QKV, QWEN3_BUF_ATTN_SCRATCH},
+    {QWEN3_BUF_Q, QWEN3_BUF_ATTN_SCRATCH},
+    {QWEN3_BUF_ATTN_HEADS, QWEN3_BUF_ATTN_SCRATCH},
+    {QWEN3_BUF_ATTN_HEADS, QWEN3_BUF_ATTN_OUT},
+    {QWEN3_BUF_ATTN_OUT, QWEN3_BUF_NORM_OUT},
+    {QWEN3_BUF_NORM_OUT, QWEN3_BUF_GATE_UP},
+    {QWEN3_BUF_NORM_OUT, QWEN3_BUF_ACT},
+    {QWEN3_BUF_GATE_UP, QWEN3_BUF_ACT},
+};
+
+/* The f16 layer also writes the FFN output over the attention output. */
+static const int kLivePairsF16[][2] = {
+    {QWEN3_BUF_ATTN_OUT, QWEN3_BUF_GATE_UP},
+    {QWEN3_BUF_ATTN_OUT, QWEN3_BUF_ACT},
+};
+
+/* Bounds, alignment and liveness of one model's plan. */
+static void check_plan(const qwen3_plan_t *plan, bool f16) {
+  size_t total = 0;
+  for (int buf = 0; buf < QWEN3_BUF_COUNT; buf++) {
+    ASSERT_EQ_SIZE(0, plan->offset[buf] % 64);
+    ASSERT_TRUE(plan_end(plan, buf) <= plan->arena_size);
+    total += (plan->size[buf] + 63) / 64 * 64;
+  }
+  for (int i = 0; i < ARRAY_LEN(kPassBuffers); i++) {
+    for (int other = 0; other < QWEN3_BUF_COUNT; other++)
+      ASSERT_TRUE(other == kPassBuffers[i] ||
+                  disjoint(plan, kPassBuffers[i], other));
+  }
+  for (int i = 0; i < ARRAY_LEN(kLivePairs); i++)
+    ASSERT_TRUE(disjoint(plan, kLivePairs[i][0], kLivePairs[i][1]));
+  for (int i = 0; f16 && i < ARRAY_LEN(kLivePairsF16); i++)
+    ASSERT_TRUE(disjoint(plan, kLivePairsF16[i][0], kLivePairsF16[i][1]));
+  /* Buffers with disjoint lifetimes do share bytes. */
+  ASSERT_TRUE(plan->arena_size < total);
+}
+
+TEST(qwen3_plan_live_buffers_do_not_overlap) {
+  const qwen3_dtype_t dtypes[] = {QWEN3_DTYPE_F32, QWEN3_DTYPE_F16};
+  const int max_tokens[] = {1, 7, 64, QWEN3_PLAN_DEFAULT_MAX_TOKENS};
+  for (int d = 0; d < ARRAY_LEN(dtypes); d++) {
+    qwen3_model_t model;
+    ASSERT_TRUE(test_qwen3_load(&model, dtypes[d]));
+    for (int i = 0; i < ARRAY_LEN(max_tokens); i++) {
+      ASSERT_TRUE(qwen3_model_set_max_tokens(&model, max_tokens[i]));
+      ASSERT_EQ_INT(max_tokens[i], model.plan.max_tokens);
+      check_plan(&model.plan, dtypes[d] == QWEN3_DTYPE_F16);
+    }
+    qwen3_model_free(&model);
+  }
+  PASS();
+}
+
+/* A prefill fed through a small arena in chunks matches one that fits. */
+static float chunked_vs_whole(qwen3_dtype_t dtype, int max_tokens) {
+  qwen3_model_t chunked, whole;
+  if (!test_qwen3_load(&chunked, dtype))
+    return 1e9f;
+  if (!test_qwen3_load(&whole, dtype)) {
+    qwen3_model_free(&chunked);
+    return 1e9f;
+  }
+  int tokens[100];
+  test_qwen3_tokens(tokens, 100, 14);
+  static float logits[TEST_QWEN3_VOCAB], expected[TEST_QWEN3_VOCAB];
+  float max_diff = 1e9f;
+  if (qwen3_model_set_max_tokens(&chunked, max_tokens) &&
+      qwen3_forward(&chunked, logits, tokens, 100) &&
+      qwen3_forward(&whole, expected, tokens, 100))
+    max_diff = test_qwen3_max_diff(logits, expected, TEST_QWEN3_VOCAB);
+  qwen3_model_free(&chunked);
+  qwen3_model_free(&whole);
+  return max_diff;
+}
+
+TEST(qwen3_plan_chunked_prefill_matches) {
+  ASSERT_TRUE(chunked_vs_whole(QWEN3_DTYPE_F32, 7) < 1e-4f);
+  ASSERT_TRUE(chunked_vs_whole(QWEN3_DTYPE_F16, 7) < 2e-2f);
+  ASSERT_TRUE(chunked_vs_whole(QWEN3_DTYPE_F32, 1) < 1e-4f);
+  PASS();
+}
+
+extern "C" {
+void run_qwen3_plan_tests(void) {
+  TEST_SUITE("Qwen3 Plan");
+  RUN_TEST(qwen3_plan_live_buffers_do_not_overlap);
+  RUN_TEST(qwen3_plan_chunked_prefill_matches);
+}
+}
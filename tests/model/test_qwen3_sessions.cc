@@ -0,0 +1,188 @@
+#include "test_framework.h"
+#include "qwen3_test_model.h"
+
+#include "inference/model/qwen3/session.h"
+
+static qwen3_session_t *session(qwen3_sessions_t *mgr, const char *id) {
+  for (int i = 0; i < mgr->num_sessions; i++) {
+    if (strcmp(mgr->sessions[i].id, id) == 0)
+      return &mgr->sessions[i];
+  }
+  return NULL;
+}
+
+static bool file_exists(const std::string &path) {
+  struct stat st;
+  return stat(path.c_str(), &st) == 0;
+}
+
+TEST(qwen3_sessions_spill_and_restore) {
+  qwen3_model_t model, fresh;
+  ASSERT_TRUE(test_qwen3_load(&model, QWEN3_DTYPE_F32));
+  ASSERT_TRUE(test_qwen3_load(&fresh, QWEN3_DTYPE_F32));
+  std::string spill_dir = test_qwen3_path("spill");
+
+  /* Room for three pages: each chat below needs two. */
+  qwen3_sessions_t mgr;
+  ASSERT_TRUE(qwen3_sessions_init(&mgr, &model, 3 * model.kv_pool.page_bytes,
+                                  spill_dir.c_str()));
+  int a[41], b[41];
+  test_qwen3_tokens(a, 41, 1);
+  test_qwen3_tokens(b, 41, 2);
+  static float logits[TEST_QWEN3_VOCAB], expected[TEST_QWEN3_VOCAB];
+
+  ASSERT_TRUE(qwen3_sessions_activate(&mgr, "chat-a"));
+  ASSERT_TRUE(qwen3_forward(&model, logits, a, 40));
+  ASSERT_TRUE(qwen3_sessions_activate(&mgr, "chat-b"));
+  ASSERT_TRUE(qwen3_forward(&model, logits, b, 40));
+
+  /* chat-b could only get its pages by spilling chat-a. */
+  qwen3_session_t *sa = session(&mgr, "chat-a");
+  ASSERT_NOT_NULL(sa);
+  ASSERT_TRUE(sa->spilled);
+  ASSERT_EQ_INT(0, sa->kv_seq.num_pages);
+  ASSERT_TRUE(file_exists(spill_dir + "/chat-a.kvspill"));
+
+  /* Restoring chat-a spills chat-b in turn. */
+  ASSERT_TRUE(qwen3_sessions_activate(&mgr, "chat-a"));
+  ASSERT_EQ_INT(40, model.cache_len[0]);
+  ASSERT_TRUE(memcmp(model.cache_tokens, a, 40 * sizeof(int)) == 0);
+  ASSERT_FALSE(file_exists(spill_dir + "/chat-a.kvspill"));
+  ASSERT_TRUE(session(&mgr, "chat-b")->spilled);
+
+  /* The restored cache continues exactly like one never evicted. */
+  ASSERT_TRUE(qwen3_forward(&model, logits, a + 40, 1));
+  ASSERT_TRUE(qwen3_forward(&fresh, expected, a, 40));
+  ASSERT_TRUE(qwen3_forward(&fresh, expected, a + 40, 1));
+  ASSERT_TRUE(test_qwen3_max_diff(logits, expected, TEST_QWEN3_VOCAB) <
+              1e-5f);
+
+  ASSERT_TRUE(qwen3_sessions_activate(&mgr, "chat-b"));
+  ASSERT_EQ_INT(40, model.cache_len[0]);
+  ASSERT_TRUE(memcmp(model.cache_tokens, b, 40 * sizeof(int)) == 0);
+
+  qwen3_sessions_free(&mgr);
+  qwen3_model_free(&model);
+  qwen3_model_free(&fresh);
+  PASS();
+}
+
+TEST(qwen3_sessions_evict_least_recently_used) {
+  qwen3_model_t model;
+  ASSERT_TRUE(test_qwen3_load(&model, QWEN3_DTYPE_F32));
+
+  /* No spill directory: evicted caches are dropped. One page per chat. */
+  qwen3_sessions_t mgr;
+  ASSERT_TRUE(
+      qwen3_sessions_init(&mgr, &model, 3 * model.kv_pool.page_bytes, NULL));
+  const char *ids[] = {"chat-a", "chat-b", "chat-c", "chat-d"};
+  int tokens[4][20];
+  static float logits[TEST_QWEN3_VOCAB];
+  for (int i = 0; i < 3; i++) {
+    test_qwen3_tokens(tokens[i], 20, i + 1);
+    ASSERT_TRUE(qwen3_sessions_activate(&mgr, ids[i]));
+    ASSERT_TRUE(qwen3_forward(&model, logits, tokens[i], 20));
+  }
+
+  /* Going back to chat-a reuses its cache and makes chat-b the oldest. */
+  ASSERT_TRUE(qwen3_sessions_activate(&mgr, "chat-a"));
+  ASSERT_EQ_INT(20, model.cache_len[0]);
+  ASSERT_EQ_SIZE(3, kv_pool_pages_in_use(&model.kv_pool));
+
+  test_qwen3_tokens(tokens[3], 20, 4);
+  ASSERT_TRUE(qwen3_sessions_activate(&mgr, "chat-d"));
+  ASSERT_TRUE(qwen3_forward(&model, logits, tokens[3], 20));
+  ASSERT_EQ_SIZE(3, kv_pool_pages_in_use(&model.kv_pool));
+
+  qwen3_session_t *sb = session(&mgr, "chat-b");
+  ASSERT_EQ_INT(0, sb->kv_seq.num_pages);
+  ASSERT_EQ_INT(0, sb->len);
+  ASSERT_FALSE(sb->spilled);
+  ASSERT_EQ_INT(1, session(&mgr, "chat-a")->kv_seq.num_pages);
+  ASSERT_EQ_INT(1, session(&mgr, "chat-c")->kv_seq.num_pages);
+
+  /* A dropped chat starts cold; the others come back whole. */
+  ASSERT_TRUE(qwen3_sessions_activate(&mgr, "chat-b"));
+  ASSERT_EQ_INT(0, model.cache_len[0]);
+  ASSERT_TRUE(qwen3_sessions_activate(&mgr, "chat-c"));
+  ASSERT_EQ_INT(20, model.cache_len[0]);
+  ASSERT_TRUE(memcmp(model.cache_tokens, tokens[2], 20 * sizeof(int)) == 0);
+
+  qwen3_sessions_free(&mgr);
+  qwen3_model_free(&model);
+  PASS();
+}
+
+TEST(qwen3_sessions_failed_restore_releases_pages) {
+  qwen3_model_t model;
+  ASSERT_TRUE(test_qwen3_load(&model, QWEN3_DTYPE_F32));
+  std::string spill_dir = test_qwen3_path("spill_bad");
+
+  qwen3_sessions_t mgr;
+  ASSERT_TRUE(qwen3_sessions_init(&mgr, &model, 3 * model.kv_pool.page_bytes,
+                                  spill_dir.c_str()));
+  int a[40], b[40];
+  test_qwen3_tokens(a, 40, 1);
+  test_qwen3_tokens(b, 40, 2);
+  static float logits[TEST_QWEN3_VOCAB];
+  ASSERT_TRUE(qwen3_sessions_activate(&mgr, "chat-a"));
+  ASSERT_TRUE(qwen3_forward(&model, logits, a, 40));
+  ASSERT_TRUE(qwen3_sessions_activate(&mgr, "chat-b"));
+  ASSERT_TRUE(qwen3_forward(&model, logits, b, 40));
+
+  /* Cut chat-a's spill file inside its first page. */
+  std::string path = spill_dir + "/chat-a.kvspill";
+  struct stat st;
+  ASSERT_EQ_INT(0, stat(path.c_str(), &st));
+  off_t pages = 2 * (off_t)model.kv_pool.page_bytes;
+  ASSERT_EQ_INT(0, truncate(path.c_str(), st.st_size - pages + 16));
+
+  /* The restore fails after reserving pages; they must go back. */
+  ASSERT_TRUE(qwen3_sessions_activate(&mgr, "chat-a"));
+  ASSERT_EQ_INT(0, model.cache_len[0]);
+  ASSERT_EQ_SIZE(0, kv_pool_pages_in_use(&model.kv_pool));
+  ASSERT_TRUE(session(&mgr, "chat-b")->spilled);
+  ASSERT_FALSE(file_exists(path));
+
+  /* The whole budget is available to prefill chat-a again. */
+  ASSERT_TRUE(qwen3_forward(&model, logits, a, 40));
+  ASSERT_EQ_INT(40, model.cache_len[0]);
+
+  qwen3_sessions_free(&mgr);
+  qwen3_model_free(&model);
+  PASS();
+}
+
+TEST(qwen3_sessions_chat_loaded_activates_chat) {
+  qwen3_model_t model;
+  ASSERT_TRUE(test_qwen3_load(&model, QWEN3_DTYPE_F32));
+  qwen3_sessions_t mgr;
+  ASSERT_TRUE(qwen3_sessions_init(&mgr, &model, 0, NULL));
+
+  int a[20];
+  test_qwen3_tokens(a, 20, 1);
+  static float logits[TEST_QWEN3_VOCAB];
+  qwen3_sessions_chat_loaded(&mgr, "chat-a", "");
+  ASSERT_TRUE(qwen3_forward(&model, logits, a, 20));
+  qwen3_sessions_chat_loaded(&mgr, "chat-b", "");
+  ASSERT_EQ_INT(0, model.cache_len[0]);
+  ASSERT_EQ_STR("chat-b", mgr.sessions[mgr.active].id);
+
+  qwen3_sessions_chat_loaded(&mgr, "chat-a", "");
+  ASSERT_EQ_STR("chat-a", mgr.sessions[mgr.active].id);
+  ASSERT_EQ_INT(20, model.cache_len[0]);
+
+  qwen3_sessions_free(&mgr);
+  qwen3_model_free(&model);
+  PASS();
+}
+
+extern "C" {
+void run_qwen3_sessions_tests(void) {
+  TEST_SUITE("Qwen3 Sessions");
+  RUN_TEST(qwen3_sessions_spill_and_restore);
+  RUN_TEST(qwen3_sessions_evict_least_recently_used);
+  RUN_TEST(qwen3_sessions_failed_restore_releases_pages);
+  RUN_TEST(qwen3_sessions_chat_loaded_activates_chat);
+}
+}
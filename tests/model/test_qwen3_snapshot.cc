@@ -0,0 +1,197 @@
+#include "test_framework.h"
+#include "qwen3_test_model.h"
+
+#include "inference/model/qwen3/session.h"
+#include "inference/model/qwen3/snapshot.h"
+
+/* Same tokens and byte-identical K/V rows (and INT8 scales) in every layer. */
+static bool same_cache(const qwen3_model_t *a, const qwen3_model_t *b) {
+  int len = a->cache_len[0];
+  if (b->cache_len[0] != len || a->kv_pool.row_bytes != b->kv_pool.row_bytes ||
+      a->kv_pool.quantized != b->kv_pool.quantized)
+    return false;
+  if (memcmp(a->cache_tokens, b->cache_tokens, len * sizeof(int)) != 0)
+    return false;
+
+  for (int layer = 0; layer < TEST_QWEN3_LAYERS; layer++) {
+    kv_layer_view_t va = kv_seq_layer(&a->kv_seq, layer);
+    kv_layer_view_t vb = kv_seq_layer(&b->kv_seq, layer);
+    for (int pos = 0; pos < len; pos++) {
+      if (memcmp(kv_view_key(&va, pos), kv_view_key(&vb, pos), va.row_bytes) ||
+          memcmp(kv_view_value(&va, pos), kv_view_value(&vb, pos),
+                 va.row_bytes))
+        return false;
+      if (va.quantized &&
+          (memcmp(kv_view_key_scale(&va, pos), kv_view_key_scale(&vb, pos),
+                  va.scale_row_bytes) ||
+           memcmp(kv_view_value_scale(&va, pos),
+                  kv_view_value_scale(&vb, pos), va.scale_row_bytes)))
+        return false;
+    }
+  }
+  return true;
+}
+
+/* Prefill model, save it, load the file into restored and compare. */
+static void check_roundtrip(qwen3_model_t *model, qwen3_model_t *restored,
+                            const char *name) {
+  std::string path = test_qwen3_path(name);
+  int tokens[46];
+  test_qwen3_tokens(tokens, 46, 3);
+  static float logits[TEST_QWEN3_VOCAB], expected[TEST_QWEN3_VOCAB];
+
+  ASSERT_TRUE(qwen3_forward(model, logits, tokens, 45));
+  ASSERT_TRUE(qwen3_kv_snapshot_save(model, path.c_str()));
+  ASSERT_TRUE(qwen3_kv_snapshot_load(restored, path.c_str()));
+  ASSERT_EQ_INT(45, restored->cache_len[0]);
+  ASSERT_EQ_INT(45, restored->cache_len[TEST_QWEN3_LAYERS - 1]);
+  ASSERT_TRUE(same_cache(model, restored));
+  ASSERT_EQ_SIZE(2, kv_pool_pages_in_use(&restored->kv_pool));
+
+  ASSERT_TRUE(qwen3_forward(model, expected, tokens + 45, 1));
+  ASSERT_TRUE(qwen3_forward(restored, logits, tokens + 45, 1));
+  ASSERT_TRUE(test_qwen3_max_diff(logits, expected, TEST_QWEN3_VOCAB) == 0.0f);
+}
+
+TEST(qwen3_snapshot_roundtrip_f16) {
+  qwen3_model_t model, restored;
+  ASSERT_TRUE(test_qwen3_load(&model, QWEN3_DTYPE_F16));
+  ASSERT_TRUE(test_qwen3_load(&restored, QWEN3_DTYPE_F16));
+  ASSERT_EQ_SIZE(sizeof(uint16_t), model.kv_pool.elem_size);
+
+  check_roundtrip(&model, &restored, "f16.kv");
+
+  qwen3_model_free(&model);
+  qwen3_model_free(&restored);
+  PASS();
+}
+
+TEST(qwen3_snapshot_roundtrip_int8) {
+  qwen3_model_t model, restored;
+  ASSERT_TRUE(test_qwen3_load(&model, QWEN3_DTYPE_F32));
+  ASSERT_TRUE(test_qwen3_load(&restored, QWEN3_DTYPE_F32));
+  ASSERT_TRUE(qwen3_model_set_kv_int8(&model, true));
+  ASSERT_TRUE(qwen3_model_set_kv_int8(&restored, true));
+
+  check_roundtrip(&model, &restored, "int8.kv");
+
+  qwen3_model_free(&model);
+  qwen3_model_free(&restored);
+  PASS();
+}
+
+TEST(qwen3_snapshot_rejects_wrong_fingerprint) {
+  qwen3_model_t model, other;
+  ASSERT_TRUE(test_qwen3_load(&model, QWEN3_DTYPE_F16));
+  ASSERT_TRUE(test_qwen3_load(&other, QWEN3_DTYPE_F32));
+  std::string path = test_qwen3_path("fingerprint.kv");
+  int tokens[20];
+  test_qwen3_tokens(tokens, 20, 4);
+  static float logits[TEST_QWEN3_VOCAB];
+  ASSERT_TRUE(qwen3_forward(&model, logits, tokens, 20));
+  ASSERT_TRUE(qwen3_kv_snapshot_save(&model, path.c_str()));
+
+  /* A model with another compute dtype has another fingerprint. */
+  ASSERT_TRUE(qwen3_model_fingerprint(&model) !=
+              qwen3_model_fingerprint(&other));
+  ASSERT_TRUE(qwen3_forward(&other, logits, tokens, 20));
+  ASSERT_FALSE(qwen3_kv_snapshot_load(&other, path.c_str()));
+  ASSERT_EQ_INT(0, other.cache_len[0]);
+  ASSERT_EQ_SIZE(0, kv_pool_pages_in_use(&other.kv_pool));
+
+  /* Same shape, but the header names a different model. */
+  FILE *f = fopen(path.c_str(), "r+b");
+  ASSERT_NOT_NULL(f);
+  qwen3_kv_snapshot_header_t header;
+  ASSERT_EQ_SIZE(1, fread(&header, sizeof(header), 1, f));
+  header.fingerprint ^= 1;
+  ASSERT_EQ_INT(0, fseek(f, 0, SEEK_SET));
+  ASSERT_EQ_SIZE(1, fwrite(&header, sizeof(header), 1, f));
+  ASSERT_EQ_INT(0, fclose(f));
+  ASSERT_FALSE(qwen3_kv_snapshot_load(&model, path.c_str()));
+  ASSERT_EQ_INT(0, model.cache_len[0]);
+  ASSERT_EQ_SIZE(0, kv_pool_pages_in_use(&model.kv_pool));
+
+  qwen3_model_free(&model);
+  qwen3_model_free(&other);
+  PASS();
+}
+
+TEST(qwen3_snapshot_rejects_truncated_file) {
+  qwen3_model_t model;
+  ASSERT_TRUE(test_qwen3_load(&model, QWEN3_DTYPE_F16));
+  std::string path = test_qwen3_path("truncated.kv");
+  int tokens[40];
+  test_qwen3_tokens(tokens, 40, 5);
+  static float logits[TEST_QWEN3_VOCAB];
+  ASSERT_TRUE(qwen3_forward(&model, logits, tokens, 40));
+  ASSERT_TRUE(qwen3_kv_snapshot_save(&model, path.c_str()));
+
+  /* Drop the last V row of the last layer. */
+  struct stat st;
+  ASSERT_EQ_INT(0, stat(path.c_str(), &st));
+  ASSERT_EQ_INT(0, truncate(path.c_str(),
+                            st.st_size - (off_t)model.kv_pool.row_bytes));
+  ASSERT_FALSE(qwen3_kv_snapshot_load(&model, path.c_str()));
+  ASSERT_EQ_INT(0, model.cache_len[0]);
+  ASSERT_EQ_SIZE(0, kv_pool_pages_in_use(&model.kv_pool));
+
+  /* Shorter than a header. */
+  ASSERT_EQ_INT(0, truncate(path.c_str(), 8));
+  ASSERT_FALSE(qwen3_kv_snapshot_load(&model, path.c_str()));
+  ASSERT_EQ_INT(0, model.cache_len[0]);
+
+  qwen3_model_free(&model);
+  PASS();
+}
+
+TEST(qwen3_snapshot_resumes_chat_through_hooks) {
+  qwen3_model_t model, fresh;
+  ASSERT_TRUE(test_qwen3_load(&model, QWEN3_DTYPE_F16));
+  ASSERT_TRUE(test_qwen3_load(&fresh, QWEN3_DTYPE_F16));
+  qwen3_sessions_t mgr;
+  ASSERT_TRUE(qwen3_sessions_init(&mgr, &model, 0, NULL));
+  std::string path = test_qwen3_path("chat-a.kv");
+  int tokens[30];
+  test_qwen3_tokens(tokens, 30, 6);
+  static float logits[TEST_QWEN3_VOCAB];
+
+  qwen3_sessions_chat_loaded(&mgr, "chat-a", path.c_str());
+  ASSERT_EQ_INT(0, model.cache_len[0]);
+  ASSERT_TRUE(qwen3_forward(&model, logits, tokens, 30));
+
+  /* Saving another chat leaves the snapshot alone. */
+  qwen3_sessions_chat_saved(&mgr, "chat-b", path.c_str());
+  struct stat st;
+  ASSERT_TRUE(stat(path.c_str(), &st) != 0);
+  qwen3_sessions_chat_saved(&mgr, "chat-a", path.c_str());
+  ASSERT_EQ_INT(0, stat(path.c_str(), &st));
+
+  /* After a restart the manager keeps nothing; the snapshot is loaded. */
+  qwen3_sessions_drop(&mgr, "chat-a");
+  ASSERT_EQ_INT(0, model.cache_len[0]);
+  qwen3_sessions_chat_loaded(&mgr, "chat-a", path.c_str());
+  ASSERT_TRUE(qwen3_forward(&fresh, logits, tokens, 30));
+  ASSERT_TRUE(same_cache(&model, &fresh));
+
+  /* A chat without a snapshot starts cold. */
+  qwen3_sessions_chat_loaded(&mgr, "chat-b",
+                             test_qwen3_path("chat-b.kv").c_str());
+  ASSERT_EQ_INT(0, model.cache_len[0]);
+
+  qwen3_sessions_free(&mgr);
+  qwen3_model_free(&model);
+  qwen3_model_free(&fresh);
+  PASS();
+}
+
+extern "C" {
+void run_qwen3_snapshot_tests(void) {
+  TEST_SUITE("Qwen3 KV Snapshots");
+  RUN_TEST(qwen3_snapshot_roundtrip_f16);
+  RUN_TEST(qwen3_snapshot_roundtrip_int8);
+  RUN_TEST(qwen3_snapshot_rejects_wrong_fingerprint);
+  RUN_TEST(qwen3_snapshot_rejects_truncated_file);
+  RUN_TEST(qwen3_snapshot_resumes_chat_through_hooks);
+}
+}
@@ -0,0 +1,194 @@
+#include "test_framework.h"
+#include "qwen3_test_model.h"
+
+TEST(qwen3_weights_packed_without_sidecar) {
+  ASSERT_TRUE(test_qwen3_write());
+
+  /* A directory where the sidecar goes makes its rename fail, so the
+   * projections are packed in memory instead. */
+  std::string sidecar = test_qwen3_path("model.safetensors.packed");
+  std::string blocker = sidecar + "/blocker";
+  ASSERT_EQ_INT(0, mkdir(sidecar.c_str(), 0755));
+  ASSERT_EQ_INT(0, mkdir(blocker.c_str(), 0755));
+
+  qwen3_model_t packed, plain;
+  bool loaded = qwen3_model_load_with_mode(&packed, test_qwen3_dir(),
+                                           QWEN3_DTYPE_F16, QWEN3_LOAD_PACKED);
+  rmdir(blocker.c_str());
+  rmdir(sidecar.c_str());
+  ASSERT_TRUE(loaded);
+  ASSERT_TRUE(test_qwen3_load(&plain, QWEN3_DTYPE_F16));
+  ASSERT_TRUE(packed.weights.packed_map == NULL);
+
+  int tokens[40];
+  test_qwen3_tokens(tokens, 40, 7);
+  static float logits[TEST_QWEN3_VOCAB], expected[TEST_QWEN3_VOCAB];
+  ASSERT_TRUE(qwen3_forward(&packed, logits, tokens, 40));
+  ASSERT_TRUE(qwen3_forward(&plain, expected, tokens, 40));
+  ASSERT_TRUE(test_qwen3_max_diff(logits, expected, TEST_QWEN3_VOCAB) < 1e-2f);
+
+  qwen3_model_free(&packed);
+  qwen3_model_free(&plain);
+  PASS();
+}
+
+static bool load_mode(qwen3_model_t *model, qwen3_dtype_t dtype,
+                      qwen3_load_mode_t mode) {
+  return test_qwen3_write() &&
+         qwen3_model_load_with_mode(model, test_qwen3_dir(), dtype, mode);
+}
+
+static bool same_rows(const float *a, const float *b, int rows) {
+  return memcmp(a, b, (size_t)rows * 64 * sizeof(float)) == 0;
+}
+
+TEST(qwen3_weights_fused_layout) {
+  /* Copied projections are fused; mapped F32 ones are the file's tensors. */
+  qwen3_model_t fused, parts;
+  ASSERT_TRUE(load_mode(&fused, QWEN3_DTYPE_F32, QWEN3_LOAD_COPY));
+  ASSERT_TRUE(load_mode(&parts, QWEN3_DTYPE_F32, QWEN3_LOAD_MMAP));
+
+  const int q_dim = 64, kv_dim = TEST_QWEN3_KV_DIM, inter = 128;
+  const int B = QWEN3_GATE_UP_BLOCK;
+  for (int l = 0; l < TEST_QWEN3_LAYERS; l++) {
+    const qwen3_layer_weights_t *f = &fused.weights.layers[l];
+    const qwen3_layer_weights_t *p = &parts.weights.layers[l];
+    ASSERT_NOT_NULL(f->qkv_proj);
+    ASSERT_NOT_NULL(f->gate_up_proj);
+    ASSERT_TRUE(f->q_proj == NULL && f->gate_proj == NULL);
+    ASSERT_TRUE(p->qkv_proj == NULL && p->gate_up_proj == NULL);
+
+    /* q, k and v stacked. */
+    const float *qkv = (const float *)f->qkv_proj;
+    ASSERT_TRUE(same_rows(qkv, (const float *)p->q_proj, q_dim));
+    ASSERT_TRUE(same_rows(qkv + q_dim * 64, (const float *)p->k_proj, kv_dim));
+    ASSERT_TRUE(same_rows(qkv + (q_dim + kv_dim) * 64,
+                          (const float *)p->v_proj, kv_dim));
+
+    /* Each 64-row block of gate rows is followed by the same up rows. */
+    const float *gate_up = (const float *)f->gate_up_proj;
+    for (int b = 0; b < inter / B; b++) {
+      const float *block = gate_up + (size_t)2 * b * B * 64;
+      ASSERT_TRUE(same_rows(block, (const float *)p->gate_proj + b * B * 64,
+                            B));
+      ASSERT_TRUE(same_rows(block + B * 64,
+                            (const float *)p->up_proj + b * B * 64, B));
+    }
+  }
+
+  qwen3_model_free(&fused);
+  qwen3_model_free(&parts);
+  PASS();
+}
+
+/* Prefill and decode logits of a mapped model, whose projections run as
+ * grouped GEMMs, against a copied one, whose projections are fused. */
+static float mapped_vs_copied(qwen3_dtype_t dtype) {
+  qwen3_model_t mapped, copied;
+  if (!load_mode(&mapped, dtype, QWEN3_LOAD_MMAP))
+    return 1e9f;
+  if (!load_mode(&copied, dtype, QWEN3_LOAD_COPY)) {
+    qwen3_model_free(&mapped);
+    return 1e9f;
+  }
+  int tokens[33];
+  test_qwen3_tokens(tokens, 33, 13);
+  static float logits[TEST_QWEN3_VOCAB], expected[TEST_QWEN3_VOCAB];
+  float max_diff = 1e9f;
+  if (qwen3_forward(&mapped, logits, tokens, 32) &&
+      qwen3_forward(&copied, expected, tokens, 32)) {
+    max_diff = test_qwen3_max_diff(logits, expected, TEST_QWEN3_VOCAB);
+    if (qwen3_forward(&mapped, logits, tokens + 32, 1) &&
+        qwen3_forward(&copied, expected, tokens + 32, 1)) {
+      float d = test_qwen3_max_diff(logits, expected, TEST_QWEN3_VOCAB);
+      max_diff = d > max_diff ? d : max_diff;
+    } else {
+      max_diff = 1e9f;
+    }
+  }
+  qwen3_model_free(&mapped);
+  qwen3_model_free(&copied);
+  return max_diff;
+}
+
+TEST(qwen3_weights_unfused_matches_fused) {
+  ASSERT_TRUE(mapped_vs_copied(QWEN3_DTYPE_F32) < 1e-4f);
+  ASSERT_TRUE(mapped_vs_copied(QWEN3_DTYPE_F16) < 2e-2f);
+  PASS();
+}
+
+/* The same checkpoint split across three shards by an index loads to the
+ * same model as the single file. */
+static float sharded_vs_single(qwen3_dtype_t dtype) {
+  std::string dir = test_qwen3_path("sharded");
+  qwen3_model_t sharded, single;
+  if (!test_qwen3_write() || !test_qwen3_write_checkpoint(dir, 3) ||
+      !qwen3_model_load(&sharded, dir.c_str(), dtype))
+    return 1e9f;
+  if (!test_qwen3_load(&single, dtype)) {
+    qwen3_model_free(&sharded);
+    return 1e9f;
+  }
+  int tokens[24];
+  test_qwen3_tokens(tokens, 24, 17);
+  static float logits[TEST_QWEN3_VOCAB], expected[TEST_QWEN3_VOCAB];
+  float max_diff = 1e9f;
+  if (qwen3_forward(&sharded, logits, tokens, 24) &&
+      qwen3_forward(&single, expected, tokens, 24))
+    max_diff = test_qwen3_max_diff(logits, expected, TEST_QWEN3_VOCAB);
+  qwen3_model_free(&sharded);
+  qwen3_model_free(&single);
+  return max_diff;
+}
+
+TEST(qwen3_weights_sharded_matches_single_file) {
+  ASSERT_TRUE(sharded_vs_single(QWEN3_DTYPE_F32) == 0.0f);
+  ASSERT_TRUE(sharded_vs_single(QWEN3_DTYPE_F16) == 0.0f);
+  PASS();
+}
+
+/* Prefill logits of the checkpoint in dir loaded as dtype against the F32
+ * checkpoint computed in F32. */
+static float vs_f32(const char *dir, qwen3_dtype_t dtype) {
+  qwen3_model_t model, reference;
+  if (!test_qwen3_write() || !qwen3_model_load(&model, dir, dtype))
+    return 1e9f;
+  if (!test_qwen3_load(&reference, QWEN3_DTYPE_F32)) {
+    qwen3_model_free(&model);
+    return 1e9f;
+  }
+  int tokens[40];
+  test_qwen3_tokens(tokens, 40, 18);
+  static float logits[TEST_QWEN3_VOCAB], expected[TEST_QWEN3_VOCAB];
+  float max_diff = 1e9f;
+  if (qwen3_forward(&model, logits, tokens, 40) &&
+      qwen3_forward(&reference, expected, tokens, 40))
+    max_diff = test_qwen3_max_diff(logits, expected, TEST_QWEN3_VOCAB);
+  qwen3_model_free(&model);
+  qwen3_model_free(&reference);
+  return max_diff;
+}
+
+TEST(qwen3_weights_dtypes_agree) {
+  /* F16 compute, and a BF16 checkpoint in either compute dtype, stay close
+   * to F32 over a multi-token prefill, whose last row is the one sampled.
+   * The logits are about 15 at most. */
+  std::string bf16 = test_qwen3_path("bf16");
+  ASSERT_TRUE(test_qwen3_write());
+  ASSERT_TRUE(test_qwen3_write_checkpoint(bf16, 1, true));
+  ASSERT_TRUE(vs_f32(test_qwen3_dir(), QWEN3_DTYPE_F16) < 2e-2f);
+  ASSERT_TRUE(vs_f32(bf16.c_str(), QWEN3_DTYPE_F32) < 5e-2f);
+  ASSERT_TRUE(vs_f32(bf16.c_str(), QWEN3_DTYPE_F16) < 5e-2f);
+  PASS();
+}
+
+extern "C" {
+void run_qwen3_weights_tests(void) {
+  TEST_SUITE("Qwen3 Weights");
+  RUN_TEST(qwen3_weights_packed_without_sidecar);
+  RUN_TEST(qwen3_weights_fused_layout);
+  RUN_TEST(qwen3_weights_unfused_matches_fused);
+  RUN_TEST(qwen3_weights_sharded_matches_single_file);
+  RUN_TEST(qwen3_weights_dtypes_agree);
+}
+}
@@ -39,6 +39,7 @@ extern void run_config_integration_tests(void);
 extern void run_persona_integration_tests(void);
 extern void run_tokenizer_integration_tests(void);
 extern void run_safetensors_tests(void);
+extern void run_gguf_tests(void);
 extern void run_gemm_tests(void);
 extern void run_gemm_pytorch_accuracy_tests(void);
 extern void run_layernorm_tests(void);
@@ -55,6 +56,13 @@ extern void run_sampling_tests(void);
 extern void run_sampling_pytorch_tests(void);
 extern void run_kv_cache_tests(void);
 extern void run_kv_cache_pytorch_tests(void);
+extern void run_threadpool_tests(void);
+extern void run_convert_tests(void);
+extern void run_qwen3_context_tests(void);
+extern void run_qwen3_plan_tests(void);
+extern void run_qwen3_sessions_tests(void);
+extern void run_qwen3_snapshot_tests(void);
+extern void run_qwen3_weights_tests(void);
 
 int main(int argc, char **argv) {
   (void)argc;
@@ -114,6 +122,7 @@ int main(int argc, char **argv) {
   run_persona_integration_tests();
   run_tokenizer_integration_tests();
   run_safetensors_tests();
+  run_gguf_tests();
   run_gemm_tests();
   run_gemm_pytorch_accuracy_tests();
   run_layernorm_tests();
@@ -130,6 +139,13 @@ int main(int argc, char **argv) {
   run_sampling_pytorch_tests();
   run_kv_cache_tests();
   run_kv_cache_pytorch_tests();
+  run_threadpool_tests();
+  run_convert_tests();
+  run_qwen3_context_tests();
+  run_qwen3_plan_tests();
+  run_qwen3_sessions_tests();
+  run_qwen3_snapshot_tests();
+  run_qwen3_weights_tests();
 
   clock_t end = clock();
   double elapsed = (double)(end - start) / CLOCKS_PER_SEC;
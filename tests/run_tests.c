@@ -15,6 +15,7 @@ extern void run_tokenizer_tests(void);
 extern void run_modal_tests(void);
 extern void run_attachment_tests(void);
 extern void run_safetensors_tests(void);
+extern void run_gguf_tests(void);
 extern void run_gemm_tests(void);
 extern void run_gemm_pytorch_accuracy_tests(void);
 extern void run_layernorm_tests(void);
@@ -31,6 +32,13 @@ extern void run_sampling_tests(void);
 extern void run_sampling_pytorch_tests(void);
 extern void run_kv_cache_tests(void);
 extern void run_kv_cache_pytorch_tests(void);
+extern void run_threadpool_tests(void);
+extern void run_convert_tests(void);
+extern void run_qwen3_context_tests(void);
+extern void run_qwen3_plan_tests(void);
+extern void run_qwen3_sessions_tests(void);
+extern void run_qwen3_snapshot_tests(void);
+extern void run_qwen3_weights_tests(void);
 
 int main(int argc, char **argv) {
   (void)argc;
@@ -54,6 +62,7 @@ int main(int argc, char **argv) {
   run_modal_tests();
   run_attachment_tests();
   run_safetensors_tests();
+  run_gguf_tests();
   run_gemm_tests();
   run_gemm_pytorch_accuracy_tests();
   run_layernorm_tests();
@@ -70,6 +79,13 @@ int main(int argc, char **argv) {
   run_sampling_pytorch_tests();
   run_kv_cache_tests();
   run_kv_cache_pytorch_tests();
+  run_threadpool_tests();
+  run_convert_tests();
+  run_qwen3_context_tests();
+  run_qwen3_plan_tests();
+  run_qwen3_sessions_tests();
+  run_qwen3_snapshot_tests();
+  run_qwen3_weights_tests();
 
   print_test_summary();
 
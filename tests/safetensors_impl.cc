@@ -1,2 +0,0 @@
-#define SAFETENSORS_CPP_IMPLEMENTATION
-#include "inference/model_loader/safetensors.hh"
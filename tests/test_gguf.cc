@@ -0,0 +1,250 @@
+#include "test_framework.h"
+#include <cstring>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#include "inference/model_loader/gguf.h"
+
+/* Builds a GGUF file in memory; tensors are added with their data and laid
+ * out at 32-byte aligned offsets. */
+struct gguf_builder {
+  std::vector<uint8_t> kv;
+  size_t num_kv = 0;
+  std::vector<uint8_t> infos;
+  std::vector<uint8_t> data;
+  size_t num_tensors = 0;
+
+  template <typename T> static void put(std::vector<uint8_t> &out, T v) {
+    const uint8_t *p = (const uint8_t *)&v;
+    out.insert(out.end(), p, p + sizeof(T));
+  }
+  static void put_str(std::vector<uint8_t> &out, const std::string &s) {
+    put<uint64_t>(out, s.size());
+    out.insert(out.end(), s.begin(), s.end());
+  }
+
+  void kv_u32(const std::string &key, uint32_t v) {
+    put_str(kv, key);
+    put<uint32_t>(kv, GGUF_VALUE_UINT32);
+    put<uint32_t>(kv, v);
+    num_kv++;
+  }
+  void kv_f32(const std::string &key, float v) {
+    put_str(kv, key);
+    put<uint32_t>(kv, GGUF_VALUE_FLOAT32);
+    put<float>(kv, v);
+    num_kv++;
+  }
+  void kv_str(const std::string &key, const std::string &v) {
+    put_str(kv, key);
+    put<uint32_t>(kv, GGUF_VALUE_STRING);
+    put_str(kv, v);
+    num_kv++;
+  }
+  void kv_strs(const std::string &key, const std::vector<std::string> &v) {
+    put_str(kv, key);
+    put<uint32_t>(kv, GGUF_VALUE_ARRAY);
+    put<uint32_t>(kv, GGUF_VALUE_STRING);
+    put<uint64_t>(kv, v.size());
+    for (const std::string &s : v)
+      put_str(kv, s);
+    num_kv++;
+  }
+
+  void tensor(const std::string &name, std::vector<uint64_t> ne,
+              gguf_tensor_type_t type, const void *bytes, size_t size) {
+    put_str(infos, name);
+    put<uint32_t>(infos, (uint32_t)ne.size());
+    for (uint64_t n : ne)
+      put<uint64_t>(infos, n);
+    put<uint32_t>(infos, type);
+    data.resize((data.size() + 31) & ~(size_t)31);
+    put<uint64_t>(infos, data.size());
+    data.insert(data.end(), (const uint8_t *)bytes,
+                (const uint8_t *)bytes + size);
+    num_tensors++;
+  }
+
+  bool write(const char *path) const {
+    std::vector<uint8_t> out;
+    put<uint32_t>(out, GGUF_MAGIC);
+    put<uint32_t>(out, 3);
+    put<uint64_t>(out, num_tensors);
+    put<uint64_t>(out, num_kv);
+    out.insert(out.end(), kv.begin(), kv.end());
+    out.insert(out.end(), infos.begin(), infos.end());
+    out.resize((out.size() + 31) & ~(size_t)31);
+    out.insert(out.end(), data.begin(), data.end());
+
+    FILE *f = fopen(path, "wb");
+    if (!f)
+      return false;
+    bool ok = fwrite(out.data(), 1, out.size(), f) == out.size();
+    fclose(f);
+    return ok;
+  }
+};
+
+static const char *test_path(void) { return "/tmp/sillytui_test.gguf"; }
+
+static uint16_t half(float f) {
+  /* Exact for the small powers of two and integers used here. */
+  uint32_t bits;
+  memcpy(&bits, &f, sizeof(bits));
+  if (f == 0.0f)
+    return 0;
+  uint32_t sign = (bits >> 16) & 0x8000;
+  int exp = (int)((bits >> 23) & 0xff) - 127 + 15;
+  return (uint16_t)(sign | (exp << 10) | ((bits >> 13) & 0x3ff));
+}
+
+TEST(gguf_metadata_and_tensors) {
+  gguf_builder b;
+  b.kv_str("general.architecture", "qwen3");
+  b.kv_u32("qwen3.block_count", 2);
+  b.kv_f32("qwen3.rope.freq_base", 1000000.0f);
+  b.kv_strs("tokenizer.ggml.tokens", {"a", "bc", ""});
+  float matrix[6] = {1, 2, 3, 4, 5, 6};
+  b.tensor("blk.0.attn_q.weight", {3, 2}, GGUF_TENSOR_F32, matrix,
+           sizeof(matrix));
+  ASSERT_TRUE(b.write(test_path()));
+
+  gguf_file_t gguf;
+  ASSERT_TRUE(gguf_open(&gguf, test_path()));
+  ASSERT_EQ_INT(3, (int)gguf.version);
+  ASSERT_EQ_SIZE(4, gguf.num_kv);
+
+  int64_t layers;
+  ASSERT_TRUE(gguf_kv_int(gguf_find_kv(&gguf, "qwen3.block_count"), &layers));
+  ASSERT_EQ_INT(2, (int)layers);
+  double theta;
+  ASSERT_TRUE(
+      gguf_kv_float(gguf_find_kv(&gguf, "qwen3.rope.freq_base"), &theta));
+  ASSERT_NEAR(1000000.0, theta, 1e-3);
+
+  const gguf_kv_t *arch = gguf_find_kv(&gguf, "general.architecture");
+  const char *str;
+  size_t len;
+  ASSERT_TRUE(gguf_kv_string(arch, &str, &len));
+  ASSERT_EQ_SIZE(5, len);
+  ASSERT_TRUE(memcmp(str, "qwen3", 5) == 0);
+  ASSERT_FALSE(gguf_kv_int(arch, &layers));
+  ASSERT_NULL(gguf_find_kv(&gguf, "qwen3.missing"));
+
+  const gguf_kv_t *tokens = gguf_find_kv(&gguf, "tokenizer.ggml.tokens");
+  ASSERT_NOT_NULL(tokens);
+  ASSERT_EQ_SIZE(3, (size_t)tokens->array_len);
+  const char *strs[3];
+  size_t lens[3];
+  ASSERT_TRUE(gguf_kv_strings(tokens, strs, lens));
+  ASSERT_EQ_SIZE(2, lens[1]);
+  ASSERT_TRUE(memcmp(strs[1], "bc", 2) == 0);
+  ASSERT_EQ_SIZE(0, lens[2]);
+
+  const gguf_tensor_t *t = gguf_find_tensor(&gguf, "blk.0.attn_q.weight");
+  ASSERT_NOT_NULL(t);
+  ASSERT_EQ_INT(2, t->n_dims);
+  ASSERT_EQ_SIZE(3, (size_t)t->ne[0]);
+  ASSERT_EQ_SIZE(6, gguf_tensor_elems(t));
+  ASSERT_EQ_SIZE(sizeof(matrix), t->size);
+  /* Tensor data is a view into the mapping. */
+  ASSERT_TRUE(t->data >= gguf.data && t->data < gguf.data + gguf.data_size);
+  ASSERT_NEAR(6.0f, ((const float *)t->data)[5], 0.0f);
+  ASSERT_NULL(gguf_find_tensor(&gguf, "output.weight"));
+
+  gguf_close(&gguf);
+  PASS();
+}
+
+TEST(gguf_dequantize_q8_0) {
+  uint8_t block[34];
+  uint16_t d = half(0.5f);
+  memcpy(block, &d, 2);
+  for (int i = 0; i < 32; i++)
+    block[2 + i] = (uint8_t)(int8_t)(i - 16);
+
+  float out[32];
+  ASSERT_TRUE(gguf_dequantize(out, block, GGUF_TENSOR_Q8_0, 32));
+  ASSERT_NEAR(-8.0f, out[0], 0.0f);
+  ASSERT_NEAR(7.5f, out[31], 0.0f);
+  PASS();
+}
+
+TEST(gguf_dequantize_q4_0_and_q4_1) {
+  /* Low nibbles hold elements 0-15, high nibbles 16-31. */
+  uint8_t block[20];
+  uint16_t d = half(2.0f), m = half(-1.0f);
+  memcpy(block, &d, 2);
+  for (int i = 0; i < 16; i++)
+    block[2 + i] = (uint8_t)(i | (15 - i) << 4);
+
+  float out[32];
+  ASSERT_TRUE(gguf_dequantize(out, block, GGUF_TENSOR_Q4_0, 32));
+  ASSERT_NEAR(-16.0f, out[0], 0.0f);
+  ASSERT_NEAR(-14.0f, out[1], 0.0f);
+  ASSERT_NEAR(14.0f, out[16], 0.0f);
+
+  memcpy(block + 2, &m, 2);
+  for (int i = 0; i < 16; i++)
+    block[4 + i] = (uint8_t)(i | (15 - i) << 4);
+  ASSERT_TRUE(gguf_dequantize(out, block, GGUF_TENSOR_Q4_1, 32));
+  ASSERT_NEAR(-1.0f, out[0], 0.0f);
+  ASSERT_NEAR(29.0f, out[16], 0.0f);
+  ASSERT_NEAR(-1.0f, out[31], 0.0f);
+  PASS();
+}
+
+TEST(gguf_dequantize_q4_k) {
+  /* d = 1, dmin = 0, every sub-block scale 1: values are the raw nibbles.
+   * Each 32 bytes of qs hold 64 values, low nibbles first. */
+  uint8_t block[144] = {0};
+  uint16_t d = half(1.0f);
+  memcpy(block, &d, 2);
+  for (int j = 0; j < 4; j++)
+    block[4 + j] = 1;
+  for (int j = 8; j < 12; j++)
+    block[4 + j] = 0x11;
+  for (int i = 0; i < 128; i++)
+    block[16 + i] = (uint8_t)((i % 16) | (15 - i % 16) << 4);
+
+  float out[256];
+  ASSERT_TRUE(gguf_dequantize(out, block, GGUF_TENSOR_Q4_K, 256));
+  ASSERT_NEAR(3.0f, out[3], 0.0f);
+  ASSERT_NEAR(12.0f, out[32 + 3], 0.0f);
+  ASSERT_NEAR(3.0f, out[64 + 3], 0.0f);
+  ASSERT_NEAR(15.0f, out[255 - 15], 0.0f);
+  ASSERT_FALSE(gguf_can_dequantize(GGUF_TENSOR_Q2_K));
+  PASS();
+}
+
+TEST(gguf_rejects_malformed_file) {
+  gguf_builder b;
+  float v[4] = {0};
+  b.tensor("t", {4}, GGUF_TENSOR_F32, v, sizeof(v));
+  ASSERT_TRUE(b.write(test_path()));
+
+  /* Cut the file inside the tensor data. */
+  FILE *f = fopen(test_path(), "r+b");
+  ASSERT_NOT_NULL(f);
+  fseek(f, 0, SEEK_END);
+  long size = ftell(f);
+  fclose(f);
+  ASSERT_EQ_INT(0, truncate(test_path(), size - 4));
+
+  gguf_file_t gguf;
+  ASSERT_FALSE(gguf_open(&gguf, test_path()));
+  ASSERT_FALSE(gguf_open(&gguf, "/nonexistent/model.gguf"));
+  PASS();
+}
+
+extern "C" {
+void run_gguf_tests(void) {
+  TEST_SUITE("GGUF Loader");
+  RUN_TEST(gguf_metadata_and_tensors);
+  RUN_TEST(gguf_dequantize_q8_0);
+  RUN_TEST(gguf_dequantize_q4_0_and_q4_1);
+  RUN_TEST(gguf_dequantize_q4_k);
+  RUN_TEST(gguf_rejects_malformed_file);
+}
+}
@@ -274,6 +274,54 @@ TEST(safetensors_large_model_optional) {
   PASS();
 }
 
+TEST(safetensors_ordered_dict_find) {
+  safetensors::ordered_dict<int> d;
+  d.insert("b", 1);
+  d.insert("a", 2);
+  d.insert("c", 3);
+  d.insert("a", 4);
+
+  size_t idx = 99;
+  ASSERT_TRUE(d.find("a", &idx));
+  ASSERT_EQ_SIZE(1, idx);
+  ASSERT_FALSE(d.find("missing", &idx));
+  ASSERT_EQ_SIZE(3, d.size());
+
+  int v = 0;
+  ASSERT_TRUE(d.at("a", &v));
+  ASSERT_EQ(4, v);
+  ASSERT_TRUE(d.at(2, &v));
+  ASSERT_EQ(3, v);
+
+  ASSERT_TRUE(d.erase("b"));
+  ASSERT_FALSE(d.count("b"));
+  ASSERT_TRUE(d.find("c", &idx));
+  ASSERT_EQ_SIZE(1, idx);
+  ASSERT_TRUE(d.keys()[idx] == "c");
+
+  PASS();
+}
+
+TEST(safetensors_ordered_dict_find_prefix) {
+  safetensors::ordered_dict<int> d;
+  d.insert("model.layers.10.mlp.up_proj.weight", 0);
+  d.insert("model.layers.1.self_attn.q_proj.weight", 1);
+  d.insert("model.embed_tokens.weight", 2);
+  d.insert("model.layers.1.mlp.up_proj.weight", 3);
+  d.insert("model.layers.2.mlp.up_proj.weight", 4);
+
+  std::vector<size_t> layer1 = d.find_prefix("model.layers.1.");
+  ASSERT_EQ_SIZE(2, layer1.size());
+  ASSERT_EQ_SIZE(3, layer1[0]);
+  ASSERT_EQ_SIZE(1, layer1[1]);
+
+  ASSERT_EQ_SIZE(4, d.find_prefix("model.layers.").size());
+  ASSERT_EQ_SIZE(5, d.find_prefix("").size());
+  ASSERT_EQ_SIZE(0, d.find_prefix("lm_head.").size());
+
+  PASS();
+}
+
 extern "C" {
 void run_safetensors_tests(void) {
   TEST_SUITE("Safetensors Loader");
@@ -293,5 +341,7 @@ void run_safetensors_tests(void) {
   RUN_TEST(safetensors_tensor_data_access);
   RUN_TEST(safetensors_tensor_ordering);
   RUN_TEST(safetensors_large_model_optional);
+  RUN_TEST(safetensors_ordered_dict_find);
+  RUN_TEST(safetensors_ordered_dict_find_prefix);
 }
 }